@@ -0,0 +1,183 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compresses gcode the way the controller does for a .lz upload and reads it back the way the player does, in read
+// ahead sized pieces, after a goto and after the buffers were lent to an upload, and with damaged files.
+
+#include "CompressedFile.h"
+#include "SimTest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// the player's buffers, xbuff and fbuff
+static uint8_t in[8200];
+static uint8_t out[4096];
+
+static std::string make_gcode(size_t lines)
+{
+    std::string s;
+    char l[64];
+    for(size_t i = 0; i < lines; i++) {
+        snprintf(l, sizeof(l), "G1 X%.3f Y%.3f S%u\n", (i % 977) * 0.013, (i % 613) * 0.029, (unsigned)(i % 1000));
+        s += l;
+    }
+    return s;
+}
+
+static std::vector<uint8_t> compress(const std::string &gcode, size_t block)
+{
+    static qlz_state_compress state;
+    std::vector<uint8_t> f;
+    std::vector<char> c(block + 400);
+    uint16_t sum = 0;
+    for(size_t i = 0; i < gcode.size(); i += block) {
+        size_t n = std::min(block, gcode.size() - i);
+        memset(&state, 0, sizeof(state));
+        size_t k = qlz_compress(gcode.data() + i, c.data(), n, &state);
+        f.push_back(k >> 24);
+        f.push_back(k >> 16);
+        f.push_back(k >> 8);
+        f.push_back(k);
+        f.insert(f.end(), c.begin(), c.begin() + k);
+        for(size_t j = 0; j < n; j++) sum += (uint8_t)gcode[i + j];
+    }
+    f.push_back(sum >> 8);
+    f.push_back(sum & 0xFF);
+    return f;
+}
+
+static FILE *as_file(const std::vector<uint8_t> &data)
+{
+    FILE *fp = tmpfile();
+    fwrite(data.data(), 1, data.size(), fp);
+    rewind(fp);
+    return fp;
+}
+
+static std::string read_all(CompressedFile &lz, size_t piece)
+{
+    std::string s;
+    std::vector<char> buf(piece);
+    size_t n;
+    while((n = lz.read(buf.data(), piece)) > 0) s.append(buf.data(), n);
+    return s;
+}
+
+int main()
+{
+    std::string gcode = make_gcode(20000);
+
+    // read back whole in read ahead sized pieces, and in odd ones
+    {
+        FILE *fp = as_file(compress(gcode, sizeof(out)));
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == (long)gcode.size());
+        CHECK(read_all(lz, 1024) == gcode);
+        CHECK(!lz.is_damaged() && lz.sum_matches());
+        CHECK(lz.get_blocks() == (gcode.size() + sizeof(out) - 1) / sizeof(out));
+        lz.rewind();
+        CHECK(read_all(lz, 333) == gcode && lz.sum_matches());
+        fclose(fp);
+    }
+
+    // smaller blocks than out holds
+    {
+        FILE *fp = as_file(compress(gcode, 1000));
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == (long)gcode.size());
+        CHECK(read_all(lz, 1024) == gcode && lz.sum_matches());
+        fclose(fp);
+    }
+
+    // a goto reads from the start again part way through, the sum still covers the whole file once
+    {
+        FILE *fp = as_file(compress(gcode, sizeof(out)));
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        char buf[1024];
+        for(int i = 0; i < 30; i++) lz.read(buf, sizeof(buf));
+        lz.rewind();
+        CHECK(read_all(lz, 1024) == gcode && lz.sum_matches());
+        fclose(fp);
+    }
+
+    // the buffers lent to an upload part way through a block
+    {
+        FILE *fp = as_file(compress(gcode, sizeof(out)));
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        std::string s;
+        char buf[1000];
+        for(int i = 0; i < 7; i++) s.append(buf, lz.read(buf, sizeof(buf)));
+        memset(in, 0x55, sizeof(in));
+        memset(out, 0xAA, sizeof(out));
+        lz.invalidate();
+        s += read_all(lz, 1024);
+        CHECK(s == gcode && lz.sum_matches());
+        fclose(fp);
+    }
+
+    // no gcode at all
+    {
+        FILE *fp = as_file(compress("", sizeof(out)));
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == 0);
+        CHECK(read_all(lz, 1024).empty() && lz.sum_matches());
+        fclose(fp);
+    }
+
+    // a damaged block length, the gcode before it is read and then nothing
+    {
+        std::vector<uint8_t> f = compress(gcode, sizeof(out));
+        size_t first = ((size_t)f[2] << 8) | f[3];
+        f[4 + first + 2] ^= 0x40;
+        FILE *fp = as_file(f);
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == -1);
+        std::string s = read_all(lz, 1024);
+        CHECK(s == gcode.substr(0, sizeof(out)));
+        CHECK(lz.is_damaged() && !lz.sum_matches());
+        fclose(fp);
+    }
+
+    // a sum that does not match
+    {
+        std::vector<uint8_t> f = compress(gcode, sizeof(out));
+        f[f.size() - 1] ^= 0x01;
+        FILE *fp = as_file(f);
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == (long)gcode.size());
+        while(lz.next_block()) continue;
+        CHECK(!lz.is_damaged() && !lz.sum_matches());
+        fclose(fp);
+    }
+
+    // cut short
+    {
+        std::vector<uint8_t> f = compress(gcode, sizeof(out));
+        f.resize(f.size() / 2);
+        FILE *fp = as_file(f);
+        CompressedFile lz(in, sizeof(in), out, sizeof(out));
+        lz.attach(fp);
+        CHECK(lz.length() == -1);
+        std::string s = read_all(lz, 1024);
+        CHECK(s.size() < gcode.size() && s == gcode.substr(0, s.size()));
+        CHECK(!lz.sum_matches());
+        fclose(fp);
+    }
+
+    return test_result("compressed file");
+}
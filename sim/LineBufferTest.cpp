@@ -0,0 +1,123 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Feeds the console receive buffer the way the receive interrupts do and takes the lines out the way the consoles do,
+// with lines that wrap round the end of the buffer, several lines ahead and lines too long to fit.
+
+#include "LineBuffer.h"
+#include "SimTest.h"
+
+#include <stdio.h>
+#include <string>
+
+template<size_t length> static void push(LineBuffer<length> &b, const std::string &s)
+{
+    for(char c : s) b.push_back(c);
+}
+
+int main()
+{
+    // nothing until the newline
+    {
+        LineBuffer<16> b;
+        std::string line;
+        CHECK(b.at_line_start());
+        push(b, "G1 X1");
+        CHECK(!b.has_line() && !b.get_line(line) && !b.at_line_start());
+        push(b, "\n");
+        CHECK(b.has_line() && b.at_line_start());
+        CHECK(b.get_line(line) && line == "G1 X1");
+        CHECK(!b.has_line() && b.size() == 0);
+    }
+
+    // lines ahead, and round the end of the buffer many times
+    {
+        LineBuffer<32> b;
+        std::string line;
+        char buf[32];
+        int n = 0;
+        for(int i = 0; i < 1000; i++) {
+            char l[16];
+            snprintf(l, sizeof(l), "G1 X%d\n", i);
+            push(b, l);
+            if(i % 3 == 2) {
+                // three lines ahead, taken alternately as a string and into a buffer
+                for(int k = 0; k < 3; k++, n++) {
+                    snprintf(l, sizeof(l), "G1 X%d", n);
+                    if(n % 2) {
+                        CHECK(b.get_line(line) && line == l);
+                    } else {
+                        CHECK(b.get_line(buf, sizeof(buf)) == (int)strlen(l) && strcmp(buf, l) == 0);
+                    }
+                }
+                CHECK(!b.has_line());
+            }
+        }
+        CHECK(n == 999 && b.has_line() && b.get_line(line) && line == "G1 X999");
+        CHECK(b.take_dropped() == 0);
+    }
+
+    // empty lines are lines
+    {
+        LineBuffer<16> b;
+        std::string line = "x";
+        push(b, "\n\n");
+        CHECK(b.get_line(line) && line.empty());
+        CHECK(b.get_line(line) && line.empty());
+        CHECK(!b.has_line());
+    }
+
+    // a line that does not fit is dropped whole, the lines either side of it are not
+    {
+        LineBuffer<16> b;
+        std::string line;
+        push(b, "M3\n");
+        push(b, "G1 X123456789012345678\n");
+        push(b, "M5\n");
+        CHECK(b.take_dropped() == 1 && b.take_overflowed() == 0);
+        CHECK(b.take_dropped() == 0);
+        CHECK(b.get_line(line) && line == "M3");
+        CHECK(b.get_line(line) && line == "M5");
+        CHECK(!b.has_line());
+    }
+
+    // the longest line that fits, its newline takes the last slot
+    {
+        LineBuffer<16> b;
+        std::string line;
+        push(b, std::string(b.capacity() - 1, 'a') + "\n");
+        CHECK(b.size() == b.capacity() && b.take_dropped() == 0);
+        CHECK(b.get_line(line) && line == std::string(b.capacity() - 1, 'a'));
+        push(b, std::string(b.capacity(), 'a') + "\n");
+        CHECK(!b.has_line() && b.take_dropped() == 1 && b.size() == 0);
+    }
+
+    // a full buffer of waiting lines drops the next one until there is room again
+    {
+        LineBuffer<16> b;
+        std::string line;
+        push(b, "G0\nG1\nG2\n");
+        push(b, "G3 X12345\n");
+        CHECK(b.take_overflowed() == 1 && b.take_dropped() == 0);
+        CHECK(b.get_line(line) && line == "G0");
+        push(b, "G4\n");
+        CHECK(b.get_line(line) && line == "G1");
+        CHECK(b.get_line(line) && line == "G2");
+        CHECK(b.get_line(line) && line == "G4");
+    }
+
+    // a line cut short to fit the caller's buffer
+    {
+        LineBuffer<16> b;
+        char buf[4];
+        push(b, "G28.1\nM2\n");
+        CHECK(b.get_line(buf, sizeof(buf)) == 3 && strcmp(buf, "G28") == 0);
+        CHECK(b.get_line(buf, sizeof(buf)) == 2 && strcmp(buf, "M2") == 0);
+    }
+
+    return test_result("line buffer");
+}
@@ -0,0 +1,245 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the firmware Modbus master against a loopback port standing in for the slaves, on a virtual clock, so the
+// transaction engine can be checked without a VFD. The loopback answers as a Huanyang VFD at address 1 and as a
+// standard holding register slave at address 2, and can drop, garble or delay its replies.
+
+#include "Modbus.h"
+#include "SimTest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+
+static uint32_t now_us = 0;
+
+// stands in for the one in SimHal, the clock only moves when run() moves it
+extern "C" uint32_t us_ticker_read(void) { return now_us; }
+
+class Loopback : public ModbusPort {
+    public:
+        uint32_t char_us{1146};     // 9600 8N1
+        uint32_t latency_us{2000};  // from the end of the request to the first byte of the reply
+        int drop{0};                // replies still to be lost
+        int garble{0};              // replies still to be sent with a bad CRC
+        bool transmitting{false};
+        std::vector<std::vector<uint8_t>> requests;
+
+        uint16_t registers[16]{};
+        uint16_t hz{0};
+        uint16_t rotation{0};
+        uint16_t current{0};
+
+        void transmit(const uint8_t *data, uint8_t len)
+        {
+            transmitting = true;
+            requests.emplace_back(data, data + len);
+            if(Modbus::crc16(data, len - 2) != (data[len - 2] | (data[len - 1] << 8))) return;
+
+            std::vector<uint8_t> reply = answer(data, len - 2);
+            if(reply.empty()) return;
+            if(drop > 0) {
+                drop--;
+                return;
+            }
+            uint16_t crc = Modbus::crc16(reply.data(), reply.size());
+            if(garble > 0) {
+                garble--;
+                crc ^= 0x5555;
+            }
+            reply.push_back(crc & 0xFF);
+            reply.push_back(crc >> 8);
+
+            // one byte per character time after the request has gone out
+            uint32_t t = now_us + len * char_us + latency_us;
+            for(uint8_t b : reply) {
+                t += char_us;
+                rx.push_back({t, b});
+            }
+        }
+
+        void release() { transmitting = false; }
+
+        int receive()
+        {
+            if(rx.empty() || rx.front().first > now_us) return -1;
+            int c = rx.front().second;
+            rx.pop_front();
+            return c;
+        }
+
+        uint32_t char_time_us() const { return char_us; }
+
+    private:
+        std::deque<std::pair<uint32_t, uint8_t>> rx;
+
+        std::vector<uint8_t> answer(const uint8_t *r, uint8_t len)
+        {
+            if(r[0] == 1) {
+                // Huanyang, replies are address, function, length and the data
+                switch(r[1]) {
+                    case 0x03: return { 0x01, 0x03, 0x01, r[3] };
+                    case 0x04: {
+                        uint16_t v = r[3] == 0x03 ? rotation : r[3] == 0x02 ? current : 0;
+                        return { 0x01, 0x04, 0x03, r[3], (uint8_t)(v >> 8), (uint8_t)v };
+                    }
+                    case 0x05:
+                        hz = (r[3] << 8) | r[4];
+                        return { 0x01, 0x05, 0x02, r[3], r[4] };
+                }
+                return {};
+            }
+            if(r[0] == 2) {
+                uint16_t addr = (r[2] << 8) | r[3];
+                switch(r[1]) {
+                    case 0x03: {
+                        uint16_t n = (r[4] << 8) | r[5];
+                        if(addr + n > 16) return { 0x02, 0x83, 0x02 };
+                        std::vector<uint8_t> v = { 0x02, 0x03, (uint8_t)(n * 2) };
+                        for(uint16_t i = 0; i < n; i++) {
+                            v.push_back(registers[addr + i] >> 8);
+                            v.push_back(registers[addr + i]);
+                        }
+                        return v;
+                    }
+                    case 0x05:
+                        return std::vector<uint8_t>(r, r + len);
+                    case 0x06:
+                        registers[addr & 15] = (r[4] << 8) | r[5];
+                        return std::vector<uint8_t>(r, r + len);
+                    case 0x10: {
+                        uint16_t n = (r[4] << 8) | r[5];
+                        for(uint16_t i = 0; i < n; i++) registers[(addr + i) & 15] = (r[7 + i * 2] << 8) | r[8 + i * 2];
+                        return std::vector<uint8_t>(r, r + 6);
+                    }
+                }
+            }
+            return {};
+        }
+};
+
+// polls as on_idle would, every 100us, until the master has nothing left to do
+static void run(Modbus &modbus, uint32_t limit_us = 2000000)
+{
+    uint32_t end = now_us + limit_us;
+    do {
+        modbus.poll();
+        now_us += 100;
+    } while(!modbus.is_idle() && now_us < end);
+}
+
+int main()
+{
+    Loopback bus;
+    Modbus modbus(&bus);
+
+    // the telegrams match the Huanyang protocol description in HuanyangSpindleControl.cpp
+    {
+        uint8_t start[4] = { 0x01, 0x03, 0x01, 0x01 };
+        uint16_t crc = Modbus::crc16(start, 4);
+        CHECK((crc & 0xFF) == 0x31 && (crc >> 8) == 0x88);
+        uint8_t read_frequency[6] = { 0x01, 0x04, 0x03, 0x00, 0x00, 0x00 };
+        crc = Modbus::crc16(read_frequency, 6);
+        CHECK((crc & 0xFF) == 0xF0 && (crc >> 8) == 0x4E);
+    }
+
+    // a plain round trip, the caller is not held up while it is on the bus
+    {
+        bus.rotation = 12000;
+        int calls = 0;
+        uint16_t value = 0;
+        uint8_t msg[6] = { 0x01, 0x04, 0x03, 0x03, 0x00, 0x00 };
+        CHECK(modbus.request(msg, 6, 0, [&](const uint8_t *reply, uint8_t len) {
+            calls++;
+            if(reply != nullptr && len == 6) value = (reply[4] << 8) | reply[5];
+        }));
+        modbus.poll();
+        CHECK(bus.transmitting && calls == 0);
+        run(modbus);
+        CHECK(calls == 1 && value == 12000 && !bus.transmitting);
+    }
+
+    // requests are sent one at a time in order, with the frame gap between them
+    {
+        std::vector<int> order;
+        uint16_t regs[3] = { 100, 200, 300 };
+        bus.requests.clear();
+        CHECK(modbus.write_multiple_registers(2, 4, 3, regs, [&](const uint8_t *r, uint8_t) { order.push_back(r ? 1 : -1); }));
+        CHECK(modbus.write_holding_register(2, 5, 250, [&](const uint8_t *r, uint8_t) { order.push_back(r ? 2 : -2); }));
+        uint16_t got[3] = {};
+        CHECK(modbus.read_holding_registers(2, 4, 3, [&](const uint8_t *r, uint8_t len) {
+            order.push_back(r ? 3 : -3);
+            if(r != nullptr && len == 9) for(int i = 0; i < 3; i++) got[i] = (r[3 + i * 2] << 8) | r[4 + i * 2];
+        }));
+        run(modbus);
+        CHECK(order == std::vector<int>({ 1, 2, 3 }));
+        CHECK(got[0] == 100 && got[1] == 250 && got[2] == 300);
+        CHECK(bus.requests.size() == 3);
+    }
+
+    // lost and garbled replies are asked for again
+    {
+        uint32_t failures = modbus.get_failures();
+        int ok = 0;
+        bus.drop = 1;
+        bus.garble = 1;
+        bus.requests.clear();
+        CHECK(modbus.read_holding_registers(2, 0, 1, [&](const uint8_t *r, uint8_t) { ok += r != nullptr; }));
+        run(modbus);
+        CHECK(ok == 1 && bus.requests.size() == 3 && modbus.get_failures() == failures);
+    }
+
+    // and given up on once the retries are used up, without holding up the next request
+    {
+        uint32_t failures = modbus.get_failures();
+        int failed_calls = 0, ok = 0;
+        bus.drop = 3;
+        bus.requests.clear();
+        uint32_t start = now_us;
+        CHECK(modbus.read_holding_registers(2, 0, 1, [&](const uint8_t *r, uint8_t) { failed_calls += r == nullptr; }));
+        CHECK(modbus.write_holding_register(2, 1, 7, [&](const uint8_t *r, uint8_t) { ok += r != nullptr; }));
+        run(modbus);
+        CHECK(failed_calls == 1 && ok == 1 && modbus.get_failures() == failures + 1);
+        CHECK(bus.requests.size() == 1 + Modbus::default_retries + 1);
+        // three timeouts and not much else
+        CHECK(now_us - start < 4 * Modbus::default_timeout_ms * 1000);
+    }
+
+    // an exception reply fails straight away
+    {
+        int failed_calls = 0;
+        bus.requests.clear();
+        CHECK(modbus.read_holding_registers(2, 14, 4, [&](const uint8_t *r, uint8_t) { failed_calls += r == nullptr; }));
+        run(modbus);
+        CHECK(failed_calls == 1 && bus.requests.size() == 1);
+    }
+
+    // a slave that answers slower than the timeout allows for
+    {
+        int ok = 0;
+        bus.latency_us = 150000;
+        uint8_t msg[5] = { 0x01, 0x05, 0x02, 0x13, 0x88 };
+        CHECK(modbus.request(msg, 5, 0, [&](const uint8_t *r, uint8_t) { ok += r != nullptr; }, 250, 0));
+        run(modbus);
+        CHECK(ok == 1 && bus.hz == 5000);
+        bus.latency_us = 2000;
+    }
+
+    // the queue takes seven and refuses the rest rather than losing any
+    {
+        int done = 0, queued = 0;
+        for(int i = 0; i < 10; i++) {
+            queued += modbus.write_coil(2, i, true, [&](const uint8_t *, uint8_t) { done++; });
+        }
+        run(modbus);
+        CHECK(queued == 7 && done == 7);
+    }
+
+    return test_result("modbus loopback");
+}
@@ -0,0 +1,250 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SimHal.h"
+
+#include "LPC17xx.h"
+#include "mbed.h"
+#include "platform_memory.h"
+#include "MemoryPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// the registers the firmware writes to
+LPC_SC_TypeDef      sim_LPC_SC = {};
+LPC_GPIO_TypeDef    sim_LPC_GPIO[5] = {};
+LPC_WDT_TypeDef     sim_LPC_WDT = {};
+LPC_TIM_TypeDef     sim_LPC_TIM[4] = {};
+LPC_RIT_TypeDef     sim_LPC_RIT = {};
+LPC_PWM_TypeDef     sim_LPC_PWM1 = {};
+LPC_GPIOINT_TypeDef sim_LPC_GPIOINT = {};
+LPC_PINCON_TypeDef  sim_LPC_PINCON = {};
+LPC_ADC_TypeDef     sim_LPC_ADC = {};
+SCB_Type            sim_SCB = {};
+
+uint32_t SystemCoreClock = 100000000;
+
+// The pool allocator itself is target code (it marks allocations for gdb with inline asm),
+// on the host the heap is used but the 32K budget of the AHB SRAM bank is still enforced
+// so a configuration that would not fit on the board fails here as well.
+MemoryPool *MemoryPool::first = nullptr;
+
+MemoryPool::MemoryPool(void *base, uint16_t size) : next(nullptr), base(base), size(size) {}
+MemoryPool::~MemoryPool() {}
+
+static uint32_t ahb_used = 0;
+
+void *MemoryPool::alloc(size_t nbytes)
+{
+    if(ahb_used + nbytes + sizeof(size_t) > size) return nullptr;
+    size_t *p = (size_t *)malloc(nbytes + sizeof(size_t));
+    if(p == nullptr) return nullptr;
+    *p = nbytes + sizeof(size_t);
+    ahb_used += *p;
+    return p + 1;
+}
+
+void MemoryPool::dealloc(void *d)
+{
+    if(d == nullptr) return;
+    size_t *p = (size_t *)d - 1;
+    ahb_used -= *p;
+    ::free(p);
+}
+
+uint32_t MemoryPool::free() { return size - ahb_used; }
+bool MemoryPool::has(void *p) { return true; }
+
+// the vectors are provided by whichever firmware objects are linked in
+extern "C" {
+    void TIMER0_IRQHandler(void) __attribute__((weak));
+    void TIMER1_IRQHandler(void) __attribute__((weak));
+    void TIMER2_IRQHandler(void) __attribute__((weak));
+    void TIMER3_IRQHandler(void) __attribute__((weak));
+    void PendSV_Handler(void) __attribute__((weak));
+}
+
+namespace {
+    struct SimTimer {
+        void (*handler)(void);
+        IRQn_Type irq;
+        bool armed;
+        uint64_t fire_at;
+    };
+
+    SimTimer timers[4] = {
+        { TIMER0_IRQHandler, TIMER0_IRQn, false, 0 },
+        { TIMER1_IRQHandler, TIMER1_IRQn, false, 0 },
+        { TIMER2_IRQHandler, TIMER2_IRQn, false, 0 },
+        { TIMER3_IRQHandler, TIMER3_IRQn, false, 0 },
+    };
+    SimHal::IrqStats stats[4];
+    SimHal::IrqStats pendsv;
+    bool pendsv_enabled = true;
+
+    bool irq_enabled[64];
+    uint32_t irq_priority[64];
+    int irq_disable_count = 0;
+    bool in_irq = false;
+    uint64_t current_time = 0;
+    std::function<void(int)> irq_observer;
+
+    int irq_index(IRQn_Type irq) { return (int)irq + 16; }
+
+    // PendSV is below the timers so it runs once the interrupt that pended it returns, or straight away
+    // if it was pended from the main loop, which is as soon as the simulator next looks as no time passes in between
+    void run_pendsv()
+    {
+        while((sim_SCB.ICSR & SCB_ICSR_PENDSVSET_Msk) && PendSV_Handler != nullptr && irq_disable_count == 0) {
+            sim_SCB.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+            if(!pendsv_enabled) continue;
+            in_irq = true;
+            uint64_t start = SimHal::host_ns();
+            PendSV_Handler();
+            pendsv.host_ns += SimHal::host_ns() - start;
+            pendsv.calls++;
+            in_irq = false;
+        }
+    }
+
+    // pick up timers the firmware started or stopped since we last looked
+    void sync_timers()
+    {
+        for (int i = 0; i < 4; ++i) {
+            LPC_TIM_TypeDef *tim = &sim_LPC_TIM[i];
+            if(!(tim->TCR & 1)) {
+                timers[i].armed = false;
+            } else if(!timers[i].armed) {
+                timers[i].armed = true;
+                timers[i].fire_at = current_time + tim->MR0 + ((tim->MCR & 2) ? 1 : 0);
+            }
+        }
+    }
+}
+
+namespace SimHal {
+
+void init()
+{
+    static uint8_t ahb_sram[32768];
+    _ahb = new MemoryPool(ahb_sram, sizeof(ahb_sram) - 1);
+}
+
+uint64_t now() { return current_time; }
+
+uint32_t counts_per_us() { return SystemCoreClock / 4 / 1000000; }
+
+bool run_next_irq()
+{
+    if(irq_disable_count > 0 || in_irq) return false;
+
+    run_pendsv();
+    sync_timers();
+
+    // the earliest armed timer wins, ties go to the higher NVIC priority (lower number)
+    int next = -1;
+    for (int i = 0; i < 4; ++i) {
+        SimTimer &t = timers[i];
+        if(!t.armed || !irq_enabled[irq_index(t.irq)] || t.handler == nullptr) continue;
+        if(next < 0 || t.fire_at < timers[next].fire_at ||
+           (t.fire_at == timers[next].fire_at && irq_priority[irq_index(t.irq)] < irq_priority[irq_index(timers[next].irq)])) {
+            next = i;
+        }
+    }
+    if(next < 0) return false;
+
+    SimTimer &t = timers[next];
+    LPC_TIM_TypeDef *tim = &sim_LPC_TIM[next];
+    if(t.fire_at > current_time) current_time = t.fire_at;
+
+    tim->IR |= 1;
+    uint64_t match = current_time;
+    if(tim->MCR & 2) {
+        // reset on match, the counter starts again from zero
+        t.fire_at = current_time + tim->MR0 + 1;
+    } else {
+        t.armed = false;
+        if(tim->MCR & 4) tim->TCR &= ~1; // stop on match
+    }
+
+    in_irq = true;
+    uint64_t start = host_ns();
+    t.handler();
+    stats[next].host_ns += host_ns() - start;
+    stats[next].calls++;
+    in_irq = false;
+    // a new match value written by the handler applies to the period that just started as the counter is still below it
+    if(t.armed && (tim->MCR & 2)) t.fire_at = match + tim->MR0 + 1;
+    run_pendsv();
+
+    // a one shot timer restarted by the handler counts from now
+    if(next == 0 && (sim_LPC_TIM[1].TCR & 1) && !(sim_LPC_TIM[1].MCR & 2)) timers[1].armed = false;
+    sync_timers();
+
+    if(irq_observer) irq_observer(next);
+    return true;
+}
+
+void run_until(uint64_t t)
+{
+    for (;;) {
+        sync_timers();
+        uint64_t next = UINT64_MAX;
+        for (int i = 0; i < 4; ++i) {
+            if(timers[i].armed && irq_enabled[irq_index(timers[i].irq)] && timers[i].handler != nullptr && timers[i].fire_at < next) next = timers[i].fire_at;
+        }
+        if(next > t || in_irq || irq_disable_count > 0 || !run_next_irq()) break;
+    }
+    if(t > current_time) current_time = t;
+}
+
+void set_irq_observer(std::function<void(int)> fnc) { irq_observer = fnc; }
+
+void set_pendsv_enabled(bool on) { pendsv_enabled = on; }
+
+const IrqStats& timer_stats(int timer) { return stats[timer]; }
+const IrqStats& pendsv_stats() { return pendsv; }
+
+uint64_t host_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+} // namespace SimHal
+
+extern "C" {
+
+void NVIC_EnableIRQ(IRQn_Type irq) { irq_enabled[irq_index(irq)] = true; }
+void NVIC_DisableIRQ(IRQn_Type irq) { irq_enabled[irq_index(irq)] = false; }
+void NVIC_SetPendingIRQ(IRQn_Type irq) {}
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { irq_priority[irq_index(irq)] = priority; }
+uint32_t NVIC_GetPriority(IRQn_Type irq) { return irq_priority[irq_index(irq)]; }
+void NVIC_SetPriorityGrouping(uint32_t group) {}
+void NVIC_SystemReset(void) { fprintf(stderr, "sim: system reset requested\n"); exit(1); }
+
+void __disable_irq(void) { ++irq_disable_count; }
+void __enable_irq(void) { if(irq_disable_count > 0) --irq_disable_count; }
+
+uint32_t us_ticker_read(void) { return current_time / SimHal::counts_per_us(); }
+
+void wait_us(int us)
+{
+    if(in_irq) {
+        // nothing else can run while the interrupt is busy waiting
+        current_time += (uint64_t)us * SimHal::counts_per_us();
+    } else {
+        SimHal::run_until(current_time + (uint64_t)us * SimHal::counts_per_us());
+    }
+}
+void wait_ms(int ms) { wait_us(ms * 1000); }
+void wait(float s) { wait_us(s * 1000000.0F); }
+
+} // extern "C"
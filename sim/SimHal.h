@@ -0,0 +1,43 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Virtual time of the simulated LPC1768.
+// The clock is measured in peripheral timer counts (SystemCoreClock/4) and only moves
+// when the simulator asks for it, so a replay is bit for bit repeatable.
+namespace SimHal {
+
+    // cumulative host cost of one interrupt vector
+    struct IrqStats {
+        uint64_t calls;
+        uint64_t host_ns;
+    };
+
+    void init();                     // must run before the Kernel is created
+
+    uint64_t now();                  // timer counts since reset
+    uint32_t counts_per_us();
+
+    // run the next pending timer interrupt, returns false if no timer is armed
+    bool run_next_irq();
+    // run every timer interrupt due up to and including the given time, then park the clock there
+    void run_until(uint64_t t);
+
+    // called after every simulated interrupt with the timer number that fired
+    void set_irq_observer(std::function<void(int timer)> fnc);
+
+    // PendSV is not run when off, as if the main loop were the only one to prepare step segments
+    void set_pendsv_enabled(bool on);
+
+    const IrqStats& timer_stats(int timer);
+    const IrqStats& pendsv_stats();
+    uint64_t host_ns();              // monotonic host clock, for benchmarks only
+}
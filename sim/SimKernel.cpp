@@ -0,0 +1,211 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host build of the Kernel with only the motion modules loaded.
+// Mirrors the start up order of libs/Kernel.cpp so the modules see the same state they would on the board.
+
+#include "libs/Kernel.h"
+#include "libs/Module.h"
+#include "libs/Config.h"
+#include "libs/ConfigValue.h"
+#include "libs/ConfigSources/FirmConfigSource.h"
+#include "libs/ConfigSources/FileConfigSource.h"
+#include "libs/StreamOutputPool.h"
+#include "libs/StepTicker.h"
+#include "libs/PublicData.h"
+#include "modules/communication/GcodeDispatch.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/robot/Robot.h"
+#include "modules/robot/Planner.h"
+#include "modules/utils/simpleshell/SimpleShell.h"
+#include "checksumm.h"
+#include "utils.h"
+#include "platform_memory.h"
+#include "SimKernel.h"
+
+#include <string.h>
+
+#define base_stepping_frequency_checksum            CHECKSUM("base_stepping_frequency")
+#define microseconds_per_step_pulse_checksum        CHECKSUM("microseconds_per_step_pulse")
+#define step_smoothing_enable_checksum              CHECKSUM("step_smoothing_enable")
+#define grbl_mode_checksum                          CHECKSUM("grbl_mode")
+#define ok_per_line_checksum                        CHECKSUM("ok_per_line")
+
+Kernel* Kernel::instance;
+
+// set by the simulator before the Kernel is constructed
+ConfigSource *sim_config_source = nullptr;
+char sim_machine_model = CARVERA;
+
+Kernel::Kernel()
+{
+    halted = false;
+    feed_hold = false;
+    enable_feed_hold = false;
+    bad_mcu = false;
+    stop_request = false;
+    internal_stop_request = false;
+    uploading = false;
+    laser_mode = false;
+    vacuum_mode = false;
+    optional_stop_mode = false;
+    line_by_line_exec_mode = false;
+    sleeping = false;
+    waiting = false;
+    tool_waiting = false;
+    suspending = false;
+    aborted = false;
+    halt_reason = MANUAL;
+    atc_state = 0;
+    zprobing = false;
+    probeLaserOn = false;
+    probe_addr = 0;
+    checkled = false;
+    spindleon = false;
+    cachewait = false;
+    disable_serial_console = true;
+    halt_on_error_debug = false;
+    keep_alive_request = false;
+    flex_compensation_active = false;
+    flex_compensation_load_error = false;
+    use_leds = false;
+    serial = nullptr;
+    i2c = nullptr;
+    slow_ticker = nullptr;
+    adc = nullptr;
+    simpleshell = nullptr;
+    configurator = nullptr;
+
+    instance = this;
+
+    // no eeprom on the host, the machine model picks the built in config like the factory data would
+    this->factory_set = new(AHB) FACTORY_SET();
+    memset(this->factory_set, 0, sizeof(FACTORY_SET));
+    this->factory_set->MachineModel = sim_machine_model;
+
+    this->config = new(AHB) Config(sim_config_source != nullptr ? sim_config_source : new FirmConfigSource("firm"));
+    this->config->config_cache_load();
+
+    this->streams = new(AHB) StreamOutputPool();
+    this->current_path = "/";
+
+    this->grbl_mode = this->config->value( grbl_mode_checksum )->by_default(true)->as_bool();
+    this->ok_per_line = this->config->value( ok_per_line_checksum )->by_default(true)->as_bool();
+
+    this->step_ticker = new(AHB) StepTicker();
+
+    NVIC_SetPriorityGrouping(0);
+    NVIC_SetPriority(TIMER0_IRQn, 2);
+    NVIC_SetPriority(TIMER1_IRQn, 1);
+    NVIC_SetPriority(TIMER2_IRQn, 4);
+    NVIC_SetPriority(TIMER3_IRQn, 4);
+
+    this->base_stepping_frequency = this->config->value(base_stepping_frequency_checksum)->by_default(100000)->as_number();
+    float microseconds_per_step_pulse = this->config->value(microseconds_per_step_pulse_checksum)->by_default(1)->as_number();
+    this->step_ticker->set_frequency( this->base_stepping_frequency );
+    this->step_ticker->set_unstep_time( microseconds_per_step_pulse );
+    this->step_ticker->set_step_smoothing( this->config->value(step_smoothing_enable_checksum)->by_default(false)->as_bool() );
+
+    this->eeprom_data = new(AHB) EEPROM_data();
+    memset(this->eeprom_data, 0, sizeof(EEPROM_data));
+    this->eeprom_data->TOOL = -1;
+
+    this->add_module( this->conveyor       = new(AHB) Conveyor()      );
+    this->add_module( this->gcode_dispatch = new(AHB) GcodeDispatch() );
+    this->add_module( this->robot          = new(AHB) Robot()         );
+
+    this->planner = new(AHB) Planner();
+}
+
+uint8_t Kernel::get_state()
+{
+    if(halted) return ALARM;
+    if(feed_hold) return HOLD;
+    return conveyor->is_idle() ? IDLE : RUN;
+}
+
+std::string Kernel::get_query_string() { return ""; }
+std::string Kernel::get_diagnose_string() { return ""; }
+
+void Kernel::add_module(Module* module)
+{
+    module->on_module_loaded();
+}
+
+void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod)
+{
+    this->hooks[id_event].push_back(mod);
+}
+
+void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
+{
+    bool was_idle = true;
+    if(id_event == ON_HALT) {
+        this->halted = (argument == nullptr);
+        if(!this->halted && this->feed_hold) this->feed_hold= false;
+        was_idle = conveyor->is_idle();
+    }
+
+    for (auto m : hooks[id_event]) {
+        (m->*kernel_callback_functions[id_event])(argument);
+    }
+
+    if(id_event == ON_HALT && (!this->halted || !was_idle)) {
+        this->robot->reset_position_from_current_actuator_position();
+    }
+}
+
+bool Kernel::kernel_has_event(_EVENT_ENUM id_event, Module *mod)
+{
+    for (auto m : hooks[id_event]) {
+        if(m == mod) return true;
+    }
+    return false;
+}
+
+void Kernel::unregister_for_event(_EVENT_ENUM id_event, Module *mod)
+{
+    for (auto i = hooks[id_event].begin(); i != hooks[id_event].end(); ++i) {
+        if(*i == mod) {
+            hooks[id_event].erase(i);
+            return;
+        }
+    }
+}
+
+// eeprom and factory data live in RAM only
+void Kernel::read_eeprom_data() {}
+void Kernel::write_eeprom_data() {}
+void Kernel::erase_eeprom_data() {}
+void Kernel::check_eeprom_data() {}
+void Kernel::read_Factory_data() {}
+void Kernel::write_Factory_data() {}
+void Kernel::erase_Factory_data() {}
+void Kernel::read_Factroy_SD() {}
+
+void Kernel::set_tool_waiting(bool f) { this->tool_waiting = f; }
+
+// console commands are not part of the motion replay
+bool SimpleShell::parse_command(const char *cmd, string args, StreamOutput *stream)
+{
+    return false;
+}
+
+// there is no sd card, config-set and friends have nothing to write to
+FileConfigSource::FileConfigSource(string config_file, const char *name) : config_file(config_file), config_file_found(false)
+{
+    this->name_checksum = get_checksum(name);
+}
+void FileConfigSource::transfer_values_to_cache( ConfigCache *cache ) {}
+void FileConfigSource::transfer_values_to_cache( ConfigCache *cache, const char * file_name ) {}
+bool FileConfigSource::is_named( uint16_t check_sum ) { return check_sum == this->name_checksum; }
+bool FileConfigSource::write( string setting, string value ) { return false; }
+bool FileConfigSource::remove( string setting ) { return false; }
+string FileConfigSource::read( uint16_t check_sums[3] ) { return ""; }
+bool FileConfigSource::has_config_file() { return false; }
+void FileConfigSource::try_config_file(string candidate) {}
+string FileConfigSource::get_config_file() { return config_file; }
@@ -0,0 +1,8 @@
+#pragma once
+
+class ConfigSource;
+
+// replaces the built in config.default when set before the Kernel is created
+extern ConfigSource *sim_config_source;
+// CARVERA or CARVERA_AIR, selects which built in config is used
+extern char sim_machine_model;
@@ -0,0 +1,292 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays a gcode file through the real GcodeDispatch, Robot, Planner, Conveyor and StepTicker
+// on the host. The step ticker runs from simulated timer interrupts, so the step timeline and the
+// block timing written out are exactly what the firmware would produce for the same config.
+
+#include "libs/Kernel.h"
+#include "libs/Module.h"
+#include "libs/SerialMessage.h"
+#include "libs/StreamOutput.h"
+#include "libs/StreamOutputPool.h"
+#include "libs/StepTicker.h"
+#include "libs/StepperMotor.h"
+#include "libs/ConfigSources/FirmConfigSource.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/robot/Robot.h"
+#include "modules/robot/Block.h"
+
+#include "SimHal.h"
+#include "SimKernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+// firmware replies go to stderr, "ok" is dropped unless asked for
+class SimConsole : public StreamOutput {
+    public:
+        bool verbose{false};
+
+        int puts(const char *s, int size = 0)
+        {
+            size_t n = size > 0 ? size : strlen(s);
+            if(verbose || !(n >= 2 && strncmp(s, "ok", 2) == 0)) fwrite(s, 1, n, stderr);
+            return n;
+        }
+};
+
+// Drives the virtual clock whenever the firmware idles waiting for the step ticker,
+// which is what the main loop does on the board while the planner queue is full.
+// Time is advanced to the next block boundary, or by a millisecond at most as the main loop has to come round
+// again to prepare more step segments.
+class SimClock : public Module {
+    public:
+        bool in_main_loop{false};
+        uint64_t wait_ns{0};
+
+        void on_module_loaded() { register_for_event(ON_IDLE); }
+
+        void on_idle(void *)
+        {
+            if(in_main_loop) return;
+            uint64_t start = SimHal::host_ns();
+            const Block *b = THEKERNEL->step_ticker->get_current_block();
+            uint64_t until = SimHal::now() + 1000 * SimHal::counts_per_us();
+            do {
+                if(!SimHal::run_next_irq()) {
+                    fprintf(stderr, "sim: firmware is waiting but no timer is running\n");
+                    exit(2);
+                }
+            } while(b != nullptr && THEKERNEL->step_ticker->get_current_block() == b && SimHal::now() < until);
+            wait_ns += SimHal::host_ns() - start;
+        }
+};
+
+struct BlockRecord {
+    const Block *block;
+    uint64_t start;
+    unsigned int line;
+    uint32_t steps;
+    uint32_t planned_ticks;
+    float millimeters, nominal, entry, exit;
+};
+
+static FILE *steps_out = nullptr;
+static FILE *blocks_out = nullptr;
+static std::vector<int32_t> last_position;
+static BlockRecord current{nullptr};
+static uint64_t block_count = 0;
+static uint64_t step_count = 0;
+static uint64_t tick_count = 0;
+
+static uint64_t to_ns(uint64_t t) { return t * 1000 / SimHal::counts_per_us(); }
+
+static void finish_block(uint64_t now)
+{
+    if(current.block == nullptr) return;
+    if(blocks_out != nullptr) {
+        uint64_t actual = (now - current.start) * THEKERNEL->step_ticker->get_frequency() / (SimHal::counts_per_us() * 1000000);
+        fprintf(blocks_out, "%llu,%u,%llu,%llu,%u,%.4f,%.4f,%.4f,%.4f,%u,%llu\n",
+                (unsigned long long)block_count, current.line,
+                (unsigned long long)to_ns(current.start), (unsigned long long)to_ns(now),
+                current.steps, current.millimeters, current.nominal, current.entry, current.exit,
+                current.planned_ticks, (unsigned long long)actual);
+    }
+    ++block_count;
+    current.block = nullptr;
+}
+
+// sample the machine after every simulated interrupt
+static void observe(int timer)
+{
+    if(timer != 0) return;
+    uint64_t now = SimHal::now();
+    ++tick_count;
+
+    const Block *b = THEKERNEL->step_ticker->get_current_block();
+    if(b != current.block) {
+        finish_block(now);
+        if(b != nullptr) {
+            current = { b, now, b->line, b->steps_event_count, b->total_move_ticks,
+                        b->millimeters, b->nominal_speed, b->entry_speed, b->exit_speed };
+        }
+    }
+
+    for (size_t i = 0; i < last_position.size(); ++i) {
+        StepperMotor *m = THEROBOT->actuators[i];
+        int32_t pos = (int32_t)m->get_current_step();
+        if(pos == last_position[i]) continue;
+        step_count += abs(pos - last_position[i]);
+        last_position[i] = pos;
+        if(steps_out != nullptr) {
+            fprintf(steps_out, "%llu,%u,%d,%d\n", (unsigned long long)to_ns(now), (unsigned)i, m->which_direction() ? 1 : 0, pos);
+        }
+    }
+}
+
+static FILE *open_output(const char *fn)
+{
+    if(strcmp(fn, "-") == 0) return stdout;
+    FILE *fp = fopen(fn, "w");
+    if(fp == nullptr) {
+        perror(fn);
+        exit(1);
+    }
+    return fp;
+}
+
+static ConfigSource *load_config(const char *fn)
+{
+    FILE *fp = fopen(fn, "rb");
+    if(fp == nullptr) {
+        perror(fn);
+        exit(1);
+    }
+    std::string *buf = new std::string;
+    char tmp[4096];
+    size_t n;
+    while((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) buf->append(tmp, n);
+    fclose(fp);
+    return new FirmConfigSource("sim", buf->data(), buf->data() + buf->size());
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] file.cnc\n"
+            "  -c config   use this config file instead of the built in config.default\n"
+            "  -a          use the built in Carvera Air config (config2.default)\n"
+            "  -s file     write the step timeline as csv (time_ns,motor,dir,position), - for stdout\n"
+            "  -b file     write per block timing as csv, - for stdout\n"
+            "  -l us       virtual main loop time spent per gcode line, default 0\n"
+            "  -r count    replay the file count times, to benchmark the main loop on a long job\n"
+            "  -n          no PendSV, so only the main loop prepares step segments\n"
+            "  -v          echo every reply from the firmware including ok\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *config_file = nullptr;
+    const char *steps_file = nullptr;
+    const char *blocks_file = nullptr;
+    uint32_t line_us = 0;
+    unsigned int repeat = 1;
+    bool verbose = false;
+
+    int c;
+    while((c = getopt(argc, argv, "c:as:b:l:r:nv")) != -1) {
+        switch(c) {
+            case 'c': config_file = optarg; break;
+            case 'a': sim_machine_model = CARVERA_AIR; break;
+            case 's': steps_file = optarg; break;
+            case 'b': blocks_file = optarg; break;
+            case 'l': line_us = strtoul(optarg, nullptr, 10); break;
+            case 'r': repeat = strtoul(optarg, nullptr, 10); break;
+            case 'n': SimHal::set_pendsv_enabled(false); break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1) usage(argv[0]);
+
+    FILE *gcode = fopen(argv[optind], "r");
+    if(gcode == nullptr) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    SimHal::init();
+    if(config_file != nullptr) sim_config_source = load_config(config_file);
+
+    Kernel *kernel = new Kernel();
+    SimConsole console;
+    console.verbose = verbose;
+    kernel->streams->append_stream(&console);
+
+    SimClock clock;
+    kernel->add_module(&clock);
+
+    // same as main() once all modules are loaded
+    kernel->conveyor->start(THEROBOT->get_number_registered_motors());
+    kernel->step_ticker->start();
+
+    for(auto a : THEROBOT->actuators) last_position.push_back((int32_t)a->get_current_step());
+    if(steps_file != nullptr) {
+        steps_out = open_output(steps_file);
+        fprintf(steps_out, "time_ns,motor,dir,position\n");
+    }
+    if(blocks_file != nullptr) {
+        blocks_out = open_output(blocks_file);
+        fprintf(blocks_out, "block,line,start_ns,end_ns,steps,mm,nominal_mm_s,entry_mm_s,exit_mm_s,planned_ticks,actual_ticks\n");
+    }
+    SimHal::set_irq_observer(observe);
+
+    uint64_t host_start = SimHal::host_ns();
+    unsigned int lines = 0;
+    char buf[1024];
+    for(unsigned int pass = 0; pass < repeat && !kernel->is_halted(); pass++) {
+        rewind(gcode);
+        while(fgets(buf, sizeof(buf), gcode) != nullptr && !kernel->is_halted()) {
+            size_t n = strlen(buf);
+            while(n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r')) buf[--n] = '\0';
+            ++lines;
+            if(n == 0) continue;
+
+            SerialMessage message;
+            message.message = buf;
+            message.stream = &console;
+            message.line = lines;
+            kernel->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+
+            // one pass of the main loop per line, then let the machine run for the time that took
+            clock.in_main_loop = true;
+            kernel->call_event(ON_MAIN_LOOP);
+            kernel->call_event(ON_IDLE);
+            clock.in_main_loop = false;
+            if(line_us > 0) SimHal::run_until(SimHal::now() + (uint64_t)line_us * SimHal::counts_per_us());
+        }
+    }
+    fclose(gcode);
+
+    if(!kernel->is_halted()) THECONVEYOR->wait_for_idle();
+    finish_block(SimHal::now());
+    uint64_t host_total = SimHal::host_ns() - host_start;
+
+    const SimHal::IrqStats &t0 = SimHal::timer_stats(0);
+    const SimHal::IrqStats &t1 = SimHal::timer_stats(1);
+    const SimHal::IrqStats &ps = SimHal::pendsv_stats();
+    uint64_t planner_ns = host_total - clock.wait_ns;
+
+    printf("lines           %u\n", lines);
+    printf("blocks          %llu\n", (unsigned long long)block_count);
+    printf("steps           %llu\n", (unsigned long long)step_count);
+    printf("step ticks      %llu\n", (unsigned long long)tick_count);
+    printf("cycle time      %.6f s\n", SimHal::now() / (SimHal::counts_per_us() * 1e6));
+    printf("underruns       %lu\n", (unsigned long)kernel->step_ticker->get_underruns());
+    // everything below depends on the host and is only meaningful relative to another run on the same machine
+    printf("host main loop  %.1f blocks/s, %.1f lines/s (%.3f ms)\n", planner_ns > 0 ? block_count * 1e9 / planner_ns : 0,
+           planner_ns > 0 ? lines * 1e9 / planner_ns : 0, planner_ns / 1e6);
+    printf("host step isr   %.1f ns/tick\n", t0.calls > 0 ? (double)t0.host_ns / t0.calls : 0);
+    printf("host unstep isr %.1f ns/call\n", t1.calls > 0 ? (double)t1.host_ns / t1.calls : 0);
+    printf("host pendsv     %.1f ns/call, %llu calls\n", ps.calls > 0 ? (double)ps.host_ns / ps.calls : 0, (unsigned long long)ps.calls);
+
+    if(steps_out != nullptr && steps_out != stdout) fclose(steps_out);
+    if(blocks_out != nullptr && blocks_out != stdout) fclose(blocks_out);
+
+    if(kernel->is_halted()) {
+        fprintf(stderr, "sim: machine halted, reason %d\n", kernel->get_halt_reason());
+        return 2;
+    }
+    return 0;
+}
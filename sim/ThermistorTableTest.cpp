@@ -0,0 +1,107 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Builds the thermistor lookup table for every predefined thermistor and checks it against the exact conversion over
+// the whole ADC range, the same way Thermistor builds it from its config.
+
+#include "ThermistorTable.h"
+#include "predefined_thermistors.h"
+#include "SimTest.h"
+
+#include <stdio.h>
+#include <math.h>
+
+// what Adc::get_max_value() gives with the oversampling the board uses
+static const uint32_t max_adc_value= 4095 << 2;
+
+// the tolerance asked for
+static const float tolerance= 0.05F;
+
+// Thermistor::adc_value_to_temperature
+static float exact(uint32_t adc_value, int r1, int r2, bool steinhart_hart, float c1, float c2, float c3, float r0)
+{
+    if ((adc_value >= max_adc_value) || (adc_value == 0))
+        return INFINITY;
+
+    float r = r2 / (((float)max_adc_value / adc_value) - 1.0F);
+    if (r1 > 0.0F) r = (r1 * r) / (r1 - r);
+
+    if(r > r0 * 8) return INFINITY;
+
+    if(steinhart_hart) {
+        float l = logf(r);
+        return (1.0F / (c1 + c2 * l + c3 * powf(l,3))) - 273.15F;
+    }
+    // c1 and c2 are j and k
+    return (1.0F / (c2 + (c1 * logf(r / r0)))) - 273.15F;
+}
+
+static void check(const char *name, std::function<float(uint32_t)> conversion)
+{
+    ThermistorTable table;
+    CHECK(table.build(conversion, max_adc_value, tolerance));
+
+    float worst= 0;
+    uint32_t first= 0, last= 0;
+    float previous= INFINITY;
+    for(uint32_t adc= 0; adc <= max_adc_value; adc++) {
+        float t= conversion(adc);
+        float l= table.lookup(adc);
+        if(!isfinite(t) || fabsf(t) > ThermistorTable::max_temperature) {
+            // outside the table it reads as a fault
+            CHECK(isinf(l));
+            continue;
+        }
+        if(first == 0) first= adc;
+        last= adc;
+        float e= fabsf(l - t);
+        if(e > worst) worst= e;
+        // a hotter thermistor never reads colder
+        CHECK(l <= previous);
+        previous= l;
+    }
+
+    printf("%-24s %3d knots, adc %5lu to %5lu, %6.1f to %5.1f°C, worst error %.3f°C\n", name, table.get_size(),
+           (unsigned long)first, (unsigned long)last, conversion(last), conversion(first), worst);
+    CHECK(first != 0);
+    // every ADC value is checked when the table is built, with the same sums lookup() does
+    CHECK(worst <= table.get_tolerance());
+    // the predefined thermistors all fit in the table at the tolerance asked for
+    CHECK(table.get_tolerance() == tolerance);
+}
+
+int main()
+{
+    char name[64];
+
+    for(auto &i : predefined_thermistors) {
+        snprintf(name, sizeof(name), "S/H %s", i.name);
+        check(name, [&i](uint32_t adc) { return exact(adc, i.r1, i.r2, true, i.c1, i.c2, i.c3, 100000.0F); });
+    }
+
+    for(auto &i : predefined_thermistors_beta) {
+        snprintf(name, sizeof(name), "beta %s", i.name);
+        float j= 1.0F / i.beta, k= 1.0F / (i.t0 + 273.15F);
+        check(name, [&i, j, k](uint32_t adc) { return exact(adc, i.r1, i.r2, false, j, k, 0, i.r0); });
+    }
+
+    // the defaults when nothing is configured
+    check("beta default", [](uint32_t adc) { return exact(adc, 0, 4700, false, 1.0F / 4066, 1.0F / (25 + 273.15F), 0, 100000.0F); });
+
+    // a table that cannot be built keeps the one it has
+    {
+        ThermistorTable table;
+        auto conversion= [](uint32_t adc) { return exact(adc, 0, 4700, false, 1.0F / 3950, 1.0F / (25 + 273.15F), 0, 100000.0F); };
+        CHECK(table.build(conversion, max_adc_value));
+        float t= table.lookup(max_adc_value / 2);
+        CHECK(!table.build([](uint32_t) { return INFINITY; }, max_adc_value));
+        CHECK(table.lookup(max_adc_value / 2) == t);
+        CHECK(isinf(ThermistorTable().lookup(max_adc_value / 2)));
+    }
+
+    return test_result("thermistor table");
+}
@@ -0,0 +1,399 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the firmware end of the windowed upload against a host sending over a simulated link, on a virtual clock, so
+// the protocol and its throughput can be checked without a machine. The link has a bandwidth and a latency each way,
+// reading what has arrived and writing a block to the SD card take the receiver time, and the host keeps sending
+// while it does. Frames and replies can be lost or damaged on the way.
+
+#include "WindowedUpload.h"
+#include "crc16.h"
+#include "SimTest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+#include <algorithm>
+
+struct segment_t {
+    uint64_t arrival_us;
+    std::vector<uint8_t> bytes;
+};
+
+class Loopback : public UploadLink, public UploadSink {
+    public:
+        // the link and the machine
+        double bytes_per_us{1.0};           // about 1MB/s each way
+        uint32_t latency_us{10000};         // one way
+        double read_us_per_byte{0.5};       // taking what has arrived off the module
+        uint32_t write_us{12000};           // an 8K block to the SD card
+        uint32_t host_timeout_us{2000000};  // the host sends again from the oldest unacknowledged block
+
+        // faults, by block index the first time it is sent and by reply count
+        std::set<size_t> lose_frame, damage_frame;
+        std::set<size_t> lose_reply;
+        size_t cancel_at{0};                // the host cancels once this many blocks are acknowledged, 0 never
+        bool eager_eot{false};              // EOT goes straight after the last frame instead of its ACK
+
+        // what the host sends
+        std::vector<uint8_t> file;
+        bool send_md5{true};
+
+        // what arrived
+        std::vector<uint8_t> received;
+        std::string md5_received;
+        uint64_t now_us{0};
+        bool host_done{false};
+        bool host_canceled{false};
+        size_t frames_sent{0};
+
+        void start()
+        {
+            blocks = (file.size() + WindowedUpload::block_size - 1) / WindowedUpload::block_size;
+            base = next = send_md5 ? 0 : 1;
+            total = blocks + 1;
+        }
+
+        // UploadLink, the machine end
+        int receive(uint8_t *buf, int size, uint32_t timeout_ms)
+        {
+            uint64_t deadline = now_us + (uint64_t)timeout_ms * 1000;
+            while(true) {
+                if(!downlink.empty() && downlink.front().arrival_us <= now_us) {
+                    int n = 0;
+                    while(n < size && !downlink.empty() && downlink.front().arrival_us <= now_us) {
+                        segment_t &s = downlink.front();
+                        int k = std::min<int>(size - n, s.bytes.size() - offset);
+                        memcpy(buf + n, &s.bytes[offset], k);
+                        n += k;
+                        offset += k;
+                        if(offset == s.bytes.size()) {
+                            downlink.pop_front();
+                            offset = 0;
+                        }
+                    }
+                    advance_to(now_us + (uint64_t)(n * read_us_per_byte));
+                    return n;
+                }
+                if(now_us >= deadline) return 0;
+                uint64_t t = deadline;
+                if(!downlink.empty() && downlink.front().arrival_us < t) t = downlink.front().arrival_us;
+                advance_to(t, true);
+            }
+        }
+
+        void send(const uint8_t *data, int len)
+        {
+            if(lose_reply.count(replies++)) return;
+            uplink.push_back({ now_us + latency_us + (uint64_t)(len / bytes_per_us), std::vector<uint8_t>(data, data + len) });
+        }
+
+        // UploadSink
+        bool write(const uint8_t *data, size_t len)
+        {
+            received.insert(received.end(), data, data + len);
+            advance_to(now_us + write_us);
+            return true;
+        }
+
+        void md5(const uint8_t *hex)
+        {
+            md5_received.assign((const char *)hex, 32);
+            advance_to(now_us + 100);
+        }
+
+    private:
+        std::deque<segment_t> downlink;     // host to machine
+        size_t offset{0};
+        std::deque<segment_t> uplink;       // machine to host
+        size_t replies{0};
+        std::vector<uint8_t> pending;       // a reply split across segments
+
+        size_t blocks{0};                   // of data, block index 0 is the md5
+        size_t total{0};                    // indexes 0 to total - 1
+        size_t base{0};                     // oldest not acknowledged
+        size_t next{0};                     // next to send
+        uint8_t window{0};                  // 0 until the machine has offered one
+        uint64_t tx_free_us{0};             // when the host's side of the link is free
+        uint64_t progress_us{0};            // when base last moved
+        bool eot_sent{false};
+        std::set<size_t> sent_once;
+
+        // runs the host up to t, or when waiting for data until the host has sent something that arrives before then
+        void advance_to(uint64_t t, bool wake = false)
+        {
+            while(true) {
+                if(wake && !downlink.empty() && downlink.front().arrival_us < t) t = std::max(now_us, downlink.front().arrival_us);
+                uint64_t e = t;
+                if(!uplink.empty() && uplink.front().arrival_us < e) e = uplink.front().arrival_us;
+                uint64_t timeout = progress_us + host_timeout_us;
+                bool timed_out = window != 0 && !host_done && timeout < e;
+                if(timed_out) e = timeout;
+                if(e > now_us) now_us = e;
+
+                if(timed_out) {
+                    progress_us = now_us;
+                    next = base;
+                    eot_sent = false;
+                    transmit();
+                    continue;
+                }
+                if(!uplink.empty() && uplink.front().arrival_us <= now_us) {
+                    std::vector<uint8_t> b = uplink.front().bytes;
+                    uplink.pop_front();
+                    pending.insert(pending.end(), b.begin(), b.end());
+                    host_receive();
+                    transmit();
+                    continue;
+                }
+                if(now_us >= t) return;
+            }
+        }
+
+        size_t index_of(uint8_t seq) const
+        {
+            // the block number is the index modulo 256, the nearest one at or after base within the window
+            return base + (uint8_t)(seq - (uint8_t)base);
+        }
+
+        void host_receive()
+        {
+            size_t i = 0;
+            while(i < pending.size()) {
+                uint8_t c = pending[i];
+                if(c == 'W' || c == WindowedUpload::ack || c == WindowedUpload::nak) {
+                    if(i + 1 >= pending.size()) {
+                        // EOT is acknowledged with a single byte
+                        if(c == WindowedUpload::ack && eot_sent) {
+                            host_done = true;
+                            i++;
+                        }
+                        break;
+                    }
+                    uint8_t v = pending[i + 1];
+                    i += 2;
+                    if(c == 'W') {
+                        if(window == 0) {
+                            window = v;
+                            progress_us = now_us;
+                        }
+                    } else if(c == WindowedUpload::ack) {
+                        size_t k = index_of(v);
+                        if(k >= base && k < next) {
+                            base = k + 1;
+                            progress_us = now_us;
+                        }
+                    } else {
+                        size_t k = index_of(v);
+                        if(k >= base && k <= next) {
+                            base = next = k;
+                            eot_sent = false;
+                            progress_us = now_us;
+                        }
+                    }
+                } else {
+                    i++;
+                }
+            }
+            pending.erase(pending.begin(), pending.begin() + i);
+        }
+
+        void transmit()
+        {
+            if(window == 0 || host_done || host_canceled) return;
+
+            if(cancel_at != 0 && base >= cancel_at) {
+                const uint8_t c[2] = { WindowedUpload::can, WindowedUpload::can };
+                queue(c, 2, false);
+                host_canceled = true;
+                return;
+            }
+
+            while(next < total && next < base + window) {
+                std::vector<uint8_t> f = frame(next);
+                bool first = sent_once.insert(next).second;
+                if(first && damage_frame.count(next)) f[100] ^= 0x55;
+                queue(f.data(), f.size(), first && lose_frame.count(next));
+                frames_sent++;
+                next++;
+            }
+            if((eager_eot ? next == total : base == total) && !eot_sent) {
+                const uint8_t e[2] = { WindowedUpload::eot, (uint8_t)(total - 1) };
+                queue(e, 2, false);
+                eot_sent = true;
+            }
+        }
+
+        // out over the link in TCP sized segments, a lost frame still takes its time on the link
+        void queue(const uint8_t *data, size_t len, bool lose)
+        {
+            uint64_t t = std::max(now_us, tx_free_us);
+            for(size_t i = 0; i < len; i += 1460) {
+                size_t n = std::min<size_t>(1460, len - i);
+                t += (uint64_t)(n / bytes_per_us);
+                if(!lose) downlink.push_back({ t + latency_us, std::vector<uint8_t>(data + i, data + i + n) });
+            }
+            tx_free_us = t;
+        }
+
+        std::vector<uint8_t> frame(size_t index)
+        {
+            const size_t bs = WindowedUpload::block_size;
+            std::vector<uint8_t> f(WindowedUpload::frame_size, 0x1A);
+            size_t len;
+            if(index == 0) {
+                len = 32;
+                memcpy(&f[5], "0123456789abcdef0123456789abcdef", 32);
+            } else {
+                size_t from = (index - 1) * bs;
+                len = std::min(bs, file.size() - from);
+                memcpy(&f[5], &file[from], len);
+            }
+            f[0] = WindowedUpload::stx;
+            f[1] = index & 0xFF;
+            f[2] = ~f[1];
+            f[3] = len >> 8;
+            f[4] = len & 0xFF;
+            uint16_t crc = crc16_xmodem(&f[3], bs + 2);
+            f[bs + 5] = crc >> 8;
+            f[bs + 6] = crc & 0xFF;
+            return f;
+        }
+};
+
+static std::vector<uint8_t> make_file(size_t size)
+{
+    std::vector<uint8_t> v(size);
+    uint32_t x = 12345;
+    for(auto &b : v) {
+        x = x * 1103515245 + 12345;
+        b = x >> 16;
+    }
+    return v;
+}
+
+static uint8_t frame_buffer[WindowedUpload::frame_size];
+
+static WindowedUpload::result_t run(Loopback &l, uint8_t window)
+{
+    l.start();
+    WindowedUpload upload(&l, &l, frame_buffer);
+    return upload.run(window);
+}
+
+int main()
+{
+    // throughput against the window, a 4MB file is 512 blocks so the block number wraps round
+    {
+        std::vector<uint8_t> file = make_file(4 * 1024 * 1024 + 1000);
+        double kbs[5];
+        int w[5] = { 1, 2, 4, 8, 16 };
+        for(int i = 0; i < 5; i++) {
+            Loopback l;
+            l.file = file;
+            CHECK(run(l, w[i]) == WindowedUpload::DONE);
+            CHECK(l.received == file);
+            CHECK(l.md5_received == "0123456789abcdef0123456789abcdef");
+            kbs[i] = file.size() / 1024.0 / (l.now_us / 1e6);
+            printf("window %2d: %7.1f KB/s, %zu frames sent for %zu blocks\n", w[i], kbs[i], l.frames_sent, file.size() / 8192 + 2);
+        }
+        // a window of one is the plain stop and wait upload, a bigger one hides the round trip until writing to the
+        // SD card is what holds it up
+        CHECK(kbs[3] > 1.5 * kbs[0]);
+        CHECK(kbs[4] >= kbs[3] * 0.95);
+    }
+
+    // with a longer round trip
+    {
+        std::vector<uint8_t> file = make_file(1024 * 1024);
+        double kbs[2];
+        int w[2] = { 1, 8 };
+        for(int i = 0; i < 2; i++) {
+            Loopback l;
+            l.file = file;
+            l.latency_us = 50000;
+            CHECK(run(l, w[i]) == WindowedUpload::DONE);
+            CHECK(l.received == file);
+            kbs[i] = file.size() / 1024.0 / (l.now_us / 1e6);
+        }
+        printf("100ms round trip: window 1 %.1f KB/s, window 8 %.1f KB/s\n", kbs[0], kbs[1]);
+        CHECK(kbs[1] > 4 * kbs[0]);
+    }
+
+    // a damaged frame and a lost one are asked for again, and the blocks after them are not written twice
+    {
+        Loopback l;
+        l.file = make_file(300 * 1024);
+        l.damage_frame = { 3, 20 };
+        l.lose_frame = { 7, 8 };
+        CHECK(run(l, 8) == WindowedUpload::DONE);
+        CHECK(l.received == l.file);
+        CHECK(l.frames_sent > l.file.size() / 8192 + 2);
+    }
+
+    // lost replies, the host sends the block again and it is acknowledged again
+    {
+        Loopback l;
+        l.file = make_file(100 * 1024);
+        l.lose_reply = { 2, 5, 6, 14 };
+        CHECK(run(l, 4) == WindowedUpload::DONE);
+        CHECK(l.received == l.file);
+    }
+
+    // the next to last block lost with EOT sent straight after the last one, EOT is not taken until it has come again
+    {
+        Loopback l;
+        l.file = make_file(100 * 1024);
+        l.eager_eot = true;
+        size_t blocks = (l.file.size() + WindowedUpload::block_size - 1) / WindowedUpload::block_size;
+        l.lose_frame = { blocks - 1 };
+        CHECK(run(l, 4) == WindowedUpload::DONE);
+        CHECK(l.received == l.file);
+    }
+
+    // the last frame lost with EOT sent straight after it, the block is asked for again rather than left out
+    {
+        Loopback l;
+        l.file = make_file(100 * 1024 + 500);
+        l.eager_eot = true;
+        size_t blocks = (l.file.size() + WindowedUpload::block_size - 1) / WindowedUpload::block_size;
+        l.lose_frame = { blocks };
+        CHECK(run(l, 4) == WindowedUpload::DONE);
+        CHECK(l.received == l.file);
+    }
+
+    // no md5 block, as for firmware.bin
+    {
+        Loopback l;
+        l.file = make_file(20000);
+        l.send_md5 = false;
+        CHECK(run(l, 4) == WindowedUpload::DONE);
+        CHECK(l.received == l.file && l.md5_received.empty());
+    }
+
+    // the host cancels part way
+    {
+        Loopback l;
+        l.file = make_file(200 * 1024);
+        l.cancel_at = 10;
+        CHECK(run(l, 4) == WindowedUpload::CANCELED);
+        CHECK(l.received.size() < l.file.size());
+    }
+
+    // nobody sending
+    {
+        Loopback l;
+        WindowedUpload upload(&l, &l, frame_buffer);
+        l.host_done = true;
+        CHECK(upload.run(8) == WindowedUpload::TIMED_OUT);
+    }
+
+    return test_result("upload loopback");
+}
@@ -0,0 +1 @@
+#include "mbed.h"
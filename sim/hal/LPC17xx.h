@@ -0,0 +1,104 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host replacement for the CMSIS device header.
+// The real register layouts are used, but every peripheral pointer is redirected
+// to a plain struct in host memory which SimHal.cpp inspects to emulate the timers.
+
+#ifndef SIM_LPC17XX_H
+#define SIM_LPC17XX_H
+
+#include <stdint.h>
+
+// keep the Cortex-M3 core headers (inline asm) out of the host build
+#define __CORE_CM3_H_GENERIC
+#define __CORE_CM3_H_DEPENDANT
+#define __CM3_CORE_H__
+
+#define __I  volatile const
+#define __O  volatile
+#define __IO volatile
+
+#include "../../mbed/src/vendor/NXP/cmsis/LPC1768/LPC17xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern LPC_SC_TypeDef      sim_LPC_SC;
+extern LPC_GPIO_TypeDef    sim_LPC_GPIO[5];
+extern LPC_WDT_TypeDef     sim_LPC_WDT;
+extern LPC_TIM_TypeDef     sim_LPC_TIM[4];
+extern LPC_RIT_TypeDef     sim_LPC_RIT;
+extern LPC_PWM_TypeDef     sim_LPC_PWM1;
+extern LPC_GPIOINT_TypeDef sim_LPC_GPIOINT;
+extern LPC_PINCON_TypeDef  sim_LPC_PINCON;
+extern LPC_ADC_TypeDef     sim_LPC_ADC;
+
+#undef LPC_SC
+#undef LPC_GPIO0
+#undef LPC_GPIO1
+#undef LPC_GPIO2
+#undef LPC_GPIO3
+#undef LPC_GPIO4
+#undef LPC_WDT
+#undef LPC_TIM0
+#undef LPC_TIM1
+#undef LPC_TIM2
+#undef LPC_TIM3
+#undef LPC_RIT
+#undef LPC_PWM1
+#undef LPC_GPIOINT
+#undef LPC_PINCON
+#undef LPC_ADC
+
+#define LPC_SC      (&sim_LPC_SC)
+#define LPC_GPIO0   (&sim_LPC_GPIO[0])
+#define LPC_GPIO1   (&sim_LPC_GPIO[1])
+#define LPC_GPIO2   (&sim_LPC_GPIO[2])
+#define LPC_GPIO3   (&sim_LPC_GPIO[3])
+#define LPC_GPIO4   (&sim_LPC_GPIO[4])
+#define LPC_WDT     (&sim_LPC_WDT)
+#define LPC_TIM0    (&sim_LPC_TIM[0])
+#define LPC_TIM1    (&sim_LPC_TIM[1])
+#define LPC_TIM2    (&sim_LPC_TIM[2])
+#define LPC_TIM3    (&sim_LPC_TIM[3])
+#define LPC_RIT     (&sim_LPC_RIT)
+#define LPC_PWM1    (&sim_LPC_PWM1)
+#define LPC_GPIOINT (&sim_LPC_GPIOINT)
+#define LPC_PINCON  (&sim_LPC_PINCON)
+#define LPC_ADC     (&sim_LPC_ADC)
+
+// the only core register used is ICSR, to pend PendSV
+typedef struct {
+    __IO uint32_t ICSR;
+} SCB_Type;
+extern SCB_Type sim_SCB;
+#define SCB (&sim_SCB)
+#define SCB_ICSR_PENDSVSET_Msk (1UL << 28)
+
+// NVIC, only the calls the firmware actually makes
+void     NVIC_EnableIRQ(IRQn_Type irq);
+void     NVIC_DisableIRQ(IRQn_Type irq);
+void     NVIC_SetPendingIRQ(IRQn_Type irq);
+void     NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type irq);
+void     NVIC_SetPriorityGrouping(uint32_t group);
+void     NVIC_SystemReset(void);
+
+void     __disable_irq(void);
+void     __enable_irq(void);
+static inline void __NOP(void) {}
+static inline void __WFI(void) {}
+static inline void __DSB(void) {}
+static inline void __ISB(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
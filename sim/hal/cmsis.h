@@ -0,0 +1,6 @@
+#ifndef SIM_CMSIS_H
+#define SIM_CMSIS_H
+
+#include "LPC17xx.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef SIM_FASTMATH_H
+#define SIM_FASTMATH_H
+
+#include <math.h>
+
+#endif
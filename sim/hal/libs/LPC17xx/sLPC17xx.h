@@ -0,0 +1,7 @@
+#ifndef SIM_SLPC17XX_H
+#define SIM_SLPC17XX_H
+
+// the firmware's private copy of the device header maps onto the same host registers
+#include "LPC17xx.h"
+
+#endif
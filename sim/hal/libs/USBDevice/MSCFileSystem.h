@@ -0,0 +1,7 @@
+#ifndef SIM_MSCFILESYSTEM_H
+#define SIM_MSCFILESYSTEM_H
+
+// USB mass storage is not part of the simulated machine
+class MSCFileSystem;
+
+#endif
@@ -0,0 +1,102 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host replacement for the subset of mbed the motion code links against.
+// Time comes from the simulated timers, the peripherals that are not modelled are inert.
+
+#ifndef SIM_MBED_H
+#define SIM_MBED_H
+
+#include <stdint.h>
+#include <string>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cmsis.h"
+#include "PinNames.h"
+#include "wait_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t us_ticker_read(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace mbed {
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl) {}
+    void frequency(int hz) {}
+    int  read(int address, char *data, int length, bool repeated = false) { return -1; }
+    int  read(int ack) { return 0xFF; }
+    int  write(int address, const char *data, int length, bool repeated = false) { return -1; }
+    int  write(int data) { return 0; }
+    void start(void) {}
+    void stop(void) {}
+};
+
+class PwmOut {
+public:
+    PwmOut(PinName pin) : _period_us(20000), _pulse_us(0) {}
+    void  write(float value) { _pulse_us = value * _period_us; }
+    float read() { return _period_us ? (float)_pulse_us / _period_us : 0; }
+    void  period(float seconds) { _period_us = seconds * 1000000; }
+    void  period_ms(int ms) { _period_us = ms * 1000; }
+    void  period_us(int us) { _period_us = us; }
+    void  pulsewidth(float seconds) { _pulse_us = seconds * 1000000; }
+    void  pulsewidth_ms(int ms) { _pulse_us = ms * 1000; }
+    void  pulsewidth_us(int us) { _pulse_us = us; }
+    PwmOut& operator= (float value) { write(value); return *this; }
+    operator float() { return read(); }
+
+private:
+    int _period_us;
+    int _pulse_us;
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin) {}
+    int  read() { return 0; }
+    void mode(PinMode pull) {}
+    template<typename T> void rise(T *tptr, void (T::*mptr)(void)) {}
+    template<typename T> void fall(T *tptr, void (T::*mptr)(void)) {}
+    void rise(void (*fptr)(void)) {}
+    void fall(void (*fptr)(void)) {}
+    void enable_irq() {}
+    void disable_irq() {}
+    operator int() { return read(); }
+};
+
+class Timer {
+public:
+    Timer() : _start(0), _time(0), _running(false) {}
+    void  start() { if(!_running) { _start = us_ticker_read(); _running = true; } }
+    void  stop() { _time = read_us(); _running = false; }
+    void  reset() { _start = us_ticker_read(); _time = 0; }
+    int   read_us() { return _running ? _time + (us_ticker_read() - _start) : _time; }
+    int   read_ms() { return read_us() / 1000; }
+    float read() { return read_us() / 1000000.0F; }
+    operator float() { return read(); }
+
+private:
+    uint32_t _start;
+    int      _time;
+    bool     _running;
+};
+
+} // namespace mbed
+
+using namespace mbed;
+using namespace std;
+
+#endif
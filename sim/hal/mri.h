@@ -0,0 +1,9 @@
+#ifndef SIM_MRI_H
+#define SIM_MRI_H
+
+#include <stdlib.h>
+
+// there is no debugger to break into on the host
+static inline void __debugbreak(void) { abort(); }
+
+#endif
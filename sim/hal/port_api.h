@@ -0,0 +1,12 @@
+#ifndef SIM_PORT_API_H
+#define SIM_PORT_API_H
+
+#include "PinNames.h"
+#include "PortNames.h"
+
+static inline PinName port_pin(PortName port, int pin_n)
+{
+    return (PinName)(LPC_GPIO0_BASE + ((port << PORT_SHIFT) | pin_n));
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SIM_WAIT_API_H
+#define SIM_WAIT_API_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// busy waits advance the virtual clock, running any timer interrupts that fall due
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
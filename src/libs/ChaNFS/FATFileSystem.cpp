@@ -151,6 +151,17 @@ DirHandle *FATFileSystem::opendir(const char *name) {
     return new FATDirHandle(dir);
 }
 
+/* Function: stat
+ * the size and modification time of a file, 0 if it is there. info->lfname has to be set, to NULL if the
+ * long name is not wanted
+ */
+int FATFileSystem::stat(const char *name, FILINFO *info) {
+    char n[64];
+    sprintf(n, "%d:/%s", _fsid, name);
+    FRESULT res = f_stat(n, info);
+    return res == 0 ? 0 : -1;
+}
+
 int FATFileSystem::mkdir(const char *name, mode_t mode) {
     FRESULT res = f_mkdir(name);
     return res == 0 ? 0 : -1;
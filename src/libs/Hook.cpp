@@ -5,4 +5,13 @@ extern "C"{
 
 // Hook is just a glorified FPointer
 
-Hook::Hook(){}
+Hook::Hook()
+{
+    interval= 0;
+    due= 0;
+    slot= -1;
+    enabled= false;
+    calls= 0;
+    max_time= 0;
+    total_time= 0;
+}
@@ -2,13 +2,20 @@
 #define HOOK_H
 #include "libs/FPointer.h"
 
-// Hook is just a glorified FPointer
+// Hook is just a glorified FPointer, with what SlowTicker needs to schedule it
 
 class Hook : public FPointer {
     public:
         Hook();
-        int     interval;
-        int     countdown;
+        uint32_t interval;      // TIMER2 counts between calls
+        uint32_t due;           // TIMER2 count of the next call
+        int16_t  slot;          // where it is in the SlowTicker queue, -1 when it is not in it
+        bool     enabled;
+
+        // what the calls have cost, in TIMER2 counts
+        uint32_t calls;
+        uint32_t max_time;
+        uint64_t total_time;
 };
 
 #endif
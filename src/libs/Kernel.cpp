@@ -55,6 +55,7 @@
 
 #define base_stepping_frequency_checksum            CHECKSUM("base_stepping_frequency")
 #define microseconds_per_step_pulse_checksum        CHECKSUM("microseconds_per_step_pulse")
+#define step_smoothing_enable_checksum              CHECKSUM("step_smoothing_enable")
 #define disable_leds_checksum                       CHECKSUM("leds_disable")
 #define grbl_mode_checksum                          CHECKSUM("grbl_mode")
 #define feed_hold_enable_checksum                   CHECKSUM("enable_feed_hold")
@@ -160,7 +161,14 @@ Kernel::Kernel()
     NVIC_SetPriority(TIMER1_IRQn, 1);
     NVIC_SetPriority(TIMER2_IRQn, 4);
     NVIC_SetPriority(TIMER3_IRQn, 4);
-    NVIC_SetPriority(PendSV_IRQn, 3);
+    // the lowest there is, the step segment top up in PendSV only ever holds up the main loop
+    NVIC_SetPriority(PendSV_IRQn, 31);
+    // the probe and endstop pin interrupts latch step positions, so they are level with TIMER0 and an edge waits at
+    // most for the step tick under way. Everything else on the same vector is as short, so the step tick waits no
+    // longer for them: WifiProvider sets its data flag, PWMSpindleControl counts a feedback pulse and reads the
+    // us ticker, and SoftSerial (the Modbus RX) reads the us ticker on a start bit and schedules the first bit
+    // sample, its bit sampling runs from the us ticker not from here. The SD card detect pin is not connected.
+    NVIC_SetPriority(EINT3_IRQn, 2);
 
     // Set other priorities lower than the timers
     NVIC_SetPriority(ADC_IRQn, 5);
@@ -186,6 +194,7 @@ Kernel::Kernel()
     // Configure the step ticker
     this->step_ticker->set_frequency( this->base_stepping_frequency );
     this->step_ticker->set_unstep_time( microseconds_per_step_pulse );
+    this->step_ticker->set_step_smoothing( this->config->value(step_smoothing_enable_checksum)->by_default(false)->as_bool() );
 
     this->eeprom_data = new(AHB) EEPROM_data();
     // read eeprom data
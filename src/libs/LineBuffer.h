@@ -0,0 +1,148 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEBUFFER_H
+#define LINEBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// Receive buffer for a console. Characters are pushed from the receive interrupt and whole lines taken out in the main
+// loop, it keeps count of the complete lines in it so the main loop does not have to scan for a newline. Safe for one
+// producer and one consumer, the producer only writes head, line_start and completed, the consumer tail and taken.
+//
+// A line that does not fit is dropped whole when its newline arrives rather than passed on cut short. The consumer can
+// find out with take_dropped() when the line alone was too long for the buffer, and with take_overflowed() when it
+// would have fitted but complete lines not yet taken out left no room for it. The buffer is a member so it lives
+// wherever its owner was allocated, AHB for the consoles. length has to be a power of two.
+template<size_t length> class LineBuffer {
+    public:
+        LineBuffer() : head(0), tail(0), line_start(0), completed(0), taken(0), dropped(0), reported(0), overflowed(0),
+                       reported_overflowed(0), discarding(false), discard_length(0) {
+            static_assert((length & (length - 1)) == 0, "LineBuffer length must be a power of two");
+        }
+
+        // producer side, '\n' ends a line
+        void push_back(char c) {
+            if(c == '\n') {
+                if(discarding) {
+                    // throw away what there is of the line
+                    discarding = false;
+                    head = line_start;
+                    if(discard_length > length - 2) dropped++;
+                    else overflowed++;
+                    return;
+                }
+                buffer[head] = c;
+                head = (head + 1) & (length - 1);
+                line_start = head;
+                completed++;
+                return;
+            }
+
+            // the last free slot is kept for the newline
+            if(discarding) {
+                discard_length++;
+                return;
+            }
+            if(used(head) >= length - 2) {
+                // whether it was too long or only came too soon after the lines ahead of it is known at its newline
+                discarding = true;
+                discard_length = ((head - line_start) & (length - 1)) + 1;
+                return;
+            }
+            buffer[head] = c;
+            head = (head + 1) & (length - 1);
+        }
+
+        // nothing has been pushed since the last newline
+        bool at_line_start() const { return head == line_start; }
+
+        // consumer side
+        bool has_line() const { return completed != taken; }
+
+        // copies the next line without its newline into buf as a C string and returns its length, or -1 if there is no
+        // complete line. A line longer than size - 1 is cut short to fit
+        int get_line(char *buf, size_t size) {
+            if(!has_line()) return -1;
+
+            size_t t = tail;
+            size_t n = line_length(t);
+            size_t copy = n < size - 1 ? n : size - 1;
+            size_t first = length - t;
+            if(first > copy) first = copy;
+            memcpy(buf, &buffer[t], first);
+            memcpy(buf + first, buffer, copy - first);
+            buf[copy] = '\0';
+
+            pop_line(t, n);
+            return copy;
+        }
+
+        // the same into a string, replacing what it held
+        bool get_line(std::string &line) {
+            if(!has_line()) return false;
+
+            size_t t = tail;
+            size_t n = line_length(t);
+            size_t first = length - t;
+            if(first > n) first = n;
+            line.assign(&buffer[t], first);
+            line.append(buffer, n - first);
+
+            pop_line(t, n);
+            return true;
+        }
+
+        // lines dropped for being too long since the last call
+        uint32_t take_dropped() { return take_count(dropped, reported); }
+        // lines dropped since the last call because the lines before them had not been taken out
+        uint32_t take_overflowed() { return take_count(overflowed, reported_overflowed); }
+
+        // characters waiting, complete lines or not
+        size_t size() const { return used(head); }
+        static size_t capacity() { return length - 1; }
+
+    private:
+        size_t used(size_t h) const { return (h - tail) & (length - 1); }
+
+        // the newline is there, the bytes before it were written before completed was counted
+        size_t line_length(size_t t) const {
+            size_t n = 0;
+            while(buffer[(t + n) & (length - 1)] != '\n') n++;
+            return n;
+        }
+
+        static uint32_t take_count(volatile uint32_t &count, uint32_t &reported) {
+            uint32_t c = count;
+            uint32_t n = c - reported;
+            reported = c;
+            return n;
+        }
+
+        void pop_line(size_t t, size_t n) {
+            tail = (t + n + 1) & (length - 1);
+            taken++;
+        }
+
+        char buffer[length];
+        volatile size_t head;
+        volatile size_t tail;
+        volatile size_t line_start;
+        volatile uint32_t completed;
+        volatile uint32_t taken;
+        volatile uint32_t dropped;
+        uint32_t reported;
+        volatile uint32_t overflowed;
+        uint32_t reported_overflowed;
+        volatile bool discarding;
+        size_t discard_length;          // of the line being discarded so far, only the producer uses it
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Md5Cache.h"
+
+#include "libs/Kernel.h"
+#include "SDFAT.h"
+#include "md5.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+extern SDFAT mounter;
+
+bool get_file_stamp(const std::string &path, uint32_t &size, uint32_t &stamp)
+{
+    if(path.compare(0, 4, "/sd/") != 0) return false;
+
+    FILINFO info;
+    info.lfname = NULL;
+    info.lfsize = 0;
+    if(mounter.stat(path.c_str() + 4, &info) != 0) return false;
+    size = info.fsize;
+    stamp = ((uint32_t)info.fdate << 16) | info.ftime;
+    return true;
+}
+
+bool read_md5_record(const std::string &md5_path, uint32_t size, uint32_t stamp, char *hex)
+{
+    FILE *fp = fopen(md5_path.c_str(), "r");
+    if(fp == NULL) return false;
+    char line[64];
+    size_t n = fread(line, 1, sizeof(line) - 1, fp);
+    fclose(fp);
+    line[n] = '\0';
+
+    // a side file from before has the digits alone and is taken again
+    char *p;
+    if(n < 34 || line[32] != ' ') return false;
+    uint32_t s = strtoul(&line[33], &p, 10);
+    if(*p != ' ') return false;
+    uint32_t t = strtoul(p + 1, NULL, 10);
+    if(s != size || t != stamp) return false;
+
+    memcpy(hex, line, 32);
+    hex[32] = '\0';
+    return true;
+}
+
+void write_md5_record(FILE *fp, const char *hex, uint32_t size, uint32_t stamp)
+{
+    fprintf(fp, "%.32s %lu %lu", hex, (unsigned long)size, (unsigned long)stamp);
+}
+
+bool md5_file(const std::string &path, MD5 &md5, uint8_t *buf, size_t size)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if(fp == NULL) return false;
+
+    // whole sectors go straight from the card into buf instead of through the stdio buffer
+    setvbuf(fp, NULL, _IONBF, 0);
+    size_t n;
+    while((n = fread(buf, 1, size, fp)) > 0) {
+        md5.update(buf, n);
+        THEKERNEL->call_event(ON_IDLE);
+    }
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,29 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+class MD5;
+
+// The md5 of a file under /sd/gcodes is kept in its side file in /sd/gcodes/.md5 together with the size and FAT time
+// stamp of the file it was taken from, "<32 hex digits> <size> <stamp>", so md5sum only reads the file through again
+// once it has changed. download sends the digits alone.
+
+// the size and the FAT date and time, date in the high half, of a file under /sd, false if it is not there
+bool get_file_stamp(const std::string &path, uint32_t &size, uint32_t &stamp);
+
+// the digest from an md5 side file into hex, 33 chars, if it was taken from a file of this size and time stamp
+bool read_md5_record(const std::string &md5_path, uint32_t size, uint32_t stamp, char *hex);
+void write_md5_record(FILE *fp, const char *hex, uint32_t size, uint32_t stamp);
+
+// reads the file through into md5 through buf, size should be a whole number of sectors
+bool md5_file(const std::string &path, MD5 &md5, uint8_t *buf, size_t size);
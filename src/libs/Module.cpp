@@ -7,6 +7,7 @@
 
 #include "libs/Module.h"
 #include "libs/Kernel.h"
+#include "libs/PublicData.h"
 
 Module::Module(){}
 Module::~Module(){}
@@ -32,3 +33,9 @@ void Module::register_for_event(_EVENT_ENUM event_id){
     // You add things to Smoothie by making a new class that inherits the Module class. See http://smoothieware.org/moduleexample for a crude introduction
     THEKERNEL->register_for_event(event_id, this);
 }
+
+void Module::register_for_public_data(_EVENT_ENUM event_id, uint16_t csa, uint16_t csb){
+    // ON_GET_PUBLIC_DATA or ON_SET_PUBLIC_DATA, see PublicData::add_handler
+    // the event still gets the request when it is broadcast, for a csa with no handlers or with publicdata -b
+    if(PublicData::add_handler(event_id, csa, csb, this)) register_for_event(event_id);
+}
@@ -192,6 +192,29 @@ mbed::PwmOut* Pin::hardware_pwm()
     return nullptr;
 }
 
+uint8_t Pin::hardware_pwm_channel() const
+{
+    if (port_number == 1)
+    {
+        if (pin == 18) { return 1; }
+        if (pin == 20) { return 2; }
+        if (pin == 21) { return 3; }
+        if (pin == 23) { return 4; }
+        if (pin == 24) { return 5; }
+        if (pin == 26) { return 6; }
+    }
+    else if (port_number == 2)
+    {
+        if (pin <= 5) { return pin + 1; }
+    }
+    else if (port_number == 3)
+    {
+        if (pin == 25) { return 2; }
+        if (pin == 26) { return 3; }
+    }
+    return 0;
+}
+
 mbed::InterruptIn* Pin::interrupt_pin()
 {
     if(!this->valid) return nullptr;
@@ -201,7 +224,12 @@ mbed::InterruptIn* Pin::interrupt_pin()
 
     if (port_number == 0 || port_number == 2) {
         PinName pinname = port_pin((PortName)port_number, pin);
-        return new mbed::InterruptIn(pinname);
+        // InterruptIn sets the pin to pull down, so keep the pull mode it was configured with
+        __IO uint32_t *pinmode = &LPC_PINCON->PINMODE0 + port_number * 2 + (pin >= 16 ? 1 : 0);
+        uint32_t mode = *pinmode;
+        mbed::InterruptIn *interrupt = new mbed::InterruptIn(pinname);
+        *pinmode = mode;
+        return interrupt;
 
     }else{
         this->valid= false;
@@ -64,6 +64,8 @@ class Pin {
         }
 
         mbed::PwmOut *hardware_pwm();
+        // the PWM1 channel hardware_pwm() drives this pin with, 0 if it has none
+        uint8_t hardware_pwm_channel() const;
 
         mbed::InterruptIn *interrupt_pin();
 
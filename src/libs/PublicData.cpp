@@ -1,13 +1,29 @@
 #include "libs/Kernel.h"
 #include "PublicData.h"
 #include "PublicDataRequest.h"
+#include "StreamOutput.h"
+
+#include "us_ticker_api.h"
+
+#include <algorithm>
+
+std::vector<PublicData::handler_t> PublicData::handlers[2];
+bool PublicData::broadcast_only= false;
+PublicData::stats_t PublicData::direct_stats;
+PublicData::stats_t PublicData::broadcast_stats;
 
 bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
+    uint32_t start= us_ticker_read();
     PublicDataRequest pdr(csa, csb, csc);
     // the caller may have created the storage for the returned data so we clear the flag,
     // if it gets set by the callee setting the data ptr that means the data is a pointer to a pointer and is set to a pointer to the returned data
     pdr.set_data_ptr(data, false);
-    THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
+    if(dispatch(ON_GET_PUBLIC_DATA, csa, csb, &pdr)) {
+        count(direct_stats, start);
+    }else{
+        THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
+        count(broadcast_stats, start);
+    }
     if(pdr.is_taken() && pdr.has_returned_data()) {
         // the callee set the returned data pointer
         *(void**)data= pdr.get_data_ptr();
@@ -16,8 +32,67 @@ bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data)
 }
 
 bool PublicData::set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
+    uint32_t start= us_ticker_read();
     PublicDataRequest pdr(csa, csb, csc);
     pdr.set_data_ptr(data);
-    THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
+    if(dispatch(ON_SET_PUBLIC_DATA, csa, csb, &pdr)) {
+        count(direct_stats, start);
+    }else{
+        THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
+        count(broadcast_stats, start);
+    }
     return pdr.is_taken();
 }
+
+bool PublicData::add_handler(int event, uint16_t csa, uint16_t csb, Module *module)
+{
+    std::vector<handler_t> &table= handlers[event == ON_SET_PUBLIC_DATA];
+    bool first= std::none_of(table.begin(), table.end(), [module](const handler_t &h) { return h.module == module; });
+    uint32_t key= ((uint32_t)csa << 16) | csb;
+    // after the ones already there with the same key, so they are called in the order they registered like the events are
+    auto i= std::upper_bound(table.begin(), table.end(), key, [](uint32_t k, const handler_t &h) { return k < h.key; });
+    table.insert(i, {key, module});
+    return first;
+}
+
+// calls the handlers for all of csa then the ones for csa and csb, false if there are none for csa at all
+bool PublicData::dispatch(int event, uint16_t csa, uint16_t csb, void *pdr)
+{
+    if(broadcast_only) return false;
+
+    const std::vector<handler_t> &table= handlers[event == ON_SET_PUBLIC_DATA];
+    auto key_less= [](const handler_t &h, uint32_t key) { return h.key < key; };
+    uint32_t first= (uint32_t)csa << 16;
+    auto i= std::lower_bound(table.begin(), table.end(), first, key_less);
+    if(i == table.end() || (i->key >> 16) != csa) return false;
+
+    // they sort first with a csb of 0
+    for (auto h= i; h != table.end() && h->key == first; ++h) {
+        (h->module->*kernel_callback_functions[event])(pdr);
+    }
+    if(csb != 0) {
+        for (auto h= std::lower_bound(i, table.end(), first | csb, key_less); h != table.end() && h->key == (first | csb); ++h) {
+            (h->module->*kernel_callback_functions[event])(pdr);
+        }
+    }
+    return true;
+}
+
+void PublicData::count(stats_t &stats, uint32_t start)
+{
+    stats.count++;
+    stats.us += us_ticker_read() - start;
+}
+
+void PublicData::print_stats(StreamOutput *stream, bool reset)
+{
+    stream->printf("%d get and %d set handlers registered%s\n", handlers[0].size(), handlers[1].size(), broadcast_only ? ", broadcasting everything" : "");
+    stream->printf("direct: %lu requests, %lu us, %1.1f us each\n", direct_stats.count, direct_stats.us,
+                   direct_stats.count == 0 ? 0.0F : (float)direct_stats.us / direct_stats.count);
+    stream->printf("broadcast: %lu requests, %lu us, %1.1f us each\n", broadcast_stats.count, broadcast_stats.us,
+                   broadcast_stats.count == 0 ? 0.0F : (float)broadcast_stats.us / broadcast_stats.count);
+    if(reset) {
+        direct_stats= {0, 0};
+        broadcast_stats= {0, 0};
+    }
+}
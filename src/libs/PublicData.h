@@ -8,6 +8,12 @@
 #ifndef PUBLICDATA_H
 #define PUBLICDATA_H
 
+#include <stdint.h>
+#include <vector>
+
+class Module;
+class StreamOutput;
+
 class PublicData {
     public:
         // there are two ways to get data from a module
@@ -23,6 +29,37 @@ class PublicData {
         static bool set_value(uint16_t csa, uint16_t csb, void *data) { return set_value(csa, csb, 0, data); }
         static bool set_value(uint16_t cs[3], void *data) { return set_value(cs[0], cs[1], cs[2], data); }
         static bool set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data);
+
+        // A module that answers get or set requests for csa registers for them here, with ON_GET_PUBLIC_DATA or
+        // ON_SET_PUBLIC_DATA, and those requests then go straight to the modules registered for them instead of to every
+        // module registered for the event. A csb of 0 takes every request for csa. Once one module has registered for a
+        // csa every module that answers it has to, requests for a csa nobody registered for still go to the event.
+        // Returns true the first time the module registers for the event, so it can register for the event as well.
+        static bool add_handler(int event, uint16_t csa, uint16_t csb, Module *module);
+
+        // how many requests went each way and how long they took, for the publicdata command
+        static void print_stats(StreamOutput *stream, bool reset);
+        // send every request to the events even when there are handlers for it, to compare the two
+        static void set_broadcast_only(bool flag) { broadcast_only= flag; }
+
+    private:
+        struct handler_t {
+            uint32_t key;   // csa in the top half, csb in the bottom
+            Module *module;
+        };
+
+        struct stats_t {
+            uint32_t count;
+            uint32_t us;
+        };
+
+        static bool dispatch(int event, uint16_t csa, uint16_t csb, void *pdr);
+        static void count(stats_t &stats, uint32_t start);
+
+        // for get and set, sorted on key
+        static std::vector<handler_t> handlers[2];
+        static bool broadcast_only;
+        static stats_t direct_stats, broadcast_stats;
 };
 
 #endif
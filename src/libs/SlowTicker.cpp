@@ -23,18 +23,19 @@ SlowTicker* global_slow_ticker;
 
 SlowTicker::SlowTicker(){
     global_slow_ticker = this;
+    running= nullptr;
+    flag_1s_flag = 0;
 
     // ISP button FIXME: WHy is this here?
     ispbtn.from_string("2.10")->as_input()->pull_up();
 
     LPC_SC->PCONP |= (1 << 22);     // Power Ticker ON
-    LPC_TIM2->MCR = 3;              // Match on MR0, reset on MR0
+    LPC_TIM2->MCR = 1;              // Interrupt on MR0, the counter runs free
     // do not enable interrupt until setup is complete
-    LPC_TIM2->TCR = 0;              // Disable interrupt
+    LPC_TIM2->TCR = 2;              // Reset and hold
 
-    max_frequency = 5;  // initial max frequency is set to 5Hz
-    set_frequency(max_frequency);
-    flag_1s_flag = 0;
+    attach(1, this, &SlowTicker::second_tick);
+    attach(5, this, &SlowTicker::isp_tick);
 }
 
 void SlowTicker::start()
@@ -47,44 +48,175 @@ void SlowTicker::on_module_loaded(){
     register_for_event(ON_IDLE);
 }
 
-// Set the base frequency we use for all sub-frequencies
-void SlowTicker::set_frequency( int frequency ){
-    this->interval = (SystemCoreClock >> 2) / frequency;   // SystemCoreClock/4 = Timer increments in a second
-    LPC_TIM2->MR0 = this->interval;
-    LPC_TIM2->TCR = 3;  // Reset
-    LPC_TIM2->TCR = 1;  // Reset
-    flag_1s_count= SystemCoreClock>>2;
+void SlowTicker::add(Hook *hook, bool enabled)
+{
+    // to avoid race conditions we must stop the interupts before updating these non thread safe vectors
+    __disable_irq();
+    this->hooks.push_back(hook);
+    this->queue.reserve(this->hooks.size());
+    __enable_irq();
+    set_enabled(hook, enabled);
+}
+
+void SlowTicker::set_enabled(Hook *hook, bool enabled)
+{
+    __disable_irq();
+    if(enabled && !hook->enabled) {
+        hook->enabled= true;
+        // if it is being called it goes back in the queue when it returns
+        if(hook != running) {
+            hook->due= LPC_TIM2->TC + hook->interval;
+            push(hook);
+            if(queue[0] == hook && !arm()) NVIC_SetPendingIRQ(TIMER2_IRQn);
+        }
+
+    }else if(!enabled && hook->enabled) {
+        hook->enabled= false;
+        if(hook->slot >= 0) remove(hook);
+    }
+    __enable_irq();
 }
 
 // The actual interrupt being called by the timer, this is where work is done
 void SlowTicker::tick(){
 
-    // Call all hooks that need to be called
-    for (Hook* hook : this->hooks){
-        hook->countdown -= this->interval;
-        if (hook->countdown < 0)
-        {
-            hook->countdown += hook->interval;
-            hook->call();
-        }
+    // Call the hooks that are due, soonest first, until the next one is in the future
+    while(!queue.empty() && !arm()) {
+        Hook *hook= queue[0];
+        remove(hook);
+
+        uint32_t start= LPC_TIM2->TC;
+        running= hook;
+        hook->call();
+        running= nullptr;
+        uint32_t end= LPC_TIM2->TC;
+
+        uint32_t t= end - start;
+        hook->calls++;
+        hook->total_time += t;
+        if(t > hook->max_time) hook->max_time= t;
+
+        // keep to its own beat, unless it has fallen a whole interval behind
+        hook->due += hook->interval;
+        if((int32_t)(hook->due - end) <= 0) hook->due= end + hook->interval;
+        if(hook->enabled) push(hook);
     }
+}
 
-    // deduct tick time from second counter
-    flag_1s_count -= this->interval;
-    // if a whole second has elapsed,
-    if (flag_1s_count < 0)
-    {
-        // add a second to our counter
-        flag_1s_count += SystemCoreClock >> 2;
-        // and set a flag for idle event to pick up
-        flag_1s_flag++;
+// sets MR0 to the time the first hook in the queue is due, false if that has already passed
+bool SlowTicker::arm()
+{
+    uint32_t due= queue[0]->due;
+    if((int32_t)(due - LPC_TIM2->TC) <= 0) return false;
+    LPC_TIM2->MR0 = due;
+    // if the counter went past it while it was being set there will be no match until the counter wraps
+    return (int32_t)(due - LPC_TIM2->TC) > 0;
+}
+
+static inline bool sooner(const Hook *a, const Hook *b)
+{
+    // the counter wraps, so the times are compared by their difference
+    return (int32_t)(a->due - b->due) < 0;
+}
+
+void SlowTicker::push(Hook *hook)
+{
+    hook->slot= queue.size();
+    queue.push_back(hook);
+    sift_up(hook->slot);
+}
+
+void SlowTicker::remove(Hook *hook)
+{
+    int16_t i= hook->slot;
+    Hook *last= queue.back();
+    queue.pop_back();
+    hook->slot= -1;
+    if(last != hook) {
+        queue[i]= last;
+        last->slot= i;
+        sift_down(i);
+        sift_up(last->slot);
+    }
+}
+
+void SlowTicker::sift_up(int16_t i)
+{
+    while(i > 0) {
+        int16_t parent= (i - 1) / 2;
+        if(!sooner(queue[i], queue[parent])) break;
+        swap(i, parent);
+        i= parent;
     }
+}
+
+void SlowTicker::sift_down(int16_t i)
+{
+    int16_t n= queue.size();
+    while(true) {
+        int16_t child= 2 * i + 1;
+        if(child >= n) break;
+        if(child + 1 < n && sooner(queue[child + 1], queue[child])) child++;
+        if(!sooner(queue[child], queue[i])) break;
+        swap(i, child);
+        i= child;
+    }
+}
+
+void SlowTicker::swap(int16_t i, int16_t j)
+{
+    Hook *h= queue[i];
+    queue[i]= queue[j];
+    queue[j]= h;
+    queue[i]->slot= i;
+    queue[j]->slot= j;
+}
 
-    // Enter MRI mode if the ISP button is pressed
-    // TODO: This should have it's own module
+// set a flag for idle event to pick up
+uint32_t SlowTicker::second_tick(uint32_t)
+{
+    flag_1s_flag++;
+    return 0;
+}
+
+// Enter MRI mode if the ISP button is pressed
+// TODO: This should have it's own module
+uint32_t SlowTicker::isp_tick(uint32_t)
+{
     if (ispbtn.get() == 0)
         __debugbreak();
+    return 0;
+}
 
+// what each hook costs the interrupt, for the ticks command
+void SlowTicker::print_stats(StreamOutput *stream, bool reset)
+{
+    const float us_per_count= 1000000.0F / (SystemCoreClock >> 2);
+    float load= 0;
+    int enabled= 0;
+    stream->printf("hook     Hz  on      calls   avg us   max us\n");
+    for (int i = 0; i < (int)hooks.size(); i++) {
+        Hook *hook= hooks[i];
+        __disable_irq();
+        uint32_t calls= hook->calls;
+        uint32_t max_time= hook->max_time;
+        uint64_t total_time= hook->total_time;
+        if(reset) {
+            hook->calls= 0;
+            hook->max_time= 0;
+            hook->total_time= 0;
+        }
+        __enable_irq();
+
+        uint32_t frequency= (SystemCoreClock >> 2) / hook->interval;
+        float avg= calls == 0 ? 0 : total_time * us_per_count / calls;
+        if(hook->enabled) {
+            enabled++;
+            load += avg * frequency / 10000.0F;
+        }
+        stream->printf("%4d %6lu  %s %10lu %8.1f %8.1f\n", i, frequency, hook->enabled ? "on " : "off", calls, avg, max_time * us_per_count);
+    }
+    stream->printf("%d of %d hooks enabled, about %1.2f%% of the time spent in them\n", enabled, hooks.size(), load);
 }
 
 bool SlowTicker::flag_1s(){
@@ -17,6 +17,11 @@
 #include "system_LPC17xx.h" // for SystemCoreClock
 #include <math.h>
 
+class StreamOutput;
+
+// Calls hooks at the frequency each asked for from the TIMER2 interrupt. The timer runs free and is matched against the
+// next hook due, which the hooks queue up for soonest first, so an interrupt only happens when there is something to call
+// and a slow hook never pays for a fast one. A hook can be disabled while its module has nothing to watch.
 class SlowTicker : public Module{
     public:
         SlowTicker();
@@ -24,42 +29,40 @@ class SlowTicker : public Module{
         void on_module_loaded(void);
         void on_idle(void*);
         void start();
-        void set_frequency( int frequency );
         void tick();
         // For some reason this can't go in the .cpp, see :  http://mbed.org/forum/mbed/topic/2774/?page=1#comment-14221
         // TODO replace this with std::function()
-        template<typename T> Hook* attach( uint32_t frequency, T *optr, uint32_t ( T::*fptr )( uint32_t ) ){
+        template<typename T> Hook* attach( uint32_t frequency, T *optr, uint32_t ( T::*fptr )( uint32_t ), bool enabled= true ){
             Hook* hook = new Hook();
             hook->interval = floorf((SystemCoreClock/4)/frequency);
             hook->attach(optr, fptr);
-            hook->countdown = hook->interval;
-
-            // to avoid race conditions we must stop the interupts before updating this non thread safe vector
-            __disable_irq();
-            if( frequency > this->max_frequency ){
-                this->max_frequency = frequency;
-                this->set_frequency(frequency);
-            }
-            this->hooks.push_back(hook);
-            __enable_irq();
+            add(hook, enabled);
             return hook;
         }
 
+        // a disabled hook is not called and costs nothing, once enabled again it is first called an interval later
+        void set_enabled(Hook *hook, bool enabled);
+        void print_stats(StreamOutput *stream, bool reset);
+
     private:
+        void add(Hook *hook, bool enabled);
+        bool arm();
+        void push(Hook *hook);
+        void remove(Hook *hook);
+        void sift_up(int16_t i);
+        void sift_down(int16_t i);
+        void swap(int16_t i, int16_t j);
+        uint32_t second_tick(uint32_t);
+        uint32_t isp_tick(uint32_t);
         bool flag_1s();
 
-        std::vector<Hook*> hooks;
-        uint32_t max_frequency;
-        uint32_t interval;
+        std::vector<Hook*> hooks;   // all of them, in the order they were attached
+        std::vector<Hook*> queue;   // the enabled ones as a binary heap on their due time
+        Hook *running;              // the one being called, it is out of the queue until it returns
 
         Pin ispbtn;
 protected:
-    int flag_1s_count;
     volatile int flag_1s_flag;
 };
 
-
-
-
-
 #endif
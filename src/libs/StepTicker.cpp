@@ -54,6 +54,28 @@ StepTicker::StepTicker()
 
     this->running = false;
     this->current_block = nullptr;
+    this->aborted_block = nullptr;
+    this->counter = 0;
+    this->rate = 0;
+    this->segment_steps = 0;
+    this->segment_period = 0;
+    this->segment_brake = 0;
+    this->segment_last = false;
+    this->bresenham_shift = max_smoothing_level;
+    this->bresenham_limit = 0;
+    this->move_steps = nullptr;
+    this->step_smoothing = false;
+    this->segment_reported = false;
+    this->taken_ticks = 0;
+    this->dry = FED;
+    this->stop_steps = 0;
+    this->stop_left = 0;
+    this->underruns = 0;
+    this->queued_ticks = 0;
+    this->queued_steps = 0;
+    this->preparing = false;
+    this->prep.block = nullptr;
+    this->prep.resuming = false;
 
     #ifdef STEPTICKER_DEBUG_PIN
     // setup debug pin if defined
@@ -71,7 +93,6 @@ void StepTicker::start()
 {
     NVIC_EnableIRQ(TIMER0_IRQn);     // Enable interrupt handler
     NVIC_EnableIRQ(TIMER1_IRQn);     // Enable interrupt handler
-    current_tick= 0;
 }
 
 // Set the base stepping frequency
@@ -79,6 +100,9 @@ void StepTicker::set_frequency( float frequency )
 {
     this->frequency = frequency;
     this->period = floorf((SystemCoreClock / 4.0F) / frequency); // SystemCoreClock/4 = Timer increments in a second
+    this->segment_ticks = ceilf(frequency / 500.0F); // segments are about 2ms long
+    this->buffer_ticks = frequency * buffer_ms / 1000;
+    this->low_ticks = frequency * low_ms / 1000;
     LPC_TIM0->MR0 = this->period;
     LPC_TIM0->TCR = 3;  // Reset
     LPC_TIM0->TCR = 1;  // start
@@ -121,93 +145,88 @@ extern "C" void TIMER0_IRQHandler (void)
 extern "C" void PendSV_Handler(void)
 {
     StepTicker::getInstance()->handle_finish();
+    StepTicker::getInstance()->top_up_segments();
 }
 
-// slightly lower priority than TIMER0, the whole end of block/start of block is done here allowing the timer to continue ticking
+// below every other interrupt, the whole end of block can be done here allowing the timer to continue ticking
 void StepTicker::handle_finish (void)
 {
     // all moves finished signal block is finished
     if(finished_fnc) finished_fnc();
 }
 
+float StepTicker::get_current_rate() const
+{
+    if(!step_smoothing || dry == STOPPING) return rate * frequency / 4294967296.0F;
+
+    // every tick is an event, oversampled by the bresenham shift, so the timer period sets the rate
+    return (period + 1) * frequency / ((LPC_TIM0->MR0 + 1) << (max_smoothing_level - bresenham_shift));
+}
+
 // step clock
 void StepTicker::step_tick (void)
 {
     //SET_STEPTICKER_DEBUG_PIN(running ? 1 : 0);
 
+    if(THEKERNEL->is_halted()) {
+        // drop everything queued, the segment preparation drops its block when it sees the halt
+        segment_t s;
+        while(segments.get(s)) taken_ticks= taken_ticks + s.ticks;
+        running= false;
+        current_block= nullptr;
+        aborted_block= nullptr;
+        dry= FED;
+        if(step_smoothing) LPC_TIM0->MR0 = period;
+        return;
+    }
+
     // if nothing has been setup we ignore the ticks
     if(!running){
         // check if anything new available
-        if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
-            running= start_next_block(); // returns true if there is at least one motor with steps to issue
-            if(!running) return;
-        }else{
+        running= next_segment();
+        // when smoothing the first event is a whole segment period away
+        if(!running || step_smoothing) return;
+    }
+
+    if(dry == STOPPING) {
+        // out of segments, braking along the block, but never past its end
+        if(rate <= segment_brake || stop_left == 0) {
+            dry= STOPPED;
+            running= false;
             return;
         }
+        rate -= segment_brake;
     }
 
-    if(THEKERNEL->is_halted()) {
-        running= false;
-        current_tick = 0;
-        current_block= nullptr;
-        return;
+    if(rate != 0xFFFFFFFF) {
+        // the step event rate is a 32 bit DDA, an event is due every time the counter wraps
+        uint32_t c= counter + rate;
+        bool event= c < counter;
+        counter= c;
+        if(!event) return;
     }
 
+    // bresenham hands out the event to each motor in proportion to its steps
     bool still_moving= false;
-    // foreach motor, if it is active see if time to issue a step to that motor
     for (uint8_t m = 0; m < num_motors; m++) {
-        if(current_block->tick_info[m].steps_to_move == 0) continue; // not active
-
-        current_block->tick_info[m].steps_per_tick += current_block->tick_info[m].acceleration_change;
-
-        if(current_tick == current_block->tick_info[m].next_accel_event) {
-            if(current_tick == current_block->accelerate_until) { // We are done accelerating, deceleration becomes 0 : plateau
-                current_block->tick_info[m].acceleration_change = 0;
-                if(current_block->decelerate_after < current_block->total_move_ticks) {
-                    current_block->tick_info[m].next_accel_event = current_block->decelerate_after;
-                    if(current_tick != current_block->decelerate_after) { // We are plateauing
-                        // steps/sec / tick frequency to get steps per tick
-                        current_block->tick_info[m].steps_per_tick = current_block->tick_info[m].plateau_rate;
-                    }
-                }
-            }
-
-            if(current_tick == current_block->decelerate_after) { // We start decelerating
-                current_block->tick_info[m].acceleration_change = current_block->tick_info[m].deceleration_change;
-            }
-        }
+        if(!active[m]) continue;
 
-        // protect against rounding errors and such
-        if(current_block->tick_info[m].steps_per_tick <= 0) {
-            current_block->tick_info[m].counter = STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
-            current_block->tick_info[m].steps_per_tick = 0;
+        if(!motor[m]->is_moving()) {
+            // stopped externally (probes, endstops etc)
+            active.reset(m);
+            continue;
         }
+        still_moving= true;
 
-        current_block->tick_info[m].counter += current_block->tick_info[m].steps_per_tick;
-
-        if(current_block->tick_info[m].counter >= STEPTICKER_FPSCALE) { // >= 1.0 step time
-            current_block->tick_info[m].counter -= STEPTICKER_FPSCALE; // -= 1.0F;
-            ++current_block->tick_info[m].step_count;
-
-            // step the motor
-            bool ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
+        bresenham[m] += move_steps[m] << bresenham_shift;
+        if(bresenham[m] >= bresenham_limit) {
+            bresenham[m] -= bresenham_limit;
+            motor[m]->step();
             // we stepped so schedule an unstep
             unstep.set(m);
-
-            if(!ismoving || current_block->tick_info[m].step_count == current_block->tick_info[m].steps_to_move) {
-                // done
-                current_block->tick_info[m].steps_to_move = 0;
-                motor[m]->stop_moving(); // let motor know it is no longer moving
-            }
         }
-
-        // see if any motors are still moving after this tick
-        if(motor[m]->is_moving()) still_moving= true;
     }
 
-    // do this after so we start at tick 0
-    current_tick++; // count number of ticks
-
     // We may have set a pin on in this tick, now we reset the timer to set it off
     // Note there could be a race here if we run another tick before the unsteps have happened,
     // right now it takes about 3-4us but if the unstep were near 10uS or greater it would be an issue
@@ -217,66 +236,494 @@ void StepTicker::step_tick (void)
         LPC_TIM1->TCR = 1;
     }
 
-
-    // see if any motors are still moving
     if(!still_moving) {
-        //SET_STEPTICKER_DEBUG_PIN(0);
+        // nothing left to move in this block, skip whatever is left of it
+        aborted_block= current_block;
+        dry= FED;
+        running= next_segment();
+
+    } else if(dry == STOPPING) {
+        stop_steps= stop_steps + 1;
+        stop_left--;
+
+    } else if(--segment_steps == 0) {
+        if(segment_last) finish_block(current_block);
+        running= next_segment();
+        if(!running && !segment_last) run_dry();
+    }
+}
 
-        // all moves finished
-        current_tick = 0;
+// only called from the step tick ISR
+// The preparation has fallen behind in the middle of a block. Rather than stop dead at speed the block carries on,
+// braking at its acceleration, and the preparation takes it on from wherever it comes to a stop. An arc stops dead
+// as before, its chord does not follow the arc.
+void StepTicker::run_dry()
+{
+    underruns= underruns + 1;
+    request_segments();
+    if(segment_brake == 0) return;
+
+    if(step_smoothing) {
+        // the same event rate on the DDA at the base period, the bresenham is on a whole event at the end of a segment
+        uint64_t r= ((uint64_t)(period + 1) << 32) / ((uint64_t)(segment_period + 1) << (max_smoothing_level - bresenham_shift));
+        rate= r > 0xFFFFFFFF ? 0xFFFFFFFF : r;
+        bresenham_shift= max_smoothing_level;
+    }
+    stop_left= current_block->steps_event_count - queued_steps;
+    stop_steps= 0;
+    dry= STOPPING;
+    running= true;
+}
 
-        // get next block
-        // do it here so there is no delay in ticks
-        THECONVEYOR->block_finished();
+void StepTicker::request_segments()
+{
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
 
-        if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
-            running= start_next_block(); // returns true if there is at least one motor with steps to issue
+// only called from the step tick ISR (single consumer)
+// loads the next segment, starting or finishing blocks as they come, returns false if there is none ready
+bool StepTicker::next_segment()
+{
+    segment_t s;
+    while(segments.get(s)) {
+        taken_ticks= taken_ticks + s.ticks;
+        // running low, PendSV tops it up if the main loop is busy elsewhere
+        if(queued_ticks - taken_ticks < low_ticks) request_segments();
+
+        if(s.block == aborted_block || s.steps == 0) {
+            // skipped, or an empty block
+            if(s.last) {
+                finish_block(s.block);
+                aborted_block= nullptr;
+            }
+            continue;
+        }
 
-        }else{
-            current_block= nullptr;
-            running= false;
+        if(s.block != current_block) start_block(s.block);
+
+        rate= s.rate;
+        segment_steps= s.steps;
+        segment_period= s.period;
+        segment_brake= s.brake;
+        segment_last= s.last;
+        bresenham_shift= s.shift;
+        if(s.block->is_arc) start_chord(s);
+        // the counter is only just past zero so the new period applies to this one
+        if(step_smoothing) LPC_TIM0->MR0 = s.period;
+        if(segment_fnc) {
+            segment_fnc(s.block, s.s_index, s.speed);
+            segment_reported= true;
         }
+        return true;
+    }
 
-        // all moves finished
-        // we delegate the slow stuff to the pendsv handler which will run as soon as this interrupt exits
-        //NVIC_SetPendingIRQ(PendSV_IRQn); this doesn't work
-        //SCB->ICSR = 0x10000000; // SCB_ICSR_PENDSVSET_Msk;
+    // back to the base rate so the next segment is picked up quickly
+    if(step_smoothing) LPC_TIM0->MR0 = period;
+    if(segment_reported) {
+        segment_reported= false;
+        if(segment_fnc) segment_fnc(nullptr, 0, 0);
     }
+    return false;
 }
 
-// only called from the step tick ISR (single consumer)
-bool StepTicker::start_next_block()
+// only called from the step tick ISR
+void StepTicker::start_block(Block *block)
 {
-    if(current_block == nullptr) return false;
+    // the event counter carries on from the previous block so back to back blocks keep their timing
+    if(current_block == nullptr) counter= 0;
+
+    current_block= block;
+    active.reset();
+
+    if(block->is_arc) {
+        // the directions and bresenham are set up for each chord as it comes
+        move_steps= chord_steps.data();
+        for (int i = 0; i < 3; i++) {
+            uint8_t m= block->arc.axis[i];
+            if(i == 2 && block->arc.linear == 0) break; // not a helix
+            active.set(m);
+            motor[m]->start_moving();
+        }
+        moving= active;
+        return;
+    }
+
+    move_steps= block->steps.data();
+    // the motor steps are scaled up by the maximum oversampling so the bresenham carries over when it changes
+    bresenham_limit= block->steps_event_count << max_smoothing_level;
 
-    bool ok= false;
     // need to prepare each active motor
     for (uint8_t m = 0; m < num_motors; m++) {
-        if(current_block->tick_info[m].steps_to_move == 0) continue;
+        if(block->steps[m] == 0) continue;
+
+        active.set(m);
+        // the motor with the most steps steps on the last oversampled event of each event so whatever the level,
+        // the others round to the nearest one
+        bresenham[m]= block->steps[m] == block->steps_event_count ? 0 : bresenham_limit / 2;
 
-        ok= true; // mark at least one motor is moving
         // set direction bit here
         // NOTE this would be at least 10us before first step pulse.
         // TODO does this need to be done sooner, if so how without delaying next tick
-        motor[m]->set_direction(current_block->direction_bits[m]);
+        motor[m]->set_direction(block->direction_bits[m]);
         motor[m]->start_moving(); // also let motor know it is moving now
     }
+    moving= active;
+}
 
-    current_tick= 0;
+// only called from the step tick ISR
+// each chord of an arc is stepped as a short line of its own, over the events of its segment
+void StepTicker::start_chord(const segment_t &segment)
+{
+    uint32_t events= segment.steps >> (max_smoothing_level - segment.shift);
+    bresenham_limit= events << max_smoothing_level;
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t m= current_block->arc.axis[i];
+        int16_t steps= segment.chord[i];
+        chord_steps[m]= abs(steps);
+        bresenham[m]= chord_steps[m] == events ? 0 : bresenham_limit / 2;
+        // the first step is at least one tick after this
+        if(steps != 0) motor[m]->set_direction(steps < 0);
+    }
+}
 
-    if(ok) {
-        //SET_STEPTICKER_DEBUG_PIN(1);
-        return true;
+// only called from the step tick ISR
+void StepTicker::finish_block(Block *block)
+{
+    if(block == current_block) {
+        for (uint8_t m = 0; m < num_motors; m++) {
+            if(moving[m]) motor[m]->stop_moving(); // let motor know it is no longer moving
+        }
+        current_block= nullptr;
+    }
+    active.reset();
+
+    // we increment the isr_tail_i so the block can be cleaned up
+    THECONVEYOR->block_finished();
+}
 
-    }else{
-        // this is an edge condition that should never happen, but we need to discard this block if it ever does
-        // basically it is a block that has zero steps for all motors
-        THECONVEYOR->block_finished();
+// Called from the conveyor's on_idle, so the float math never holds up an interrupt. Fills the segment buffer with
+// buffer_ms of motion, taking the next block from the conveyor when the current one is all sliced up.
+void StepTicker::prepare_segments()
+{
+    preparing= true;
+    fill_segments(0);
+    preparing= false;
+}
+
+// Called from PendSV, which the step tick pends once less than low_ms is left. It is below every other interrupt so
+// only the main loop waits for it, and it prepares a few segments at a time as it is pended again for each one taken.
+void StepTicker::top_up_segments()
+{
+    // on_idle was part way through filling it, it is not behind
+    if(preparing) return;
+    fill_segments(top_up_budget);
+}
+
+// at most budget segments, 0 for as many as the buffer takes
+void StepTicker::fill_segments(uint8_t budget)
+{
+    if(THEKERNEL->is_halted()) {
+        prep.block= nullptr;
+        // still ask as that is where the conveyor flushes its queue
+        Block *block;
+        THECONVEYOR->get_next_block(&block);
+        return;
     }
 
-    return false;
+    // the step tick ran out, nothing more goes in until it has stopped and the block carries on from there
+    if(dry == STOPPING) return;
+    if(dry == STOPPED) resume_block();
+
+    uint8_t n= 0;
+    while(!segments.full() && queued_ticks - taken_ticks < buffer_ticks && (budget == 0 || n++ < budget)) {
+        if(prep.block == nullptr) {
+            Block *block;
+            if(!THECONVEYOR->get_next_block(&block)) return; // returns false if no new block is available
+            prepare_block(block);
+        }
+
+        segment_t s;
+        s.block= prep.block;
+        if(prep.block == aborted_block || (prep.resuming && prep.steps == prep.block->steps_event_count)) {
+            // the step tick stopped this block early or braked to its end, just tell it there is no more of it
+            s.rate= 0;
+            s.steps= 0;
+            s.speed= 0;
+            s.ticks= 0;
+            s.s_index= 0;
+            s.last= true;
+        } else {
+            prepare_segment(s);
+        }
+
+        if(!queue_segment(s)) return;
+        if(s.last) prep.block= nullptr;
+    }
+}
+
+// The step tick is held off while it is queued, so either it sees the segment or it ran dry before it came, and
+// then the segment is thrown away as the block carries on from wherever the step tick stops.
+bool StepTicker::queue_segment(const segment_t &segment)
+{
+    bool queued= false;
+    __disable_irq();
+    if(dry == FED) {
+        segments.put(segment);
+        queued_ticks= queued_ticks + segment.ticks;
+        queued_steps= prep.steps;
+        queued= true;
+    }
+    __enable_irq();
+    return queued;
 }
 
+// start slicing up a new block
+void StepTicker::prepare_block(Block *block)
+{
+    prep.block= block;
+    prep.tick= 0;
+    prep.steps= 0;
+    prep.phase= 0;
+    prep.position= 0;
+    prep.crossing= 0;
+    prep.rate= block->initial_rate / frequency;
+    prep.acceleration= block->acceleration_per_tick;
+    prep.jerk= block->accel_jerk_per_tick;
+    prep.resuming= false;
+
+    // what the step tick brakes at if it runs out of segments, step events per tick² and in its 0.32 fixed point
+    prep.accel= block->millimeters > 0 ? block->acceleration * block->steps_event_count / (block->millimeters * frequency * frequency) : 0;
+    float brake= prep.accel * 4294967296.0F;
+    prep.brake= block->is_arc ? 0 : brake >= 4294967295.0F ? 0xFFFFFFFF : std::max<uint32_t>(1, brake);
+
+    if(block->is_arc) {
+        prep.arc_vector[0]= block->arc.radius[0];
+        prep.arc_vector[1]= block->arc.radius[1];
+        prep.arc_angle= 0;
+        prep.arc_count= 0;
+        for (int i = 0; i < 3; i++) prep.chord[i]= 0;
+    }
+}
+
+// The step tick ran out of segments and braked the block to a stop. The block carries on from where it stopped rather
+// than from where its profile had got to, from rest to its exit rate.
+void StepTicker::resume_block()
+{
+    if(prep.block != nullptr) {
+        prep.steps= queued_steps + stop_steps;
+        prep.position= prep.steps;
+        prep.rate= 0;
+        prep.crossing= prep.tick;
+        prep.resuming= true;
+    }
+    dry= FED;
+}
+
+// Moves a block carrying on from a stop on by the given ticks, accelerating at the block's acceleration and braking
+// in time to leave at its exit rate. It never goes slower than a segment of acceleration gets to, so it does not creep
+// up on the last step when the block ends in a stop.
+void StepTicker::advance_resume(uint32_t ticks)
+{
+    const Block *b= prep.block;
+    float dt= ticks;
+    float maximum= b->maximum_rate / frequency;
+    float exit= b->nominal_speed > 0 ? b->nominal_rate * b->exit_speed / (b->nominal_speed * frequency) : 0;
+    float least= std::min(std::max(exit, prep.accel * segment_ticks), maximum);
+    float left= b->steps_event_count - prep.position;
+
+    float r= std::min(prep.rate + prep.accel * dt, maximum);
+    r= std::min(r, sqrtf(exit * exit + 2.0F * prep.accel * std::max(0.0F, left - prep.rate * dt)));
+    r= std::max(r, least);
+    prep.position= std::min(prep.position + (prep.rate + r) / 2.0F * dt, (float)b->steps_event_count);
+    prep.rate= r;
+    prep.tick += ticks;
+}
+
+// Moves the profile of the block being prepared on by the given ticks. The phases of the profile change at the
+// tick counts set by the planner, in that order, and each has a constant jerk so is integrated exactly.
+void StepTicker::advance_profile(uint32_t ticks)
+{
+    const Block *b= prep.block;
+    const uint32_t phase_ticks[]= { b->accel_jerk_until, b->accel_jerk_after, b->accelerate_until, b->decelerate_after,
+                                    b->decel_jerk_until, b->decel_jerk_after, b->total_move_ticks };
+    uint32_t end= prep.tick + ticks;
+
+    while(prep.tick < end) {
+        while(prep.phase < 7 && prep.tick == phase_ticks[prep.phase]) {
+            switch(prep.phase++) {
+                case 0: // constant acceleration
+                    prep.jerk= 0;
+                    break;
+                case 1: // acceleration ramps down to the plateau
+                    prep.jerk= -b->accel_jerk_per_tick;
+                    break;
+                case 2: // plateau
+                    prep.jerk= 0;
+                    prep.acceleration= 0;
+                    prep.rate= b->maximum_rate / frequency;
+                    break;
+                case 3: // start decelerating, a trapezoid does it at once, an S-curve ramps it up
+                    prep.acceleration= -b->deceleration_per_tick;
+                    prep.jerk= -b->decel_jerk_per_tick;
+                    break;
+                case 4: // constant deceleration
+                    prep.jerk= 0;
+                    break;
+                case 5: // deceleration ramps down to the exit rate
+                    prep.jerk= b->decel_jerk_per_tick;
+                    break;
+                case 6: // hold the exit rate for anything left over from rounding
+                    prep.jerk= 0;
+                    prep.acceleration= 0;
+                    if(prep.rate < 0) prep.rate= 0;
+                    break;
+            }
+        }
+
+        uint32_t until= end;
+        if(prep.phase < 7 && phase_ticks[prep.phase] < until) until= phase_ticks[prep.phase];
+
+        float dt= until - prep.tick;
+        prep.position += dt * (prep.rate + dt * (prep.acceleration / 2.0F + dt * prep.jerk / 6.0F));
+        prep.rate += dt * (prep.acceleration + dt * prep.jerk / 2.0F);
+        prep.acceleration += dt * prep.jerk;
+        prep.tick= until;
+    }
+}
+
+// Slices off the next segment of the block being prepared, it is about segment_ticks long but always has at least one
+// step event, so it is stretched when stepping slowly
+void StepTicker::prepare_segment(segment_t &segment)
+{
+    const Block *b= prep.block;
+    float start_position= prep.position;
+    uint32_t start_tick= prep.tick;
+    uint32_t steps;
+
+    // A block with several laser intensities is cut where the next one starts, so the power changes right on that step event
+    uint8_t s_index= 0;
+    uint32_t s_next= b->steps_event_count;
+    if(b->s_count > 1) {
+        s_index= (uint64_t)prep.steps * b->s_count / b->steps_event_count;
+        s_next= ((uint64_t)(s_index + 1) * b->steps_event_count + b->s_count - 1) / b->s_count;
+    }
+
+    do {
+        if(prep.resuming) {
+            advance_resume(segment_ticks);
+        } else if(prep.tick >= b->total_move_ticks) {
+            // the profile is done, whatever rounding left over goes out at the exit rate
+            float left= b->steps_event_count - prep.position;
+            uint32_t ticks= segment_ticks;
+            if(left > 0 && prep.rate * segment_ticks > left) ticks= ceilf(left / prep.rate);
+            prep.position= b->steps_event_count;
+            prep.tick += ticks;
+        } else {
+            // stop about where the next intensity starts rather than running on past it
+            uint32_t ticks= segment_ticks;
+            if(s_next < b->steps_event_count && prep.rate > 0 && prep.rate * segment_ticks > s_next - prep.position) {
+                ticks= std::max(1.0F, ceilf((s_next - prep.position) / prep.rate));
+            }
+            advance_profile(std::min(ticks, b->total_move_ticks - prep.tick));
+        }
+
+        steps= prep.position <= 0 ? 0 : prep.position >= b->steps_event_count ? b->steps_event_count : (uint32_t)prep.position;
+    } while(steps == prep.steps);
+    if(steps > s_next) steps= s_next;
+
+    // Segments end on a step event, so the step tick starts each one right where the last whole step was crossed.
+    // Work out when the profile crossed the last whole step of this one, going back from the end at the average rate,
+    // and run the segment at the rate that gets from one crossing to the other.
+    float average= (prep.position - start_position) / (prep.tick - start_tick);
+    float crossing= prep.tick - (prep.position - steps) / average;
+    float ticks= crossing - prep.crossing;
+    if(ticks < 1.0F) ticks= 1.0F;
+
+    uint32_t events= b->is_arc ? prepare_chord(segment, steps) : steps - prep.steps;
+    float rate= events / ticks;
+    segment.rate= rate >= 1.0F ? 0xFFFFFFFF : (uint32_t)(rate * 4294967296.0F);
+    segment.steps= events;
+    // the speed along the path, arcs included, so anything following the feed rate does not need any float math in the step tick
+    float speed= b->nominal_rate > 0 ? (steps - prep.steps) * frequency / (ticks * b->nominal_rate) : 0;
+    segment.speed= speed >= 1.0F ? 0xFFFF : (uint16_t)(speed * 65536.0F);
+    segment.period= period;
+    segment.brake= prep.brake;
+    segment.ticks= ticks >= 65535.0F ? 0xFFFF : (uint16_t)ticks;
+    segment.shift= max_smoothing_level;
+    segment.s_index= s_index;
+    segment.last= steps == b->steps_event_count;
+
+    if(step_smoothing) {
+        // Adaptive multi axis step smoothing, as in Grbl. Rather than waiting on the DDA the timer period follows the
+        // event rate so every tick is an event, timed to a timer clock instead of a whole base tick. At low rates the
+        // events are oversampled by up to 2^3, so the bresenham steps the other motors closer to where they should be
+        // and the tick rate stays nearer the base frequency than the event rate.
+        uint8_t level= 0;
+        while(level < max_smoothing_level && rate * (2 << level) <= 1.0F) level++;
+
+        float clocks= (period + 1) * ticks / (segment.steps << level); // timer reset on match so a period is MR0 + 1
+        segment.rate= 0xFFFFFFFF;
+        segment.steps <<= level;
+        segment.period= clocks > period + 1 ? lroundf(clocks) - 1 : period;
+        segment.shift= max_smoothing_level - level;
+    }
+
+    prep.steps= steps;
+    prep.crossing= crossing;
+}
+
+// Works out the chord of an arc block from where the last one ended to the given step event along the path, as the steps
+// each plane motor moves. Returns the step events to do them in, the path's own unless rounding puts a motor a step ahead.
+uint32_t StepTicker::prepare_chord(segment_t &segment, uint32_t steps)
+{
+    const Block *b= prep.block;
+    int32_t target[3];
+
+    if(steps == b->steps_event_count) {
+        // end exactly where the planner left the motors
+        for (int i = 0; i < 3; i++) {
+            uint8_t m= b->arc.axis[i];
+            target[i]= b->direction_bits[m] ? -(int32_t)b->steps[m] : (int32_t)b->steps[m];
+        }
+
+    } else {
+        // Turn the radius vector on to this far along the arc. As in Robot::append_arc a small angle approximation is
+        // good enough between chords, and the exact vector is worked out every so often so the rounding can not build up.
+        float fraction= (float)steps / b->steps_event_count;
+        float angle= b->arc.angle * fraction;
+        float theta= angle - prep.arc_angle;
+        if(++prep.arc_count < arc_correction && fabsf(theta) < 0.1F) {
+            float theta_2= theta * theta;
+            float cos_t= 1.0F - theta_2 / 2.0F * (1.0F - theta_2 / 12.0F);
+            float sin_t= theta * (1.0F - theta_2 / 6.0F);
+            float r0= prep.arc_vector[0] * cos_t - prep.arc_vector[1] * sin_t;
+            prep.arc_vector[1]= prep.arc_vector[0] * sin_t + prep.arc_vector[1] * cos_t;
+            prep.arc_vector[0]= r0;
+        } else {
+            float cos_t= cosf(angle);
+            float sin_t= sinf(angle);
+            prep.arc_vector[0]= b->arc.radius[0] * cos_t - b->arc.radius[1] * sin_t;
+            prep.arc_vector[1]= b->arc.radius[0] * sin_t + b->arc.radius[1] * cos_t;
+            prep.arc_count= 0;
+        }
+        prep.arc_angle= angle;
+
+        float travel[3]= { prep.arc_vector[0] - b->arc.radius[0], prep.arc_vector[1] - b->arc.radius[1], b->arc.linear * fraction };
+        for (int i = 0; i < 3; i++) {
+            target[i]= lroundf(travel[i] * motor[b->arc.axis[i]]->get_steps_per_mm());
+        }
+    }
+
+    uint32_t events= steps - prep.steps;
+    for (int i = 0; i < 3; i++) {
+        int32_t d= target[i] - prep.chord[i];
+        segment.chord[i]= d;
+        if((uint32_t)abs(d) > events) events= abs(d);
+        prep.chord[i]= target[i];
+    }
+    return events;
+}
 
 // returns index of the stepper motor in the array and bitset
 int StepTicker::register_motor(StepperMotor* m)
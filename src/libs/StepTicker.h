@@ -21,45 +21,149 @@
 class StepperMotor;
 class Block;
 
-// handle 2.62 Fixed point
-#define STEPTICKER_FPSCALE (1LL<<62)
-#define STEPTICKER_FROMFP(x) ((float)(x)/STEPTICKER_FPSCALE)
-
 class StepTicker{
     public:
         StepTicker();
         ~StepTicker();
         void set_frequency( float frequency );
+        void set_step_smoothing( bool flag ) { step_smoothing= flag; }
         void set_unstep_time( float microseconds );
         int register_motor(StepperMotor* motor);
         float get_frequency() const { return frequency; }
         void unstep_tick();
         const Block *get_current_block() const { return current_block; }
+        // step events per second of the segment being stepped
+        float get_current_rate() const;
 
         void step_tick (void);
         void handle_finish (void);
         void start();
+        // fills the segment buffer, called from on_idle
+        void prepare_segments();
+        // a few more segments when the buffer runs low, called from PendSV so a busy main loop does not starve it
+        void top_up_segments();
+        // times the step tick ran out of segments in the middle of a block
+        uint32_t get_underruns() const { return underruns; }
 
         // whatever setup the block should register this to know when it is done
         std::function<void()> finished_fnc{nullptr};
+        // called from the step tick as each segment starts, with its block, the laser intensity it is in and its speed as a
+        // 0.16 fixed point fraction of the block's nominal rate, then with nullptr once there is nothing left to step
+        std::function<void(const Block *, uint8_t, uint16_t)> segment_fnc{nullptr};
 
         static StepTicker *getInstance() { return instance; }
 
     private:
         static StepTicker *instance;
 
-        bool start_next_block();
+        // A short slice of a block at a constant step event rate. They are prepared ahead in on_idle so the
+        // step tick only has to run a 32 bit DDA and bresenham for the motors.
+        struct segment_t {
+            Block *block;
+            uint32_t rate;       // step events per tick, 0.32 fixed point, 0xFFFFFFFF is an event every tick
+            uint32_t steps;      // step events in this segment, oversampled ones when smoothing
+            uint32_t period;     // TIMER0 match value while stepping it, only used when smoothing
+            uint32_t brake;      // what rate drops by each tick to stop if the next segment is late, 0 stops dead
+            uint16_t speed;      // fraction of the block's nominal rate, 0.16 fixed point, 0xFFFF is full speed
+            uint16_t ticks;      // how long it takes, up to 0xFFFF
+            uint8_t shift;       // bresenham shift, max_smoothing_level less the oversampling level
+            uint8_t s_index;     // which of the block's laser intensities this is in, segments never span two
+            bool last;           // last segment of the block
+            int16_t chord[3];    // arcs only, the steps each plane motor moves in this segment, negative is backwards
+        };
+
+        // up to 2^3 times oversampling of the bresenham at low step rates
+        static const uint8_t max_smoothing_level= 3;
+        // the radius vector of an arc is worked out exactly at least this often, by small angle rotations in between
+        static const uint8_t arc_correction= 16;
+        // the buffer is filled to this much motion, and topped up from PendSV once less than low_ms is left
+        static const uint16_t buffer_ms= 100;
+        static const uint16_t low_ms= 50;
+        // segments one PendSV prepares at most, it is pended again as each segment is taken
+        static const uint8_t top_up_budget= 4;
+
+        // the step tick ran out of segments in the middle of a block and is braking to a stop, or has stopped and
+        // waits for the preparation to carry on from there
+        enum dry_t : uint8_t { FED, STOPPING, STOPPED };
+
+        bool next_segment();
+        void run_dry();
+        void request_segments();
+        void start_block(Block *block);
+        void start_chord(const segment_t &segment);
+        void finish_block(Block *block);
+
+        void fill_segments(uint8_t budget);
+        bool queue_segment(const segment_t &segment);
+        void prepare_block(Block *block);
+        void resume_block();
+        void prepare_segment(segment_t &segment);
+        uint32_t prepare_chord(segment_t &segment, uint32_t steps);
+        void advance_profile(uint32_t ticks);
+        void advance_resume(uint32_t ticks);
 
         float frequency;
         uint32_t period;
+        uint32_t segment_ticks;
+        uint32_t buffer_ticks;
+        uint32_t low_ticks;
         std::array<StepperMotor*, k_max_actuators> motor;
         std::bitset<k_max_actuators> unstep;
+        std::bitset<k_max_actuators> active;
+        std::bitset<k_max_actuators> moving;
 
+        // step tick state
+        TSRingBuffer<segment_t, 64> segments;
         Block *current_block;
-        uint32_t current_tick{0};
+        Block * volatile aborted_block;
+        uint32_t counter;
+        uint32_t rate;
+        uint32_t segment_steps;
+        uint32_t segment_period;
+        uint32_t segment_brake;
+        bool segment_last;
+        uint8_t bresenham_shift;
+        uint32_t bresenham_limit;
+        std::array<uint32_t, k_max_actuators> bresenham;
+        const uint32_t *move_steps;  // steps of the current block for each motor, or of the current chord of an arc
+        std::array<uint32_t, k_max_actuators> chord_steps;
+        volatile uint32_t taken_ticks;   // of all the segments taken, it wraps, only the difference to queued_ticks counts
+        volatile dry_t dry;
+        volatile uint32_t stop_steps;    // step events taken while braking, beyond the last segment
+        uint32_t stop_left;              // step events left in the block when it started braking
+        volatile uint32_t underruns;
+
+        // written only by the preparation, and only with the step tick held off so it sees them change with the buffer
+        volatile uint32_t queued_ticks;  // of all the segments queued
+        volatile uint32_t queued_steps;  // into the block being prepared, at the end of the last segment queued
+        volatile bool preparing;         // on_idle is filling the buffer, PendSV leaves it to it
+
+        // segment preparation state, only touched by prepare_segments()
+        struct {
+            Block *block;
+            uint32_t tick;       // ticks into the block's acceleration profile
+            uint32_t steps;      // step events already handed out as segments
+            uint8_t phase;       // next phase change of the profile
+            float position;      // step events, rate per tick, acceleration per tick² and jerk per tick³ at tick
+            float rate;
+            float acceleration;
+            float jerk;
+            float crossing;      // tick at which the profile crossed the last step event handed out
+            // carrying on from a stop when the step tick ran dry, a trapezoid from rest to the exit rate
+            bool resuming;
+            float accel;         // the block's acceleration, step events per tick²
+            uint32_t brake;      // the same in the step tick's units, 0 for arcs
+            // arcs only
+            float arc_vector[2]; // radius vector at the end of the last chord
+            float arc_angle;     // angle it has turned through from the start
+            uint8_t arc_count;   // chords since it was last worked out exactly
+            int32_t chord[3];    // steps each plane motor has been handed out from the start
+        } prep;
 
         struct {
             volatile bool running:1;
+            bool step_smoothing:1;
+            bool segment_reported:1; // segment_fnc has been given a segment since it was told nothing is stepping
             uint8_t num_motors:4;
         };
 };
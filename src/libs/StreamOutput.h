@@ -30,6 +30,7 @@ class StreamOutput {
         virtual int puts(const char* buf, int size = 0) = 0;
         virtual bool ready() { return true; };
         virtual int type() {return 0; }; // 0: serial, 1: wifi
+        virtual bool is_tx_full() { return false; } // true while output is still queued up from before, producers should hold off
 
         static NullStreamOutput NullStream;
 };
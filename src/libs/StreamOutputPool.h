@@ -44,6 +44,11 @@ public:
         this->streams.erase(stream);
     }
 
+    bool has_stream(StreamOutput* stream) const
+    {
+        return this->streams.count(stream) != 0;
+    }
+
 private:
     set<StreamOutput*> streams;
 };
@@ -148,8 +148,8 @@ void MSCFileSystem::on_module_loaded()
 
     register_for_event(ON_IDLE);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, msc_file_system_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, msc_file_system_checksum);
 }
 
 void MSCFileSystem::on_idle(void*)
@@ -24,6 +24,7 @@
 #include "modules/utils/configurator/Configurator.h"
 #include "modules/utils/player/Player.h"
 #include "modules/utils/mainbutton/MainButton.h"
+#include "modules/utils/statusreport/StatusReport.h"
 #include "modules/communication/SerialConsole2.h"
 #include "libs/USBDevice/MSCFileSystem.h"
 #include "Config.h"
@@ -167,6 +168,9 @@ void init() {
     // Wifi Provider
     kernel->add_module( new(AHB) WifiProvider);
 
+    // Binary status frames for consoles that ask for them
+    kernel->add_module( new(AHB) StatusReport() );
+
     // these modules can be completely disabled in the Makefile by adding to EXCLUDE_MODULES
     #ifndef NO_TOOLS_SWITCH
     SwitchPool *sp= new SwitchPool();
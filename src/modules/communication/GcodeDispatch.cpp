@@ -43,6 +43,7 @@ GcodeDispatch::GcodeDispatch()
 {
     uploading = false;
     modal_group_1= 0;
+    modal_subcode= 0;
 }
 
 // Called when the module has just been loaded
@@ -51,20 +52,44 @@ void GcodeDispatch::on_module_loaded()
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
 }
 
+// string::find_first_of for the line being split up, which is a plain C string
+static size_t find_first_of(const char *s, const char *chars, size_t pos)
+{
+    for (size_t i = 0; i < pos; ++i) {
+        if(s[i] == '\0') return string::npos;
+    }
+    const char *p= strpbrk(s + pos, chars);
+    return p == nullptr ? string::npos : p - s;
+}
+
 // When a command is received, if it is a Gcode, dispatch it as an object via an event
 void GcodeDispatch::on_console_line_received(void *line)
 {
-    SerialMessage new_message = *static_cast<SerialMessage *>(line);
-    string possible_command = new_message.message;
+    SerialMessage &new_message = *static_cast<SerialMessage *>(line);
 
     // just reply ok to empty lines
-    if(possible_command.empty()) {
+    if(new_message.message.empty()) {
         new_message.stream->printf("ok\r\n");
         return;
     }
 
+    // The line is copied once and then edited and split up in place, with room left in front for a modal G code.
+    // Short lines are copied to the stack so only Gcodes get allocated.
+    const size_t headroom= 8;
+    char short_line[128];
+    string long_line;
+    size_t len= new_message.message.size();
+    char *possible_command;
+    if(headroom + len < sizeof(short_line)) {
+        possible_command= short_line + headroom;
+    } else {
+        long_line.resize(headroom + len + 1);
+        possible_command= &long_line[headroom];
+    }
+    memcpy(possible_command, new_message.message.c_str(), len + 1);
+
     // get rid of spaces
-    ltrim(possible_command);
+    possible_command += strspn(possible_command, " \t\n\r\f\v");
 
 try_again:
 
@@ -84,83 +109,72 @@ try_again:
 
         //Get linenumber
         if ( first_char == 'N' ) {
-            //Strip line number value from possible_command
-			size_t lnsize = possible_command.find_first_not_of("N0123456789.,- ");
-			if(lnsize != string::npos) {
-				possible_command = possible_command.substr(lnsize);
-			}else{
-				// it is a blank line
-				possible_command.clear();
-			}
+            //Strip line number value from possible_command, if that is all there is it is a blank line
+            possible_command += strspn(possible_command, "N0123456789.,- ");
         }
 
         if ( first_char == 'G'){
-			//check if has G90/G91
-			std::string g90_g91_command;
-			std::string modified_command = possible_command;
-			size_t g90_pos = modified_command.find("G90");
-			size_t g91_pos = modified_command.find("G91");
 			// if we have G90 or G91，then we move G90/G91 to the beginning
-			if (g90_pos != std::string::npos) {
-				g90_g91_command = "G90";
-				modified_command.erase(g90_pos, 3); // delete "G90"
-				possible_command = g90_g91_command + modified_command;
-			} else if (g91_pos != std::string::npos) {
-				g90_g91_command = "G91";
-				modified_command.erase(g91_pos, 3); // delete "G91"
-				possible_command = g90_g91_command + modified_command;
+			char *g90_g91 = strstr(possible_command, "G90");
+			if (g90_g91 == nullptr) {
+				g90_g91 = strstr(possible_command, "G91");
+			}
+			if (g90_g91 != nullptr) {
+				char mode = g90_g91[2];
+				memmove(possible_command + 3, possible_command, g90_g91 - possible_command);
+				possible_command[0] = 'G';
+				possible_command[1] = '9';
+				possible_command[2] = mode;
 			}
 		}
 
         //Remove comments
-        size_t comment = possible_command.find_first_of(";(");
-        if( comment != string::npos ) {
-            possible_command = possible_command.substr(0, comment);
+        char *comment = strpbrk(possible_command, ";(");
+        if( comment != nullptr ) {
+            *comment = '\0';
         }
 
 		bool sent_ok= false; // used for G1 optimization
-		string single_command;
+		// the command being dispatched is the first single_len characters of single_command, the rest of the line follows it
+		const char *single_command;
+		size_t single_len;
 		size_t cmd_pos = string::npos;
-		while (possible_command.size() > 0) {
+		while (*possible_command != '\0') {
 			// assumes G or M are always the first on the line
 			// -> G or M are in the line but not always the first char
 			// -> S or T could be in front of or after M
 			first_char = possible_command[0];
 			if (first_char == 'G') {
 				// find next G/M/S/T
-				if (possible_command.find_first_of("S", 2) != string::npos
-						&& possible_command.find_first_of("M", 2) != string::npos) {
-					cmd_pos = possible_command.find_first_of("GMST", 2);
+				if (find_first_of(possible_command, "S", 2) != string::npos
+						&& find_first_of(possible_command, "M", 2) != string::npos) {
+					cmd_pos = find_first_of(possible_command, "GMST", 2);
 				} else {
-					cmd_pos = possible_command.find_first_of("GMT", 2);
+					cmd_pos = find_first_of(possible_command, "GMT", 2);
 				}
 			} else if (first_char == 'M') {
 				// find next G/M
-				cmd_pos = possible_command.find_first_of("GM", 2);
+				cmd_pos = find_first_of(possible_command, "GM", 2);
 			} else if (first_char == 'T' || first_char == 'S') {
 				// find first M
-				cmd_pos = possible_command.find_first_of("M", 2);
+				cmd_pos = find_first_of(possible_command, "M", 2);
 				if (cmd_pos == string::npos) {
 					// find first G/S/T
-					cmd_pos = possible_command.find_first_of("GST", 2);
+					cmd_pos = find_first_of(possible_command, "GST", 2);
 				} else {
 					// M found, find second G/M/S/T
-					cmd_pos = possible_command.find_first_of("GMST", cmd_pos + 2);
+					cmd_pos = find_first_of(possible_command, "GMST", cmd_pos + 2);
 				}
 			}
 
-			if (cmd_pos == string::npos) {
-				single_command = possible_command;
-				possible_command = "";
-			} else {
-				single_command = possible_command.substr(0, cmd_pos);
-				possible_command = possible_command.substr(cmd_pos);
-			}
+			single_command = possible_command;
+			single_len = cmd_pos == string::npos ? strlen(possible_command) : cmd_pos;
+			possible_command += single_len;
 
 			if(!uploading || upload_stream != new_message.stream) {
 				// Prepare gcode for dispatch
-				// new_message.stream->printf("GCode1: %s!\n", single_command.c_str());
-				Gcode *gcode = new Gcode(single_command, new_message.stream, false, new_message.line);
+				// new_message.stream->printf("GCode1: %.*s!\n", single_len, single_command);
+				Gcode *gcode = new Gcode(single_command, single_len, new_message.stream, false, new_message.line);
 
 				if ( first_char == '#'){
 					gcode->set_variable_value();
@@ -194,7 +208,7 @@ try_again:
 					if(gcode->g == 53) { // G53 makes next movement command use machine coordinates
 						// this is ugly to implement as there may or may not be a G0/G1 on the same line
 						// valid version seem to include G53 G0 X1 Y2 Z3 G53 X1 Y2
-						if(possible_command.empty()) {
+						if(*possible_command == '\0') {
 							// use last gcode G1 or G0 if none on the line, and pass through as if it was a G0/G1
 							// TODO it is really an error if the last is not G0 thru G3
 							if(modal_group_1 > 3) {
@@ -208,8 +222,9 @@ try_again:
 						}else{
 							delete gcode;
 							// extract next G0/G1 from the rest of the line, ignore if it is not one of these
-							gcode = new Gcode(possible_command, new_message.stream);
-							possible_command= "";
+							size_t rest = strlen(possible_command);
+							gcode = new Gcode(possible_command, rest, new_message.stream);
+							possible_command += rest;
 							if(!gcode->has_g || gcode->g > 1) {
 								// not G0 or G1 so ignore it as it is invalid
 								delete gcode;
@@ -229,8 +244,9 @@ try_again:
 					}
 
 					// remember last modal group 1 code
-					if(gcode->g < 4) {
+					if(gcode->g < 4 || gcode->g == 5) {
 						modal_group_1= gcode->g;
+						modal_subcode= gcode->g == 5 ? gcode->subcode : 0;
 					}
 				}
 
@@ -239,7 +255,8 @@ try_again:
 						case 28: // start upload command
 							delete gcode;
 
-							this->upload_filename = "/sd/" + single_command.substr(4); // rest of line is filename
+							this->upload_filename = "/sd/"; // rest of line is filename
+							if(single_len > 4) this->upload_filename.append(single_command + 4, single_len - 4);
 							// open file
 							upload_fd = fopen(this->upload_filename.c_str(), "w");
 							if(upload_fd != NULL) {
@@ -262,6 +279,7 @@ try_again:
 						case 2:
 							{
 								modal_group_1= 1; // set to G1
+								modal_subcode= 0;
 								// issue M5 and M9 in case spindle and coolant are being used
 								Gcode gc1("M5", &StreamOutput::NullStream);
 								THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc1);
@@ -305,7 +323,7 @@ try_again:
 
 						case 117: // M117 is a special non compliant Gcode as it allows arbitrary text on the line following the command
 						{    // concatenate the command again and send to panel if enabled
-							string str= single_command.substr(4) + possible_command;
+							string str= single_command + 4;
 							PublicData::set_value( panel_checksum, panel_display_message_checksum, &str );
 							delete gcode;
 							new_message.stream->printf("ok\r\n");
@@ -322,7 +340,7 @@ try_again:
 								}
 							}
 							
-							string str= single_command.substr(4) + possible_command;
+							string str= single_command + 4;
 							delete gcode;
 							THEKERNEL->streams->printf("%s \r\n", str.c_str());
 							return;
@@ -331,7 +349,7 @@ try_again:
 						case 1000: // M1000 is a special command that will pass thru the raw lowercased command to the simpleshell (for hosts that do not allow such things)
 						{
 							// reconstruct entire command line again
-							string str= single_command.substr(5) + possible_command;
+							string str= single_command + 5;
 							while(is_whitespace(str.front())){ str= str.substr(1); } // strip leading whitespace
 
 							delete gcode;
@@ -380,7 +398,7 @@ try_again:
 						case 501: // load config override
 						case 504: // save to specific config override file
 							{
-								string arg= get_arguments(single_command + possible_command); // rest of line is filename
+								string arg= get_arguments(single_command); // rest of line is filename
 								if(arg.empty()) arg= "/sd/config-override";
 								else arg= "/sd/config-override." + arg;
 								//new_message.stream->printf("args: <%s>\n", arg.c_str());
@@ -448,7 +466,7 @@ try_again:
 					} else {
 						if(THEKERNEL->is_ok_per_line() || THEKERNEL->is_grbl_mode()) {
 							// only send ok once per line if this is a multi g code line send ok on the last one
-							if(possible_command.empty())
+							if(*possible_command == '\0')
 								new_message.stream->printf("ok\r\n");
 						} else {
 							// maybe should do the above for all hosts?
@@ -461,7 +479,7 @@ try_again:
 
 			} else {
 				// we are uploading and it is the upload stream so so save it
-				if(single_command.substr(0, 3) == "M29") {
+				if(strncmp(single_command, "M29", 3) == 0) {
 					// done uploading, close file
 					fclose(upload_fd);
 					upload_fd = NULL;
@@ -478,8 +496,7 @@ try_again:
 					continue;
 				}
 
-				single_command.append("\n");
-				if(fwrite(single_command.c_str(), 1, single_command.size(), upload_fd) != single_command.size()) {
+				if(fwrite(single_command, 1, single_len, upload_fd) != single_len || fputc('\n', upload_fd) == EOF) {
 					// error writing to file
 					new_message.stream->printf("Error:error writing to file.\r\n");
 					fclose(upload_fd);
@@ -496,23 +513,30 @@ try_again:
         // Ignore comments and blank lines
         new_message.stream->printf("ok\n");
 
-    } else if( (n=possible_command.find_first_of("XYZAF")) == 0 || (first_char == ' ' && n != string::npos) ) {
+    } else if( (n=find_first_of(possible_command, "XYZAF", 0)) == 0 || (first_char == ' ' && n != string::npos) ) {
         // handle pycam syntax, use last modal group 1 command and resubmit if an X Y Z or F is found on its own line
-        char buf[6];
+        char buf[8];
         if(possible_command[n] == 'F') {
             // F on its own always applies to G1
             strcpy(buf,"G1 ");
         }else{
             // use last modal command (G1 or G0 etc)
-            snprintf(buf, sizeof(buf), "G%d ", modal_group_1);
+            if(modal_subcode != 0) {
+                snprintf(buf, sizeof(buf), "G%d.%d ", modal_group_1, modal_subcode);
+            }else{
+                snprintf(buf, sizeof(buf), "G%d ", modal_group_1);
+            }
         }
-        possible_command.insert(0, buf);
+        // there is always room left in front of the line for it
+        size_t buf_len= strlen(buf);
+        possible_command -= buf_len;
+        memcpy(possible_command, buf, buf_len);
         goto try_again;
 
 
     } else {
         // an uppercase non command word on its own (except XYZAF) just returns ok, we could add an error but no hosts expect that.
-        new_message.stream->printf("ok - ignore: [%s]\n", possible_command.c_str());
+        new_message.stream->printf("ok - ignore: [%s]\n", possible_command);
     }
 }
 
@@ -23,12 +23,13 @@ public:
     virtual void on_module_loaded();
     virtual void on_console_line_received(void *line);
 
-    uint8_t get_modal_command() const { return modal_group_1<4 ? modal_group_1 : 0; }
+    uint8_t get_modal_command() const { return modal_group_1<4 || modal_group_1 == 5 ? modal_group_1 : 0; }
 private:
     std::string upload_filename;
     FILE *upload_fd;
     StreamOutput* upload_stream{nullptr};
     uint8_t modal_group_1;
+    uint8_t modal_subcode; // G5.1 is modal as well as G5
     struct {
         bool uploading: 1;
     };
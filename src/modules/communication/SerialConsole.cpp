@@ -13,7 +13,6 @@ using std::string;
 #include "libs/Kernel.h"
 #include "libs/nuts_bolts.h"
 #include "SerialConsole.h"
-#include "libs/RingBuffer.h"
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
@@ -52,7 +51,7 @@ void SerialConsole::on_module_loaded() {
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_IDLE);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum, set_serial_rx_irq_checksum);
 
     // Add to the pack of streams kernel can call to, for example for broadcasting
     THEKERNEL->streams->append_stream(this);
@@ -128,7 +127,7 @@ void SerialConsole::on_serial_char_received() {
             continue;
         }
         if(THEKERNEL->is_feed_hold_enabled()) {
-            bool at_line_start = (this->buffer.head == this->buffer.tail) || (this->previous_char == '\n') || (this->previous_char == '\r');
+            bool at_line_start = this->buffer.at_line_start() || (this->previous_char == '\n') || (this->previous_char == '\r');
             if(at_line_start) {
                 if(received == '!') { // safe pause
                     THEKERNEL->set_feed_hold(true);
@@ -186,24 +185,18 @@ void SerialConsole::on_idle(void * argument)
 
 // Actual event calling must happen in the main loop because if it happens in the interrupt we will loose data
 void SerialConsole::on_main_loop(void * argument){
-    if ( this->has_char('\n') ){
-        string received;
-        received.reserve(20);
-        while(1){
-           char c;
-           this->buffer.pop_front(c);
-           if( c == '\n' ){
-                struct SerialMessage message;
-                message.message = received;
-                message.stream = this;
-                message.line = 0;
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-                // this->puts(received.c_str());
-                return;
-            }else{
-                received += c;
-            }
-        }
+    if (this->buffer.take_dropped() != 0) {
+        puts("error:Discarded long line\r\n", 0);
+    }
+    if (this->buffer.take_overflowed() != 0) {
+        puts("error:Receive buffer full, line discarded\r\n", 0);
+    }
+
+    struct SerialMessage message;
+    if (this->buffer.get_line(message.message)) {
+        message.stream = this;
+        message.line = 0;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
     }
 }
 
@@ -237,15 +230,3 @@ bool SerialConsole::ready()
 {
     return this->serial->readable();
 }
-
-// Does the queue have a given char ?
-bool SerialConsole::has_char(char letter){
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
@@ -14,7 +14,7 @@
 #include <vector>
 #include <string>
 using std::string;
-#include "libs/RingBuffer.h"
+#include "libs/LineBuffer.h"
 #include "libs/StreamOutput.h"
 
 
@@ -29,7 +29,6 @@ class SerialConsole : public Module, public StreamOutput {
         void on_main_loop(void * argument);
         void on_idle(void * argument);
         void on_set_public_data(void *argument);
-        bool has_char(char letter);
         void attach_irq(bool enable_irq);
 
         int _putc(int c);
@@ -44,7 +43,7 @@ class SerialConsole : public Module, public StreamOutput {
 
         //string receive_buffer;                 // Received chars are stored here until a newline character is received
         //vector<std::string> received_lines;    // Received lines are stored here until they are requested
-        RingBuffer<char,256> buffer;             // Receive buffer
+        LineBuffer<1024> buffer;                 // Receive buffer, big enough for a host sending several lines ahead
         mbed::Serial* serial;
         char previous_char;                       // Track previous character for ?1 detection
         int current_baud_rate;
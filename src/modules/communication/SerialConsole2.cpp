@@ -15,7 +15,6 @@ using std::string;
 #include "ConfigValue.h"
 #include "libs/nuts_bolts.h"
 #include "SerialConsole2.h"
-#include "libs/RingBuffer.h"
 #include "libs/SerialMessage.h"
 #include "PublicDataRequest.h"
 #include "PublicData.h"
@@ -53,8 +52,9 @@ void SerialConsole2::on_module_loaded() {
 
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, atc_handler_checksum, get_wp_voltage_checksum);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, atc_handler_checksum, show_wp_state_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum, set_wp_laser_checksum);
     this->register_for_event(ON_GCODE_RECEIVED);
 }
 
@@ -77,51 +77,41 @@ void SerialConsole2::on_main_loop(void * argument) {
         this->firstrun = false;
 	}
 	
-    if ( this->has_char('\n') ) {
-        string received;
-        received.reserve(20);
-        while (1) {
-           char c;
-           this->buffer.pop_front(c);
-           if ( c == '\n' ) {
-        	   // THEKERNEL->streams->printf("WP received: [%s]\n", received.c_str());
-        	   if (received[0] == 'V') {
-            	   // get wireless probe voltage
-            	   Gcode gc(received, &StreamOutput::NullStream);
-            	   if (gc.get_value('V') <= 4.2) {
-                	   this->wp_voltage = gc.get_value('V');
-                	   // compare voltage value and switch probe charger
-                	   if (this->wp_voltage <= this->min_voltage) {
-                		   struct pad_switch pad;
-                           bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
-                           if (!ok || !pad.state) {
-                        	   if (!THEKERNEL->is_uploading())
-                        		   THEKERNEL->streams->printf("WP voltage: [%1.2fV], start charging\n", this->wp_voltage);
-                    		   bool b = true;
-                    		   PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
-                           }
-                	   } else if (this->wp_voltage >= this->max_voltage) {
-                		   struct pad_switch pad;
-                           bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
-                           if (!ok || pad.state) {
-                        	   if (!THEKERNEL->is_uploading())
-                        		   THEKERNEL->streams->printf("WP voltage: [%1.2fV], end charging\n", this->wp_voltage);
-                    		   bool b = false;
-                    		   PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
-                           }
-                	   }
-            	   }
-        	   } else if (received[0] == 'A' && received.length() > 2) {
-        		   // get wireless probe address
-        		   THEKERNEL->probe_addr = ((uint16_t)received[2] << 8) | received[1];
-        		   THEKERNEL->streams->printf("WP power: [%1.2fv], addr: [%0d]\n", this->wp_voltage, THEKERNEL->probe_addr);
-        	   } else if (received[0] == 'P' && received.length() > 1) {
-        		   THEKERNEL->streams->printf("WP PAIR %s!\n", received[1] ? "SUCCESS" : "TIMEOUT");
-        	   }
-               return;
-            } else {
-                received += c;
+    string received;
+    if ( this->buffer.get_line(received) ) {
+        // THEKERNEL->streams->printf("WP received: [%s]\n", received.c_str());
+        if (received[0] == 'V') {
+            // get wireless probe voltage
+            Gcode gc(received, &StreamOutput::NullStream);
+            if (gc.get_value('V') <= 4.2) {
+                this->wp_voltage = gc.get_value('V');
+                // compare voltage value and switch probe charger
+                if (this->wp_voltage <= this->min_voltage) {
+                    struct pad_switch pad;
+                    bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
+                    if (!ok || !pad.state) {
+                        if (!THEKERNEL->is_uploading())
+                            THEKERNEL->streams->printf("WP voltage: [%1.2fV], start charging\n", this->wp_voltage);
+                        bool b = true;
+                        PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
+                    }
+                } else if (this->wp_voltage >= this->max_voltage) {
+                    struct pad_switch pad;
+                    bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
+                    if (!ok || pad.state) {
+                        if (!THEKERNEL->is_uploading())
+                            THEKERNEL->streams->printf("WP voltage: [%1.2fV], end charging\n", this->wp_voltage);
+                        bool b = false;
+                        PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
+                    }
+                }
             }
+        } else if (received[0] == 'A' && received.length() > 2) {
+            // get wireless probe address
+            THEKERNEL->probe_addr = ((uint16_t)received[2] << 8) | received[1];
+            THEKERNEL->streams->printf("WP power: [%1.2fv], addr: [%0d]\n", this->wp_voltage, THEKERNEL->probe_addr);
+        } else if (received[0] == 'P' && received.length() > 1) {
+            THEKERNEL->streams->printf("WP PAIR %s!\n", received[1] ? "SUCCESS" : "TIMEOUT");
         }
     }
 }
@@ -153,18 +143,6 @@ int SerialConsole2::_getc()
     return this->serial->getc();
 }
 
-// Does the queue have a given char ?
-bool SerialConsole2::has_char(char letter){
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
-
 void SerialConsole2::on_get_public_data(void *argument) {
     PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
 
@@ -14,7 +14,7 @@
 #include <vector>
 #include <string>
 using std::string;
-#include "libs/RingBuffer.h"
+#include "libs/LineBuffer.h"
 #include "libs/StreamOutput.h"
 
 
@@ -37,8 +37,6 @@ class SerialConsole2 : public Module {
         float max_voltage;        
         bool firstrun;
 
-        bool has_char(char letter);
-
         int _putc(int c);
         int _getc(void);
         int puts(const char*);
@@ -46,7 +44,7 @@ class SerialConsole2 : public Module {
         char getc_result;
 
         //string receive_buffer;                 // Received chars are stored here until a newline character is received
-        RingBuffer<char,256> buffer;             // Receive buffer
+        LineBuffer<256> buffer;                  // Receive buffer
         mbed::Serial* serial;
 };
 
@@ -11,6 +11,7 @@
 #include "libs/StreamOutputPool.h"
 #include "utils.h"
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 
 
@@ -25,22 +26,28 @@
 // This is a gcode object. It represents a GCode string/command, and caches some important values about that command for the sake of performance.
 // It gets passed around in events, and attached to the queue ( that'll change )
 Gcode::Gcode(const string &command, StreamOutput *stream, bool strip, unsigned int line)
+    : Gcode(command.c_str(), strlen(command.c_str()), stream, strip, line)
 {
-    this->command= strdup(command.c_str());
+}
+
+// from the first length characters of command, so a command can be taken straight out of a line holding several
+Gcode::Gcode(const char *command, size_t length, StreamOutput *stream, bool strip, unsigned int line)
+{
+    set_command(command, length);
     this->m= 0;
     this->g= 0;
     this->subcode= 0;
     this->add_nl= false;
     this->is_error= false;
     this->stream= stream;
-    prepare_cached_values(strip);
     this->stripped= strip;
+    prepare_cached_values(strip);
     this->line = line;
 }
 
 Gcode::~Gcode()
 {
-    if(command != nullptr) {
+    if(command != inline_command) {
         // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
         free(command);
     }
@@ -48,7 +55,7 @@ Gcode::~Gcode()
 
 Gcode::Gcode(const Gcode &to_copy)
 {
-    this->command               = strdup(to_copy.command); // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
+    set_command(to_copy.command, strlen(to_copy.command));
     this->has_m                 = to_copy.has_m;
     this->has_g                 = to_copy.has_g;
     this->m                     = to_copy.m;
@@ -56,14 +63,23 @@ Gcode::Gcode(const Gcode &to_copy)
     this->subcode               = to_copy.subcode;
     this->add_nl                = to_copy.add_nl;
     this->is_error              = to_copy.is_error;
+    this->stripped              = to_copy.stripped;
+    this->line                  = to_copy.line;
     this->stream                = to_copy.stream;
     this->txt_after_ok.assign( to_copy.txt_after_ok );
+    this->letters               = to_copy.letters;
+    this->numbers               = to_copy.numbers;
+    this->args                  = to_copy.args;
+    this->num_args              = to_copy.num_args;
+    memcpy(this->offset, to_copy.offset, sizeof(offset));
+    memcpy(this->value, to_copy.value, sizeof(value));
 }
 
 Gcode &Gcode::operator= (const Gcode &to_copy)
 {
     if( this != &to_copy ) {
-        this->command               = strdup(to_copy.command); // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
+        if(command != inline_command) free(command);
+        set_command(to_copy.command, strlen(to_copy.command));
         this->has_m                 = to_copy.has_m;
         this->has_g                 = to_copy.has_g;
         this->m                     = to_copy.m;
@@ -71,18 +87,40 @@ Gcode &Gcode::operator= (const Gcode &to_copy)
         this->subcode               = to_copy.subcode;
         this->add_nl                = to_copy.add_nl;
         this->is_error              = to_copy.is_error;
+        this->stripped              = to_copy.stripped;
+        this->line                  = to_copy.line;
         this->stream                = to_copy.stream;
         this->txt_after_ok.assign( to_copy.txt_after_ok );
+        this->letters               = to_copy.letters;
+        this->numbers               = to_copy.numbers;
+        this->args                  = to_copy.args;
+        this->num_args              = to_copy.num_args;
+        memcpy(this->offset, to_copy.offset, sizeof(offset));
+        memcpy(this->value, to_copy.value, sizeof(value));
     }
     return *this;
 }
 
+// keep a copy of the line, only long ones go on the heap
+void Gcode::set_command(const char *cmd, size_t n)
+{
+    if(n < inline_command_size) {
+        command= inline_command;
+    } else {
+        command= (char *)malloc(n + 1);
+    }
+    memcpy(command, cmd, n);
+    command[n]= '\0';
+}
 
 // Whether or not a Gcode has a letter
 bool Gcode::has_letter( char letter ) const
 {
-    for (size_t i = 0; i < strlen(this->command); ++i) {
-        if( command[i] == letter ) {
+    if(letter >= 'A' && letter <= 'Z') {
+        return (letters & (1 << (letter - 'A'))) != 0;
+    }
+    for (const char *cs = command; *cs; cs++) {
+        if( *cs == letter ) {
             return true;
         }
     }
@@ -594,6 +632,16 @@ float Gcode::get_value( char letter, char **ptr ) const
 {
     const char *cs = command;
     char *cn = NULL;
+    if(letter >= 'A' && letter <= 'Z') {
+        uint32_t bit= 1 << (letter - 'A');
+        if((letters & bit) == 0) {
+            if(ptr != nullptr) *ptr = nullptr;
+            return 0;
+        }
+        if(ptr == nullptr && (numbers & bit) != 0) return value[letter - 'A'];
+        // anything else is evaluated from its first word on
+        cs += offset[letter - 'A'];
+    }
     for (; *cs; cs++) {
         if( letter == *cs ) {
             cs++;
@@ -610,24 +658,17 @@ float Gcode::get_value( char letter, char **ptr ) const
     return 0;
 }
 
-// 2024
-/*
-// Retrieve the value for a given letter
-float Gcode::get_value_at_index( int index ) const
-{
-    const char *cs = command + index + 1;
-    char *cn = NULL;
-	float r = strtof(cs, &cn);
-	if(cn > cs)
-		return r;
-
-    return 0;
-}*/
-
 int Gcode::get_int( char letter, char **ptr ) const
 {
     const char *cs = command;
     char *cn = NULL;
+    if(letter >= 'A' && letter <= 'Z') {
+        if((letters & (1 << (letter - 'A'))) == 0) {
+            if(ptr != nullptr) *ptr= nullptr;
+            return 0;
+        }
+        cs += offset[letter - 'A'];
+    }
     for (; *cs; cs++) {
         if( letter == *cs ) {
             cs++;
@@ -645,6 +686,13 @@ uint32_t Gcode::get_uint( char letter, char **ptr ) const
 {
     const char *cs = command;
     char *cn = NULL;
+    if(letter >= 'A' && letter <= 'Z') {
+        if((letters & (1 << (letter - 'A'))) == 0) {
+            if(ptr != nullptr) *ptr= nullptr;
+            return 0;
+        }
+        cs += offset[letter - 'A'];
+    }
     for (; *cs; cs++) {
         if( letter == *cs ) {
             cs++;
@@ -660,24 +708,15 @@ uint32_t Gcode::get_uint( char letter, char **ptr ) const
 
 int Gcode::get_num_args() const
 {
-    int count = 0;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        if( this->command[i] >= 'A' && this->command[i] <= 'Z' ) {
-            if(this->command[i] == 'T') continue;
-            count++;
-        }
-    }
-    return count;
+    return num_args;
 }
 
 std::map<char,float> Gcode::get_args() const
 {
     std::map<char,float> m;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        char c= this->command[i];
-        if( c >= 'A' && c <= 'Z' ) {
-            if(c == 'T') continue;
-            m[c]= get_value(c);
+    for(int i = 0; i < 26; i++) {
+        if(args & (1 << i)) {
+            m['A' + i]= get_value('A' + i);
         }
     }
     return m;
@@ -686,21 +725,70 @@ std::map<char,float> Gcode::get_args() const
 std::map<char,int> Gcode::get_args_int() const
 {
     std::map<char,int> m;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        char c= this->command[i];
-        if( c >= 'A' && c <= 'Z' ) {
-            if(c == 'T') continue;
-            m[c]= get_int(c);
+    for(int i = 0; i < 26; i++) {
+        if(args & (1 << i)) {
+            m['A' + i]= get_int('A' + i);
         }
     }
     return m;
 }
 
+// Reads a number the way get_value() would if that is all the word holds, anything that needs evaluating is left to it
+static bool plain_number(const char *s, float &value)
+{
+    while (isspace(*s)) s++;
+    const char *start= s;
+    if(*s == '-' || *s == '+') s++;
+    bool digits= false;
+    while (isdigit(*s)) { s++; digits= true; }
+    if(*s == '.') {
+        s++;
+        while (isdigit(*s)) { s++; digits= true; }
+    }
+
+    char buf[24];
+    size_t n= s - start;
+    if(!digits || n >= sizeof(buf)) return false;
+
+    // an operator or anything else but the next word makes it an expression
+    while (isspace(*s)) s++;
+    if(*s != '\0' && (*s < 'A' || *s > 'Z')) return false;
+
+    // E is the next word not an exponent
+    memcpy(buf, start, n);
+    buf[n]= '\0';
+    value= strtof(buf, nullptr);
+    return true;
+}
+
+// Fill in the word table from the command
+void Gcode::scan_words()
+{
+    letters= numbers= args= 0;
+    num_args= 0;
+    const char *first_arg= command + (stripped ? 0 : 1);
+    for (const char *cs = command; *cs; cs++) {
+        char c= *cs;
+        if(c < 'A' || c > 'Z') continue;
+        uint32_t bit= 1 << (c - 'A');
+        if(cs >= first_arg && c != 'T') {
+            args |= bit;
+            num_args++;
+        }
+        if(letters & bit) continue;
+
+        letters |= bit;
+        offset[c - 'A']= cs - command;
+        if(plain_number(cs + 1, value[c - 'A'])) numbers |= bit;
+    }
+}
+
 // Cache some of this command's properties, so we don't have to parse the string every time we want to look at them
 void Gcode::prepare_cached_values(bool strip)
 {
     char *p= nullptr;
 
+    scan_words();
     if( this->has_letter('G') ) {
         this->has_g = true;
         this->g = this->get_int('G', &p);
@@ -732,9 +820,8 @@ void Gcode::prepare_cached_values(bool strip)
 
     // remove the Gxxx or Mxxx from string
     if (p != nullptr) {
-        char *n= strdup(p); // create new string starting at end of the numeric value
-        free(command);
-        command= n;
+        memmove(command, p, strlen(p) + 1); // string now starts at end of the numeric value
+        scan_words();
     }
 }
 
@@ -742,15 +829,16 @@ void Gcode::prepare_cached_values(bool strip)
 void Gcode::strip_parameters()
 {
     if(has_g && g < 4){
-        // strip the command of the XYZIJK parameters
-        string newcmd;
+        // strip the command of the XYZIJK parameters, in place as it only gets shorter
+        char *out= command;
         char *cn= command;
         // find the start of each parameter
         char *pch= strpbrk(cn, "XYZIJK");
         while (pch != nullptr) {
             if(pch > cn) {
                 // copy non parameters to new string
-                newcmd.append(cn, pch-cn);
+                memmove(out, cn, pch-cn);
+                out += pch-cn;
             }
             // find the end of the parameter and its value
             char *eos;
@@ -759,14 +847,11 @@ void Gcode::strip_parameters()
             pch= strpbrk(cn, "XYZIJK"); // find next parameter
         }
         // append anything left on the line
-        newcmd.append(cn);
+        memmove(out, cn, strlen(cn) + 1);
 
         // strip whitespace to save even more, this causes problems so don't do it
         //newcmd.erase(std::remove_if(newcmd.begin(), newcmd.end(), ::isspace), newcmd.end());
 
-        // release the old one
-        free(command);
-        // copy the new shortened one
-        command= strdup(newcmd.c_str());
+        scan_words();
     }
 }
@@ -22,23 +22,19 @@ class Gcode {
         using wcs_t= std::tuple<float, float, float>;
 
         Gcode(const string&, StreamOutput*, bool strip = true, unsigned int line = 0);
+        Gcode(const char *command, size_t length, StreamOutput*, bool strip = true, unsigned int line = 0);
         Gcode(const Gcode& to_copy);
         Gcode& operator= (const Gcode& to_copy);
         ~Gcode();
 
         const char* get_command() const { return command; }
         bool has_letter ( char letter ) const;
-        // 2024
 
-// 2024
         float get_variable_value(const char * expr, char ** endptr) const;
         float set_variable_value() const;
 
         float evaluate_expression(const char * expr, char ** endptr) const;
-        // int  index_of_letter( char letter, int start = 0) const;
         float get_value ( char letter, char **ptr= nullptr ) const;
-        // 2024
-        // float get_value_at_index(int index) const;
         int get_int ( char letter, char **ptr= nullptr ) const;
         uint32_t get_uint ( char letter, char **ptr= nullptr ) const;
         int get_num_args() const;
@@ -65,8 +61,23 @@ class Gcode {
         string txt_after_ok;
 
     private:
+        void set_command(const char *cmd, size_t n);
         void prepare_cached_values(bool strip=true);
+        void scan_words();
         char *command;
+
+        // most lines fit in the object itself so parsing them does not touch the heap
+        static const size_t inline_command_size= 64;
+        char inline_command[inline_command_size];
+
+        // the words on the line, found once when it is parsed so looking up a letter does not rescan it
+        uint32_t letters;            // a bit for every letter A-Z on the line
+        uint32_t numbers;            // a bit for every letter whose first word is a plain number held in value[]
+        uint32_t args;               // the letters get_args() returns
+        uint16_t num_args;
+        uint16_t offset[26];         // where the first word of each letter is in command
+        float value[26];
+
         float parse_expression(const char*& expr) const;
         float parse_term(const char*& expr) const;
         float parse_factor(const char*& expr) const;
@@ -26,7 +26,6 @@ using std::string;
 #define STEP_TICKER_FREQUENCY THEKERNEL->step_ticker->get_frequency()
 
 uint8_t Block::n_actuators= 0;
-double Block::fp_scale= 0;
 
 // A block represents a movement, it's length for each stepper motor, and the corresponding acceleration curves.
 // It's stacked on a queue, and that queue is then executed in order, to move the motors.
@@ -42,7 +41,6 @@ Block::Block()
 void Block::init(uint8_t n)
 {
     n_actuators= n;
-    fp_scale= (double)STEPTICKER_FPSCALE / pow((double)STEP_TICKER_FREQUENCY, 2.0); // we scale up by fixed point offset first to avoid tiny values
 }
 
 void Block::clear()
@@ -58,53 +56,30 @@ void Block::clear()
     entry_speed         = 0.0F;
     exit_speed          = 0.0F;
     acceleration        = 100.0F; // we don't want to get divide by zeroes if this is not set
+    jerk                = 0.0F;
     initial_rate        = 0.0F;
     accelerate_until    = 0;
     decelerate_after    = 0;
+    accel_jerk_until    = 0;
+    accel_jerk_after    = 0;
+    decel_jerk_until    = 0;
+    decel_jerk_after    = 0;
+    acceleration_per_tick = 0.0F;
+    deceleration_per_tick = 0.0F;
+    accel_jerk_per_tick = 0.0F;
+    decel_jerk_per_tick = 0.0F;
     direction_bits      = 0;
     recalculate_flag    = false;
     nominal_length_flag = false;
     max_entry_speed     = 0.0F;
     is_ticking          = false;
     is_g123             = false;
-    locked              = false;
-
-	s_value             = 0.0F;
-    // 2024
-    /*
-	move_axis           = 0;
-    s_values[0]         = 0.0F;
-    s_values[1]         = 0.0F;
-    s_values[2]         = 0.0F;
-    s_values[3]         = 0.0F;
-    s_values[4]         = 0.0F;
-    s_values[5]         = 0.0F;
-    s_values[6]         = 0.0F;
-    s_values[7]         = 0.0F;
-    s_count 			= 1;
-    */
+    is_arc              = false;
 
-    total_move_ticks= 0;
-
-    for(int i = 0; i < n_actuators; ++i) {
-        tick_info[i].steps_per_tick= 0;
-        tick_info[i].counter= 0;
-        tick_info[i].acceleration_change= 0;
-        tick_info[i].deceleration_change= 0;
-        tick_info[i].plateau_rate= 0;
-        tick_info[i].steps_to_move= 0;
-        tick_info[i].step_count= 0;
-        tick_info[i].next_accel_event= 0;
-    }
-}
+    s_values[0]         = 0;
+    s_count             = 1;
 
-// Only used for continuous mode to reuse the same block over and over
-void Block::reset(tickinfo_t *saved)
-{
-    for(int i = 0; i < n_actuators; ++i) {
-        if(saved[i].steps_to_move == 0) continue;
-        tick_info[i]= saved[i];
-    }
+    total_move_ticks= 0;
 }
 
 void Block::debug() const
@@ -113,7 +88,7 @@ void Block::debug() const
     for (size_t i = E_AXIS; i < n_actuators; ++i) {
         THEKERNEL->streams->printf("%c:%lu ", 'A' + i-E_AXIS, this->steps[i]);
     }
-    THEKERNEL->streams->printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d locked:%d ticking:%d recalc:%d nomlen:%d time:%f\r\n",
+    THEKERNEL->streams->printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d ticking:%d recalc:%d nomlen:%d time:%f\r\n",
                                this->steps_event_count,
                                this->nominal_rate,
                                this->nominal_speed,
@@ -129,12 +104,15 @@ void Block::debug() const
                                this->exit_speed,
                                this->primary_axis,
                                this->is_ready,
-                               this->locked,
                                this->is_ticking,
                                recalculate_flag ? 1 : 0,
                                nominal_length_flag ? 1 : 0,
                                total_move_ticks/STEP_TICKER_FREQUENCY
                               );
+    if(is_arc) {
+        THEKERNEL->streams->printf("  arc: plane:%c%c radius:%1.4f/%1.4f angle:%1.4f linear:%1.4f\r\n",
+                                   'X' + arc.axis[0], 'X' + arc.axis[1], arc.radius[0], arc.radius[1], arc.angle, arc.linear);
+    }
 }
 
 
@@ -155,6 +133,12 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     float initial_rate = this->nominal_rate * (entryspeed / this->nominal_speed); // steps/sec
     float final_rate = this->nominal_rate * (exitspeed / this->nominal_speed);
     //printf("Initial rate: %f, final_rate: %f\n", initial_rate, final_rate);
+
+    if(this->jerk > 0.0F) {
+        this->exit_speed = exitspeed;
+        calculate_s_curve(initial_rate, final_rate);
+        return;
+    }
     // How many steps ( can be fractions of steps, we need very precise values ) to accelerate and decelerate
     // This is a simplification to get rid of rate_delta and get the steps/s² accel directly from the mm/s² accel
     float acceleration_per_second = (this->acceleration * this->steps_event_count) / this->millimeters;
@@ -219,9 +203,6 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     float acceleration_in_steps = (acceleration_time > 0.0F ) ? ( this->maximum_rate - initial_rate ) / acceleration_time : 0;
     float deceleration_in_steps =  (deceleration_time > 0.0F ) ? ( this->maximum_rate - final_rate ) / deceleration_time : 0;
 
-    // we have a potential race condition here as we could get interrupted anywhere in the middle of this call, we need to lock
-    // the updates to the blocks to get around it
-    this->locked= true;
     // Now figure out the two acceleration ramp change events in ticks
     this->accelerate_until = acceleration_ticks;
     this->decelerate_after = total_move_ticks - deceleration_ticks;
@@ -233,16 +214,156 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     this->initial_rate = initial_rate;
     this->exit_speed = exitspeed;
 
-    // prepare the block for stepticker
-    this->prepare(acceleration_in_steps, deceleration_in_steps);
+    // no jerk segments, the step ticker goes straight from one constant acceleration to the next
+    this->accel_jerk_until = 0;
+    this->accel_jerk_after = 0;
+    this->decel_jerk_until = total_move_ticks;
+    this->decel_jerk_after = total_move_ticks;
+
+    // the step ticker works in step events per tick, so per tick² here
+    this->acceleration_per_tick = acceleration_in_steps / powf(STEP_TICKER_FREQUENCY, 2);
+    this->deceleration_per_tick = deceleration_in_steps / powf(STEP_TICKER_FREQUENCY, 2);
+    this->accel_jerk_per_tick = 0.0F;
+    this->decel_jerk_per_tick = 0.0F;
+}
 
-    this->locked= false;
+// time in seconds to change speed by dv with a jerk limited ramp, either jerk/constant acceleration/jerk
+// or, if dv is too small to ever reach full acceleration, just the two jerk segments
+static float s_curve_time(float dv, float acceleration, float jerk)
+{
+    if(dv * jerk >= acceleration * acceleration) return dv / acceleration + acceleration / jerk;
+    return 2.0F * sqrtf(dv / jerk);
+}
+
+// the ramp is symmetric so the distance covered is the time it takes at the mean of the two speeds
+static float s_curve_distance(float v0, float v1, float acceleration, float jerk)
+{
+    return (v0 + v1) * 0.5F * s_curve_time(fabsf(v1 - v0), acceleration, jerk);
+}
+
+// Splits a ramp of dv (steps/sec) into whole ticks of jerk and of constant acceleration, and returns the jerk in steps/tick³
+// which gives exactly dv over those ticks. The rate changes by jerk * n * (n + c) steps/tick over a ramp with n ticks in each
+// jerk segment and c ticks of constant acceleration.
+static float s_curve_ticks(float dv, float acceleration, float jerk, uint32_t &jerk_ticks, uint32_t &const_ticks)
+{
+    if(dv <= 0.0F) {
+        jerk_ticks= 0;
+        const_ticks= 0;
+        return 0;
+    }
+
+    float jerk_time, const_time;
+    if(dv * jerk >= acceleration * acceleration) {
+        jerk_time = acceleration / jerk;
+        const_time = dv / acceleration - jerk_time;
+    } else {
+        jerk_time = sqrtf(dv / jerk);
+        const_time = 0;
+    }
+
+    jerk_ticks = std::max(1.0F, floorf(jerk_time * STEP_TICKER_FREQUENCY));
+    const_ticks = floorf(const_time * STEP_TICKER_FREQUENCY);
+
+    return (dv / STEP_TICKER_FREQUENCY) / ((float)jerk_ticks * (jerk_ticks + const_ticks));
+}
+
+// Same job as calculate_trapezoid but for a 7 segment S-curve, the acceleration ramps up and down at the given jerk
+// so it is zero at both ends of the block and at the start of the plateau
+//                                   +-----+ <- maximum_rate
+//                                 /         \
+//                                |           |
+//               initial_rate -> /             \ <- final_rate
+void Block::calculate_s_curve( float initial_rate, float final_rate )
+{
+    float acceleration_per_second = (this->acceleration * this->steps_event_count) / this->millimeters;
+    float jerk_per_second = (this->jerk * this->steps_event_count) / this->millimeters;
+    float distance = this->steps_event_count;
+
+    // find the highest rate we can reach and still get down to final_rate within the block
+    float peak_rate = this->nominal_rate;
+    if(s_curve_distance(initial_rate, peak_rate, acceleration_per_second, jerk_per_second) + s_curve_distance(peak_rate, final_rate, acceleration_per_second, jerk_per_second) > distance) {
+        float lo = std::max(initial_rate, final_rate);
+
+        // if both ramps reach full acceleration the distance is a quadratic of the peak rate
+        float k = acceleration_per_second / jerk_per_second;
+        float c = (k / 2.0F) * (initial_rate + final_rate) - (powf(initial_rate, 2) + powf(final_rate, 2)) / (2.0F * acceleration_per_second) - distance;
+        peak_rate = (acceleration_per_second / 2.0F) * (-k + sqrtf(k * k - 4.0F * c / acceleration_per_second));
+
+        if(!(peak_rate - initial_rate >= acceleration_per_second * k && peak_rate - final_rate >= acceleration_per_second * k)) {
+            // otherwise search for it, the distance needed only grows with the peak rate
+            float hi = this->nominal_rate;
+            for (int i = 0; i < 16; ++i) {
+                peak_rate = (lo + hi) / 2.0F;
+                if(s_curve_distance(initial_rate, peak_rate, acceleration_per_second, jerk_per_second) + s_curve_distance(peak_rate, final_rate, acceleration_per_second, jerk_per_second) > distance) {
+                    hi = peak_rate;
+                } else {
+                    lo = peak_rate;
+                }
+            }
+            peak_rate = lo;
+        }
+
+        peak_rate = std::min(std::max(peak_rate, lo), this->nominal_rate);
+    }
+
+    uint32_t accel_jerk_ticks, accel_const_ticks, decel_jerk_ticks, decel_const_ticks;
+    float accel_jerk = s_curve_ticks(peak_rate - initial_rate, acceleration_per_second, jerk_per_second, accel_jerk_ticks, accel_const_ticks);
+    float decel_jerk = s_curve_ticks(peak_rate - final_rate, acceleration_per_second, jerk_per_second, decel_jerk_ticks, decel_const_ticks);
+    uint32_t acceleration_ticks = 2 * accel_jerk_ticks + accel_const_ticks;
+    uint32_t deceleration_ticks = 2 * decel_jerk_ticks + decel_const_ticks;
+
+    // the plateau covers whatever the ramps, as rounded to ticks, do not
+    float ramp_distance = ((initial_rate + peak_rate) * acceleration_ticks + (peak_rate + final_rate) * deceleration_ticks) / (2.0F * STEP_TICKER_FREQUENCY);
+    uint32_t plateau_ticks = 0;
+    if(ramp_distance < distance && peak_rate > 0.0F) {
+        plateau_ticks = roundf((distance - ramp_distance) / peak_rate * STEP_TICKER_FREQUENCY);
+    }
+
+    // the ticks at which each segment starts, StepTicker walks through them in order
+    this->accel_jerk_until = accel_jerk_ticks;
+    this->accel_jerk_after = accel_jerk_ticks + accel_const_ticks;
+    this->accelerate_until = acceleration_ticks;
+    this->decelerate_after = acceleration_ticks + plateau_ticks;
+    this->decel_jerk_until = this->decelerate_after + decel_jerk_ticks;
+    this->decel_jerk_after = this->decel_jerk_until + decel_const_ticks;
+    this->total_move_ticks = this->decelerate_after + deceleration_ticks;
+
+    this->maximum_rate = peak_rate;
+    this->initial_rate = initial_rate;
+
+    this->acceleration_per_tick = 0.0F;
+    this->deceleration_per_tick = 0.0F;
+    this->accel_jerk_per_tick = accel_jerk;
+    this->decel_jerk_per_tick = decel_jerk;
+}
+
+// Fastest speed from which target_velocity can still be reached within distance using an S-curve ramp
+static float s_curve_max_speed(float acceleration, float jerk, float target_velocity, float distance)
+{
+    if(distance <= 0.0F) return target_velocity;
+
+    // if the ramp reaches full acceleration, distance is a quadratic of the speed
+    float k = acceleration * acceleration / jerk;
+    float v = (-k + sqrtf(powf(k - 2.0F * target_velocity, 2) + 8.0F * acceleration * distance)) / 2.0F;
+    if(v - target_velocity >= k) return v;
+
+    // otherwise distance = (2 * target_velocity + jerk * t²) * t where t is the time spent in each jerk segment,
+    // newton converges monotonically on that from any start above the root
+    float t = cbrtf(distance / jerk);
+    if(target_velocity > 0.0F) t = std::min(t, distance / (2.0F * target_velocity));
+    for (int i = 0; i < 6; ++i) {
+        float f = (2.0F * target_velocity + jerk * t * t) * t - distance;
+        t -= f / (2.0F * target_velocity + 3.0F * jerk * t * t);
+    }
+    return target_velocity + jerk * t * t;
 }
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
 // acceleration within the allotted distance.
 float Block::max_allowable_speed(float acceleration, float target_velocity, float distance)
 {
+    if(this->jerk > 0.0F) return s_curve_max_speed(-acceleration, this->jerk, target_velocity, distance);
+
     return sqrtf(target_velocity * target_velocity - 2.0F * acceleration * distance);
 }
 
@@ -316,72 +437,13 @@ float Block::max_exit_speed()
     return min(max, nominal_speed);
 }
 
-// prepare block for the step ticker, called everytime the block changes
-// this is done during planning so does not delay tick generation and step ticker can simply grab the next block during the interrupt
-void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
-{
-
-    float inv = 1.0F / this->steps_event_count;
-
-    // Now figure out the acceleration PER TICK, this should ideally be held as a double as it's very critical to the block timing
-    // steps/tick^2
-    // was....
-    // float acceleration_per_tick = acceleration_in_steps / STEP_TICKER_FREQUENCY_2; // that is 100,000² too big for a float
-    // float deceleration_per_tick = deceleration_in_steps / STEP_TICKER_FREQUENCY_2;
-    double acceleration_per_tick = acceleration_in_steps * fp_scale; // this is now scaled to fit a 2.30 fixed point number
-    double deceleration_per_tick = deceleration_in_steps * fp_scale;
-
-    for (uint8_t m = 0; m < n_actuators; m++) {
-        uint32_t steps = this->steps[m];
-        this->tick_info[m].steps_to_move = steps;
-        if(steps == 0) continue;
-
-        float aratio = inv * steps;
-
-        this->tick_info[m].steps_per_tick = (int64_t)round((((double)this->initial_rate * aratio) / STEP_TICKER_FREQUENCY) * STEPTICKER_FPSCALE); // steps/sec / tick frequency to get steps per tick in 2.62 fixed point
-        this->tick_info[m].counter = 0; // 2.62 fixed point
-        this->tick_info[m].step_count = 0;
-        this->tick_info[m].next_accel_event = this->total_move_ticks + 1;
-
-        double acceleration_change = 0;
-        if(this->accelerate_until != 0) { // If the next accel event is the end of accel
-            this->tick_info[m].next_accel_event = this->accelerate_until;
-            acceleration_change = acceleration_per_tick;
-
-        } else if(this->decelerate_after == 0 /*&& this->accelerate_until == 0*/) {
-            // we start off decelerating
-            acceleration_change = -deceleration_per_tick;
-
-        } else if(this->decelerate_after != this->total_move_ticks /*&& this->accelerate_until == 0*/) {
-            // If the next event is the start of decel ( don't set this if the next accel event is accel end )
-            this->tick_info[m].next_accel_event = this->decelerate_after;
-        }
-
-        // already converted to fixed point just needs scaling by ratio
-        //#define STEPTICKER_TOFP(x) ((int64_t)round((double)(x)*STEPTICKER_FPSCALE))
-        this->tick_info[m].acceleration_change= (int64_t)round(acceleration_change * aratio);
-        this->tick_info[m].deceleration_change= -(int64_t)round(deceleration_per_tick * aratio);
-        this->tick_info[m].plateau_rate= (int64_t)round(((this->maximum_rate * aratio) / STEP_TICKER_FREQUENCY) * STEPTICKER_FPSCALE);
-
-        #if 0
-        THEKERNEL->streams->printf("spt: %08lX %08lX, ac: %08lX %08lX, dc: %08lX %08lX, pr: %08lX %08lX\n",
-            (uint32_t)(this->tick_info[m].steps_per_tick>>32), // 2.62 fixed point
-            (uint32_t)(this->tick_info[m].steps_per_tick&0xFFFFFFFF), // 2.62 fixed point
-            (uint32_t)(this->tick_info[m].acceleration_change>>32), // 2.62 fixed point signed
-            (uint32_t)(this->tick_info[m].acceleration_change&0xFFFFFFFF), // 2.62 fixed point signed
-            (uint32_t)(this->tick_info[m].deceleration_change>>32), // 2.62 fixed point
-            (uint32_t)(this->tick_info[m].deceleration_change&0xFFFFFFFF), // 2.62 fixed point
-            (uint32_t)(this->tick_info[m].plateau_rate>>32), // 2.62 fixed point
-            (uint32_t)(this->tick_info[m].plateau_rate&0xFFFFFFFF) // 2.62 fixed point
-        );
-        #endif
-    }
-}
-
 // returns current rate (steps/sec) for the given actuator
+// only valid for the block the step ticker is currently running
 float Block::get_trapezoid_rate(int i) const
 {
-    // convert steps per tick from fixed point to float and convert to steps/sec
-    // FIXME steps_per_tick can change at any time, potential race condition if it changes while being read here
-    return STEPTICKER_FROMFP(tick_info[i].steps_per_tick) * STEP_TICKER_FREQUENCY;
+    // the motors of an arc keep changing speed along it, give the rate along the path
+    if(is_arc) return THEKERNEL->step_ticker->get_current_rate();
+
+    // the step ticker only has the step event rate of its current segment, this actuator does its share of those events
+    return THEKERNEL->step_ticker->get_current_rate() * this->steps[i] / this->steps_event_count;
 }
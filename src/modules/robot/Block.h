@@ -26,12 +26,21 @@ class Block {
         void ready() { is_ready= true; }
         void clear();
         float get_trapezoid_rate(int i) const;
-
-    private:
         float max_allowable_speed( float acceleration, float target_velocity, float distance);
-        void prepare(float acceleration_in_steps, float deceleration_in_steps);
 
-        static double fp_scale; // optimize to store this as it does not change
+        // the path of an arc block, relative to where it starts
+        struct arc_t {
+            float radius[2];     // radius vector from the centre to the start, along the first two plane axes
+            float angle;         // radians swept, positive turns from the first plane axis towards the second
+            float linear;        // travel along the third plane axis, for a helix
+            uint8_t axis[3];     // plane axes, also the motors they move as arcs are only queued for cartesian machines
+        };
+
+        // most laser intensities one block can carry, spread evenly along it
+        static const uint8_t max_s_values= 8;
+
+    private:
+        void calculate_s_curve( float initial_rate, float final_rate );
 
     public:
         std::array<uint32_t, k_max_actuators> steps; // Number of steps for each axis for this block
@@ -42,6 +51,7 @@ class Block {
         float entry_speed;
         float exit_speed;
         float acceleration;       // the acceleration for this block
+        float jerk;               // max jerk in mm/s³ for an S-curve profile, 0 for a trapezoid
         float initial_rate;       // Initial rate in steps per second
         float maximum_rate;
 
@@ -52,28 +62,27 @@ class Block {
         uint32_t accelerate_until;
         uint32_t decelerate_after;
         uint32_t total_move_ticks;
-        std::bitset<k_max_actuators> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
 
-        // this is the data needed to determine when each motor needs to be issued a step
-        using tickinfo_t= struct {
-            int64_t steps_per_tick; // 2.62 fixed point
-            int64_t counter; // 2.62 fixed point
-            int64_t acceleration_change; // 2.62 fixed point signed
-            int64_t deceleration_change; // 2.62 fixed point
-            int64_t plateau_rate; // 2.62 fixed point
-            uint32_t steps_to_move;
-            uint32_t step_count;
-            uint32_t next_accel_event;
-        };
-        void reset(tickinfo_t *saved);
+        // S-curve only, ticks at which the jerk changes within the acceleration and deceleration ramps
+        uint32_t accel_jerk_until;   // jerk drops to zero, constant acceleration
+        uint32_t accel_jerk_after;   // negative jerk until accelerate_until
+        uint32_t decel_jerk_until;
+        uint32_t decel_jerk_after;
+
+        // the rate changes in step events per tick, per tick² or per tick³, the step ticker slices the block into segments with these
+        float acceleration_per_tick; // trapezoid only
+        float deceleration_per_tick; // trapezoid only
+        float accel_jerk_per_tick;   // S-curve only
+        float decel_jerk_per_tick;   // S-curve only
+        std::bitset<k_max_actuators> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
 
-        // need info for each active motor
-        std::array<tickinfo_t, k_max_actuators> tick_info;
+        // arcs only, steps and direction_bits are the net move and the step ticker steps the arc as short chords
+        arc_t arc;
 
         static uint8_t n_actuators;
 
-        // 2024
-        // uint16_t s_values[8];
+        // laser intensities, 1.11 fixed point, each for an equal share of the step events in order
+        uint16_t s_values[max_s_values];
 
         struct {
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
@@ -82,11 +91,7 @@ class Block {
             bool primary_axis:1;                 // set if this move is a primary axis
             bool is_g123:1;                      // set if this is a G1, G2 or G3
             volatile bool is_ticking:1;          // set when this block is being actively ticked by the stepticker
-            volatile bool locked:1;              // set to true when the critical data is being updated, stepticker will have to skip if this is set
-
-            // 2024
-            // uint8_t  s_count:4;                  // number of laser intensity values
-            // uint8_t  move_axis:3;                // axis of greatest movement
-            uint16_t s_value:12;                 // for laser 1.11 Fixed point
+            bool is_arc:1;                       // set if this is a G2 or G3 queued as one block
+            uint8_t s_count:4;                   // number of laser intensities in s_values
         };
 };
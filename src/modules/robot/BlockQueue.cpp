@@ -14,6 +14,8 @@ BlockQueue::BlockQueue()
 {
     head_i = tail_i = length = 0;
     isr_tail_i = tail_i;
+    prep_i = tail_i;
+    planned_i = tail_i;
     ring = nullptr;
 }
 
@@ -21,6 +23,8 @@ BlockQueue::BlockQueue(unsigned int length)
 {
     head_i = tail_i = 0;
     isr_tail_i = tail_i;
+    prep_i = tail_i;
+    planned_i = tail_i;
     void *v= AHB.alloc(sizeof(Block) * length);
     if (v == nullptr) {
         // TODO: Optionally add error reporting here (e.g., THEKERNEL->streams->printf("FATAL: BlockQueue alloc failed!\n");)
@@ -43,6 +47,8 @@ BlockQueue::~BlockQueue()
 {
     head_i = tail_i = length = 0;
     isr_tail_i = tail_i;
+    prep_i = tail_i;
+    planned_i = tail_i;
     if(ring != nullptr)
         AHB.dealloc(ring); // delete [] ring;
     ring = nullptr;
@@ -75,6 +75,8 @@ protected:
     volatile unsigned int head_i;
     volatile unsigned int tail_i;
     volatile unsigned int isr_tail_i;
+    volatile unsigned int prep_i;     // next block for the step ticker to slice into segments, between isr_tail_i and head_i
+    unsigned int planned_i;           // last block the planner has found optimal, it never looks behind it
 
 private:
     Block* ring;
@@ -55,6 +55,12 @@
  * When isr_tail_i != tail, we clean up the tail block (performing ISR-unsafe delete operations) and consume it (increment tail pointer), returning it to the pool of clean, unused blocks which HEAD is allowed to prepare for queueing
  *
  * Thus, our two ringbuffers exist sharing the one ring of blocks, and we safely marshall used blocks from ISR context to IDLE context for safe cleanup.
+ *
+ * The step ticker slices blocks into segments ahead of running them, so in ISR context there is one more index, prep_i, between isr_tail_i and HEAD.
+ * get_next_block() hands out the block at prep_i, and isr_tail_i only moves once the block has actually been stepped.
+ *
+ * In IDLE context the planner also keeps planned_i, the last block it has found optimal. Nothing queued after it can make it or
+ * any block before it go any faster, so the planner never looks behind it. It is pushed along when its block is cleaned up.
  */
 
 
@@ -65,6 +71,7 @@ Conveyor::Conveyor()
     flush= false;
     continuous_mode = 0;
     hold_queue= false;
+    planning= false;
 }
 
 void Conveyor::on_module_loaded()
@@ -74,7 +81,8 @@ void Conveyor::on_module_loaded()
 
     // Attach to the end_of_move stepper event
     //THEKERNEL->step_ticker->finished_fnc = std::bind( &Conveyor::all_moves_finished, this);
-    queue_size = THEKERNEL->config->value(planner_queue_size_checksum)->by_default(32)->as_number();
+    // blocks only hold what the planner and segment preparation need, so 96 take little more RAM than 32 used to
+    queue_size = THEKERNEL->config->value(planner_queue_size_checksum)->by_default(96)->as_number();
     queue_delay_time_ms = THEKERNEL->config->value(queue_delay_time_ms_checksum)->by_default(100)->as_number();
 }
 
@@ -101,6 +109,9 @@ void Conveyor::on_idle(void*)
         check_queue();
     }
 
+    // slice the next blocks up for the step ticker, PendSV tops it up when the main loop is away for long
+    THEKERNEL->step_ticker->prepare_segments();
+
     // we can garbage collect the block queue here
     if (queue.tail_i != queue.isr_tail_i) {
         if (queue.is_empty()) {
@@ -110,6 +121,8 @@ void Conveyor::on_idle(void*)
             Block* block = queue.tail_ref();
             //block->debug();
             block->clear();
+            // the block after it is as far back as the planner can look now
+            if(queue.planned_i == queue.tail_i) queue.planned_i = queue.next(queue.tail_i);
             queue.consume_tail();
         }
     }
@@ -227,7 +240,7 @@ bool Conveyor::set_continuous_mode(bool f)
     */
 }
 
-// called from step ticker ISR
+// called from the step ticker segment preparation, in on_idle or in PendSV when the main loop is away, never both at once
 bool Conveyor::get_next_block(Block **block)
 {
     // this is used to allow us to put blocks onto an empty queue and not start until we say so
@@ -239,18 +252,18 @@ bool Conveyor::get_next_block(Block **block)
         while (queue.isr_tail_i != queue.head_i) {
             queue.isr_tail_i = queue.next(queue.isr_tail_i);
         }
+        queue.prep_i = queue.head_i;
     }
 
     // default the feerate to zero if there is no block available
     this->current_feedrate= 0;
 
-    if(THEKERNEL->is_halted() || queue.isr_tail_i == queue.head_i) return false; // we do not have anything to give
+    if(THEKERNEL->is_halted() || queue.prep_i == queue.head_i) return false; // we do not have anything to give
 
     if(continuous_mode > 1){
-            // keep feeding the second in the queue
-            Block *b= queue.item_ref(queue.isr_tail_i);
-            // reset variable parts of the block
-            b->reset(static_cast<Block::tickinfo_t*>(saved_block));
+            // keep feeding the second in the queue, the step ticker slices it up from the start every time
+            calculate_trapezoid(queue.prep_i);
+            Block *b= queue.item_ref(queue.prep_i);
             b->is_ticking= true;
             b->recalculate_flag= false;
             this->current_feedrate= b->nominal_speed;
@@ -261,19 +274,29 @@ bool Conveyor::get_next_block(Block **block)
     // wait for queue to fill up, optimizes planning
     if(!allow_fetch) return false;
 
-    Block *b= queue.item_ref(queue.isr_tail_i);
-    // we cannot use this now if it is being updated
-    if(!b->locked) {
-        if(!b->is_ready) __debugbreak(); // should never happen
+    // we cannot use this now if the speeds are being updated
+    if(planning) return false;
 
-        b->is_ticking= true;
-        b->recalculate_flag= false;
-        this->current_feedrate= b->nominal_speed;
-        *block= b;
-        return true;
-    }
+    Block *b= queue.item_ref(queue.prep_i);
+    if(!b->is_ready) __debugbreak(); // should never happen
 
-    return false;
+    calculate_trapezoid(queue.prep_i);
+    b->is_ticking= true;
+    b->recalculate_flag= false;
+    this->current_feedrate= b->nominal_speed;
+    *block= b;
+    queue.prep_i= queue.next(queue.prep_i);
+    return true;
+}
+
+// The planner only works out the speeds, the acceleration profile of a block is worked out once here as the step ticker
+// takes it, its entry speed is final and it exits at the entry speed of the next one, or stops if there is none yet
+void Conveyor::calculate_trapezoid(unsigned int index)
+{
+    Block *b= queue.item_ref(index);
+    unsigned int next= queue.next(index);
+    float exit_speed= next != queue.head_i ? queue.item_ref(next)->entry_speed : THEKERNEL->planner->get_minimum_planner_speed();
+    b->calculate_trapezoid(b->entry_speed, exit_speed);
 }
 
 // called from step ticker ISR when block is finished, do not do anything slow here
@@ -39,11 +39,12 @@ public:
     bool is_continuous_mode() const { return continuous_mode == 1; }
     void set_hold(bool f) { hold_queue= f; }
 
-    friend class Planner; // for queue
+    friend class Planner; // for queue and planning
 
 private:
     void check_queue(bool force= false);
     void queue_head_block(void);
+    void calculate_trapezoid(unsigned int index);
 
     using  Queue_t= BlockQueue;
     Queue_t queue;  // Queue of Blocks
@@ -59,6 +60,7 @@ private:
         bool flush:1;
         volatile bool hold_queue:1;
         volatile uint8_t continuous_mode:2;
+        volatile bool planning:1;            // set while the planner is changing block speeds
     };
 
 };
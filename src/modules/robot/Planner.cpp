@@ -28,6 +28,7 @@ using namespace std;
 #define junction_deviation_checksum    CHECKSUM("junction_deviation")
 #define z_junction_deviation_checksum  CHECKSUM("z_junction_deviation")
 #define minimum_planner_speed_checksum CHECKSUM("minimum_planner_speed")
+#define jerk_checksum                  CHECKSUM("jerk")
 
 // The Planner does the acceleration math for the queue of Blocks ( movements ).
 // It makes sure the speed stays within the configured constraints ( acceleration, junction_deviation, etc )
@@ -45,13 +46,14 @@ void Planner::config_load()
     this->junction_deviation = THEKERNEL->config->value(junction_deviation_checksum)->by_default(0.05F)->as_number();
     this->z_junction_deviation = THEKERNEL->config->value(z_junction_deviation_checksum)->by_default(NAN)->as_number(); // disabled by default
     this->minimum_planner_speed = THEKERNEL->config->value(minimum_planner_speed_checksum)->by_default(0.0f)->as_number();
+    this->jerk = THEKERNEL->config->value(jerk_checksum)->by_default(0.0f)->as_number(); // 0 is a plain trapezoid
 }
 
 
 // Append a block to the queue, compute it's speed factors
-// 2024
-bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float s_value, bool g123, unsigned int _line)
-// bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float *s_values, int s_count, bool g123, unsigned int _line)
+// For an arc, unit_vec is the direction it starts off in and the arc describes the path to the target
+// The laser intensities in s_values are spread evenly along the move
+bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, const float *s_values, uint8_t s_count, bool g123, unsigned int _line, const Block::arc_t *arc)
 {
     // Create ( recycle ) a new block
     Block* block = THECONVEYOR->queue.head_ref();
@@ -60,12 +62,6 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     // Direction bits
     bool has_steps = false;
 
-    // 2024
-    /*
-    int bigaxis = 0;
-    int32_t bigsteps = 0;
-    */
-
     for (size_t i = 0; i < n_motors; i++) {
         int32_t steps = THEROBOT->actuators[i]->steps_to_target(actuator_pos[i]);
         // Update current position
@@ -78,44 +74,29 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
         block->direction_bits[i] = (steps < 0) ? 1 : 0;
         // save actual steps in block
         block->steps[i] = labs(steps);
-
-        // 2024
-        /*
-        if( labs(steps) > bigsteps ) {
-			bigaxis = i;
-			bigsteps = labs(steps);
-		}*/
     }
 
-    // sometimes even though there is a detectable movement it turns out there are no steps to be had from such a small move
-    if (!has_steps) {
+    // sometimes even though there is a detectable movement it turns out there are no steps to be had from such a small move,
+    // a full circle ends where it started though
+    if (!has_steps && arc == nullptr) {
         block->clear();
         // we still return true so the tiny move will still be accumulated and eventually create steps
         return true;
     }
 
     // info needed by laser
-    // 2024
-    block->s_value = roundf(s_value*(1<<11)); // 1.11 fixed point
+    block->s_count = std::min(s_count, Block::max_s_values);
+    for (size_t i = 0; i < block->s_count; i++) {
+        block->s_values[i] = std::min(std::max(roundf(s_values[i] * (1<<11)), 0.0F), 4095.0F); // 1.11 fixed point
+    }
     block->is_g123 = g123;
 
-    /*
-	block->move_axis = bigaxis;
-	block->s_count = s_count;
-	for( int i = 0; i < s_count; i++ ) {
-		block->s_values[i] = roundf(s_values[i] * (1<<11)); // 1.11 fixed point
-	}
-	block->s_value = block->s_values[0];
-
-	block->is_g123 = g123;
-	*/
-
     // use default JD
     float junction_deviation = this->junction_deviation;
 
     // use either regular junction deviation or z specific and see if a primary axis move
     block->primary_axis = true;
-    if(block->steps[ALPHA_STEPPER] == 0 && block->steps[BETA_STEPPER] == 0) {
+    if(arc == nullptr && block->steps[ALPHA_STEPPER] == 0 && block->steps[BETA_STEPPER] == 0) {
         if(block->steps[GAMMA_STEPPER] != 0) {
             // z only move
             if(!isnan(this->z_junction_deviation)) junction_deviation = this->z_junction_deviation;
@@ -136,11 +117,22 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     }
 
     block->acceleration = acceleration; // save in block
+    block->jerk = this->jerk;
 
     // Max number of steps, for all axes
     auto mi = std::max_element(block->steps.begin(), block->steps.end());
     block->steps_event_count = *mi;
 
+    if(arc != nullptr) {
+        // The step ticker walks the profile along the arc and steps each motor to the point it has got to, so there
+        // have to be enough step events for the finest motor to take a step for every one of them along the path
+        float steps_per_mm = std::max(THEROBOT->actuators[arc->axis[0]]->get_steps_per_mm(), THEROBOT->actuators[arc->axis[1]]->get_steps_per_mm());
+        if(arc->linear != 0) steps_per_mm = std::max(steps_per_mm, THEROBOT->actuators[arc->axis[2]]->get_steps_per_mm());
+        block->steps_event_count = std::max(block->steps_event_count, (uint32_t)ceilf(distance * steps_per_mm));
+        block->arc = *arc;
+        block->is_arc = true;
+    }
+
     block->millimeters = distance;
 
     // Calculate speed in mm/sec for each axis. No divide by zero due to previous checks.
@@ -203,7 +195,7 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     block->max_entry_speed = vmax_junction;
 
     // Initialize block entry speed. Compute based on deceleration to user-defined minimum_planner_speed.
-    float v_allowable = max_allowable_speed(-acceleration, minimum_planner_speed, block->millimeters);
+    float v_allowable = block->max_allowable_speed(-acceleration, minimum_planner_speed, block->millimeters);
     block->entry_speed = std::min(vmax_junction, v_allowable);
 
     // Initialize planner efficiency flags
@@ -221,14 +213,25 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     block->recalculate_flag = true;
 
     // Update previous path unit_vector and nominal speed
-    if(unit_vec != nullptr) {
+    if(arc != nullptr) {
+        // the next block joins on where the arc ends, its tangent there is square to the radius vector it ends on
+        float c = cosf(arc->angle), s = sinf(arc->angle);
+        float r0 = arc->radius[0] * c - arc->radius[1] * s;
+        float r1 = arc->radius[0] * s + arc->radius[1] * c;
+        previous_unit_vec[arc->axis[0]] = -r1 * arc->angle / distance;
+        previous_unit_vec[arc->axis[1]] = r0 * arc->angle / distance;
+        previous_unit_vec[arc->axis[2]] = arc->linear / distance;
+    } else if(unit_vec != nullptr) {
         memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec)); // previous_unit_vec[] = unit_vec[]
     } else {
         memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
     }
 
     // Math-heavy re-computing of the whole queue to take the new
+    // the step ticker must not take a block while its speeds are part way through being changed
+    THECONVEYOR->planning = true;
     this->recalculate();
+    THECONVEYOR->planning = false;
 
     // The block can now be used
     block->ready();
@@ -244,7 +247,6 @@ void Planner::recalculate()
 
     unsigned int block_index;
 
-    Block* previous;
     Block* current;
 
     /*
@@ -254,9 +256,8 @@ void Planner::recalculate()
      *
      * for each block, walking backwards in the queue:
      *
-     * if max entry speed == current entry speed
-     * then we can set recalculate to false, since clearly adding another block didn't allow us to enter faster
-     * and thus we don't need to check entry speed for this block any more
+     * we stop at the planned block (queue.planned_i) or at one the step ticker already has, as nothing queued
+     * after those can change them or anything before them
      *
      * once we find an accel limited block, we must find the max exit speed and walk the queue forwards
      *
@@ -266,11 +267,16 @@ void Planner::recalculate()
      * we can tell if we're accel or decel limited (or coasting)
      *
      * if prev_exit > max_entry
-     *     then we're still decel limited. update previous trapezoid with our max entry for prev exit
+     *     then we're still decel limited
      * if max_entry >= prev_exit
-     *     then we're accel limited. set recalculate to false, work out max exit speed
+     *     then we're accel limited (or at max entry speed). set recalculate to false, work out max exit speed
      *
-     * finally, work out trapezoid for the final (and newest) block.
+     * a block with recalculate false is optimal, it becomes the planned block so later passes stop there (like Grbl's
+     * planned pointer).
+     *
+     * only the speeds are planned here, the trapezoid of a block is worked out once when the step ticker takes it
+     * (Conveyor::get_next_block) as its entry and exit speeds are final then. So a deep queue of short segments that
+     * are all decel limited costs a cheap forward and reverse pass per new block rather than a trapezoid for each.
      */
 
     /*
@@ -284,18 +290,17 @@ void Planner::recalculate()
     current     = queue.item_ref(block_index);
 
     if (!queue.is_empty()) {
-        while ((block_index != queue.tail_i) && current->recalculate_flag) {
+        do {
             entry_speed = current->reverse_pass(entry_speed);
 
             block_index = queue.prev(block_index);
             current     = queue.item_ref(block_index);
-        }
+        } while (block_index != queue.tail_i && block_index != queue.planned_i && !current->is_ticking);
 
         /*
          * Step 2:
-         * now current points to either tail or first non-recalculate block
+         * now current points to either tail, the planned block or one being ticked
          * and has not had its reverse_pass called
-         * or its calculate_trapezoid
          * entry_speed is set to the *exit* speed of current.
          * each block from current to head has its entry speed set to its max entry speed- limited by decel or nominal_rate
          */
@@ -303,7 +308,6 @@ void Planner::recalculate()
         float exit_speed = current->max_exit_speed();
 
         while (block_index != queue.head_i) {
-            previous    = current;
             block_index = queue.next(block_index);
             current     = queue.item_ref(block_index);
 
@@ -311,18 +315,9 @@ void Planner::recalculate()
             // so this block can decide if it's accel or decel limited and update its fields as appropriate
             exit_speed = current->forward_pass(exit_speed);
 
-            previous->calculate_trapezoid(previous->entry_speed, current->entry_speed);
+            if (!current->recalculate_flag) queue.planned_i = block_index;
         }
     }
-
-    /*
-     * Step 3:
-     * work out trapezoid for final (and newest) block
-     */
-
-    // now current points to the head item
-    // which has not had calculate_trapezoid run yet
-    current->calculate_trapezoid(current->entry_speed, minimum_planner_speed);
 }
 
 
@@ -9,26 +9,26 @@
 #define PLANNER_H
 
 #include "ActuatorCoordinates.h"
-class Block;
+#include "Block.h"
 
 class Planner
 {
 public:
     Planner();
     float max_allowable_speed( float acceleration, float target_velocity, float distance);
+    float get_minimum_planner_speed() const { return minimum_planner_speed; }
 
-    friend class Robot; // for acceleration, junction deviation, minimum_planner_speed
+    friend class Robot; // for acceleration, junction deviation, minimum_planner_speed, jerk
 
 private:
-    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float s_value, bool g123, unsigned int _line);
-    // 2024
-    // bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float *s_values, int s_count, bool g123, unsigned int _line);
+    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, const float *s_values, uint8_t s_count, bool g123, unsigned int _line, const Block::arc_t *arc= nullptr);
     void recalculate();
     void config_load();
     float previous_unit_vec[N_PRIMARY_AXIS];
     float junction_deviation;    // Setting
     float z_junction_deviation;  // Setting
     float minimum_planner_speed; // Setting
+    float jerk;                  // Setting, mm/s³ for S-curve acceleration, 0 to disable
 };
 
 
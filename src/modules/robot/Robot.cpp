@@ -49,6 +49,7 @@
 #define  mm_per_arc_segment_checksum         CHECKSUM("mm_per_arc_segment")
 #define  mm_max_arc_error_checksum           CHECKSUM("mm_max_arc_error")
 #define  arc_correction_checksum             CHECKSUM("arc_correction")
+#define  arc_blocks_enable_checksum          CHECKSUM("arc_blocks_enable")
 #define  x_axis_max_speed_checksum           CHECKSUM("x_axis_max_speed")
 #define  y_axis_max_speed_checksum           CHECKSUM("y_axis_max_speed")
 #define  z_axis_max_speed_checksum           CHECKSUM("z_axis_max_speed")
@@ -141,6 +142,7 @@ Robot::Robot()
     this->n_motors= 0;
     memset(this->sin_r, 0, sizeof sin_r);
     memset(this->r, 0, sizeof r);
+    this->spline_end_offset[0] = this->spline_end_offset[1] = NAN;
 }
 
 //Called when the module has just been loaded
@@ -201,6 +203,7 @@ void Robot::load_config()
     // Here we read the config to find out which arm solution to use
     if (this->arm_solution) delete this->arm_solution;
     int solution_checksum = get_checksum(THEKERNEL->config->value(arm_solution_checksum)->by_default("cartesian")->as_string());
+    bool cartesian = false;
     // Note checksums are not const expressions when in debug mode, so don't use switch
     if(solution_checksum == hbot_checksum || solution_checksum == corexy_checksum) {
         this->arm_solution = new HBotSolution(THEKERNEL->config);
@@ -222,9 +225,11 @@ void Robot::load_config()
 
     } else if(solution_checksum == cartesian_checksum) {
         this->arm_solution = new CartesianSolution(THEKERNEL->config);
+        cartesian = true;
 
     } else {
         this->arm_solution = new CartesianSolution(THEKERNEL->config);
+        cartesian = true;
     }
 
     this->feed_rate           = THEKERNEL->config->value(default_feed_rate_checksum   )->by_default( 1000.0F)->as_number();
@@ -234,6 +239,8 @@ void Robot::load_config()
     this->mm_per_arc_segment  = THEKERNEL->config->value(mm_per_arc_segment_checksum  )->by_default(    0.0f)->as_number();
     this->mm_max_arc_error    = THEKERNEL->config->value(mm_max_arc_error_checksum    )->by_default(   0.002f)->as_number();
     this->arc_correction      = THEKERNEL->config->value(arc_correction_checksum      )->by_default(    5   )->as_number();
+    // the step ticker can only follow an arc itself when the motors move along the axes
+    this->arc_blocks          = THEKERNEL->config->value(arc_blocks_enable_checksum   )->by_default(false)->as_bool() && cartesian;
 
     // in mm/sec but specified in config as mm/min
     this->max_speeds[X_AXIS]  = THEKERNEL->config->value(x_axis_max_speed_checksum    )->by_default(4000.0F)->as_number() / 60.0F;
@@ -261,12 +268,8 @@ void Robot::load_config()
     // default s value for laser
     this->s_value = THEKERNEL->config->value(laser_module_default_power_checksum)->by_default(1.0F)->as_number()
     					* THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number();
-
-    // 2024
-    /*
-	this->s_values[0] = this->s_value;
-	this->s_count = 1;
-	*/
+    this->s_values[0] = this->s_value;
+    this->s_count = 1;
 
 	this->laser_module_offset_x = THEKERNEL->config->value(laser_module_offset_x_checksum)->by_default(-38.0f)->as_number() ;
 	this->laser_module_offset_y = THEKERNEL->config->value(laser_module_offset_y_checksum)->by_default(5.0f)->as_number() ;
@@ -604,6 +607,7 @@ void Robot::on_gcode_received(void *argument)
             case 1:  motion_mode = LINEAR;  break;
             case 2:  motion_mode = CW_ARC;  break;
             case 3:  motion_mode = CCW_ARC; break;
+            case 5:  motion_mode = gcode->subcode == 1 ? QUADRATIC_SPLINE : CUBIC_SPLINE; break;
             case 4: { // G4 Dwell
                 uint32_t delay_ms = 0;
                 if (gcode->has_letter('P')) {
@@ -1046,7 +1050,7 @@ void Robot::on_gcode_received(void *argument)
                 }
                 break;
 
-            case 205: // M205 Xnnn - set junction deviation, Z - set Z junction deviation, Snnn - Set minimum planner speed
+            case 205: // M205 Xnnn - set junction deviation, Z - set Z junction deviation, Snnn - Set minimum planner speed, Jnnn - set jerk
                 if (gcode->has_letter('X')) {
                     float jd = gcode->get_value('X');
                     // enforce minimum
@@ -1068,6 +1072,13 @@ void Robot::on_gcode_received(void *argument)
                         mps = 0.0F;
                     THEKERNEL->planner->minimum_planner_speed = mps;
                 }
+                if (gcode->has_letter('J')) {
+                    float j = gcode->get_value('J');
+                    // 0 goes back to trapezoidal acceleration
+                    if (j < 0.0F)
+                        j = 0.0F;
+                    THEKERNEL->planner->jerk = j;
+                }
                 break;
 
             case 211: // M211 Sn turns soft endstops on/off
@@ -1132,7 +1143,7 @@ void Robot::on_gcode_received(void *argument)
                 }
                 gcode->stream->printf("\n");
 
-                gcode->stream->printf(";X- Junction Deviation, Z- Z junction deviation, S - Minimum Planner speed mm/sec:\nM205 X%1.5f Z%1.5f S%1.5f\n", THEKERNEL->planner->junction_deviation, isnan(THEKERNEL->planner->z_junction_deviation)?-1:THEKERNEL->planner->z_junction_deviation, THEKERNEL->planner->minimum_planner_speed);
+                gcode->stream->printf(";X- Junction Deviation, Z- Z junction deviation, S - Minimum Planner speed mm/sec, J - Jerk mm/sec³:\nM205 X%1.5f Z%1.5f S%1.5f J%1.5f\n", THEKERNEL->planner->junction_deviation, isnan(THEKERNEL->planner->z_junction_deviation)?-1:THEKERNEL->planner->z_junction_deviation, THEKERNEL->planner->minimum_planner_speed, THEKERNEL->planner->jerk);
 
                 gcode->stream->printf(";Max cartesian feedrates in mm/sec:\nM203 X%1.5f Y%1.5f Z%1.5f S%1.5f\n", this->max_speeds[X_AXIS], this->max_speeds[Y_AXIS], this->max_speeds[Z_AXIS], this->max_speed);
 
@@ -1439,74 +1450,28 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
         return;
     }
 
+    // S is modal When specified on a G0/1/2/3 command, a G1 can also carry several spread evenly along it, S1:0:0.5:0.75
+    s_count = 1;
     if(gcode->has_letter('S')) {
-    	s_value = gcode->get_value('S');
-    }
-
-    // S is modal When specified on a G0/1/2/3 command
-    if(gcode->has_letter('S')) {
-    	s_value = gcode->get_value('S');
+        char *p;
+        s_values[0] = gcode->get_value('S', &p);
+        while(motion_mode == LINEAR && p != nullptr && *p == ':' && s_count < Block::max_s_values) {
+            char *e;
+            float s = strtof(p + 1, &e);
+            if(e == p + 1) break;
+            s_values[s_count++] = s;
+            p = e;
+        }
+        // the last one carries on
+        s_value = s_values[s_count - 1];
+    } else {
+        s_values[0] = s_value;
     }
 
-    /*
-	s_count = 1;
-	int index = gcode->index_of_letter('S');
-    if (index >= 0) {
-		s_value = gcode->get_value_at_index(index);
-		s_values[0] = s_value;
-
-		index = gcode->index_of_letter(':', index + 1);
-		if(index >= 0) {
-			s_values[1] = gcode->get_value_at_index(index);
-			s_count = 2;
-
-			index = gcode->index_of_letter(':', index+1);
-			if(index >= 0) {
-				s_values[2] = gcode->get_value_at_index(index);
-				s_count = 3;
-
-				index = gcode->index_of_letter(':', index+1);
-				if(index >= 0) {
-					s_values[3] = gcode->get_value_at_index(index);
-					s_count = 4;
-
-					index = gcode->index_of_letter(':', index+1);
-					if(index >= 0) {
-						s_values[4] = gcode->get_value_at_index(index);
-						s_count = 5;
-
-						index = gcode->index_of_letter(':', index+1);
-						if(index >= 0) {
-							s_values[5] = gcode->get_value_at_index(index);
-							s_count = 6;
-
-							index = gcode->index_of_letter(':', index+1);
-							if(index >= 0) {
-								s_values[6] = gcode->get_value_at_index(index);
-								s_count = 7;
-
-								index = gcode->index_of_letter(':', index+1);
-								if(index >= 0) {
-									s_values[7] = gcode->get_value_at_index(index);
-									s_count = 8;
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-	}*/
-
     // fill
     arc_target_unrotated[A_AXIS] = target[A_AXIS];
     arc_target_unrotated[B_AXIS] = target[B_AXIS];
 
-    // S is modal When specified on a G0/1/2/3 command
-    // if(gcode->has_letter('S')) {
-    //	s_value = gcode->get_value('S');
-    //}
-
     bool moved= false;
 
     // Perform any physical actions
@@ -1532,6 +1497,21 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
             // Note arcs are not currently supported by extruder based machines, as 3D slicers do not use arcs (G2/G3)
             moved = this->compute_arc(gcode, offset, arc_target_unrotated, target, motion_mode);
             break;
+
+        case CUBIC_SPLINE:
+        case QUADRATIC_SPLINE:
+            {
+                float end_offset[2]{NAN, NAN};
+                if(gcode->has_letter('P')) end_offset[0] = this->to_millimeters(gcode->get_value('P'));
+                if(gcode->has_letter('Q')) end_offset[1] = this->to_millimeters(gcode->get_value('Q'));
+                moved = this->compute_spline(gcode, offset, end_offset, target, motion_mode);
+            }
+            break;
+    }
+
+    // only a G5 straight after another G5 can leave out I and J
+    if(motion_mode != CUBIC_SPLINE || !moved) {
+        spline_end_offset[0] = spline_end_offset[1] = NAN;
     }
 
     // needed to act as start of next arc command
@@ -1921,9 +1901,7 @@ bool Robot::append_milestone(const float target[], float feed_rate, unsigned int
     // Append the block to the planner
     // NOTE that distance here should be either the distance travelled by the XYZ axis, or the E mm travel if a solo E move
     // NOTE this call will bock until there is room in the block queue, on_idle will continue to be called
-    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_value, is_g123, line)) {
-// 2024
-//    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_values, s_count, is_g123, line)) {
+    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_values, s_count, is_g123, line)) {
         // this is the new compensated machine position
         memcpy(this->compensated_machine_position, transformed_target, n_motors * sizeof(float));
         return true;
@@ -1966,6 +1944,70 @@ bool Robot::delta_move(const float *delta, float rate_mm_s, uint8_t naxis)
     return moved;
 }
 
+// Queues a laser scanline from the current position, count pixels each moving pixel in X and Y of the WCS
+// and burning at its own S value, a block per up to Block::max_s_values pixels
+bool Robot::append_raster(const float pixel[2], float feed_rate, const float s[], uint16_t count, unsigned int line)
+{
+    if(THEKERNEL->is_halted() || feed_rate <= 0.0F || count == 0) return false;
+
+    // the WCS rotation applies as it does to a relative G1
+    float step[3] = {pixel[X_AXIS], pixel[Y_AXIS], 0};
+    rotate(step);
+
+    // blocks are kept within mm_per_line_segment like a segmented line, so bed compensation still follows them
+    uint16_t per_block = Block::max_s_values;
+    float pitch = sqrtf(powf(step[X_AXIS], 2) + powf(step[Y_AXIS], 2));
+    if(!this->disable_segmentation && this->mm_per_line_segment > 0.0F && pitch * per_block > this->mm_per_line_segment) {
+        per_block = max(1.0F, floorf(this->mm_per_line_segment / pitch));
+    }
+
+    float start[n_motors];
+    float target[n_motors];
+    memcpy(start, machine_position, n_motors*sizeof(float));
+    memcpy(target, machine_position, n_motors*sizeof(float));
+
+    bool saved_g123 = this->is_g123;
+    bool saved_itm = this->inverse_time_mode;
+    this->is_g123 = true;
+    this->inverse_time_mode = false; // force G94 since the feed rate is in mm/min
+
+    bool moved = false;
+    for (uint16_t i = 0; i < count && !THEKERNEL->is_halted(); ) {
+        uint16_t n = std::min<uint16_t>(per_block, count - i);
+        memcpy(s_values, &s[i], n*sizeof(float));
+        s_count = n;
+        i += n;
+
+        // from the start each time so the pixels do not drift over a long scanline
+        target[X_AXIS] = start[X_AXIS] + step[X_AXIS] * i;
+        target[Y_AXIS] = start[Y_AXIS] + step[Y_AXIS] * i;
+
+        // this can block waiting for free block queue or if in feed hold
+        if(append_milestone(target, feed_rate, line)) {
+            memcpy(machine_position, target, n_motors*sizeof(float));
+            moved = true;
+        }
+    }
+
+    // back to the modal S value for whatever is played next
+    s_values[0] = s_value;
+    s_count = 1;
+    this->is_g123 = saved_g123;
+    this->inverse_time_mode = saved_itm;
+
+    return moved;
+}
+
+// Sets s_values to the laser intensities over the given segment of a line, as many as the whole line has
+// so each stays about the same length, taking the one the middle of each falls on
+void Robot::segment_s_values(const float line_s_values[], uint16_t segment, uint16_t segments)
+{
+    for (uint8_t i = 0; i < s_count; i++) {
+        uint32_t n = (2 * (segment * s_count + i) + 1) / (2 * segments);
+        s_values[i] = line_s_values[std::min<uint32_t>(n, s_count - 1)];
+    }
+}
+
 // Append a move to the queue ( cutting it into segments if needed )
 bool Robot::append_line(Gcode *gcode, const float target[], float feed_rate, float delta_e)
 {
@@ -2045,6 +2087,10 @@ bool Robot::append_line(Gcode *gcode, const float target[], float feed_rate, flo
         for (int i = 0; i < n_motors; i++)
             segment_delta[i] = (target[i] - machine_position[i]) / segments;
 
+        // each segment gets the laser intensities along its own part of the line
+        float line_s_values[Block::max_s_values];
+        memcpy(line_s_values, s_values, s_count * sizeof(float));
+
         // segment 0 is already done - it's the end point of the previous move so we start at segment 1
         // We always add another point after this loop so we stop at segments-1, ie i < segments
         for (int i = 1; i < segments; i++) {
@@ -2054,9 +2100,11 @@ bool Robot::append_line(Gcode *gcode, const float target[], float feed_rate, flo
 
             // Append the end of this segment to the queue
             // this can block waiting for free block queue or if in feed hold
+            segment_s_values(line_s_values, i - 1, segments);
             bool b= this->append_milestone(segment_end, feed_rate, gcode->line);
             moved= moved || b;
         }
+        segment_s_values(line_s_values, segments - 1, segments);
     }
 
     // Append the end of this full move to the queue
@@ -2134,24 +2182,27 @@ bool Robot::append_arc(Gcode * gcode, const float target[], const float rotated_
     }
 
     // limit segments by maximum arc error
-    float arc_segment = this->mm_per_arc_segment;
-    if ((this->mm_max_arc_error > 0) && (2 * radius > this->mm_max_arc_error)) {
-        float min_err_segment = 2 * sqrtf((this->mm_max_arc_error * (2 * radius - this->mm_max_arc_error)));
-        if (this->mm_per_arc_segment < min_err_segment) {
-            arc_segment = min_err_segment;
-        }
-    }
-
-    // catch fall through on above
-    if(arc_segment < 0.0001F) {
-        arc_segment= 0.5F; /// the old default, so we avoid the divide by zero
-    }
+    float arc_segment = arc_segment_length(radius);
 
     // Figure out how many segments for this gcode
     // TODO for deltas we need to make sure we are at least as many segments as requested, also if mm_per_line_segment is set we need to use the
     uint16_t segments = floorf(millimeters_of_travel / arc_segment);
     bool moved= false;
 
+    if(segments > 1 && can_append_arc_block(rotated_target, arc_center, radius)) {
+        // the start vector turns with the wcs rotation like the rest of the arc
+        rotate(&arc_start_vector[0], &arc_start_vector[1], &arc_start_vector[2]);
+        Block::arc_t arc;
+        arc.radius[0] = arc_start_vector[this->plane_axis_0];
+        arc.radius[1] = arc_start_vector[this->plane_axis_1];
+        arc.angle = angular_travel;
+        arc.linear = linear_vector[this->plane_axis_2];
+        arc.axis[0] = this->plane_axis_0;
+        arc.axis[1] = this->plane_axis_1;
+        arc.axis[2] = this->plane_axis_2;
+        return append_arc_block(rotated_target, arc, radius, millimeters_of_travel, gcode->line);
+    }
+
     // Note: for arcs, we handle the G93 transform here rather than in append_milestone
     // because we divide time by segment count, not by linear distance.
     // The rate_mm_s passed to append_milestone is already in mm/min.
@@ -2250,6 +2301,103 @@ bool Robot::append_arc(Gcode * gcode, const float target[], const float rotated_
     return moved;
 }
 
+// Arcs go to the planner as one block when the step ticker can follow them, which needs a cartesian machine with nothing
+// but the arc moving and nothing bending its path. Anything else is cut into segments, as are arcs that could cross a
+// soft endstop so they get reported the same way as lines.
+bool Robot::can_append_arc_block(const float target[], const float center[], float radius) const
+{
+    if(!this->arc_blocks || this->disable_arm_solution || compensationTransform) return false;
+
+    // the wcs rotation is about Z so it tilts arcs in the other planes
+    if(this->plane_axis_2 != Z_AXIS && sin_r[current_wcs] != 0) return false;
+
+    // The block is stepped from wherever the machine is and the last chord goes to the target, so the arc has to start
+    // there and end on its circle. The segments cope better with bad arcs, or a start that was never moved to.
+    const float tolerance = 0.005F;
+    uint8_t a0 = this->plane_axis_0, a1 = this->plane_axis_1;
+    if(fabsf(machine_position[a0] - arc_milestone[a0]) > tolerance || fabsf(machine_position[a1] - arc_milestone[a1]) > tolerance) return false;
+    if(fabsf(hypotf(target[a0] - center[a0], target[a1] - center[a1]) - radius) > tolerance) return false;
+
+    for (size_t i = A_AXIS; i < n_motors; i++) {
+        if(fabsf(target[i] - machine_position[i]) >= 0.00001F) return false;
+    }
+
+    if(soft_endstop_enabled && !THEKERNEL->is_zprobing()) {
+        for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+            if(!is_homed(i)) continue;
+            // the whole circle rather than the arc, it is only there to keep the segments for the rare arcs near the edge
+            float low = i == this->plane_axis_2 ? std::min(machine_position[i], target[i]) : center[i] - radius;
+            float high = i == this->plane_axis_2 ? std::max(machine_position[i], target[i]) : center[i] + radius;
+            if((!isnan(soft_endstop_min[i]) && low < soft_endstop_min[i]) || (!isnan(soft_endstop_max[i]) && high > soft_endstop_max[i])) return false;
+        }
+    }
+
+    return true;
+}
+
+// Append an arc to the planner as one block, the step ticker steps it as short chords as it goes.
+// The speed limits of the plane axes apply wherever the tangent lines up with them, and the speed in the plane is kept
+// down to where the centripetal acceleration stays within the acceleration.
+bool Robot::append_arc_block(const float target[], const Block::arc_t &arc, float radius, float millimeters, unsigned int line)
+{
+    float feed_rate = this->feed_rate;
+    if (this->inverse_time_mode) {
+        // in G93 the whole arc takes 1/F minutes
+        feed_rate *= millimeters;
+    }
+    float rate_mm_s = feed_rate / seconds_per_minute;
+    float acceleration = default_acceleration;
+
+    // fraction of the speed along the path that is in the plane, and along the third axis for a helix
+    float planar = fabsf(arc.angle) * radius / millimeters;
+    float linear = fabsf(arc.linear) / millimeters;
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t a = arc.axis[i];
+        float share = i < 2 ? planar : linear;
+        if(share < 0.00001F) continue;
+
+        if(max_speeds[a] > 0 && rate_mm_s * share > max_speeds[a]) rate_mm_s = max_speeds[a] / share;
+        if(rate_mm_s * share > actuators[a]->get_max_rate()) rate_mm_s = actuators[a]->get_max_rate() / share;
+
+        float ma = actuators[a]->get_acceleration(); // if axis does not have acceleration set then it uses the default_acceleration
+        if(!isnan(ma) && acceleration * share > ma) acceleration = ma / share;
+    }
+
+    if(this->max_speed > 0 && rate_mm_s > this->max_speed) rate_mm_s = this->max_speed;
+
+    // v²/r <= a
+    float centripetal_speed = sqrtf(acceleration * radius);
+    if(rate_mm_s * planar > centripetal_speed) rate_mm_s = centripetal_speed / planar;
+
+    // the direction the arc starts off in, for the junction with the previous block
+    float unit_vec[N_PRIMARY_AXIS]{0};
+    unit_vec[arc.axis[0]] = -arc.radius[1] * arc.angle / millimeters;
+    unit_vec[arc.axis[1]] = arc.radius[0] * arc.angle / millimeters;
+    unit_vec[arc.axis[2]] = arc.linear / millimeters;
+
+    ActuatorCoordinates actuator_pos;
+    arm_solution->cartesian_to_actuator(target, actuator_pos);
+    for (size_t i = A_AXIS; i < n_motors; i++) {
+        actuator_pos[i] = actuators[i]->get_last_milestone(); // nothing else moves
+    }
+
+    // if we are in feed hold wait here until it is released
+    while(THEKERNEL->get_feed_hold()) {
+        THEKERNEL->call_event(ON_IDLE, this);
+        // if we also got a HALT then break out of this
+        if(THEKERNEL->is_halted()) return false;
+    }
+
+    if(THEKERNEL->planner->append_block(actuator_pos, n_motors, rate_mm_s, millimeters, unit_vec, acceleration, s_values, s_count, is_g123, line, &arc)) {
+        // there is no compensation transform so this is the new compensated machine position
+        memcpy(this->compensated_machine_position, target, n_motors * sizeof(float));
+        return true;
+    }
+
+    return false;
+}
+
 // Do the math for an arc and add it to the queue
 bool Robot::compute_arc(Gcode * gcode, const float offset[], const float target[], const float rotated_target[], enum MOTION_MODE_T motion_mode)
 {
@@ -2267,6 +2415,188 @@ bool Robot::compute_arc(Gcode * gcode, const float offset[], const float target[
     return this->append_arc(gcode, target, rotated_target, offset, radius, is_clockwise );
 }
 
+// the length of segment that keeps within mm_max_arc_error of an arc of this radius, or mm_per_arc_segment if that is longer
+float Robot::arc_segment_length(float radius) const
+{
+    float arc_segment = this->mm_per_arc_segment;
+    if ((this->mm_max_arc_error > 0) && (2 * radius > this->mm_max_arc_error)) {
+        float min_err_segment = 2 * sqrtf((this->mm_max_arc_error * (2 * radius - this->mm_max_arc_error)));
+        if (this->mm_per_arc_segment < min_err_segment) {
+            arc_segment = min_err_segment;
+        }
+    }
+
+    // catch fall through on above
+    if(arc_segment < 0.0001F) {
+        arc_segment= 0.5F; /// the old default, so we avoid the divide by zero
+    }
+    return arc_segment;
+}
+
+// G5 is a cubic bezier from the current position to the target, I J is the first control point from the start and
+// P Q the second control point from the end. When I J are left out the first control point mirrors the second one of
+// the previous G5 so the two join smoothly. G5.1 is a quadratic with its one control point at I J from the start.
+bool Robot::compute_spline(Gcode * gcode, const float offset[], const float end_offset[], const float target[], enum MOTION_MODE_T motion_mode)
+{
+    if(this->plane_axis_2 != Z_AXIS) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= "G5 and G5.1 only work in the XY plane (G17)";
+        return false;
+    }
+
+    bool has_ij= gcode->has_letter('I') || gcode->has_letter('J');
+    float start_offset[3]{offset[X_AXIS], offset[Y_AXIS], 0};
+    float last_offset[3]{end_offset[0], end_offset[1], 0};
+
+    if(motion_mode == QUADRATIC_SPLINE) {
+        if(!has_ij) {
+            gcode->is_error= true;
+            gcode->txt_after_ok= "G5.1 needs I or J";
+            return false;
+        }
+        rotate(&start_offset[0], &start_offset[1], &start_offset[2]);
+
+    } else {
+        if(isnan(last_offset[0]) || isnan(last_offset[1])) {
+            gcode->is_error= true;
+            gcode->txt_after_ok= "G5 needs P and Q";
+            return false;
+        }
+        // the offsets are in the wcs so turn them with it like arc centers
+        rotate(&last_offset[0], &last_offset[1], &last_offset[2]);
+        if(has_ij) {
+            rotate(&start_offset[0], &start_offset[1], &start_offset[2]);
+        } else if(!isnan(spline_end_offset[0])) {
+            start_offset[0] = -spline_end_offset[0];
+            start_offset[1] = -spline_end_offset[1];
+        } else {
+            gcode->is_error= true;
+            gcode->txt_after_ok= "G5 needs I and J unless it follows another G5";
+            return false;
+        }
+    }
+
+    float control_1[2], control_2[2];
+    if(motion_mode == QUADRATIC_SPLINE) {
+        // raise it to the cubic it is equal to
+        for (int i = X_AXIS; i <= Y_AXIS; i++) {
+            float control = machine_position[i] + start_offset[i];
+            control_1[i] = machine_position[i] + 2.0F / 3.0F * (control - machine_position[i]);
+            control_2[i] = target[i] + 2.0F / 3.0F * (control - target[i]);
+        }
+    } else {
+        for (int i = X_AXIS; i <= Y_AXIS; i++) {
+            control_1[i] = machine_position[i] + start_offset[i];
+            control_2[i] = target[i] + last_offset[i];
+        }
+    }
+
+    bool moved= append_spline(gcode, target, control_1, control_2);
+    if(moved && motion_mode == CUBIC_SPLINE) {
+        spline_end_offset[0] = last_offset[0];
+        spline_end_offset[1] = last_offset[1];
+    }
+    return moved;
+}
+
+// Returns how far along the bezier the next segment can go, which is as far as a chord stays within the arc error of
+// the bend at either end of it, and the tightest radius of curvature it found.
+float Robot::spline_step(const float coefficients[3][2], float t, float &radius) const
+{
+    const float (&a)[2] = coefficients[0], (&b)[2] = coefficients[1], (&c)[2] = coefficients[2];
+    float dt = 0;
+    radius = INFINITY;
+
+    // once at the start of the segment and once half way along it, so a tighter bend further on is not stepped over
+    float u = t;
+    for (int pass = 0; pass < 2; pass++) {
+        float d1x = (3 * a[0] * u + 2 * b[0]) * u + c[0], d1y = (3 * a[1] * u + 2 * b[1]) * u + c[1];
+        float d2x = 6 * a[0] * u + 2 * b[0], d2y = 6 * a[1] * u + 2 * b[1];
+        float speed = hypotf(d1x, d1y);
+        float cross = fabsf(d1x * d2y - d1y * d2x);
+        float r = cross > 0 ? speed * speed * speed / cross : INFINITY;
+        if(r < radius) radius = r;
+
+        // a cusp has no speed, so let the curvature of the other end set the step
+        float step = speed > 0 ? arc_segment_length(radius) / speed : 1.0F;
+        if(pass == 0 || step < dt) dt = step;
+        u = std::min(t + dt / 2, 1.0F);
+    }
+
+    // keep the number of segments finite however bad the spline is
+    return std::min(t + std::max(dt, 0.0001F), 1.0F);
+}
+
+// Cuts a cubic bezier in XY into lines that keep within mm_max_arc_error of it, the other axis just move linearly with
+// it. Each line is slowed to what the acceleration allows around the bend it cuts.
+bool Robot::append_spline(Gcode * gcode, const float target[], const float control_1[], const float control_2[])
+{
+    // catch negative or zero feed rates and return the same error as GRBL does
+    if(this->feed_rate <= 0.0F) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= (this->feed_rate == 0 ? "Undefined feed rate" : "feed rate < 0");
+        THEKERNEL->streams->printf(this->feed_rate == 0 ? "Alarm:Undefined feed rate\n" : "Alarm:feed rate < 0\n");
+        return false;
+    }
+
+    // B(t) = ((a * t + b) * t + c) * t + start
+    float coefficients[3][2];
+    for (int i = X_AXIS; i <= Y_AXIS; i++) {
+        coefficients[2][i] = 3 * (control_1[i] - machine_position[i]);
+        coefficients[1][i] = 3 * (control_2[i] - 2 * control_1[i] + machine_position[i]);
+        coefficients[0][i] = target[i] - machine_position[i] - coefficients[2][i] - coefficients[1][i];
+    }
+
+    float radius;
+    float feed_rate = this->feed_rate;
+    if (this->inverse_time_mode) {
+        // the segments are not all the same length, so G93 is turned into a feed rate for the whole spline
+        float length = 0, x = machine_position[X_AXIS], y = machine_position[Y_AXIS];
+        for (float t = 0; t < 1.0F; ) {
+            t = spline_step(coefficients, t, radius);
+            float nx = ((coefficients[0][X_AXIS] * t + coefficients[1][X_AXIS]) * t + coefficients[2][X_AXIS]) * t + machine_position[X_AXIS];
+            float ny = ((coefficients[0][Y_AXIS] * t + coefficients[1][Y_AXIS]) * t + coefficients[2][Y_AXIS]) * t + machine_position[Y_AXIS];
+            length += hypotf(nx - x, ny - y);
+            x = nx;
+            y = ny;
+        }
+        feed_rate *= hypotf(length, target[Z_AXIS] - machine_position[Z_AXIS]);
+    }
+
+    bool saved_itm = this->inverse_time_mode;
+    this->inverse_time_mode = false;
+
+    float spline_target[n_motors];
+    memcpy(spline_target, machine_position, n_motors*sizeof(float));
+    bool moved= false;
+    for (float t = 0; t < 1.0F; ) {
+        if(THEKERNEL->is_halted()) {
+            // don't queue any more segments
+            this->inverse_time_mode = saved_itm;
+            return false;
+        }
+
+        t = spline_step(coefficients, t, radius);
+        if(t < 1.0F) {
+            for (int i = X_AXIS; i <= Y_AXIS; i++) {
+                spline_target[i] = ((coefficients[0][i] * t + coefficients[1][i]) * t + coefficients[2][i]) * t + machine_position[i];
+            }
+            for (int i = Z_AXIS; i < n_motors; i++) {
+                spline_target[i] = machine_position[i] + t * (target[i] - machine_position[i]);
+            }
+        } else {
+            // Ensure last segment arrives at target location.
+            memcpy(spline_target, target, n_motors*sizeof(float));
+        }
+
+        // the centripetal acceleration around the bend is v²/r
+        float rate = std::min(feed_rate, sqrtf(this->default_acceleration * radius) * seconds_per_minute);
+        if(this->append_milestone(spline_target, rate, gcode->line)) moved= true;
+    }
+
+    this->inverse_time_mode = saved_itm;
+    return moved;
+}
 
 float Robot::theta(float x, float y)
 {
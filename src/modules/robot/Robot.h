@@ -17,6 +17,7 @@ using std::string;
 
 #include "libs/Module.h"
 #include "ActuatorCoordinates.h"
+#include "Block.h"
 #include "nuts_bolts.h"
 #include <fastmath.h>
 
@@ -49,7 +50,7 @@ class Robot : public Module {
         bool get_tool_not_calibrated();
         float get_feed_rate() const;
         float get_s_value() const { return s_value; }
-        void set_s_value(float s) { s_value= s; }
+        void set_s_value(float s) { s_value= s; s_values[0]= s; s_count= 1; }
         float get_max_delta() const { return max_delta; }
         void set_max_delta(float delta) {max_delta = delta; }
         void  push_state();
@@ -67,6 +68,7 @@ class Robot : public Module {
         std::tuple<float, float, float, uint8_t> get_last_probe_position() const { return last_probe_position; }
         void set_last_probe_position(std::tuple<float, float, float, uint8_t> p) { last_probe_position = p; }
         bool delta_move(const float delta[], float rate_mm_s, uint8_t naxis);
+        bool append_raster(const float pixel[2], float feed_rate, const float s[], uint16_t count, unsigned int line);
         void rotate(float pos[]){return rotate(&pos[0], &pos[1], &pos[2]);}
         void rotate(float *x, float *y, float *z);
         void unrotate(float *x, float *y, float *z);
@@ -115,6 +117,7 @@ class Robot : public Module {
             bool is_g123:1;
             bool soft_endstop_enabled:1;
             bool soft_endstop_halt:1;
+            bool arc_blocks:1;                                // queue arcs as one block rather than cutting them into segments
             uint8_t plane_axis_0:2;                           // Current plane ( XY, XZ, YZ )
             uint8_t plane_axis_1:2;
             uint8_t plane_axis_2:2;
@@ -136,14 +139,23 @@ class Robot : public Module {
             SEEK, // G0
             LINEAR, // G1
             CW_ARC, // G2
-            CCW_ARC // G3
+            CCW_ARC, // G3
+            CUBIC_SPLINE, // G5
+            QUADRATIC_SPLINE // G5.1
         };
 
         void load_config();
         bool append_milestone(const float target[], float feed_rate, unsigned int line);
         bool append_line( Gcode* gcode, const float target[], float rate_mm_s, float delta_e);
+        void segment_s_values(const float line_s_values[], uint16_t segment, uint16_t segments);
         bool append_arc( Gcode* gcode, const float target[], const float rotated_target[], const float offset[], float radius, bool is_clockwise );
+        bool can_append_arc_block(const float target[], const float center[], float radius) const;
+        bool append_arc_block(const float target[], const Block::arc_t &arc, float radius, float millimeters, unsigned int line);
         bool compute_arc(Gcode* gcode, const float offset[], const float target[], const float rotated_target[], enum MOTION_MODE_T motion_mode);
+        float arc_segment_length(float radius) const;
+        bool compute_spline(Gcode* gcode, const float offset[], const float end_offset[], const float target[], enum MOTION_MODE_T motion_mode);
+        bool append_spline(Gcode* gcode, const float target[], const float control_1[], const float control_2[]);
+        float spline_step(const float coefficients[3][2], float t, float &radius) const;
         void process_move(Gcode *gcode, enum MOTION_MODE_T);
 
         float theta(float x, float y);
@@ -176,12 +188,10 @@ class Robot : public Module {
         float seconds_per_minute;                            // for realtime speed change
         float default_acceleration;                          // the defualt accleration if not set for each axis
         float s_value;                                       // modal S value
-        // 2024
-        /*
-        float s_values[8];                                   // block S values
-		int   s_count;
-		*/
+        float s_values[Block::max_s_values];                 // S values of the move being queued
+        uint8_t s_count;
         float arc_milestone[3];                              // used as start of an arc command
+        float spline_end_offset[2];                          // second control point of the last G5 from its end, NAN if the last move was not a G5
         float max_delta;
 
         float laser_module_offset_x;
@@ -1398,15 +1398,15 @@ void ATCHandler::on_module_loaded()
 {
 
     this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, atc_handler_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_HALT);
 
     this->on_config_reload(this);
 
-    THEKERNEL->slow_ticker->attach(1000, this, &ATCHandler::read_endstop);
-    THEKERNEL->slow_ticker->attach(1000, this, &ATCHandler::read_detector);
+    endstop_hook= THEKERNEL->slow_ticker->attach(1000, this, &ATCHandler::read_endstop, false);
+    detector_hook= THEKERNEL->slow_ticker->attach(1000, this, &ATCHandler::read_detector, false);
 
     THEKERNEL->slow_ticker->attach(1, this, &ATCHandler::countdown_probe_laser);
     
@@ -1716,6 +1716,7 @@ bool ATCHandler::laser_detect() {
     // move around and check laser detector
     detecting = true;
     detector_info.triggered = false;
+    THEKERNEL->slow_ticker->set_enabled(detector_hook, true);
 
 	float delta[Y_AXIS + 1];
 	for (size_t i = 0; i <= Y_AXIS; i++) delta[i] = 0;
@@ -1739,6 +1740,7 @@ bool ATCHandler::laser_detect() {
 
 
 	detecting = false;
+	THEKERNEL->slow_ticker->set_enabled(detector_hook, false);
 	// switch off detector
 	switch_state = false;
     ok = PublicData::set_value(switch_checksum, detector_switch_checksum, state_checksum, &switch_state);
@@ -1779,6 +1781,7 @@ void ATCHandler::home_clamp()
     atc_home_info.clamp_status = UNHOMED;
     debounce = 0;
     atc_homing = true;
+    THEKERNEL->slow_ticker->set_enabled(endstop_hook, true);
 
     // home atc
 	float delta[ATC_AXIS + 1];
@@ -1790,6 +1793,7 @@ void ATCHandler::home_clamp()
 	if(THEKERNEL->is_halted()) return;
 
 	atc_homing = false;
+	THEKERNEL->slow_ticker->set_enabled(endstop_hook, false);
 
     if (!atc_home_info.triggered) {
         THEKERNEL->set_halt_reason(ATC_HOME_FAIL);
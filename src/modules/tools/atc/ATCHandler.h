@@ -10,6 +10,8 @@ using namespace std;
 #include "Pin.h"
 #include "Gcode.h"
 
+class Hook;
+
 class ATCHandler : public Module
 {
 public:
@@ -140,6 +142,9 @@ private:
     uint16_t debounce;
     bool atc_homing;
     bool detecting;
+    // read_endstop and read_detector, only enabled while homing the clamp or detecting
+    Hook *endstop_hook;
+    Hook *detector_hook;
     bool disable_toolsensor;
 
     bool playing_file;
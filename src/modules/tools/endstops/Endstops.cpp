@@ -29,6 +29,7 @@
 #include "StepTicker.h"
 #include "BaseSolution.h"
 #include "SerialMessage.h"
+#include "InterruptIn.h"
 
 #include <ctype.h>
 #include <algorithm>
@@ -61,6 +62,8 @@ enum DEFNS { MIN_PIN, MAX_PIN, MAX_TRAVEL, FAST_RATE, SLOW_RATE, RETRACT, DIRECT
 
 #define endstop_debounce_count_checksum  CHECKSUM("endstop_debounce_count")
 #define endstop_debounce_ms_checksum     CHECKSUM("endstop_debounce_ms")
+#define endstop_interrupt_homing_checksum CHECKSUM("endstop_interrupt_homing")
+#define endstop_single_pass_homing_checksum CHECKSUM("endstop_single_pass_homing")
 
 #define home_z_first_checksum            CHECKSUM("home_z_first")
 #define homing_order_checksum            CHECKSUM("homing_order")
@@ -132,11 +135,27 @@ void Endstops::on_module_loaded()
     }
 
     register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
-    register_for_event(ON_SET_PUBLIC_DATA);
+    register_for_public_data(ON_GET_PUBLIC_DATA, endstops_checksum);
+    register_for_public_data(ON_SET_PUBLIC_DATA, endstops_checksum);
 
 
-    THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops);
+    endstop_hook= THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops, false);
+
+    if(this->interrupt_homing) {
+        // latch the homing endstops from pin interrupts, any that cannot have one are still polled by read_endstops
+        for(auto& e : homing_axis) {
+            if(e.pin_info == nullptr) continue;
+            Pin &pin= e.pin_info->pin;
+            if(pin.port_number != 0 && pin.port_number != 2) {
+                THEKERNEL->streams->printf("WARNING: %c endstop is not on P0 or P2, it will be polled\n", e.axis);
+                continue;
+            }
+            // the endstop may be NO or NC so check the level on either edge
+            mbed::InterruptIn *interrupt= pin.interrupt_pin();
+            interrupt->rise(this, &Endstops::on_endstop_edge);
+            interrupt->fall(this, &Endstops::on_endstop_edge);
+        }
+    }
 
     // load g28 data from eeprom
 //    this->g28_position[0] = THEKERNEL->eeprom_data->G28[0];
@@ -481,6 +500,9 @@ void Endstops::get_global_configs()
     // NOTE the debounce count is in milliseconds so probably does not need to beset anymore
     this->debounce_ms= THEKERNEL->config->value(endstop_debounce_ms_checksum)->by_default(10)->as_number();
     this->debounce_count= THEKERNEL->config->value(endstop_debounce_count_checksum)->by_default(100)->as_number();
+    this->interrupt_homing= THEKERNEL->config->value(endstop_interrupt_homing_checksum)->by_default(false)->as_bool();
+    // the slow second approach can only be left out when the fast one is latched
+    this->single_pass_homing= this->interrupt_homing && THEKERNEL->config->value(endstop_single_pass_homing_checksum)->by_default(false)->as_bool();
 
     this->is_corexy= THEKERNEL->config->value(corexy_homing_checksum)->by_default(false)->as_bool();
     this->is_delta=  THEKERNEL->config->value(delta_homing_checksum)->by_default(false)->as_bool();
@@ -729,6 +751,21 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
         if(e.pin_info == nullptr) continue; // ignore if not a homing endstop
         int m= e.axis_index;
 
+        if(e.pin_info->latched && this->status != A_LIMITE_CHECK) {
+            // the edge interrupt already stopped the axis, make sure it was not a glitch
+            if(!e.pin_info->triggered) {
+                if(!e.pin_info->pin.get()) {
+                    e.pin_info->latched= false;
+                    e.pin_info->debounce= 0;
+                } else if(e.pin_info->debounce < debounce_ms) {
+                    e.pin_info->debounce++;
+                } else {
+                    e.pin_info->triggered= true;
+                }
+            }
+            continue;
+        }
+
         // for corexy homing in X or Y we must only check the associated endstop, works as we only home one axis at a time for corexy
         if(is_corexy && (m == X_AXIS || m == Y_AXIS) && !axis_to_home[m]) continue;
 
@@ -765,6 +802,55 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
     return 0;
 }
 
+// Called from the pin interrupt of any homing endstop, latches the actuator position and stops the axis before it takes
+// another step, read_endstops debounces it on the following ticks
+void Endstops::on_endstop_edge()
+{
+    if(this->status != MOVING_TO_ENDSTOP_SLOW && this->status != MOVING_TO_ENDSTOP_FAST) return;
+
+    for(auto& e : homing_axis) {
+        if(e.pin_info == nullptr || e.pin_info->latched) continue;
+        int m= e.axis_index;
+
+        // for corexy homing in X or Y we must only check the associated endstop
+        if(is_corexy && (m == X_AXIS || m == Y_AXIS) && !axis_to_home[m]) continue;
+
+        if(!STEPPER[m]->is_moving() || !e.pin_info->pin.get()) continue;
+
+        e.pin_info->latched_steps= (int32_t)STEPPER[m]->get_current_step();
+        e.pin_info->latched= true;
+        if(is_corexy && (m == X_AXIS || m == Y_AXIS)) {
+            STEPPER[X_AXIS]->stop_moving();
+            STEPPER[Y_AXIS]->stop_moving();
+        }else{
+            STEPPER[m]->stop_moving();
+        }
+    }
+}
+
+void Endstops::clear_latches()
+{
+    for(auto& e : endstops) {
+        e->debounce= 0;
+        e->triggered= false;
+        e->latched= false;
+    }
+}
+
+// wait for a move towards the endstops, a latched endstop ends it straight away so also give read_endstops the time to debounce it
+void Endstops::wait_for_endstops()
+{
+    THECONVEYOR->wait_for_idle();
+    if(!this->interrupt_homing) return;
+
+    for(auto& e : homing_axis) {
+        if(e.pin_info == nullptr) continue;
+        while(e.pin_info->latched && !e.pin_info->triggered && !THEKERNEL->is_halted()) {
+            THEKERNEL->call_event(ON_IDLE);
+        }
+    }
+}
+
 void Endstops::home_xy()
 {
     if(axis_to_home[X_AXIS] && axis_to_home[Y_AXIS]) {
@@ -789,7 +875,7 @@ void Endstops::home_xy()
     }
 
     // Wait for axis to have homed
-    THECONVEYOR->wait_for_idle();
+    wait_for_endstops();
 }
 void Endstops::check_4th(char *data)
 {
@@ -801,17 +887,19 @@ void Endstops::check_4th(char *data)
 	{		
 		homing_axis[A_AXIS].pin_info->debounce= 0;
 		homing_axis[A_AXIS].pin_info->triggered = false;
+		homing_axis[A_AXIS].pin_info->latched = false;
 		homing_axis[A_AXIS].pin_info->Nontriggered = false;
 		
 		// Start moving the axes to the origin
     	this->status = MOVING_TO_ENDSTOP_SLOW;
+    	THEKERNEL->slow_ticker->set_enabled(endstop_hook, true);
     	float delta[A_AXIS+1];
 	    for (size_t j = 0; j <= A_AXIS; ++j) delta[j]= 0;
 	    delta[A_AXIS]= 380; // we go the max
 	    
 	    THEROBOT->delta_move(delta, homing_axis[A_AXIS].fast_rate, A_AXIS+1);
         // wait for it
-        THECONVEYOR->wait_for_idle();
+        wait_for_endstops();
         
         btriggered = homing_axis[A_AXIS].pin_info->triggered;
 		
@@ -821,6 +909,7 @@ void Endstops::check_4th(char *data)
     	
 			homing_axis[A_AXIS].pin_info->debounce= 0;
 			homing_axis[A_AXIS].pin_info->triggered = false;
+			homing_axis[A_AXIS].pin_info->latched = false;
 			homing_axis[A_AXIS].pin_info->Nontriggered = false;
 			for (size_t j = 0; j <= A_AXIS; ++j) delta[j]= 0;
 			delta[A_AXIS]= -380; // we go the negative max
@@ -863,10 +952,7 @@ void Endstops::home(axis_bitmap_t a)
 	}
 	
     // reset debounce counts for all endstops
-    for(auto& e : endstops) {
-       e->debounce= 0;
-       e->triggered= false;
-    }
+    clear_latches();
 
     if (is_scara) {
         THEROBOT->disable_arm_solution = true;  // Polar bots has to home in the actuator space.  Arm solution disabled.
@@ -876,6 +962,7 @@ void Endstops::home(axis_bitmap_t a)
 
     // Start moving the axes to the origin
     this->status = MOVING_TO_ENDSTOP_FAST;
+    THEKERNEL->slow_ticker->set_enabled(endstop_hook, true);
 
     THEROBOT->disable_segmentation= true; // we must disable segmentation as this won't work with it enabled
 
@@ -887,7 +974,7 @@ void Endstops::home(axis_bitmap_t a)
         if(homing_axis[Z_AXIS].home_direction) delta[Z_AXIS]= -delta[Z_AXIS];
         THEROBOT->delta_move(delta, homing_axis[Z_AXIS].fast_rate, 3);
         // wait for Z
-        THECONVEYOR->wait_for_idle();
+        wait_for_endstops();
     }
 
     if(home_z_first) home_xy();
@@ -942,7 +1029,7 @@ void Endstops::home(axis_bitmap_t a)
 	                if(homing_axis[i].home_direction) delta[i]= -delta[i];
 	                THEROBOT->delta_move(delta, homing_axis[i].fast_rate, i+1);
 	                // wait for it
-	                THECONVEYOR->wait_for_idle();
+	                wait_for_endstops();
 	            }
 	        }
 	    }
@@ -961,7 +1048,7 @@ void Endstops::home(axis_bitmap_t a)
 	                if(homing_axis[i].home_direction) delta[i]= -delta[i];
 	                THEROBOT->delta_move(delta, homing_axis[i].fast_rate, i+1);
 	                // wait for it
-	                THECONVEYOR->wait_for_idle();
+	                wait_for_endstops();
 	            }
 	        }
 	    }
@@ -974,6 +1061,7 @@ void Endstops::home(axis_bitmap_t a)
         for (size_t i = X_AXIS; i <= Z_AXIS; ++i) {
             if((axis_to_home[i] || this->is_delta || this->is_rdelta) && !homing_axis[i].pin_info->triggered) {
                 this->status = NOT_HOMING;
+                THEKERNEL->slow_ticker->set_enabled(endstop_hook, false);
                 THEKERNEL->set_halt_reason(HOME_FAIL);
                 THEKERNEL->call_event(ON_HALT, nullptr);
                 THEROBOT->disable_segmentation= false;
@@ -987,6 +1075,7 @@ void Endstops::home(axis_bitmap_t a)
         for (size_t i = A_AXIS; i < homing_axis.size(); ++i) {
             if(axis_to_home[i] && !homing_axis[i].pin_info->triggered && (axis_is_on[i] == true)) {
                 this->status = NOT_HOMING;
+                THEKERNEL->slow_ticker->set_enabled(endstop_hook, false);
                 THEKERNEL->set_halt_reason(HOME_FAIL);
                 THEKERNEL->call_event(ON_HALT, nullptr);
                 THEROBOT->disable_segmentation = false;
@@ -1002,44 +1091,62 @@ void Endstops::home(axis_bitmap_t a)
         THEROBOT->reset_position_from_current_actuator_position();
     }
 
-    // Move back a small distance for all homing axis
-    this->status = MOVING_BACK;
-    float delta[homing_axis.size()];
-    for (size_t i = 0; i < homing_axis.size(); ++i) delta[i]= 0;
-
-    // use minimum feed rate of all axes that are being homed (sub optimal, but necessary)
-    float feed_rate= homing_axis[X_AXIS].slow_rate;
-    for (auto& i : homing_axis) {
-        int c= i.axis_index;
-        if(axis_to_home[c]) {
-            delta[c]= i.retract;
-            if(!i.home_direction) delta[c]= -delta[c];
-            feed_rate= std::min(i.slow_rate, feed_rate);
+    // with the fast approach latched the slow one is not needed to get a repeatable home
+    if(!this->single_pass_homing) {
+        // Move back a small distance for all homing axis
+        this->status = MOVING_BACK;
+        float delta[homing_axis.size()];
+        for (size_t i = 0; i < homing_axis.size(); ++i) delta[i]= 0;
+
+        // use minimum feed rate of all axes that are being homed (sub optimal, but necessary)
+        float feed_rate= homing_axis[X_AXIS].slow_rate;
+        for (auto& i : homing_axis) {
+            int c= i.axis_index;
+            if(axis_to_home[c]) {
+                delta[c]= i.retract;
+                if(!i.home_direction) delta[c]= -delta[c];
+                feed_rate= std::min(i.slow_rate, feed_rate);
+            }
         }
-    }
 
-    THEROBOT->delta_move(delta, feed_rate, homing_axis.size());
-    // wait until finished
-    THECONVEYOR->wait_for_idle();
+        THEROBOT->delta_move(delta, feed_rate, homing_axis.size());
+        // wait until finished
+        THECONVEYOR->wait_for_idle();
 
-    // Start moving the axes towards the endstops slowly
-    this->status = MOVING_TO_ENDSTOP_SLOW;
-    for (auto& i : homing_axis) {
-        int c= i.axis_index;
-        if(axis_to_home[c]) {
-            delta[c]= i.retract*2; // move further than we moved off to make sure we hit it cleanly
-            if(i.home_direction) delta[c]= -delta[c];
-        }else{
-            delta[c]= 0;
+        // Start moving the axes towards the endstops slowly, the position is latched again on the way
+        if(this->interrupt_homing) clear_latches();
+        this->status = MOVING_TO_ENDSTOP_SLOW;
+        for (auto& i : homing_axis) {
+            int c= i.axis_index;
+            if(axis_to_home[c]) {
+                delta[c]= i.retract*2; // move further than we moved off to make sure we hit it cleanly
+                if(i.home_direction) delta[c]= -delta[c];
+            }else{
+                delta[c]= 0;
+            }
+        }
+        THEROBOT->delta_move(delta, feed_rate, homing_axis.size());
+        // wait until finished
+        wait_for_endstops();
+
+        // a latched endstop stops the axis at once, so it must have been confirmed or the axis stopped short
+        if(this->interrupt_homing) {
+            for (size_t i = X_AXIS; i <= Z_AXIS; ++i) {
+                if(axis_to_home[i] && !homing_axis[i].pin_info->triggered) {
+                    this->status = NOT_HOMING;
+                    THEKERNEL->slow_ticker->set_enabled(endstop_hook, false);
+                    THEKERNEL->set_halt_reason(HOME_FAIL);
+                    THEKERNEL->call_event(ON_HALT, nullptr);
+                    THEROBOT->disable_segmentation= false;
+                    return;
+                }
+            }
         }
-    }
-    THEROBOT->delta_move(delta, feed_rate, homing_axis.size());
-    // wait until finished
-    THECONVEYOR->wait_for_idle();
 
-    // we did not complete movement the full distance if we hit the endstops
-    // TODO Maybe only reset axis involved in the homing cycle
-    THEROBOT->reset_position_from_current_actuator_position();
+        // we did not complete movement the full distance if we hit the endstops
+        // TODO Maybe only reset axis involved in the homing cycle
+        THEROBOT->reset_position_from_current_actuator_position();
+    }
 
     THEROBOT->disable_segmentation= false;
     if (is_scara) {
@@ -1047,6 +1154,7 @@ void Endstops::home(axis_bitmap_t a)
     }
 
     this->status = NOT_HOMING;
+    THEKERNEL->slow_ticker->set_enabled(endstop_hook, false);
 }
 
 void Endstops::process_home_command(Gcode* gcode)
@@ -1221,7 +1329,12 @@ void Endstops::process_home_command(Gcode* gcode)
         // so XY are at a known consistent position.  (especially true if using a proximity probe)
         for (auto &p : homing_axis) {
             if (haxis[p.axis_index]) { // if we requested this axis to home
-                THEROBOT->reset_axis_position(p.homing_position + p.home_offset, p.axis_index);
+                float position= p.homing_position + p.home_offset;
+                if(!is_corexy && p.pin_info->latched && p.pin_info->triggered) {
+                    // home is where the endstop was latched, the axis stopped a little past it
+                    position += ((int32_t)STEPPER[p.axis_index]->get_current_step() - p.pin_info->latched_steps) / STEPS_PER_MM(p.axis_index);
+                }
+                THEROBOT->reset_axis_position(position, p.axis_index);
                 // set flag indicating axis was homed, it stays set once set until H/W reset or unhomed
                 p.homed= true;
             }
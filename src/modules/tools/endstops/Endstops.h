@@ -17,6 +17,7 @@
 class StepperMotor;
 class Gcode;
 class Pin;
+class Hook;
 
 class Endstops : public Module{
     public:
@@ -41,6 +42,9 @@ class Endstops : public Module{
         void process_home_command(Gcode* gcode);
         void set_homing_offset(Gcode* gcode);
         uint32_t read_endstops(uint32_t dummy);
+        void on_endstop_edge();
+        void wait_for_endstops();
+        void clear_latches();
         void handle_park_g28();
 
         // global settings
@@ -56,6 +60,10 @@ class Endstops : public Module{
         // per endstop settings
         using endstop_info_t = struct {
             Pin pin;
+            volatile int32_t latched_steps; // actuator position when the edge interrupt fired
+            // set by the edge interrupt after latched_steps, kept out of the bitfield below which read_endstops
+            // writes from TIMER2 and would undo it
+            volatile bool latched;
             struct {
                 uint16_t debounce:16;
                 char axis:8; // one of XYZABC
@@ -103,6 +111,8 @@ class Endstops : public Module{
         // axis that can be homed, 0,1,2 always there and optionally 3 is A, 4 is B, 5 is C
         std::vector<homing_info_t> homing_axis;
 
+        Hook *endstop_hook;         // read_endstops, only enabled while homing
+
         // Global state
         struct {
             uint32_t homing_order:18;
@@ -114,5 +124,7 @@ class Endstops : public Module{
             bool home_z_first:1;
             bool move_to_origin_after_home:1;
             bool park_after_home:1;
+            bool interrupt_homing:1;
+            bool single_pass_homing:1;
         };
 };
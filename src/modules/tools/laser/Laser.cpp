@@ -81,6 +81,8 @@ void Laser::on_module_loaded()
 
 
     this->pwm_inverting = dummy_pin->is_inverting();
+    this->pwm_channel = dummy_pin->hardware_pwm_channel();
+    this->pwm_match = pwm_channel < 4 ? &LPC_PWM1->MR1 + (pwm_channel - 1) : &LPC_PWM1->MR4 + (pwm_channel - 4);
 
     delete dummy_pin;
     dummy_pin = NULL;
@@ -108,6 +110,7 @@ void Laser::on_module_loaded()
 
     // S value that represents maximum (default 1)
     this->laser_maximum_s_value = THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number() ;
+    update_power_gain();
 
     set_laser_power(0);
 
@@ -115,9 +118,12 @@ void Laser::on_module_loaded()
     this->register_for_event(ON_HALT);
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, laser_checksum);
 
-    // no point in updating the power more than the PWM frequency, but not faster than 1KHz
+    // while running the power follows the speed of each segment as the step ticker starts it
+    THEKERNEL->step_ticker->segment_fnc = [this](const Block *block, uint8_t s_index, uint16_t speed) { on_segment(block, s_index, speed); };
+
+    // testing and turning off is done from here, no point in updating the power more than the PWM frequency, but not faster than 1KHz
     ms_per_tick = 1000 / std::min(1000UL, 1000000 / period);
     // 2024
     THEKERNEL->slow_ticker->attach(std::min(1000UL, 1000000 / period), this, &Laser::set_proportional_power);
@@ -367,77 +373,16 @@ void Laser::on_gcode_received(void *argument)
         } else if (gcode->m == 325) { // M223 S100 change laser power by percentage S
             if(gcode->has_letter('S')) {
                 this->scale = gcode->get_value('S') / 100.0F;
+                update_power_gain();
             } else {
             	THEKERNEL->streams->printf("Laser power scale at %6.2f %%\n", this->scale * 100.0F);
             }
+        } else if (gcode->m == 326) { // raster scanline, the player plays these with the pixel data that follows them
+            gcode->stream->printf("M326 raster scanlines can only be played from a file\n");
         }
     }
 }
 
-// calculates the current speed ratio from the currently executing block
-float Laser::current_speed_ratio(const Block *block) const
-{
-    // find the primary moving actuator (the one with the most steps)
-
-	// 2024
-    size_t pm = 0;
-    uint32_t max_steps = 0;
-    for (size_t i = 0; i < THEROBOT->get_number_registered_motors(); i++) {
-        // find the motor with the most steps
-        if(block->steps[i] > max_steps) {
-            max_steps = block->steps[i];
-            pm = i;
-        }
-    }
-
-    // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
-    // this is based on the fraction it is of the requested rate (nominal rate)
-    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
-
-    return ratio;
-
-    /*
-    // find the primary moving actuator (the one with the most steps)
-    size_t pm = block->move_axis;
-    // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
-    // this is based on the fraction it is of the requested rate (nominal rate)
-    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
-
-    return ratio;
-    */
-
-}
-
-// get laser power for the currently executing block, returns false if nothing running or a G0
-bool Laser::get_laser_power(float& power) const
-{
-    const Block *block = StepTicker::getInstance()->get_current_block();
-
-    // Note to avoid a race condition where the block is being cleared we check the is_ready flag which gets cleared first,
-    // as this is an interrupt if that flag is not clear then it cannot be cleared while this is running and the block will still be valid (albeit it may have finished)
-    if (block != nullptr && block->is_ready && block->is_g123) {
-    	// 2024
-        float requested_power = (float)block->s_value / (1 << 11) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
-        float ratio = current_speed_ratio(block);
-        power = requested_power * ratio * scale;
-        return true;
-
-        /*
-		int axis = block->move_axis;
-		int shift_steps = block->tick_info[axis].steps_to_move / int(block->s_count);
-		int idx = block->tick_info[axis].step_count / shift_steps;
-
-        float requested_power = (float)block->s_values[idx] / (1 << 11) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
-        float ratio = current_speed_ratio(block);
-        power = requested_power * ratio * scale;
-        return true;
-        */
-
-    }
-
-    return false;
-}
-
 // called every millisecond from timer ISR
 uint32_t Laser::set_proportional_power(uint32_t dummy)
 {
@@ -449,18 +394,8 @@ uint32_t Laser::set_proportional_power(uint32_t dummy)
         return 0;
     }
 
-    if (laser_on) {
-        float power;
-        if(get_laser_power(power)) {
-            // adjust power to maximum power and actual velocity
-            float proportional_power = ( (this->laser_maximum_power - this->laser_minimum_power) * power ) + this->laser_minimum_power;
-            set_laser_power(proportional_power);
-
-        } else {
-            // turn laser off
-            set_laser_power(0);
-        }
-    } else {
+    // the step ticker sets the power for each segment while the laser is on
+    if (!laser_on) {
         // turn laser off
         set_laser_power(0);
     }
@@ -468,6 +403,51 @@ uint32_t Laser::set_proportional_power(uint32_t dummy)
     return 0;
 }
 
+// called from the step tick ISR as each segment starts, with nullptr once nothing is moving,
+// a block with several intensities has a segment start where each one does
+void Laser::on_segment(const Block *block, uint8_t s_index, uint16_t speed)
+{
+    if (!laser_on || testing || !THEKERNEL->get_laser_mode()) return;
+
+    if (block == nullptr || !block->is_g123) {
+        // turn laser off
+        write_power(0);
+        return;
+    }
+
+    // adjust power to maximum power and actual velocity
+    uint32_t power = std::min<uint64_t>(((uint64_t)block->s_values[s_index] * s_value_gain) >> 16, 0xFFFF);
+    write_power(std::min<uint32_t>(minimum_power16 + ((power * speed) >> 16), 0xFFFF));
+}
+
+// precalculates the fixed point power range, whenever the scale changes
+void Laser::update_power_gain()
+{
+    // s_value is 1.11 Fixed point, the gain is 16.16 so small scales and large maximum S values keep their fraction
+    float gain = (this->laser_maximum_power - this->laser_minimum_power) * scale / this->laser_maximum_s_value * (65536.0F / (1 << 11)) * 65536.0F;
+    s_value_gain = confine(gain, 0.0F, (float)0xFFFF0000);
+    minimum_power16 = confine(this->laser_minimum_power, 0.0F, 1.0F) * 0xFFFF;
+}
+
+// sets the power, a 0.16 fixed point fraction, straight into the match register, as PwmOut::write() would
+void Laser::write_power(uint32_t power)
+{
+    // anything under 0.0001 is off
+    if (power < 7) power = 0;
+
+    uint32_t period = LPC_PWM1->MR0;
+    uint32_t v = ((uint64_t)period * power) >> 16;
+    if (this->pwm_inverting) v = period - v;
+    // workaround for PWM1[1] - Never make it equal MR0, else we get 1 cycle dropout
+    if (v == period) v++;
+
+    *pwm_match = v;
+    // accept on next period start
+    LPC_PWM1->LER |= 1 << pwm_channel;
+
+    if (power == 0 && this->ttl_used) this->ttl_pin->set(false);
+}
+
 bool Laser::set_laser_power(float power)
 {
     // Ensure power is >=0 and <= 1
@@ -27,14 +27,15 @@ class Laser : public Module{
         void on_console_line_received(void *argument);
         void on_get_public_data(void* argument);
 
-        void set_scale(float s) { scale= s/100; }
+        void set_scale(float s) { scale= s/100; update_power_gain(); }
         float get_scale() const { return scale*100; }
         bool set_laser_power(float p);
 
     private:
         uint32_t set_proportional_power(uint32_t dummy);
-        bool get_laser_power(float& power) const;
-        float current_speed_ratio(const Block *block) const;
+        void on_segment(const Block *block, uint8_t s_index, uint16_t speed);
+        void update_power_gain();
+        void write_power(uint32_t power);
 
         Pin *laser_pin;
         mbed::PwmOut *pwm_pin;    // PWM output to regulate the laser power
@@ -45,6 +46,12 @@ class Laser : public Module{
         float laser_maximum_s_value; // Value of S code that will represent max power
         float scale;
 
+        // the power range as a 0.16 fixed point fraction of the PWM period, so the step tick can set it without float math
+        uint32_t s_value_gain;     // 16.16 fixed point, times a 1.11 S value is the power above minimum at full speed
+        uint32_t minimum_power16;
+        volatile uint32_t *pwm_match; // PWM1 match register of the pwm pin
+        uint8_t pwm_channel;
+
         int32_t ms_per_tick; // ms between each ticks, depends on PWM frequency
 
         struct {
@@ -70,127 +70,99 @@
 
 #include "libs/Kernel.h"
 #include "StreamOutputPool.h"
-#include "BufferedSoftSerial.h"
 #include "ModbusSpindleControl.h"
 #include "HuanyangSpindleControl.h"
-#include "gpio.h"
 #include "Modbus.h"
+#include "mbed.h"
+
+// how often the rotation and output current are read while the bus has nothing else to do
+#define STATUS_POLL_US 500000
+
+// Control Read parameters
+#define PARAMETER_OUTPUT_CURRENT 0x02
+#define PARAMETER_ROTATION       0x03
+
+HuanyangSpindleControl::HuanyangSpindleControl()
+{
+    last_poll_us = 0;
+    rotation = 0;
+    output_current = 0;
+    status_pending = 0;
+    status_valid = false;
+}
+
+void HuanyangSpindleControl::on_idle(void *argument)
+{
+    ModbusSpindleControl::on_idle(argument);
+
+    // commands go first, the status is only read when the bus is free
+    if (status_pending == 0 && modbus->is_idle() && us_ticker_read() - last_poll_us >= STATUS_POLL_US) {
+        last_poll_us = us_ticker_read();
+        read_status(PARAMETER_ROTATION);
+        read_status(PARAMETER_OUTPUT_CURRENT);
+    }
+}
+
+// queues a Control Write, the replies are the length in their third byte plus five
+void HuanyangSpindleControl::control_write(uint8_t command)
+{
+    uint8_t msg[4] = { 0x01, 0x03, 0x01, command };
+    if (!modbus->request(msg, sizeof(msg), 0)) {
+        THEKERNEL->streams->printf("ERROR: Modbus queue full, spindle command dropped\n");
+    }
+}
+
+// queues a Control Read of the parameter, the answer is kept for report_speed()
+void HuanyangSpindleControl::read_status(uint8_t parameter)
+{
+    uint8_t msg[6] = { 0x01, 0x04, 0x03, parameter, 0x00, 0x00 };
+    bool queued = modbus->request(msg, sizeof(msg), 0, [this, parameter](const uint8_t *reply, uint8_t len) {
+        status_pending--;
+        if (reply == nullptr || len < 6 || reply[3] != parameter) {
+            status_valid = false;
+            return;
+        }
+        uint16_t value = (reply[4] << 8) | reply[5];
+        if (parameter == PARAMETER_ROTATION) {
+            rotation = value;
+        } else {
+            output_current = value;
+        }
+        status_valid = true;
+    });
+    if (queued) status_pending++;
+}
 
 void HuanyangSpindleControl::turn_on() 
 {
-    // prepare data for the spindle off command
-    char turn_on_msg[6] = { 0x01, 0x03, 0x01, 0x01, 0x00, 0x00 };
-    // calculate CRC16 checksum
-    unsigned int crc = modbus->crc16(turn_on_msg, sizeof(turn_on_msg)-2);
-    turn_on_msg[4] = crc & 0xFF;
-    turn_on_msg[5] = (crc >> 8);
-
-    // enable transmitter
-    modbus->dir_output->set();
-    modbus->delay(1);
-    // send the actual message
-    modbus->serial->write(turn_on_msg, sizeof(turn_on_msg));
-    // wait a calculated time for the data to be sent 
-    modbus->delay((int) ceil(sizeof(turn_on_msg) * modbus->delay_time));
-    // disable transmitter
-    modbus->dir_output->clear();
-    // wait 50ms, required by the Modbus standard
-    modbus->delay(50);
+    // start spindle clockwise
+    control_write(0x01);
     spindle_on = true;
-
 }
 
 void HuanyangSpindleControl::turn_off() 
 {
-    // prepare data for the spindle off command
-    char turn_off_msg[6] = { 0x01, 0x03, 0x01, 0x08, 0x00, 0x00 };
-    // calculate CRC16 checksum
-    unsigned int crc = modbus->crc16(turn_off_msg, sizeof(turn_off_msg)-2);
-    turn_off_msg[4] = crc & 0xFF;
-    turn_off_msg[5] = (crc >> 8);
-
-    // enable transmitter
-    modbus->dir_output->set();
-    modbus->delay(1);
-    // send the actual message
-    modbus->serial->write(turn_off_msg, sizeof(turn_off_msg));
-    // wait a calculated time for the data to be sent 
-    modbus->delay((int) ceil(sizeof(turn_off_msg) * modbus->delay_time));
-    // disable transmitter
-    modbus->dir_output->clear();
-    // wait 50ms, required by the Modbus standard
-    modbus->delay(50);
+    // stop spindle
+    control_write(0x08);
     spindle_on = false;
-
 }
 
 void HuanyangSpindleControl::set_speed(int target_rpm) 
 {
-
-    // prepare data for the set speed command
-    char set_speed_msg[7] = { 0x01, 0x05, 0x02, 0x00, 0x00, 0x00, 0x00 };
-    // convert RPM into Hz
-    unsigned int hz = target_rpm / 60 * 100; 
-    set_speed_msg[3] = (hz >> 8);
-    set_speed_msg[4] = hz & 0xFF;
-    // calculate CRC16 checksum
-    unsigned int crc = modbus->crc16(set_speed_msg, sizeof(set_speed_msg)-2);
-    set_speed_msg[5] = crc & 0xFF;
-    set_speed_msg[6] = (crc >> 8);
-
-    // enable transmitter
-    modbus->dir_output->set();
-    modbus->delay(1);
-    // send the actual message
-    modbus->serial->write(set_speed_msg, sizeof(set_speed_msg));
-    // wait a calculated time for the data to be sent 
-    modbus->delay((int) ceil(sizeof(set_speed_msg) * modbus->delay_time));
-    // disable transmitter
-    modbus->dir_output->clear();
-    // wait 50ms, required by the Modbus standard
-    modbus->delay(50);
-
+    // convert RPM into Hz, in 0.01Hz
+    unsigned int hz = target_rpm * 100 / 60;
+    uint8_t msg[5] = { 0x01, 0x05, 0x02, (uint8_t)(hz >> 8), (uint8_t)(hz & 0xFF) };
+    if (!modbus->request(msg, sizeof(msg), 0)) {
+        THEKERNEL->streams->printf("ERROR: Modbus queue full, spindle speed dropped\n");
+    }
 }
 
 void HuanyangSpindleControl::report_speed() 
 {
-    // clear RX buffer before start
-    while(modbus->serial->readable()){
-        modbus->serial->getc();
+    // the last answers polled, asking now would hold up the gcode
+    if (!status_valid) {
+        THEKERNEL->streams->printf("No answer from the VFD, %lu requests failed\n", (unsigned long)modbus->get_failures());
+        return;
     }
-
-    // prepare data for the get speed command
-    char get_speed_msg[8] = { 0x01, 0x04, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 };
-    // calculate CRC16 checksum
-    unsigned int crc = modbus->crc16(get_speed_msg, sizeof(get_speed_msg)-2);
-    get_speed_msg[6] = crc & 0xFF;
-    get_speed_msg[7] = (crc >> 8);
-
-    // enable transmitter
-    modbus->dir_output->set();
-    modbus->delay(1);
-    // send the actual message
-    modbus->serial->write(get_speed_msg, sizeof(get_speed_msg));
-    // wait a calculated time for the data to be sent 
-    modbus->delay((int) ceil(sizeof(get_speed_msg) * modbus->delay_time));
-    // disable transmitter
-    modbus->dir_output->clear();
-    // wait 50ms, required by the Modbus standard
-    modbus->delay(50);
-
-    // wait for the complete message to be received
-    modbus->delay((int) ceil(8 * modbus->delay_time));
-    // prepare an array for the answer
-    char speed[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-   
-    // read the answer into the buffer
-    for(int i=0; i<8; i++) {
-        speed[i] = modbus->serial->getc();
-    }
-    // get the Hz value from trhe answer and convert it into an RPM value
-    unsigned int hz = (speed[4] << 8) | speed[5];
-    unsigned int rpm = hz / 100 * 60;
-
-    // report the current RPM value
-    THEKERNEL->streams->printf("Current RPM: %d\n", rpm);
+    THEKERNEL->streams->printf("Current RPM: %d  Output current: %.1fA\n", rotation, output_current / 10.0F);
 }
@@ -14,15 +14,25 @@
 // This module implements Modbus control for spindle control over Modbus.
 class HuanyangSpindleControl: public ModbusSpindleControl {
     public:
-        HuanyangSpindleControl() {};
+        HuanyangSpindleControl();
         virtual ~HuanyangSpindleControl() {};
-        
+        void on_idle(void *argument);
+
     private:
         
         void turn_on(void);
         void turn_off(void);
         void set_speed(int);
         void report_speed(void);
+
+        void control_write(uint8_t command);
+        void read_status(uint8_t parameter);
+
+        uint32_t last_poll_us;      // when the status was last asked for
+        uint16_t rotation;          // rpm the VFD reports
+        uint16_t output_current;    // in 0.1A, the load on the spindle
+        uint8_t status_pending;     // status reads queued and not answered yet
+        bool status_valid;          // the last status reads were answered
 };
 
 #endif
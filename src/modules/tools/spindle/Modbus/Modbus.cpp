@@ -5,165 +5,200 @@
       You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "libs/Module.h"
-#include "libs/Kernel.h"
-#include "libs/nuts_bolts.h"
-#include "libs/gpio.h"
-#include "BufferedSoftSerial.h"
 #include "Modbus.h"
 
-Modbus::Modbus( PinName tx_pin, PinName rx_pin, PinName dir_pin){
-    serial = new BufferedSoftSerial( tx_pin, rx_pin );
-    serial->baud(9600);
-    serial->format(8,serial->Parity::None,1);
-    calculate_delay(9600, 8, 0, 1);
-    dir_output = new GPIO(dir_pin);
-    dir_output->output();
-    dir_output->clear();
-}
-
-Modbus::Modbus( PinName tx_pin, PinName rx_pin, PinName dir_pin, int baud_rate){
-    serial = new BufferedSoftSerial( tx_pin, rx_pin );
-    serial->baud(baud_rate);
-    serial->format(8,serial->Parity::None,1);
-    calculate_delay(baud_rate, 8, 0, 1);
-    dir_output = new GPIO(dir_pin);
-    dir_output->output();
-    dir_output->clear();
-}
-
-Modbus::Modbus( PinName tx_pin, PinName rx_pin, PinName dir_pin, int baud_rate, const char *format){
-    serial = new BufferedSoftSerial( tx_pin, rx_pin );
-    serial->baud(baud_rate);
-    
-    if(strncmp(format, "8N1", 3) == 0){
-        serial->format(8,serial->Parity::None,1);
-        calculate_delay(baud_rate, 8, 0, 1);
-    } else if(strncmp(format, "8O1", 3) == 0){
-        serial->format(8,serial->Parity::Odd,1);
-        calculate_delay(baud_rate, 8, 1, 1);
-    } else if(strncmp(format, "8E1", 3) == 0){
-        serial->format(8,serial->Parity::Even,1);
-        calculate_delay(baud_rate, 8, 1, 1);
-    } else if(strncmp(format, "8N2", 3) == 0){
-        serial->format(8,serial->Parity::None,2);
-        calculate_delay(baud_rate, 8, 0, 2);
-    } else {
-        serial->format(8,serial->Parity::None,1);
-        calculate_delay(baud_rate, 8, 0, 1);
+#include "mbed.h"
+
+#include <string.h>
+#include <algorithm>
+
+Modbus::Modbus(ModbusPort *port)
+{
+    this->port = port;
+    this->reply_count = 0;
+    this->attempts = 0;
+    this->since = 0;
+    this->wait_us = 0;
+    this->failures = 0;
+    this->state = IDLE;
+}
+
+// moves the current request along, sending the next one once the bus is free
+void Modbus::poll()
+{
+    uint32_t now = us_ticker_read(); // mbed call
+
+    switch(state) {
+        case IDLE:
+            if(!queue.get(current)) return;
+            attempts = 0;
+            send(now);
+            return;
+
+        case SENDING:
+            if(now - since < wait_us) return;
+            port->release();
+            state = WAITING;
+            since = now;
+            reply_count = 0;
+            // fall through, the reply may already be coming in
+
+        case WAITING: {
+            int c;
+            while((c = port->receive()) >= 0) {
+                if(reply_count < max_telegram) reply[reply_count++] = c;
+            }
+
+            uint8_t len = reply_length();
+            if(len > 0 && reply_count >= len) {
+                uint16_t crc = reply[len - 2] | (reply[len - 1] << 8);
+                if(reply[0] != current.telegram[0] || crc16(reply, len - 2) != crc) {
+                    // garbled, or some other slave
+                    retry(now);
+                } else if((reply[1] & 0x80) != 0) {
+                    // exception reply, no point asking again
+                    failures++;
+                    complete(now, nullptr, 0);
+                } else {
+                    complete(now, reply, len - 2);
+                }
+
+            } else if(now - since >= current.timeout_ms * 1000U) {
+                retry(now);
+            }
+            return;
+        }
+
+        case GAP:
+            if(now - since >= wait_us) state = IDLE;
+            return;
     }
-    dir_output = new GPIO(dir_pin);
-    dir_output->output();
-    dir_output->clear();
 }
 
-// Called when the module has just been loaded
-void Modbus::on_module_loaded() {
-    // We want to be called every time a new char is received
-    serial->attach(this, &Modbus::on_serial_char_received, BufferedSoftSerial::RxIrq);
+// how long the reply coming in will be, 0 while that is not known yet
+uint8_t Modbus::reply_length() const
+{
+    if(reply_count >= 2 && (reply[1] & 0x80) != 0) return 5;
+    if(current.reply_len > 0) return current.reply_len;
+    if(reply_count < 3) return 0;
+    return std::min(5 + reply[2], (int)max_telegram);
 }
 
-// Called on Serial::RxIrq interrupt, meaning we have received a char
-void Modbus::on_serial_char_received(){
-    buffer.push_back(serial->getc());
-}
+void Modbus::send(uint32_t now)
+{
+    // anything left from before is not the reply to this
+    while(port->receive() >= 0) ;
 
-void Modbus::read_coil(int slave_addr, int coil_addr, int n_coils){
-    char telegram[8];
-    unsigned int crc;
-    telegram[0] = slave_addr;       // Slave address
-    telegram[1] = 0x01;             // Function code
-    telegram[2] = (coil_addr >> 8); // Coil address MSB
-    telegram[3] = coil_addr & 0xFF; // Coil address LSB
-    telegram[4] = (n_coils >> 8);   // number of coils to read MSB
-    telegram[5] = n_coils & 0xFF;   // number of coils to read LSB
-    crc = crc16(telegram, 6);       
-    telegram[6] = crc;              // CRC LSB
-    telegram[7] = (crc >> 8);       // CRC MSB
-    dir_output->set();
-    serial->write(telegram,8);
-    delay((int) ceil(50 + 8 * delay_time));
-    dir_output->clear();
-    // TODO: read reply from buffer and return it
+    port->transmit(current.telegram, current.len);
+    state = SENDING;
+    since = now;
+    // until the last character has gone out, with one more for the stop bits of the soft serial to finish
+    wait_us = (current.len + 1) * port->char_time_us();
 }
 
-void Modbus::read_holding_register(int slave_addr, int reg_addr, int n_regs){
-
-    // TODO: implement this
+void Modbus::retry(uint32_t now)
+{
+    if(attempts++ < current.retries) {
+        send(now);
+        return;
+    }
+    failures++;
+    complete(now, nullptr, 0);
 }
 
-void Modbus::write_coil(int slave_addr, int coil_addr, bool data){
-    char telegram[8];
-    unsigned int crc;
-    telegram[0] = slave_addr;       // Slave address
-    telegram[1] = 0x05;             // Function code
-    telegram[2] = (coil_addr >> 8); // Coil address MSB
-    telegram[3] = coil_addr & 0xFF; // Coil address LSB
-    telegram[4] = 0x00;             // Data MSB
-    telegram[5] = (data == true) ? 0xFF : 0x00; // Data LSB
-    crc = crc16(telegram, 6);       
-    telegram[6] = crc;              // CRC LSB
-    telegram[7] = (crc >> 8);       // CRC MSB
-    dir_output->set();
-    serial->write(telegram,8);
-    delay((int) ceil(50 + 8 * delay_time));
-    dir_output->clear();
+void Modbus::complete(uint32_t now, const uint8_t *reply, uint8_t len)
+{
+    // frames are at least 3.5 characters apart, 1.75ms above 19200 baud
+    state = GAP;
+    since = now;
+    wait_us = std::max(port->char_time_us() * 7 / 2, (uint32_t)1750);
+
+    if(current.done) current.done(reply, len);
+    current.done = nullptr;
 }
 
+bool Modbus::request(const uint8_t *pdu, uint8_t len, uint8_t reply_len, done_t done, uint16_t timeout_ms, uint8_t retries)
+{
+    if(len + 2 > max_telegram || reply_len > max_telegram) return false;
 
-void Modbus::write_holding_register(int slave_addr, int reg_addr, int data){
-    char telegram[8];
-    unsigned int crc;
-    telegram[0] = slave_addr;       // Slave address
-    telegram[1] = 0x06;             // Function code
-    telegram[2] = (reg_addr >> 8);  // Register address MSB
-    telegram[3] = reg_addr;         // Register address LSB
-    telegram[4] = (data >> 8);      // Data MSB
-    telegram[5] = data;             // Data LSB
-    crc = crc16(telegram, 6);       
-    telegram[6] = crc;              // CRC LSB
-    telegram[7] = (crc >> 8);       // CRC MSB
-    dir_output->set();
-    serial->write(telegram,8);
-    delay((int) ceil(50 + 8 * delay_time));
-    dir_output->clear();
+    transaction_t t;
+    memcpy(t.telegram, pdu, len);
+    uint16_t crc = crc16(pdu, len);
+    t.telegram[len] = crc & 0xFF;   // CRC LSB
+    t.telegram[len + 1] = crc >> 8; // CRC MSB
+    t.len = len + 2;
+    t.reply_len = reply_len;
+    t.retries = retries;
+    t.timeout_ms = timeout_ms;
+    t.done = done;
+    return queue.put(t);
 }
 
-void Modbus::diagnostic(int slave_addr, int test_sub_code, int data){
-    // TODO: implement this
+bool Modbus::read_coils(uint8_t slave, uint16_t addr, uint16_t n, done_t done)
+{
+    uint8_t pdu[6] = { slave, 0x01, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(n >> 8), (uint8_t)n };
+    return request(pdu, sizeof(pdu), 0, done);
 }
 
-void Modbus::write_multiple_coils(int slave_addr, int coil_addr, int n_coils, int data){
-    // TODO: implement this
+bool Modbus::read_holding_registers(uint8_t slave, uint16_t addr, uint16_t n, done_t done)
+{
+    uint8_t pdu[6] = { slave, 0x03, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(n >> 8), (uint8_t)n };
+    return request(pdu, sizeof(pdu), 0, done);
 }
 
-void Modbus::write_multiple_registers(int slave_addr, int start_addr, int data){
-    // TODO: implement this
+bool Modbus::write_coil(uint8_t slave, uint16_t addr, bool value, done_t done)
+{
+    uint8_t pdu[6] = { slave, 0x05, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(value ? 0xFF : 0x00), 0x00 };
+    return request(pdu, sizeof(pdu), 8, done);
 }
 
-void Modbus::read_write_multiple_holding_registers(int slave_addr, int read_addr, int n_read, int write_addr, int data){
-    // TODO: implement this
+bool Modbus::write_holding_register(uint8_t slave, uint16_t addr, uint16_t value, done_t done)
+{
+    uint8_t pdu[6] = { slave, 0x06, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(value >> 8), (uint8_t)value };
+    return request(pdu, sizeof(pdu), 8, done);
 }
 
-void Modbus::calculate_delay(int baudrate, int bits, int parity, int stop) {
+bool Modbus::diagnostic(uint8_t slave, uint16_t sub_function, uint16_t data, done_t done)
+{
+    uint8_t pdu[6] = { slave, 0x08, (uint8_t)(sub_function >> 8), (uint8_t)sub_function, (uint8_t)(data >> 8), (uint8_t)data };
+    return request(pdu, sizeof(pdu), 8, done);
+}
 
-    float bittime = 1000.0 / baudrate;
-    // here we calculate how long a byte with all surrounding bits take
-    // startbit + number of bits + parity bit + stop bit
-    delay_time = bittime * (1 + bits + parity + 1);
+bool Modbus::write_multiple_coils(uint8_t slave, uint16_t addr, uint16_t n, const uint8_t *values, done_t done)
+{
+    uint8_t bytes = (n + 7) / 8;
+    if(7 + bytes + 2 > max_telegram) return false;
+    uint8_t pdu[max_telegram] = { slave, 0x0F, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(n >> 8), (uint8_t)n, bytes };
+    memcpy(&pdu[7], values, bytes);
+    return request(pdu, 7 + bytes, 8, done);
 }
 
-void Modbus::delay(unsigned int value) {
-    
-    uint32_t start = us_ticker_read(); // mbed call
-    while ((us_ticker_read() - start) < value*1000) {
-        THEKERNEL->call_event(ON_IDLE, this);
+bool Modbus::write_multiple_registers(uint8_t slave, uint16_t addr, uint16_t n, const uint16_t *values, done_t done)
+{
+    if(7 + n * 2 + 2 > max_telegram) return false;
+    uint8_t pdu[max_telegram] = { slave, 0x10, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(n >> 8), (uint8_t)n, (uint8_t)(n * 2) };
+    for (int i = 0; i < n; i++) {
+        pdu[7 + i * 2] = values[i] >> 8;
+        pdu[8 + i * 2] = values[i];
     }
-
+    return request(pdu, 7 + n * 2, 8, done);
+}
+
+bool Modbus::read_write_multiple_registers(uint8_t slave, uint16_t read_addr, uint16_t n_read, uint16_t write_addr, uint16_t n_write,
+                                           const uint16_t *values, done_t done)
+{
+    if(11 + n_write * 2 + 2 > max_telegram || 5 + n_read * 2 > max_telegram) return false;
+    uint8_t pdu[max_telegram] = { slave, 0x17, (uint8_t)(read_addr >> 8), (uint8_t)read_addr, (uint8_t)(n_read >> 8), (uint8_t)n_read,
+                                  (uint8_t)(write_addr >> 8), (uint8_t)write_addr, (uint8_t)(n_write >> 8), (uint8_t)n_write, (uint8_t)(n_write * 2) };
+    for (int i = 0; i < n_write; i++) {
+        pdu[11 + i * 2] = values[i] >> 8;
+        pdu[12 + i * 2] = values[i];
+    }
+    return request(pdu, 11 + n_write * 2, 0, done);
 }
 
-unsigned int Modbus::crc16(char *data, unsigned int len) {
-    
+uint16_t Modbus::crc16(const uint8_t *data, unsigned int len)
+{
     static const unsigned short crc_table[] = {
     0X0000, 0XC0C1, 0XC181, 0X0140, 0XC301, 0X03C0, 0X0280, 0XC241,
     0XC601, 0X06C0, 0X0780, 0XC741, 0X0500, 0XC5C1, 0XC481, 0X0440,
@@ -209,5 +244,4 @@ unsigned int Modbus::crc16(char *data, unsigned int len) {
     }
 
     return crc;
-
 }
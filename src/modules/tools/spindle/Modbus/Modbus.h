@@ -8,39 +8,94 @@
 #ifndef MODBUS_H
 #define MODBUS_H
 
-#include "libs/Module.h"
-#include <vector>
+#include "TSRingBuffer.h"
 
-class BufferedSoftSerial;
-class GPIO;
+#include <stdint.h>
+#include <functional>
 
-class Modbus : public Module {
+// The bus side of the master, a half duplex RS485 line. On the board it is a soft serial port and a direction pin
+// (ModbusSerial), on the host a loopback can stand in for the slave.
+class ModbusPort {
     public:
-        Modbus( PinName rx_pin, PinName tx_pin, PinName dir_pin);
-        Modbus( PinName rx_pin, PinName tx_pin, PinName dir_pin, int baud_rate);
-        Modbus( PinName rx_pin, PinName tx_pin, PinName dir_pin, int baud_rate, const char *format);
-
-        void on_module_loaded();
-        void on_serial_char_received();
-
-        void read_coil(int slave_addr, int coil_addr, int n_coils);
-        void read_holding_register(int slave_addr, int reg_addr, int n_regs);
-        void write_coil(int slave_addr, int coil_addr, bool data);
-        void write_holding_register(int slave_addr, int reg_addr, int data);
-        void diagnostic(int slave_addr, int test_sub_code, int data);
-        void write_multiple_coils(int slave_addr, int coil_addr, int n_coils, int data);
-        void write_multiple_registers(int slave_addr, int start_addr, int data);
-        void read_write_multiple_holding_registers(int slave_addr, int read_addr, int n_read, int write_addr, int data);
-        void calculate_delay(int baudrate, int bits, int parity, int stop);
-        void delay(unsigned int);
-        unsigned int crc16(char *data, unsigned int len); 
-
-        GPIO *dir_output;
-
-        BufferedSoftSerial* serial;
-        std::vector<int> buffer;
-
-        float delay_time;        
+        virtual ~ModbusPort() {};
+        // takes the bus and starts sending the telegram, returns straight away
+        virtual void transmit(const uint8_t *data, uint8_t len) = 0;
+        // gives the bus back once the telegram has gone out
+        virtual void release() = 0;
+        // the next byte received, -1 when there is none
+        virtual int receive() = 0;
+        // how long one character takes on the line
+        virtual uint32_t char_time_us() const = 0;
+};
+
+// A Modbus RTU master that never blocks. Requests are queued with a callback and sent one at a time by poll(),
+// which is called from on_idle. A reply is only taken when its CRC checks out, a request that gets no good reply within
+// its timeout is sent again up to its retries and then completed as failed.
+class Modbus {
+    public:
+        // called with the reply from the slave address up to but not including the CRC, or nullptr when the request failed
+        using done_t = std::function<void(const uint8_t *reply, uint8_t len)>;
+
+        static const uint8_t max_telegram= 24; // fits in the 32 byte buffers of the soft serial
+        static const uint16_t default_timeout_ms= 100;
+        static const uint8_t default_retries= 2;
+
+        Modbus(ModbusPort *port);
+
+        void poll();
+        bool is_idle() const { return state == IDLE && queue.empty(); }
+        uint32_t get_failures() const { return failures; }
+
+        // any request, without its CRC, for slaves like the Huanyang VFDs that have function codes of their own.
+        // reply_len is the length of the whole reply with its CRC, 0 if it is five plus the byte count in its third byte
+        bool request(const uint8_t *pdu, uint8_t len, uint8_t reply_len, done_t done= nullptr,
+                     uint16_t timeout_ms= default_timeout_ms, uint8_t retries= default_retries);
+
+        // the standard function codes
+        bool read_coils(uint8_t slave, uint16_t addr, uint16_t n, done_t done= nullptr);
+        bool read_holding_registers(uint8_t slave, uint16_t addr, uint16_t n, done_t done= nullptr);
+        bool write_coil(uint8_t slave, uint16_t addr, bool value, done_t done= nullptr);
+        bool write_holding_register(uint8_t slave, uint16_t addr, uint16_t value, done_t done= nullptr);
+        bool diagnostic(uint8_t slave, uint16_t sub_function, uint16_t data, done_t done= nullptr);
+        bool write_multiple_coils(uint8_t slave, uint16_t addr, uint16_t n, const uint8_t *values, done_t done= nullptr);
+        bool write_multiple_registers(uint8_t slave, uint16_t addr, uint16_t n, const uint16_t *values, done_t done= nullptr);
+        bool read_write_multiple_registers(uint8_t slave, uint16_t read_addr, uint16_t n_read, uint16_t write_addr, uint16_t n_write,
+                                           const uint16_t *values, done_t done= nullptr);
+
+        static uint16_t crc16(const uint8_t *data, unsigned int len);
+
+    private:
+        struct transaction_t {
+            uint8_t telegram[max_telegram]; // with its CRC
+            uint8_t len;
+            uint8_t reply_len;
+            uint8_t retries;
+            uint16_t timeout_ms;
+            done_t done;
+        };
+
+        enum STATE_T {
+            IDLE,       // nothing on the bus
+            SENDING,    // the request is going out
+            WAITING,    // for the reply
+            GAP         // the silence between two frames
+        };
+
+        void send(uint32_t now);
+        void retry(uint32_t now);
+        void complete(uint32_t now, const uint8_t *reply, uint8_t len);
+        uint8_t reply_length() const;
+
+        ModbusPort *port;
+        TSRingBuffer<transaction_t, 8> queue;
+        transaction_t current;
+        uint8_t reply[max_telegram];
+        uint8_t reply_count;
+        uint8_t attempts;
+        uint32_t since;         // us when the state was entered
+        uint32_t wait_us;       // how long SENDING and GAP last
+        uint32_t failures;      // requests given up on
+        STATE_T state;
 };
 
 #endif
@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ModbusSerial.h"
+#include "libs/gpio.h"
+#include "BufferedSoftSerial.h"
+
+#include <string.h>
+
+ModbusSerial::ModbusSerial(PinName tx_pin, PinName rx_pin, PinName dir_pin, int baud_rate, const char *format)
+{
+    serial = new BufferedSoftSerial( tx_pin, rx_pin );
+    serial->baud(baud_rate);
+
+    int parity = 0, stop = 1;
+    if(strncmp(format, "8O1", 3) == 0){
+        serial->format(8,serial->Parity::Odd,1);
+        parity = 1;
+    } else if(strncmp(format, "8E1", 3) == 0){
+        serial->format(8,serial->Parity::Even,1);
+        parity = 1;
+    } else if(strncmp(format, "8N2", 3) == 0){
+        serial->format(8,serial->Parity::None,2);
+        stop = 2;
+    } else {
+        serial->format(8,serial->Parity::None,1);
+    }
+
+    // startbit + number of bits + parity bit + stop bits
+    char_time = (1000000 * (1 + 8 + parity + stop) + baud_rate - 1) / baud_rate;
+
+    dir_output = new GPIO(dir_pin);
+    dir_output->output();
+    dir_output->clear();
+}
+
+void ModbusSerial::transmit(const uint8_t *data, uint8_t len)
+{
+    // enable transmitter, the TX interrupt sends the telegram from the buffer
+    dir_output->set();
+    serial->write(data, len);
+}
+
+void ModbusSerial::release()
+{
+    // disable transmitter
+    dir_output->clear();
+}
+
+int ModbusSerial::receive()
+{
+    return serial->readable() ? (uint8_t)serial->getc() : -1;
+}
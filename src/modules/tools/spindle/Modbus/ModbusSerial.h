@@ -0,0 +1,34 @@
+/*
+    This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+    Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+    Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODBUS_SERIAL_H
+#define MODBUS_SERIAL_H
+
+#include "Modbus.h"
+#include "PinNames.h"
+
+class BufferedSoftSerial;
+class GPIO;
+
+// RS485 on a soft serial port, with the transceiver direction on a pin. Received bytes are put in the fixed ring
+// of the BufferedSoftSerial by its RX interrupt and taken out by the master from on_idle.
+class ModbusSerial : public ModbusPort {
+    public:
+        ModbusSerial(PinName tx_pin, PinName rx_pin, PinName dir_pin, int baud_rate= 9600, const char *format= "8N1");
+
+        void transmit(const uint8_t *data, uint8_t len);
+        void release();
+        int receive();
+        uint32_t char_time_us() const { return char_time; }
+
+    private:
+        BufferedSoftSerial *serial;
+        GPIO *dir_output;
+        uint32_t char_time;
+};
+
+#endif
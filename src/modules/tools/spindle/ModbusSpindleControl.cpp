@@ -10,6 +10,7 @@
 #include "libs/Pin.h"
 #include "mbed.h"
 #include "Modbus.h"
+#include "ModbusSerial.h"
 #include "Config.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
@@ -47,7 +48,13 @@ void ModbusSpindleControl::on_module_loaded()
     }
 
     // setup the Modbus interface
-    modbus = new Modbus(tx_pin, rx_pin, dir_pin);
+    modbus = new Modbus(new ModbusSerial(tx_pin, rx_pin, dir_pin));
+}
+
+// the telegrams go out and the replies come back from here, nothing waits for them
+void ModbusSpindleControl::on_idle(void *argument)
+{
+    modbus->poll();
 }
 
 void ModbusSpindleControl::turn_on(void)
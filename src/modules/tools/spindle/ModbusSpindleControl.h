@@ -18,7 +18,8 @@ class ModbusSpindleControl: public SpindleControl {
         ModbusSpindleControl() {};
         virtual ~ModbusSpindleControl() {};
         void on_module_loaded();
-        
+        virtual void on_idle(void *argument);
+
         Modbus* modbus;
         
         virtual void turn_on(void);
@@ -16,6 +16,7 @@
 #include "checksumm.h"
 #include "ConfigValue.h"
 #include "StreamOutputPool.h"
+#include "SpindlePublicAccess.h"
 
 #define spindle_checksum                   CHECKSUM("spindle")
 #define enable_checksum                    CHECKSUM("enable")
@@ -58,8 +59,8 @@ void SpindleMaker::load_spindle(){
     if( spindle != NULL) {
 
         spindle->register_for_event(ON_GCODE_RECEIVED);
-        spindle->register_for_event(ON_GET_PUBLIC_DATA);
-        spindle->register_for_event(ON_SET_PUBLIC_DATA);
+        spindle->register_for_public_data(ON_GET_PUBLIC_DATA, pwm_spindle_control_checksum);
+        spindle->register_for_public_data(ON_SET_PUBLIC_DATA, pwm_spindle_control_checksum);
         spindle->register_for_event(ON_IDLE);
         if (!THEKERNEL->config->value(spindle_checksum, spindle_ignore_on_halt_checksum)->by_default(false)->as_bool()) {
             spindle->register_for_event(ON_HALT);
@@ -96,13 +96,13 @@ void TemperatureControl::on_module_loaded()
 
     // Register for events
     this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, temperature_control_checksum);
     this->register_for_event(ON_IDLE);
     this->register_for_event(ON_SECOND_TICK);
 
     if(!this->readonly) {
         this->register_for_event(ON_MAIN_LOOP);
-        this->register_for_event(ON_SET_PUBLIC_DATA);
+        this->register_for_public_data(ON_SET_PUBLIC_DATA, temperature_control_checksum, this->name_checksum);
         this->register_for_event(ON_HALT);
     }
 }
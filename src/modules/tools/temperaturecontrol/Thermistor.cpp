@@ -180,6 +180,7 @@ void Thermistor::UpdateConfig(uint16_t module_checksum, uint16_t name_checksum)
         return;
     }
 
+    build_table();
 }
 
 // print out predefined thermistors
@@ -234,10 +235,20 @@ void Thermistor::calc_jk()
     }
 }
 
+// precompute the reading path, the temperature is read in the SlowTicker so the logf and divides are done once here
+void Thermistor::build_table()
+{
+    if(this->bad_config) return;
+    if(!table.build([this](uint32_t adc_value) { return adc_value_to_temperature(adc_value); }, THEKERNEL->adc->get_max_value())) {
+        THEKERNEL->streams->printf("WARNING: the thermistor settings give no temperatures between -%d and %d°C\n", ThermistorTable::max_temperature, ThermistorTable::max_temperature);
+        this->bad_config= true;
+    }
+}
+
 float Thermistor::get_temperature()
 {
     if(bad_config) return infinityf();
-    float t= adc_value_to_temperature(new_thermistor_reading());
+    float t= table.lookup(new_thermistor_reading());
     // keep track of min/max for M305
     if(t > max_temp) max_temp= t;
     if(t < min_temp) min_temp= t;
@@ -269,6 +280,7 @@ void Thermistor::get_raw()
         t= (1.0F / (k + (j * logf(r / r0)))) - 273.15F;
         THEKERNEL->streams->printf("beta temp= %f, min= %f, max= %f, delta= %f\n", t, min_temp, max_temp, max_temp-min_temp);
     }
+    THEKERNEL->streams->printf("table temp= %f, %d points within %f°C\n", table.lookup(adc_value), table.get_size(), table.get_tolerance());
 
     // if using a predefined thermistor show its name and which table it is from
     if(thermistor_number != 0) {
@@ -352,6 +364,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
             calc_jk();
             thermistor_number= predefined;
             this->bad_config= false;
+            build_table();
             return true;
 
         }else {
@@ -370,6 +383,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
             use_steinhart_hart= true;
             thermistor_number= predefined;
             this->bad_config= false;
+            build_table();
             return true;
         }
     }
@@ -396,6 +410,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
     }
 
     if(this->bad_config) this->bad_config= false;
+    build_table();
 
     return true;
 }
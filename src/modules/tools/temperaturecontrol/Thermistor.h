@@ -9,6 +9,7 @@
 #define THERMISTOR_H
 
 #include "TempSensor.h"
+#include "ThermistorTable.h"
 #include "RingBuffer.h"
 #include "Pin.h"
 
@@ -37,6 +38,7 @@ class Thermistor : public TempSensor
         int new_thermistor_reading();
         float adc_value_to_temperature(uint32_t adc_value);
         void calc_jk();
+        void build_table();
 
         // Thermistor computation settings using beta, not used if using Steinhart-Hart
         float r0;
@@ -61,6 +63,8 @@ class Thermistor : public TempSensor
         };
 
         Pin  thermistor_pin;
+        // what get_temperature() reads, built from adc_value_to_temperature() whenever the settings change
+        ThermistorTable table;
 
         float min_temp, max_temp;
         struct {
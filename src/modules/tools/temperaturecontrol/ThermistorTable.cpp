@@ -0,0 +1,169 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThermistorTable.h"
+
+#include <math.h>
+#include <algorithm>
+
+// knot temperatures are in 1/64 °C, and a segment is never so wide that the interpolation overflows 32 bits
+#define TEMPERATURE_SCALE 64
+#define MAX_SEGMENT 32767
+
+ThermistorTable::ThermistorTable()
+{
+    table= nullptr;
+}
+
+ThermistorTable::~ThermistorTable()
+{
+    delete table;
+}
+
+static bool in_range(float t)
+{
+    return isfinite(t) && fabsf(t) <= ThermistorTable::max_temperature;
+}
+
+bool ThermistorTable::build(std::function<float(uint32_t)> exact, uint32_t max_adc, float tolerance)
+{
+    if(max_adc < 2 || max_adc > 0xFFFF) return false;
+
+    // the temperature falls as the ADC value rises, so the values in range are one run between the hottest one at lo and
+    // the coldest one at hi. hi is the last value that is finite and not too cold
+    uint32_t a= 1, b= max_adc;
+    if(!(isfinite(exact(a)) && exact(a) >= -max_temperature)) return false;
+    while(b - a > 1) {
+        uint32_t m= (a + b) / 2;
+        float t= exact(m);
+        if(isfinite(t) && t >= -max_temperature) a= m; else b= m;
+    }
+    uint32_t hi= a;
+
+    // and lo the first one that is not too hot
+    if(!in_range(exact(hi))) return false;
+    a= 0; b= hi;
+    while(b - a > 1) {
+        uint32_t m= (a + b) / 2;
+        if(exact(m) <= max_temperature) b= m; else a= m;
+    }
+    uint32_t lo= b;
+
+    table_t *t= new table_t;
+    for(int attempt= 0; attempt < 8; attempt++, tolerance *= 2) {
+        if(place_knots(t, exact, lo, hi, tolerance)) {
+            t->tolerance= tolerance;
+            // an interrupt always runs to the end before the main loop gets here again, so once the pointer is swapped
+            // nothing can still be reading the old table
+            table_t *old= table;
+            table= t;
+            delete old;
+            return true;
+        }
+    }
+
+    delete t;
+    return false;
+}
+
+static int16_t quantize(float t)
+{
+    return roundf(t * TEMPERATURE_SCALE);
+}
+
+// the same sum lookup() does, rounded to the nearest 1/64 °C
+static int32_t interpolate(uint32_t a0, int32_t t0, uint32_t a1, int32_t t1, uint32_t adc)
+{
+    int32_t n= (t1 - t0) * (int32_t)(adc - a0), d= a1 - a0;
+    return t0 + (n >= 0 ? n + d / 2 : n - d / 2) / d;
+}
+
+bool ThermistorTable::place_knots(table_t *t, const std::function<float(uint32_t)> &exact, uint32_t lo, uint32_t hi, float tolerance) const
+{
+    const float limit= tolerance * TEMPERATURE_SCALE;
+    uint32_t a= lo;
+    int16_t ta= quantize(exact(a));
+    t->knots[0]= {(uint16_t)a, ta};
+    t->size= 1;
+
+    auto off= [&](uint32_t b, int16_t tb, uint32_t x) {
+        return fabsf(interpolate(a, ta, b, tb, x) - exact(x) * TEMPERATURE_SCALE) > limit;
+    };
+    // the interpolation error over a segment is largest somewhere inside it, it is checked at the quarters and the middle
+    // while looking for the widest segment
+    auto fits= [&](uint32_t b, int16_t tb) {
+        for(int i= 1; i <= 3; i++) {
+            uint32_t x= a + (b - a) * i / 4;
+            if(x == a) continue;
+            if(off(b, tb, x)) return false;
+        }
+        return true;
+    };
+    // then every ADC value of the one found is checked, so lookup() is within tolerance everywhere
+    auto fits_all= [&](uint32_t b, int16_t tb) {
+        for(uint32_t x= a + 1; x <= b; x++) {
+            if(off(b, tb, x)) return false;
+        }
+        return true;
+    };
+
+    if(fabsf(ta - exact(a) * TEMPERATURE_SCALE) > limit) return false;
+
+    uint32_t width= 1;
+    while(a < hi) {
+        if(t->size == max_knots) return false;
+
+        // double the width while the segment fits, then bisect between the last one that did and the first that did not
+        uint32_t good= 0, bad= 0;
+        uint32_t w= width;
+        while(true) {
+            if(w > hi - a) w= hi - a;
+            if(w > MAX_SEGMENT) w= MAX_SEGMENT;
+            if(w <= good) break;
+            if(!fits(a + w, quantize(exact(a + w)))) {
+                bad= w;
+                break;
+            }
+            good= w;
+            w *= 2;
+        }
+        while(bad != 0 && bad - good > 1) {
+            uint32_t m= (good + bad) / 2;
+            if(fits(a + m, quantize(exact(a + m)))) good= m; else bad= m;
+        }
+        // a segment one wide is only its end knot, that is checked too
+        while(!fits_all(a + good, quantize(exact(a + good)))) {
+            if(good == 1) return false;
+            good -= std::max<uint32_t>(1, good / 16);
+        }
+
+        a += good;
+        ta= quantize(exact(a));
+        t->knots[t->size++]= {(uint16_t)a, ta};
+        width= good;
+    }
+
+    return true;
+}
+
+float ThermistorTable::lookup(uint32_t adc) const
+{
+    const table_t *t= table;
+    if(t == nullptr || adc < t->knots[0].adc || adc > t->knots[t->size - 1].adc) return INFINITY;
+
+    // the last knot at or below adc
+    uint16_t l= 0, h= t->size - 1;
+    while(h - l > 1) {
+        uint16_t m= (l + h) / 2;
+        if(t->knots[m].adc <= adc) l= m; else h= m;
+    }
+
+    const knot_t &k0= t->knots[l];
+    if(k0.adc == adc) return (float)k0.temperature / TEMPERATURE_SCALE;
+    const knot_t &k1= t->knots[h];
+    return (float)interpolate(k0.adc, k0.temperature, k1.adc, k1.temperature, adc) / TEMPERATURE_SCALE;
+}
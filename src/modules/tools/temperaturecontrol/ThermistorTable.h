@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THERMISTORTABLE_H
+#define THERMISTORTABLE_H
+
+#include <stdint.h>
+#include <functional>
+
+// A piecewise linear ADC value to temperature table for a thermistor. It is built from the exact beta or Steinhart-Hart
+// conversion when the thermistor is configured, so a reading in the temperature tick is a binary search and an integer
+// interpolation instead of a logf and two divides. The knots are placed as far apart as the tolerance allows, so they
+// bunch up at both ends of the range where the curve bends the most.
+class ThermistorTable
+{
+    public:
+        ThermistorTable();
+        ~ThermistorTable();
+
+        static const uint16_t max_knots= 128;
+        // °C either way, anything beyond reads as infinity like an open or shorted thermistor
+        static const int16_t max_temperature= 500;
+
+        // exact gives the temperature for an ADC value, infinity where there is none. The knots are placed so that
+        // lookup() stays within tolerance of it at every ADC value, the tolerance is doubled until max_knots are enough.
+        // Returns false, and keeps the old table, if no ADC value gives a temperature in range
+        bool build(std::function<float(uint32_t)> exact, uint32_t max_adc, float tolerance= 0.05F);
+
+        // the temperature for an ADC value, infinity outside the table, safe to call from an interrupt
+        float lookup(uint32_t adc) const;
+
+        uint16_t get_size() const { return table == nullptr ? 0 : table->size; }
+        float get_tolerance() const { return table == nullptr ? 0 : table->tolerance; }
+
+    private:
+        struct knot_t {
+            uint16_t adc;
+            int16_t temperature;    // 1/64 °C
+        };
+
+        struct table_t {
+            float tolerance;
+            uint16_t size;
+            knot_t knots[max_knots];
+        };
+
+        bool place_knots(table_t *t, const std::function<float(uint32_t)> &exact, uint32_t lo, uint32_t hi, float tolerance) const;
+
+        // replaced in one write so the tick never sees a table half built
+        table_t * volatile table;
+};
+
+#endif
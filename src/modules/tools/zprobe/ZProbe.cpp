@@ -28,6 +28,7 @@
 #include "StepTicker.h"
 #include "utils.h"
 #include "us_ticker_api.h"
+#include "InterruptIn.h"
 #include "ATCHandlerPublicAccess.h"
 // strategies we know about
 #include "DeltaCalibrationStrategy.h"
@@ -41,6 +42,7 @@
 #define probe_pin_checksum       CHECKSUM("probe_pin")
 #define calibrate_pin_checksum   CHECKSUM("calibrate_pin")
 #define debounce_ms_checksum     CHECKSUM("debounce_ms")
+#define probe_interrupt_checksum CHECKSUM("probe_interrupt")
 #define slow_feedrate_checksum   CHECKSUM("slow_feedrate")
 #define fast_feedrate_checksum   CHECKSUM("fast_feedrate")
 #define return_feedrate_checksum CHECKSUM("return_feedrate")
@@ -89,8 +91,8 @@ void ZProbe::on_module_loaded()
     this->config_load();
     // register event-handlers
     register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
-    register_for_event(ON_SET_PUBLIC_DATA);
+    register_for_public_data(ON_GET_PUBLIC_DATA, zprobe_checksum);
+    register_for_public_data(ON_SET_PUBLIC_DATA, zprobe_checksum);
     register_for_event(ON_MAIN_LOOP);
 
     this->probing_cycle = NONE;
@@ -100,7 +102,7 @@ void ZProbe::on_module_loaded()
     calibrating = false;
     tlo_calibrating = false;
     THEKERNEL->slow_ticker->attach(1000, this, &ZProbe::read_probe);
-    THEKERNEL->slow_ticker->attach(1000, this, &ZProbe::read_calibrate);
+    calibrate_hook= THEKERNEL->slow_ticker->attach(1000, this, &ZProbe::read_calibrate, false);
 	if(CARVERA_AIR == THEKERNEL->factory_set->MachineModel)	//Manual Tool change 
 	{
     	THEKERNEL->slow_ticker->attach(100, this, &ZProbe::probe_doubleHit);
@@ -116,6 +118,20 @@ void ZProbe::config_load()
     this->probe_calibration_safety_margin = THEKERNEL->config->value(zprobe_checksum, probe_calibration_safety_margin_checksum)->by_default(0.1F)->as_number();
     this->halt_pending = false;
     this->probe_triggered = false;
+    this->probe_latched = false;
+
+    // latch the probe with a pin interrupt instead of waiting for the next read_probe tick
+    this->probe_interrupt = nullptr;
+    if(THEKERNEL->config->value(zprobe_checksum, probe_interrupt_checksum)->by_default(false)->as_bool()) {
+        if (this->pin.port_number == 0 || this->pin.port_number == 2) {
+            this->probe_interrupt = this->pin.interrupt_pin();
+            // the probe may be NO or NC and invert_probe changes per command, so check the level on either edge
+            this->probe_interrupt->rise(this, &ZProbe::on_probe_edge);
+            this->probe_interrupt->fall(this, &ZProbe::on_probe_edge);
+        } else {
+            THEKERNEL->streams->printf("Error: ZProbe interrupt pin has to be on P0 or P2.\n");
+        }
+    }
 
     // get strategies to load
     vector<uint16_t> modules;
@@ -291,6 +307,30 @@ uint32_t ZProbe::read_probe(uint32_t dummy)
 
     if (!probing) return 0;
 
+    if (probe_latched) {
+        // the edge interrupt latched the position, make sure it was not a glitch before stopping the move
+        if (!probe_detected) {
+            if (this->pin.get() != invert_probe) {
+                if (debounce < debounce_ms) {
+                    debounce ++;
+                    return 0;
+                }
+                probe_detected = true;
+                probe_pin_position = probe_latched_steps[Z_AXIS] / Z_STEPS_PER_MM;
+                // if we are calibrating, the stop to the actuators comes from the read_calibrate method
+                if (!calibrating) {
+                    for (auto &a : THEROBOT->actuators) a->stop_moving();
+                }
+                debounce = 0;
+            } else {
+                // a glitch, the move carries on and the next edge latches again
+                probe_latched = false;
+                debounce = 0;
+            }
+        }
+        return 0;
+    }
+
     // we check all axis as it maybe a G38.2 X10 for instance, not just a probe in Z
     if(STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving() || STEPPER[Z_AXIS]->is_moving()) {
         // if it is moving then we check the probe, and debounce it
@@ -319,6 +359,48 @@ uint32_t ZProbe::read_probe(uint32_t dummy)
     return 0;
 }
 
+// called from the pin interrupt, latches where every actuator is when the probe triggers. With no debounce
+// the motors are stopped before they take another step, otherwise read_probe debounces it on the following
+// ticks and only stops them once the pin has stayed on, so a glitch does not end the move
+void ZProbe::on_probe_edge()
+{
+    if (!probing || probe_latched || this->pin.get() == invert_probe) return;
+    if (!(STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving() || STEPPER[Z_AXIS]->is_moving())) return;
+
+    for (size_t i = 0; i < STEPPER.size(); i++) {
+        probe_latched_steps[i] = (int32_t)STEPPER[i]->get_current_step();
+    }
+    probe_latched = true;
+
+    if (debounce_ms == 0) {
+        probe_detected = true;
+        probe_pin_position = probe_latched_steps[Z_AXIS] / Z_STEPS_PER_MM;
+        // if we are calibrating, the stop to the actuators comes from the read_calibrate method
+        if (!calibrating) {
+            for (auto &a : THEROBOT->actuators) a->stop_moving();
+        }
+    }
+}
+
+// the move can end while a latch is still being debounced, so give read_probe the time to finish it
+void ZProbe::wait_for_probe_debounce()
+{
+    while (probe_latched && !probe_detected && !THEKERNEL->is_halted()) {
+        THEKERNEL->call_event(ON_IDLE);
+    }
+}
+
+// machine position the probe was latched at, worked out the same way as Robot::reset_position_from_current_actuator_position
+void ZProbe::get_latched_position(float pos[3])
+{
+    ActuatorCoordinates actuator_pos;
+    for (size_t i = 0; i < STEPPER.size(); i++) {
+        actuator_pos[i] = probe_latched_steps[i] / STEPS_PER_MM(i);
+    }
+    THEROBOT->arm_solution->actuator_to_cartesian(actuator_pos, pos);
+    if(THEROBOT->compensationTransform) THEROBOT->compensationTransform(pos, true, false);
+}
+
 uint32_t ZProbe::read_calibrate(uint32_t dummy)
 {
     if (!calibrating) return 0;
@@ -437,6 +519,7 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
     probing = true;
     calibrating = false;
     probe_detected = false;
+    probe_latched = false;
     debounce = 0;
     cali_debounce = 0;
 
@@ -455,11 +538,12 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
 
     // wait until finished
     THECONVEYOR->wait_for_idle();
+    wait_for_probe_debounce();
     if(THEKERNEL->is_halted()) return false;
 
     // now see how far we moved, get delta in z we moved
     // NOTE this works for deltas as well as all three actuators move the same amount in Z
-    mm = z_start_pos - THEROBOT->actuators[2]->get_current_position();
+    mm = z_start_pos - (probe_detected && probe_latched ? probe_latched_steps[Z_AXIS] / Z_STEPS_PER_MM : THEROBOT->actuators[2]->get_current_position());
 
     // set the last probe position to the actuator units moved during this home
     THEROBOT->set_last_probe_position(std::make_tuple(0, 0, mm, probe_detected ? 1:0));
@@ -830,6 +914,7 @@ bool ZProbe::probe_XYZ(Gcode *gcode)
     
     probing = true;
     probe_detected = false;
+    probe_latched = false;
     calibrating = false;
     debounce = 0;
     cali_debounce = 0;
@@ -850,6 +935,7 @@ bool ZProbe::probe_XYZ(Gcode *gcode)
     THEKERNEL->set_zprobing(false);
 
     THEKERNEL->conveyor->wait_for_idle();
+    wait_for_probe_debounce();
 
     // disable probe checking
     probing = false;
@@ -858,7 +944,12 @@ bool ZProbe::probe_XYZ(Gcode *gcode)
     // this also sets last_milestone to the machine coordinates it stopped at
     THEROBOT->reset_position_from_current_actuator_position();
     float pos[3];
-    THEROBOT->get_axis_position(pos, 3);
+    if(probe_detected && probe_latched) {
+        // report where the probe triggered rather than where the axes came to a stop
+        get_latched_position(pos);
+    } else {
+        THEROBOT->get_axis_position(pos, 3);
+    }
 
     if(THEKERNEL->is_flex_compensation_active()) {
         if(THEROBOT->compensationTransform) THEROBOT->compensationTransform(pos, true, false); // get inverse compensation transform
@@ -943,7 +1034,9 @@ void ZProbe::calibrate_Z(Gcode *gcode)
 
     probing = false;
     calibrating = true;
+    THEKERNEL->slow_ticker->set_enabled(calibrate_hook, true);
     probe_detected = false;
+    probe_latched = false;
     calibrate_detected = false;
     debounce = 0;
     cali_debounce = 0;
@@ -963,16 +1056,19 @@ void ZProbe::calibrate_Z(Gcode *gcode)
         THEKERNEL->set_halt_reason(PROBE_FAIL);
         THEKERNEL->call_event(ON_HALT, nullptr);
         calibrating = false;
+        THEKERNEL->slow_ticker->set_enabled(calibrate_hook, false);
         THEKERNEL->set_zprobing(false);
         return;
     }
     THEKERNEL->set_zprobing(false);
 
     THEKERNEL->conveyor->wait_for_idle();
+    wait_for_probe_debounce();
 
     // disable calibrate and probe tracking
     calibrating = false;
     probing = false;
+    THEKERNEL->slow_ticker->set_enabled(calibrate_hook, false);
 
     // if the probe stopped the move we need to correct the last_milestone as it did not reach where it thought
     // this also sets last_milestone to the machine coordinates it stopped at
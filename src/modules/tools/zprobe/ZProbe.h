@@ -12,9 +12,14 @@
 #include "Pin.h"
 #include <fastmath.h>
 #include "ATCHandlerPublicAccess.h"
+#include "ActuatorCoordinates.h"
 
 #include <vector>
 
+namespace mbed {
+    class InterruptIn;
+}
+
 // defined here as they are used in multiple files
 #define zprobe_checksum            CHECKSUM("zprobe")
 #define leveling_strategy_checksum CHECKSUM("leveling-strategy")
@@ -23,6 +28,7 @@ class StepperMotor;
 class Gcode;
 class StreamOutput;
 class LevelingStrategy;
+class Hook;
 
 // Homing States
 enum PROBING_CYCLES {
@@ -146,6 +152,9 @@ private:
     void single_axis_probe_double_tap();
     void calibrate_Z(Gcode *gc);
     uint32_t read_probe(uint32_t dummy);
+    void on_probe_edge();
+    void wait_for_probe_debounce();
+    void get_latched_position(float pos[3]);
     uint32_t read_calibrate(uint32_t dummy);
     void on_get_public_data(void* argument);
     void on_set_public_data(void* argument);
@@ -171,6 +180,8 @@ private:
 
     Pin pin;
     Pin calibrate_pin;
+    mbed::InterruptIn *probe_interrupt;
+    Hook *calibrate_hook;       // read_calibrate, only enabled while calibrating
     std::vector<LevelingStrategy*> strategies;
     uint16_t debounce_ms;
 	volatile uint16_t debounce, cali_debounce;
@@ -184,6 +195,8 @@ private:
     volatile bool calibrate_detected;
     volatile bool probe_triggered;
     volatile bool halt_pending;
+    volatile bool probe_latched;    // set by the edge interrupt, read_probe then debounces it
+    int32_t probe_latched_steps[k_max_actuators];
 
     PROBING_CYCLES probing_cycle;
 
@@ -0,0 +1,151 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CompressedFile.h"
+
+#include <string.h>
+
+#define SUM_SIZE 2
+
+// the QuickLZ block header, a flags byte then the compressed and decompressed sizes in 1 or 4 bytes each
+static size_t qlz_header_size(const char *q)
+{
+    return (*q & 2) ? 9 : 3;
+}
+
+CompressedFile::CompressedFile(uint8_t *in, size_t in_size, uint8_t *out, size_t out_size)
+{
+    this->fp= NULL;
+    this->in= in;
+    this->in_size= in_size;
+    this->out= out;
+    this->out_size= out_size;
+    this->data_end= 0;
+    this->rewind();
+}
+
+void CompressedFile::attach(FILE *fp)
+{
+    this->fp= fp;
+    this->data_end= 0;
+    if(fseek(fp, 0, SEEK_END) == 0) {
+        this->data_end= ftell(fp) - SUM_SIZE;
+    }
+    this->rewind();
+}
+
+void CompressedFile::rewind()
+{
+    if(this->fp != NULL) fseek(this->fp, 0, SEEK_SET);
+    this->file_pos= 0;
+    this->block_pos= 0;
+    this->out_head= 0;
+    this->out_tail= 0;
+    this->blocks= 0;
+    this->sum= 0;
+    this->damaged= this->fp != NULL && this->data_end < 0;
+    this->stale= false;
+    memset(&this->state, 0, sizeof(this->state));
+}
+
+size_t CompressedFile::read(void *buf, size_t size)
+{
+    if(this->stale) {
+        // out was lent, the same block again without counting it twice
+        this->stale= false;
+        if(this->out_head < this->out_tail) {
+            size_t head= this->out_head;
+            this->file_pos= this->block_pos;
+            if(!this->read_block(false)) return 0;
+            this->out_head= head;
+        }
+    }
+
+    size_t n= 0;
+    while(n < size) {
+        if(this->out_head == this->out_tail && !this->read_block(true)) break;
+        size_t k= this->out_tail - this->out_head;
+        if(k > size - n) k= size - n;
+        memcpy((uint8_t *)buf + n, this->out + this->out_head, k);
+        this->out_head += k;
+        n += k;
+    }
+    return n;
+}
+
+bool CompressedFile::next_block()
+{
+    return this->read_block(true);
+}
+
+bool CompressedFile::sum_matches()
+{
+    if(this->damaged || this->file_pos != this->data_end) return false;
+
+    uint8_t s[SUM_SIZE];
+    if(fseek(this->fp, this->data_end, SEEK_SET) != 0 || fread(s, 1, SUM_SIZE, this->fp) != SUM_SIZE) return false;
+    return ((s[0] << 8) | s[1]) == this->sum;
+}
+
+long CompressedFile::length()
+{
+    long size= 0;
+    long pos= 0;
+    while(pos < this->data_end) {
+        // the block length and as much of the QuickLZ header as there is
+        uint8_t h[BLOCK_HEADER_SIZE + 9];
+        if(fseek(this->fp, pos, SEEK_SET) != 0) return -1;
+        size_t n= fread(h, 1, sizeof(h), this->fp);
+        if(n < BLOCK_HEADER_SIZE + 3) return -1;
+        size_t block= ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | (h[2] << 8) | h[3];
+        const char *q= (const char *)&h[BLOCK_HEADER_SIZE];
+        if(block > this->in_size || n < BLOCK_HEADER_SIZE + qlz_header_size(q) || qlz_size_compressed(q) != block ||
+           qlz_size_decompressed(q) > this->out_size) {
+            return -1;
+        }
+        size += qlz_size_decompressed(q);
+        pos += BLOCK_HEADER_SIZE + block;
+    }
+    this->rewind();
+    return pos == this->data_end ? size : -1;
+}
+
+// decompresses the block at file_pos into out, count is false when the block has been read before
+bool CompressedFile::read_block(bool count)
+{
+    if(this->damaged || this->file_pos >= this->data_end) return false;
+
+    uint8_t h[BLOCK_HEADER_SIZE];
+    if(fseek(this->fp, this->file_pos, SEEK_SET) != 0 || fread(h, 1, BLOCK_HEADER_SIZE, this->fp) != BLOCK_HEADER_SIZE) {
+        this->damaged= true;
+        return false;
+    }
+    size_t block= ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | (h[2] << 8) | h[3];
+    if(block < 3 || block > this->in_size || this->file_pos + BLOCK_HEADER_SIZE + (long)block > this->data_end ||
+       fread(this->in, 1, block, this->fp) != block) {
+        this->damaged= true;
+        return false;
+    }
+
+    const char *q= (const char *)this->in;
+    size_t n= qlz_size_decompressed(q);
+    if(block < qlz_header_size(q) || qlz_size_compressed(q) != block || n == 0 || n > this->out_size ||
+       qlz_decompress(q, this->out, &this->state) != n) {
+        this->damaged= true;
+        return false;
+    }
+
+    this->block_pos= this->file_pos;
+    this->file_pos += BLOCK_HEADER_SIZE + block;
+    this->out_head= 0;
+    this->out_tail= n;
+    if(count) {
+        for(size_t i= 0; i < n; i++) this->sum += this->out[i];
+        this->blocks++;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPRESSEDFILE_H
+#define COMPRESSEDFILE_H
+
+#include "quicklz.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// A file uploaded with a .lz name, kept compressed in /sd/gcodes/.lz and read back as gcode without being expanded on
+// the SD card. It is a run of blocks, each a 4 byte big endian length and a QuickLZ block of at most out_size bytes of
+// gcode, then a 16 bit sum of every byte of the gcode, high byte first.
+//
+// Blocks are decompressed one at a time into out through in, neither is needed between calls except for the unread
+// part of the block in out. A caller that lends out to something else in between calls invalidate() and the block is
+// decompressed again before it is read on.
+class CompressedFile {
+    public:
+        CompressedFile(uint8_t *in, size_t in_size, uint8_t *out, size_t out_size);
+
+        // takes a file opened for reading, and reads it from the start
+        void attach(FILE *fp);
+        void rewind();
+
+        // up to size bytes of gcode, fewer only at the end of the file or at a damaged block
+        size_t read(void *buf, size_t size);
+        void invalidate() { stale = true; }
+
+        // the next block into out, false at the end of the file or at a damaged block
+        bool next_block();
+        // once every block has been read, whether the sum at the end matches them
+        bool sum_matches();
+
+        // the size of the gcode from the block headers alone, -1 if they are damaged, the file is read from the
+        // start again afterwards
+        long length();
+
+        bool is_damaged() const { return damaged; }
+        uint32_t get_blocks() const { return blocks; }
+        // the size of the block in out
+        size_t get_block_size() const { return out_tail; }
+
+    private:
+        bool read_block(bool count);
+
+        FILE *fp;
+        uint8_t *in;
+        uint8_t *out;
+        size_t in_size;
+        size_t out_size;
+        long data_end;      // where the sum starts
+        long file_pos;      // where the next block starts
+        long block_pos;     // where the block in out starts
+        size_t out_head;    // the unread part of the block in out
+        size_t out_tail;
+        uint32_t blocks;    // read since the start of the file
+        uint16_t sum;
+        bool damaged;
+        bool stale;
+        qlz_state_decompress state;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "ConfigValue.h"
 #include "SDFAT.h"
 #include "md5.h"
+#include "Md5Cache.h"
 
 #include "modules/robot/Conveyor.h"
 #include "DirHandle.h"
@@ -32,7 +33,9 @@
 #include "TemperatureControlPool.h"
 #include "StepTicker.h"
 #include "Block.h"
-#include "quicklz.h"
+#include "WindowedUpload.h"
+#include "crc16.h"
+#include "CompressedFile.h"
 
 #include <math.h>
 
@@ -49,11 +52,17 @@
 #define before_resume_gcode_checksum      CHECKSUM("before_resume_gcode")
 #define leave_heaters_on_suspend_checksum CHECKSUM("leave_heaters_on_suspend")
 #define laser_module_clustering_checksum 	  CHECKSUM("laser_module_clustering")
+#define laser_module_maximum_s_value_checksum CHECKSUM("laser_module_maximum_s_value")
 
 extern SDFAT mounter;
 
 unsigned char xbuff[8200] __attribute__((section("AHBSRAM"))); /* 2 for data length, 8192 for XModem + 3 head chars + 2 crc + nul */
 static unsigned char fbuff[4096] __attribute__((section("AHBSRAM")));
+// the file being played is read two sectors at a time, lines are split where they lie in rbuff
+#define READ_AHEAD_SIZE 1024
+#define MAX_LINE_SIZE 129 // lines up to 128 characters plus the newline are allowed, anything longer is discarded
+#define FEED_TIME_US 5000 // longest the player feeds lines before letting the rest of the main loop run
+static char rbuff[READ_AHEAD_SIZE + MAX_LINE_SIZE] __attribute__((section("AHBSRAM")));
 // used for XMODEM
 #define SOH  0x01
 #define STX  0x02
@@ -67,7 +76,7 @@ static unsigned char fbuff[4096] __attribute__((section("AHBSRAM")));
 #define TIMEOUT_MS 100
 
 
-Player::Player()
+Player::Player() : compressed_file(xbuff, sizeof(xbuff), fbuff, sizeof(fbuff))
 {
     this->playing_file = false;
     this->current_file_handler = nullptr;
@@ -75,11 +84,18 @@ Player::Player()
     this->elapsed_secs = 0;
     this->reply_stream = nullptr;
     this->inner_playing = false;
-    this->slope = 0.0;
+    this->cluster_count = 0;
     this->has_last_progress = false;
     this->last_played_lines = 0;
     this->last_percent_complete = 0;
     this->last_elapsed_secs = 0;
+    this->fed_lines = 0;
+    this->lines_per_sec = 0;
+    this->underruns = 0;
+    this->queue_was_running = false;
+    this->compressed = false;
+    this->raster_s_scale = 1.0F / 255.0F;
+    this->reset_read_ahead();
 }
 
 void Player::on_module_loaded()
@@ -87,8 +103,8 @@ void Player::on_module_loaded()
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, player_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, player_checksum);
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_HALT);
 
@@ -104,6 +120,8 @@ void Player::on_module_loaded()
     this->leave_heaters_on = THEKERNEL->config->value(leave_heaters_on_suspend_checksum)->by_default(false)->as_bool();
 
     this->laser_clustering = THEKERNEL->config->value(laser_module_clustering_checksum)->by_default(false)->as_bool();
+    // raster intensities run from 0 to 255 for no power to the laser's full S value
+    this->raster_s_scale = THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number() / 255.0F;
 }
 
 void Player::on_halt(void* argument)
@@ -126,6 +144,8 @@ void Player::on_halt(void* argument)
 void Player::on_second_tick(void *)
 {
     if(this->playing_file) this->elapsed_secs++;
+    this->lines_per_sec = this->fed_lines;
+    this->fed_lines = 0;
 }
 
 void Player::select_file(string argument)
@@ -155,20 +175,15 @@ void Player::select_file(string argument)
         this->playing_file = false;
         fclose(this->current_file_handler);
     }
-    this->current_file_handler = fopen( this->filename.c_str(), "r");
-
-    if(this->current_file_handler == NULL) {
+    if(!this->open_file(this->filename)) {
         THEKERNEL->streams->printf("file.open failed: %s\r\n", this->filename.c_str());
         return;
 
     } else {
         // get size of file
-        int result = fseek(this->current_file_handler, 0, SEEK_END);
-        if (0 != result) {
+        this->file_size = this->file_length();
+        if (this->file_size < 0) {
             this->file_size = 0;
-        } else {
-            this->file_size = ftell(this->current_file_handler);
-            fseek(this->current_file_handler, 0, SEEK_SET);
         }
         THEKERNEL->streams->printf("File opened:%s Size:%ld\r\n", this->filename.c_str(), this->file_size);
         THEKERNEL->streams->printf("File selected\r\n");
@@ -186,31 +201,150 @@ void Player::goto_line_number(unsigned long line_number)
     this->goto_line = this->goto_line < 1 ? 1 : this->goto_line;
     THEKERNEL->streams->printf("Goto line %lu...\r\n", this->goto_line);
     // goto line
-    char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
 
     // goto file begin
-    fseek(this->current_file_handler, 0, SEEK_SET);
+    if (this->compressed) {
+        this->compressed_file.rewind();
+    } else {
+        fseek(this->current_file_handler, 0, SEEK_SET);
+    }
+    this->reset_read_ahead();
     played_lines = 0;
     played_cnt   = 0;
 
     // Read lines until we've positioned at the target line
-    // We want to break BEFORE reading the target line, so the file pointer is at the target
+    // We want to break BEFORE reading the target line, so the next line read is the target
+    size_t len;
     while (played_lines < this->goto_line - 1) {
-        if (fgets(buf, sizeof(buf), this->current_file_handler) == NULL) {
+        const char *line = this->next_line(len);
+        if (line == NULL) {
             break; // EOF reached
         }
-        
+
+        // the pixels of a raster scanline are part of its header line
+        if (this->start_raster(line, len)) {
+            size_t n;
+            while (this->raster_left > 0 && this->next_bytes(std::min<uint32_t>(this->raster_left, MAX_LINE_SIZE), n) != NULL) {
+                this->raster_left -= n;
+                played_cnt += n;
+            }
+            this->raster_left = 0;
+        }
+
         if (played_lines % 100 == 0) {
             THEKERNEL->call_event(ON_IDLE);
         }
-        int len = strlen(buf);
-        if (len == 0) continue; // empty line? should not be possible
 
         played_lines += 1;
         played_cnt += len;
     }
 }
 
+bool Player::open_file(const string &fn)
+{
+    this->current_file_handler = fopen(fn.c_str(), "r");
+    this->compressed = false;
+    if(this->current_file_handler == NULL && fn.compare(0, 11, "/sd/gcodes/") == 0) {
+        // uploaded compressed, there is only the copy in .lz
+        this->current_file_handler = fopen(change_to_lz_path(fn).c_str(), "rb");
+        this->compressed = this->current_file_handler != NULL;
+    }
+    if(this->current_file_handler == NULL) return false;
+
+    // whole sector reads then go straight from the card into rbuff instead of through the stdio buffer
+    setvbuf(this->current_file_handler, NULL, _IONBF, 0);
+    if(this->compressed) this->compressed_file.attach(this->current_file_handler);
+    this->reset_read_ahead();
+    return true;
+}
+
+// the size of the gcode in the file just opened, which is read from the start afterwards, -1 if it is not known
+long Player::file_length()
+{
+    if(this->compressed) return this->compressed_file.length();
+
+    if(fseek(this->current_file_handler, 0, SEEK_END) != 0) return -1;
+    long size = ftell(this->current_file_handler);
+    fseek(this->current_file_handler, 0, SEEK_SET);
+    return size;
+}
+
+// must be called whenever the file is opened or seeked
+void Player::reset_read_ahead()
+{
+    this->read_head = 0;
+    this->read_tail = 0;
+    this->read_eof = false;
+    this->discarding = false;
+    this->raster_left = 0;
+}
+
+// moves the unread tail of the buffer to the front and reads the next two sectors behind it,
+// as every read is a whole number of sectors the card is always read on sector boundaries.
+// A compressed file gives the next 1K of gcode instead, decompressing blocks as it goes
+bool Player::fill_read_ahead()
+{
+    if(this->read_eof) return false;
+
+    size_t n = this->read_tail - this->read_head;
+    memmove(rbuff, rbuff + this->read_head, n);
+    size_t r = this->compressed ? this->compressed_file.read(rbuff + n, READ_AHEAD_SIZE) :
+                                  fread(rbuff + n, 1, READ_AHEAD_SIZE, this->current_file_handler);
+    this->read_head = 0;
+    this->read_tail = n + r;
+    if(r < READ_AHEAD_SIZE) this->read_eof = true;
+    return r > 0;
+}
+
+// returns the next line where it lies in rbuff, including its newline, or NULL at the end of the file
+// the line is only valid until the next call
+const char *Player::next_line(size_t &len)
+{
+    while(true) {
+        const char *line = rbuff + this->read_head;
+        size_t n = this->read_tail - this->read_head;
+        const char *nl = (const char *)memchr(line, '\n', this->discarding ? n : std::min(n, (size_t)MAX_LINE_SIZE));
+        if(nl != NULL) {
+            len = nl - line + 1;
+            this->read_head += len;
+            if(this->discarding) { // end of a long line
+                this->discarding = false;
+                continue;
+            }
+            return line;
+        }
+
+        if(!this->discarding && n >= MAX_LINE_SIZE) {
+            // discard long line
+            if (this->current_stream != nullptr) { this->current_stream->printf("Warning: Discarded long line\n"); }
+            this->discarding = true;
+            continue;
+        }
+        if(this->discarding) this->read_head = this->read_tail;
+
+        if(!this->fill_read_ahead()) {
+            // last line without a newline
+            line = rbuff + this->read_head;
+            len = this->read_tail - this->read_head;
+            if(len == 0 || this->discarding) return NULL;
+            this->read_head = this->read_tail;
+            return line;
+        }
+    }
+}
+
+// returns up to want bytes of binary data where they lie in rbuff, fewer only at the end of the file, or NULL once
+// there is nothing left, want must be no more than MAX_LINE_SIZE. The data is only valid until the next call
+const uint8_t *Player::next_bytes(size_t want, size_t &len)
+{
+    if(this->read_tail - this->read_head < want) this->fill_read_ahead();
+    len = std::min(want, (size_t)(this->read_tail - this->read_head));
+    if(len == 0) return NULL;
+    const uint8_t *data = (const uint8_t *)rbuff + this->read_head;
+    this->read_head += len;
+    return data;
+}
+
 void Player::end_of_file()
 {
     if (this->macro_file_queue.empty()) {
@@ -290,9 +424,7 @@ void Player::on_gcode_received(void *argument)
 
                 if(!currentfn.empty()) {
                     // reload the last file opened
-                    this->current_file_handler = fopen(currentfn.c_str() , "r");
-
-                    if(this->current_file_handler == NULL) {
+                    if(!this->open_file(currentfn)) {
                         gcode->stream->printf("file.open failed: %s\r\n", currentfn.c_str());
                     } else {
                         this->filename = currentfn;
@@ -518,8 +650,7 @@ void Player::play_command( string parameters, StreamOutput *stream )
     //empty macro queue
     this->clear_macro_file_queue();
 
-    this->current_file_handler = fopen( this->filename.c_str(), "r");
-    if(this->current_file_handler == NULL) {
+    if(!this->open_file(this->filename)) {
         stream->printf("File not found: %s\r\n", this->filename.c_str());
         return;
     }
@@ -537,13 +668,11 @@ void Player::play_command( string parameters, StreamOutput *stream )
     }
 
     // get size of file
-    int result = fseek(this->current_file_handler, 0, SEEK_END);
-    if (0 != result) {
+    file_size = this->file_length();
+    if (file_size < 0) {
         stream->printf("WARNING - Could not get file size\r\n");
         file_size = 0;
     } else {
-        file_size = ftell(this->current_file_handler);
-        fseek(this->current_file_handler, 0, SEEK_SET);
         stream->printf("  File size %ld\r\n", file_size);
     }
     this->played_cnt = 0;
@@ -552,6 +681,7 @@ void Player::play_command( string parameters, StreamOutput *stream )
     this->playing_lines = 0;
     this->goto_line = 0;
     this->has_last_progress = false;  // new job started, stop reporting previous job's last progress
+    this->underruns = 0;
 
     // force into absolute mode
     THEROBOT->absolute_mode = true;
@@ -617,7 +747,7 @@ void Player::progress_command( string parameters, StreamOutput *stream )
             if(est > 0) {
                 stream->printf(", est time: %02lu:%02lu:%02lu",  est / 3600, (est % 3600) / 60, est % 60);
             }
-            stream->printf("\r\n");
+            stream->printf(", %lu lines/s, %lu underruns\r\n", this->lines_per_sec, this->underruns);
         } else {
             stream->printf("SD printing byte %lu/%lu\r\n", played_cnt, file_size);
         }
@@ -723,11 +853,13 @@ void Player::on_main_loop(void *argument)
 
     if ( this->playing_file ) {
         if(THEKERNEL->is_halted() || THEKERNEL->is_suspending() || THEKERNEL->is_waiting() || this->inner_playing) {
+            this->queue_was_running = false;
             return;
         }
 
         // check if there are bufferd command
         while (!this->buffered_queue.empty()) {
+            this->queue_was_running = false;
         	THEKERNEL->streams->printf("%s\r\n", this->buffered_queue.front().c_str());
 			struct SerialMessage message;
 			message.message = this->buffered_queue.front();
@@ -740,111 +872,55 @@ void Player::on_main_loop(void *argument)
             return;
         }
 
-        char buf[130]; // lines up to 128 characters are allowed, anything longer is discarded
-        bool discard = false;
-
-        // 2024
-        /*
-        bool is_cluster = false;
-        int cluster_index = 0;
-        float x_value = 0.0, y_value = 0.0, sum_x_value = 0.0, sum_y_value = 0.0,
-        		s_value = 0.0, distance = 0.0, min_distance = 10000.0, min_value = 0.0,
-				sum_distance = 0.0, sum_value = 0.0;
-        string clustered_gcode = "";
-        float clustered_s_value[8];
-        float clustered_distance[8];
-        */
-
-        while (fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
-
-            int len = strlen(buf);
-            if (len == 0) continue; // empty line? should not be possible
-            if (buf[len - 1] == '\n' || feof(this->current_file_handler)) {
-                if(discard) { // we are discarding a long line
-                    discard = false;
-                    continue;
-                }
+        // the machine stopped because the last pass did not leave enough in the queue
+        if(this->queue_was_running && THECONVEYOR->is_queue_empty()) {
+            this->underruns++;
+        }
 
-                if (len == 1) continue; // empty line
-
-                /*
-            	// Add laser cluster support when in laser mode
-            	if (this->laser_clustering && THEKERNEL->get_laser_mode() && !THEROBOT->absolute_mode && played_lines > 100) {
-            		// G1 X0.5 Y 0.8 S1:0:0.5:0.75:0:0.2
-            		is_cluster = this->check_cluster(buf, &x_value, &y_value, &distance, &slope, &s_value);
-                    min_value = fmin(min_distance, distance);
-                    sum_value = sum_distance + distance;
-            		if (is_cluster && (min_value > 0 && sum_value * 1.0 / min_value < 8.1)) {
-                        min_distance = min_value;
-                        sum_distance = sum_value;
-                        sum_x_value += x_value;
-                        sum_y_value += y_value;
-                        cluster_index ++;
-                        clustered_s_value[cluster_index - 1] = s_value;
-                        clustered_distance[cluster_index - 1] = distance;
-                        played_lines += 1;
-                        played_cnt += len;
-						if (cluster_index >= 8 || (min_distance > 0 && sum_distance * 1.0 / min_distance > 7.9)) {
-	                        sprintf(md5_str, "G1 X%.3f Y%.3f S", sum_x_value, sum_y_value);
-	                        clustered_gcode = md5_str;
-	                        for (int i = 0; i < cluster_index; i ++) {
-	                            for (float j = min_distance; j < clustered_distance[i] + 0.01; j+= min_distance) {
-	                            	sprintf(md5_str, "%s%.2f", (i == 0 ? "" : ":"), clustered_s_value[i]);
-	                                clustered_gcode.append(md5_str);
-	                            }
-	                        }
-
-							struct SerialMessage message;
-							message.message = clustered_gcode;
-							message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
-							message.line = played_lines + 1;
-
-							// waits for the queue to have enough room
-							THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-							// fputs(clustered_gcode.c_str(), this->temp_file_handler);
-							// fputs("\n", this->temp_file_handler);
-							// THEKERNEL->streams->printf("1-[Line: %d] %s\n", message.line, clustered_gcode.c_str());
-							return;
-						}
-						continue;
-            		} else {
-                		if (cluster_index > 0) {
-	                        sprintf(md5_str, "G1 X%.3f Y%.3f S", sum_x_value, sum_y_value);
-	                        clustered_gcode = md5_str;
-	                        for (int i = 0; i < cluster_index; i ++) {
-	                            for (float j = min_distance; j < clustered_distance[i] + 0.01; j+= min_distance) {
-	                            	sprintf(md5_str, "%s%.2f", (i == 0 ? "" : ":"), clustered_s_value[i]);
-	                                clustered_gcode.append(md5_str);
-	                            }
-	                        }
-	                        clustered_gcode.append("\n");
-
-    						struct SerialMessage message;
-    						message.message = clustered_gcode;
-    						message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
-    						message.line = played_lines + 1;
-
-    						// waits for the queue to have enough room
-    						THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-    						// fputs(clustered_gcode.c_str(), this->temp_file_handler);
-    						// fputs("\n", this->temp_file_handler);
-    						// THEKERNEL->streams->printf("2-[Line: %d] %s\n", message.line, clustered_gcode.c_str());
-                		}
-                        sum_x_value = 0.0;
-                        sum_y_value = 0.0;
-                        sum_distance = 0.0;
-                        cluster_index = 0;
-                        min_distance = 10000.0;
-            		}
-            	}
-*/
+        // finish the scanline the last pass stopped in before reading any more lines
+        uint32_t start_us = us_ticker_read();
+        if (!this->play_raster(start_us)) {
+            this->queue_was_running = !THECONVEYOR->is_queue_empty();
+            return;
+        }
+
+        const char *buf;
+        size_t len;
+        while ((buf = this->next_line(len)) != NULL) {
+            if (len == 1) continue; // empty line
+
+            if (this->laser_clustering && this->cluster_line(buf, len)) {
+                played_lines += 1;
+                played_cnt += len;
+                fed_lines += 1;
+                if (this->cluster_count < Block::max_s_values) continue;
+                this->flush_cluster();
+
+            } else {
+                // anything else goes after the pixels before it
+                this->flush_cluster();
 
                 if (this->current_stream != nullptr) {
-                    this->current_stream->printf("%s", buf);
+                    this->current_stream->printf("%.*s", (int)len, buf);
+                }
+
+                // a raster header is played here with its pixels rather than as a command
+                if (this->start_raster(buf, len)) {
+                    played_lines += 1;
+                    played_cnt += len;
+                    fed_lines += 1;
+                    if (!this->play_raster(start_us)) {
+                        this->queue_was_running = !THECONVEYOR->is_queue_empty();
+                        return;
+                    }
+                    continue;
                 }
 
+                //M335 disables line by line, M336 Enables. Pauses after every valid gcode line
+                bool pause_after = THEKERNEL->get_line_by_line_exec_mode() && len > 2 && buf[0] != ';' && buf[0] != '(';
+
                 struct SerialMessage message;
-                message.message = buf;
+                message.message.assign(buf, len);
                 message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
                 message.line = played_lines + 1;
 
@@ -855,18 +931,31 @@ void Player::on_main_loop(void *argument)
                 // THEKERNEL->streams->printf("0-[Line: %d] %s\n", message.line, buf);
                 played_lines += 1;
                 played_cnt += len;
-                //M335 disables line by line, M336 Enables. Pauses after every valid gcode line
-                if (THEKERNEL->get_line_by_line_exec_mode() && len > 2 && buf[0] != ';' && buf[0] != '('){
+                fed_lines += 1;
+                if (pause_after) {
                     this->suspend_command("", THEKERNEL->streams);
                 }
+            }
 
-                return; // we feed one line per main loop
-
-            } else {
-                // discard long line
-                if (this->current_stream != nullptr) { this->current_stream->printf("Warning: Discarded long line\n"); }
-                discard = true;
+            // keep feeding while the queue has room, the line may also have paused, aborted or switched files
+            if (this->feeding_stopped(start_us)) {
+                // a line that did not fit in the last cluster started a new one
+                this->flush_cluster();
+                this->queue_was_running = !THECONVEYOR->is_queue_empty();
+                return;
+            }
+        }
+        this->flush_cluster();
+
+        if (this->compressed && !this->compressed_file.sum_matches()) {
+            if (this->compressed_file.is_damaged()) {
+                // the rest of the job cannot be read, it must not look finished
+                THEKERNEL->streams->printf("Error: %s is damaged after line %lu, aborting\r\n", this->filename.c_str(), played_lines);
+                THEKERNEL->call_event(ON_HALT, nullptr);
+                THEKERNEL->set_halt_reason(MANUAL);
+                return;
             }
+            THEKERNEL->streams->printf("Warning: %s does not match its checksum\r\n", this->filename.c_str());
         }
 
         // save last progress so status (?) continues to show |P:played_lines,percent_complete,elapsed_secs|
@@ -900,34 +989,182 @@ void Player::on_main_loop(void *argument)
     }
 }
 
-/*
-bool Player::check_cluster(const char *gcode_str, float *x_value, float *y_value, float *distance, float *slope, float *s_value)
+// true once the main loop has to get on with something else, the queue is full or the player has fed for long enough
+bool Player::feeding_stopped(uint32_t start_us) const
 {
-	float new_slope = 0.0;
-	bool is_cluster = false;
-	Gcode *gcode = new Gcode(gcode_str, &StreamOutput::NullStream);
-	if (!gcode->has_m && gcode->has_g && gcode->g == 1) {
-		*x_value = gcode->get_value('X');
-		*y_value = gcode->get_value('Y');
-		*s_value = gcode->get_value('S');
-		*distance = sqrtf((*x_value) * (*x_value) + (*y_value) * (*y_value));
-		if (*x_value == 0) {
-			new_slope = *y_value > 0 ? 1000 : -1000;
-		} else if (*y_value == 0) {
-			new_slope = *x_value > 0 ? 0.001 : -0.001;
-		} else {
-			new_slope = *y_value / *x_value;
-		}
-		if ((*distance) < 1.0 && fabs (new_slope - *slope) < 0.1) {
-			is_cluster = true;
-		}
-		*slope = new_slope;
-	}
-	delete gcode;
+    return !this->playing_file || THEKERNEL->is_halted() || THEKERNEL->is_suspending() || THEKERNEL->is_waiting() || this->inner_playing ||
+           !this->buffered_queue.empty() || THECONVEYOR->is_queue_full() || us_ticker_read() - start_us >= FEED_TIME_US ||
+           (this->current_stream != nullptr && this->current_stream->is_tx_full());
+}
+
+// Takes an M326 raster header, M326 A<angle> P<pitch> F<feed> L<pixels>, which is followed straight after its newline by
+// a byte of intensity per pixel, 0 to 255. The scanline runs from the current position at the angle in degrees to X in
+// the WCS, pitch mm per pixel, as if it were relative G1s. The header is recognised the way GcodeDispatch would take
+// it, after any spaces and line number and in either case, so its pixels are never played as gcode. Returns false for
+// any other line.
+bool Player::start_raster(const char *buf, size_t len)
+{
+    // a quick look first as this is asked of every line played
+    size_t i = 0;
+    while (i < len && isspace((unsigned char)buf[i])) i++;
+    if (i < len && toupper((unsigned char)buf[i]) == 'N') {
+        // the line number, stripped as GcodeDispatch does
+        i++;
+        while (i < len && (isdigit((unsigned char)buf[i]) || buf[i] == '.' || buf[i] == ',' || buf[i] == '-' || buf[i] == ' ')) i++;
+    }
+    if (len - i < 4 || toupper((unsigned char)buf[i]) != 'M' || strncmp(&buf[i + 1], "326", 3) != 0) return false;
+    if (len - i > 4 && isdigit((unsigned char)buf[i + 4])) return false;
+
+    // the word parser only takes upper case letters
+    char header[MAX_LINE_SIZE];
+    size_t n = std::min(len - i, sizeof(header));
+    for (size_t j = 0; j < n; j++) {
+        header[j] = toupper((unsigned char)buf[i + j]);
+    }
+    Gcode gcode(header, n, &(StreamOutput::NullStream));
+    if (!gcode.has_m || gcode.m != 326) return false;
 
-	return is_cluster;
+    if (!gcode.has_letter('L')) {
+        THEKERNEL->streams->printf("Error: M326 without a pixel count L, the data after it will be played as gcode\n");
+        this->raster_left = 0;
+        return true;
+    }
+    this->raster_left = gcode.get_uint('L');
+
+    float pitch = gcode.has_letter('P') ? THEROBOT->to_millimeters(gcode.get_value('P')) : 0;
+    this->raster_feed = gcode.has_letter('F') ? THEROBOT->to_millimeters(gcode.get_value('F')) : 0;
+    if (pitch <= 0 || this->raster_feed <= 0) {
+        // the pixels are still read so the file carries on after them
+        THEKERNEL->streams->printf("Error: M326 needs a pitch P and feed rate F, scanline skipped\n");
+        this->raster_feed = 0;
+    }
+
+    float angle = gcode.has_letter('A') ? gcode.get_value('A') * 3.14159265358979323846F / 180.0F : 0;
+    this->raster_pixel[0] = pitch * cosf(angle);
+    this->raster_pixel[1] = pitch * sinf(angle);
+    return true;
+}
+
+// plays what is left of the current raster scanline a block at a time, false if feeding has to stop first
+bool Player::play_raster(uint32_t start_us)
+{
+    while (this->raster_left > 0) {
+        size_t n;
+        const uint8_t *data = this->next_bytes(std::min<uint32_t>(this->raster_left, Block::max_s_values), n);
+        if (data == NULL) {
+            if (this->current_stream != nullptr) { this->current_stream->printf("Warning: Raster scanline cut short by the end of the file\n"); }
+            this->raster_left = 0;
+            break;
+        }
+
+        float s[Block::max_s_values];
+        for (size_t i = 0; i < n; i++) {
+            s[i] = data[i] * this->raster_s_scale;
+        }
+        this->raster_left -= n;
+        played_cnt += n;
+
+        // waits for the queue to have enough room
+        THEROBOT->append_raster(this->raster_pixel, this->raster_feed, s, n, played_lines);
+        if (this->feeding_stopped(start_us)) return false;
+    }
+    return true;
+}
+
+// Takes the line into the cluster if it is a short relative G1 in line with the lines already in it, and a whole number
+// of their pixels long, playing the cluster first if the line does not fit. Anything else is left to be played as it is.
+bool Player::cluster_line(const char *buf, size_t len)
+{
+    if (!THEKERNEL->get_laser_mode() || THEROBOT->absolute_mode || THEKERNEL->get_line_by_line_exec_mode() || len > MAX_LINE_SIZE) {
+        return false;
+    }
+
+    char line[MAX_LINE_SIZE + 1];
+    memcpy(line, buf, len);
+    line[len] = '\0';
+
+    // only G1 X Y and S words, the G1 can be left out when it is already the motion mode
+    bool g1 = this->cluster_count > 0 || THEROBOT->get_current_motion_mode() == 2;
+    bool has_xy = false;
+    double x = 0, y = 0;
+    float s = this->cluster_count > 0 ? this->cluster_s_values[this->cluster_count - 1] : THEROBOT->get_s_value();
+    for (char *p = line; *p; ) {
+        if (isspace(*p)) {
+            p++;
+            continue;
+        }
+        char letter = *p;
+        char *e;
+        double v = strtod(p + 1, &e);
+        if (e == p + 1) return false;
+        p = e;
+        switch (letter) {
+            case 'G': if (v != 1) return false; g1 = true; break;
+            case 'X': x = v; has_xy = true; break;
+            case 'Y': y = v; has_xy = true; break;
+            case 'S': s = v; break;
+            default: return false;
+        }
+    }
+    if (!g1 || !has_xy) return false;
+
+    float length = sqrt(x * x + y * y);
+    if (length < 0.001F || length >= 1.0F) return false;
+
+    int pixels = 1;
+    if (this->cluster_count > 0) {
+        // coordinates are usually rounded to 0.001 so anything within that is in line
+        pixels = lroundf(length / this->cluster_pitch);
+        float across = x * this->cluster_dir[1] - y * this->cluster_dir[0];
+        float along = x * this->cluster_dir[0] + y * this->cluster_dir[1];
+        if (pixels < 1 || this->cluster_count + pixels > Block::max_s_values || along <= 0 ||
+            fabsf(across) > 0.001F || fabsf(length - pixels * this->cluster_pitch) > 0.001F) {
+            this->flush_cluster();
+            pixels = 1;
+        }
+    }
+
+    if (this->cluster_count == 0) {
+        this->cluster_x = 0;
+        this->cluster_y = 0;
+        this->cluster_pitch = length;
+        this->cluster_dir[0] = x / length;
+        this->cluster_dir[1] = y / length;
+    }
+    this->cluster_x += x;
+    this->cluster_y += y;
+    for (int i = 0; i < pixels; i++) {
+        this->cluster_s_values[this->cluster_count++] = s;
+    }
+    return true;
+}
+
+// plays the lines taken into the cluster as one G1
+void Player::flush_cluster()
+{
+    if (this->cluster_count == 0) return;
+    uint8_t count = this->cluster_count;
+    this->cluster_count = 0;
+    if (!this->playing_file || THEKERNEL->is_halted()) return;
+
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf), "G1 X%.6f Y%.6f S%g", this->cluster_x, this->cluster_y, this->cluster_s_values[0]);
+    for (int i = 1; i < count; i++) {
+        n += snprintf(buf + n, sizeof(buf) - n, ":%g", this->cluster_s_values[i]);
+    }
+
+    if (this->current_stream != nullptr) {
+        this->current_stream->printf("%s\n", buf);
+    }
+
+    struct SerialMessage message;
+    message.message.assign(buf, n);
+    message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
+    message.line = played_lines;
+
+    // waits for the queue to have enough room
+    THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
 }
-*/
 
 void Player::on_get_public_data(void *argument)
 {
@@ -1149,50 +1386,7 @@ void Player::resume_command(string parameters, StreamOutput *stream )
 
 unsigned int Player::crc16_ccitt(unsigned char *data, unsigned int len)
 {
-	static const unsigned short crc_table[] = {
-		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-		0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-		0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
-		0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
-		0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
-		0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
-		0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
-		0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
-		0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-		0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
-		0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
-		0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
-		0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
-		0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
-		0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
-		0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
-		0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
-		0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-		0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
-		0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
-		0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
-		0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-		0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
-		0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
-		0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
-		0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
-		0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-		0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
-		0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
-		0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
-		0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
-		0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
-	};
-
-	unsigned char tmp;
-	unsigned short crc = 0;
-
-	for (unsigned int i = 0; i < len; i ++) {
-        tmp = ((crc >> 8) ^ data[i]) & 0xff;
-        crc = ((crc << 8) ^ crc_table[tmp]) & 0xffff;
-	}
-
-	return crc & 0xffff;
+	return crc16_xmodem(data, len);
 }
 
 int Player::check_crc(int crc, unsigned char *data, unsigned int len)
@@ -1257,75 +1451,93 @@ void Player::set_serial_rx_irq(bool enable)
     bool enable_irq = enable;
     PublicData::set_value( atc_handler_checksum, set_serial_rx_irq_checksum, &enable_irq );
 }
-int Player::decompress(string sfilename, string dfilename, uint32_t sfilesize, StreamOutput* stream)
+// reads a compressed upload through to check it against the sum at its end and take the md5 of the gcode in it, it is
+// played from the compressed copy so nothing is written
+int Player::check_compressed(string sfilename, MD5 &md5, StreamOutput* stream)
 {
-	FILE *f_in = NULL, *f_out = NULL;
-	uint16_t  u16Sum = 0;
-	uint8_t u8ReadBuffer_hdr[BLOCK_HEADER_SIZE] = { 0 };
-	uint32_t u32DcmprsSize = 0, u32BlockSize = 0, u32BlockNum = 0, u32TotalDcmprsSize = 0, i = 0,j = 0,k=0;
-	qlz_state_decompress s_stDecompressState;
-	f_in= fopen(sfilename.c_str(), "rb");
-	f_out= fopen(dfilename.c_str(), "w+");
-	if (f_in == NULL || f_out == NULL)
-	{
-		memset(fbuff, 0, sizeof(fbuff));
-		sprintf((char*)fbuff, "Error: failed to create file [%s]!\r\n", filename.substr(0, 30).c_str());
-		goto _exit;
+	FILE *f_in = fopen(sfilename.c_str(), "rb");
+	if (f_in == NULL) {
+		return 0;
 	}
-	for(i = 0; i < sfilesize-2; i+= BLOCK_HEADER_SIZE + u32BlockSize)
-	{
-
-		fread(u8ReadBuffer_hdr, sizeof(char), BLOCK_HEADER_SIZE, f_in);
-		u32BlockSize = u8ReadBuffer_hdr[0] * (1 << 24) + u8ReadBuffer_hdr[1] * (1 << 16) + u8ReadBuffer_hdr[2] * (1 << 8) + u8ReadBuffer_hdr[3];
-		if(!u32BlockSize)
-		{
-			goto _exit;
-		}
-		fread(xbuff, sizeof(char), u32BlockSize, f_in);
-		u32DcmprsSize = qlz_decompress((const char *)xbuff, fbuff, &s_stDecompressState);
-		if(!u32DcmprsSize)
-		{
-			goto _exit;
-		}
-		for(j = 0; j < u32DcmprsSize; j++)
-		{
-			u16Sum += fbuff[j];
-		}
-		// Set the file write system buffer 4096 Byte
-		setvbuf(f_out, (char*)&xbuff[4096], _IOFBF, 4096);
-		fwrite(fbuff, sizeof(char),u32DcmprsSize, f_out);
-		u32TotalDcmprsSize += u32DcmprsSize;
-		u32BlockNum += 1;
-		if(++k>10)
-		{
-			k=0;
+	CompressedFile lz(xbuff, sizeof(xbuff), fbuff, sizeof(fbuff));
+	lz.attach(f_in);
+	int k = 0;
+	while (lz.next_block()) {
+		md5.update(fbuff, lz.get_block_size());
+		if (++k > 10) {
+			k = 0;
 			THEKERNEL->call_event(ON_IDLE);
-			memset(fbuff, 0, sizeof(fbuff));
-			sprintf((char*)fbuff, "#Info: decompart = %lu\r\n", u32BlockNum);
-			stream->printf((char*)fbuff);
+			stream->printf("#Info: decompart = %lu\r\n", lz.get_blocks());
 		}
 	}
-	fread(fbuff, sizeof(char), 2, f_in);
-	if(u16Sum != ((fbuff[0] <<8) + fbuff[1]))
-	{
-		goto _exit;
-	}
+	bool ok = lz.sum_matches();
+	fclose(f_in);
+	stream->printf("#Info: decompart = %lu\r\n", lz.get_blocks());
+	return ok;
+}
+
+// the console the windowed upload runs over, read the same way inbytes() does
+class StreamUploadLink : public UploadLink {
+    public:
+        StreamUploadLink(StreamOutput *stream) : stream(stream) {}
+
+        int receive(uint8_t *buf, int size, uint32_t timeout_ms)
+        {
+            uint32_t tick_us = us_ticker_read();
+            while (us_ticker_read() - tick_us < timeout_ms * 1000) {
+                if (stream->ready()) {
+                    char *recv_buff;
+                    int n = stream->gets(&recv_buff, size);
+                    if (n > 0) {
+                        memcpy(buf, recv_buff, n);
+                        return n;
+                    }
+                }
+                safe_delay_us(100);
+            }
+            return 0;
+        }
 
-	if (f_in != NULL)
-		fclose(f_in);
-	if (f_out!= NULL)
-		fclose(f_out);
-	memset(fbuff, 0, sizeof(fbuff));
-	sprintf((char*)fbuff, "#Info: decompart = %lu\r\n", u32BlockNum);
-	stream->printf((char*)fbuff);
-	return 1;
-_exit:
-	if (f_in != NULL)
-		fclose(f_in );
-	if (f_out != NULL)
-		fclose(f_out);
-	stream->printf((char*)fbuff);
-	return 0;
+        void send(const uint8_t *data, int len)
+        {
+            stream->puts((const char *)data, len);
+        }
+
+    private:
+        StreamOutput *stream;
+};
+
+// the file the windowed upload writes to, the md5 of what is written is taken as it goes unless digest is NULL
+class FileUploadSink : public UploadSink {
+    public:
+        FileUploadSink(FILE *fd, MD5 *digest, char *client_md5) : fd(fd), digest(digest), client_md5(client_md5) {}
+
+        bool write(const uint8_t *data, size_t len)
+        {
+            bool ok = fwrite(data, sizeof(char), len, fd) == len;
+            if (digest != NULL) digest->update(data, len);
+            THEKERNEL->call_event(ON_IDLE);
+            return ok;
+        }
+
+        void md5(const uint8_t *hex)
+        {
+            memcpy(client_md5, hex, 32);
+            client_md5[32] = '\0';
+            THEKERNEL->call_event(ON_IDLE);
+        }
+
+    private:
+        FILE *fd;
+        MD5 *digest;
+        char *client_md5;
+};
+
+// where an upload is written until it checks out, it then replaces the file, ls does not show it
+static string upload_part_path(const string &path)
+{
+    size_t slash = path.rfind('/');
+    return path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".part";
 }
 
 void Player::upload_command( string parameters, StreamOutput *stream )
@@ -1341,7 +1553,19 @@ void Player::upload_command( string parameters, StreamOutput *stream )
     int timeouts = MAXRETRANS;
     int recv_count = 0;
     bool md5_received = false;
-    uint32_t u32filesize = 0;
+    // the md5 of the file is taken as it comes in and checked against the one the sender worked out, if it sent one
+    MD5 md5;
+    char md5_client[33];
+    md5_client[0] = '\0';
+    uint32_t stored_size = 0, stored_stamp = 0;
+
+    // upload <file> -w<window> asks for the windowed upload, see WindowedUpload.h
+    int window = 0;
+    size_t wpos = parameters.rfind(" -w");
+    if (wpos != string::npos && wpos + 3 < parameters.size() && parameters.find_first_not_of("0123456789", wpos + 3) == string::npos) {
+        window = atoi(parameters.c_str() + wpos + 3);
+        parameters = parameters.substr(0, wpos);
+    }
 
     // open file
 	char error_msg[64];
@@ -1373,15 +1597,16 @@ void Player::upload_command( string parameters, StreamOutput *stream )
 	
 	//if file is lzCompress file,then need to put .lz dir
 	unsigned int start_pos = filename.find(".lz");
-	FILE *fd;
-	if (start_pos != string::npos) {
+	bool is_lz = start_pos != string::npos;
+	string stored_filename = filename;
+	if (is_lz) {
 		start_pos = lzfilename.rfind(".lz");
 		lzfilename=lzfilename.substr(0, start_pos);
-    	fd = fopen(lzfilename.c_str(), "wb");
-    }
-    else {
-    	fd = fopen(filename.c_str(), "wb");
+		stored_filename = lzfilename;
     }
+	// the file being replaced stays as it is until the upload checks out
+	string part_filename = upload_part_path(stored_filename);
+	FILE *fd = fopen(part_filename.c_str(), "wb");
 		
     FILE *fd_md5 = NULL;
     //if file is lzCompress file,then need to Decompress
@@ -1389,19 +1614,46 @@ void Player::upload_command( string parameters, StreamOutput *stream )
 	if (start_pos != string::npos) {
 		md5_filename=md5_filename.substr(0, start_pos);
 	}
-    if (filename.find("firmware.bin") == string::npos) {
-    	fd_md5 = fopen(md5_filename.c_str(), "wb");
-    }
 
-    if (fd == NULL || (filename.find("firmware.bin") == string::npos && fd_md5 == NULL)) {
+    if (fd == NULL) {
         stream->_putc(EOT);
-    	sprintf(error_msg, "Error: failed to open file [%s]!\r\n", fd == NULL ? filename.substr(0, 30).c_str() : md5_filename.substr(0, 30).c_str() );
+    	sprintf(error_msg, "Error: failed to open file [%s]!\r\n", filename.substr(0, 30).c_str());
     	goto upload_error;
     }
 	
 	// stop TIMER0 and TIMER1 for save time
 	NVIC_DisableIRQ(TIMER0_IRQn);
 	NVIC_DisableIRQ(TIMER1_IRQn);
+
+    // the block of a paused compressed file in fbuff is about to go
+    this->compressed_file.invalidate();
+
+    // only offered over WiFi, the module holds the frames in flight while the SD card is written, a UART would overrun
+    if (window > 0 && stream->type() == 1) {
+        StreamUploadLink link(stream);
+        FileUploadSink sink(fd, is_lz ? NULL : &md5, md5_client);
+        WindowedUpload upload(&link, &sink, xbuff);
+        // Set the file write system buffer 4096 Byte
+        setvbuf(fd, (char*)fbuff, _IOFBF, 4096);
+        switch (upload.run(window)) {
+            case WindowedUpload::DONE:
+                goto upload_success;
+            case WindowedUpload::CANCELED:
+                sprintf(error_msg, "Info: Upload canceled by remote!\r\n");
+                break;
+            case WindowedUpload::TIMED_OUT:
+                sprintf(error_msg, "Error: upload sync error!\r\n");
+                break;
+            case WindowedUpload::TOO_MANY_ERRORS:
+                sprintf(error_msg, "Error: too many retry error!\r\n");
+                break;
+            case WindowedUpload::WRITE_FAILED:
+                sprintf(error_msg, "Error: failed to write file [%s]!\r\n", filename.substr(0, 30).c_str());
+                break;
+        }
+        goto upload_error;
+    }
+
     for (;;) {
         for (retry = 0; retry < MAXRETRANS; ++retry) {  // approx 3 seconds allowed to make connection
             if (trychar)
@@ -1480,9 +1732,8 @@ void Player::upload_command( string parameters, StreamOutput *stream )
         if (!md5_received && xbuff[1] == 0 && xbuff[1] == (unsigned char)(~xbuff[2])
         		&& check_crc(crc, &xbuff[3], bufsz + 1 + is_stx) && len == 32) {
         	// received md5
-        	if (NULL != fd_md5) {
-    			fwrite(&xbuff[4 + is_stx], sizeof(char), 32, fd_md5);
-        	}
+        	memcpy(md5_client, &xbuff[4 + is_stx], 32);
+        	md5_client[32] = '\0';
             THEKERNEL->call_event(ON_IDLE);
             stream->_putc(ACK);
             md5_received = true;
@@ -1493,7 +1744,7 @@ void Player::upload_command( string parameters, StreamOutput *stream )
             // Set the file write system buffer 4096 Byte
         	setvbuf(fd, (char*)fbuff, _IOFBF, 4096);
 			fwrite(&xbuff[4 + is_stx], sizeof(char), len, fd);
-			u32filesize += len;
+			if (!is_lz) md5.update(&xbuff[4 + is_stx], len);
 			++ packetno;
 			retrans = MAXRETRANS + 1;
 			THEKERNEL->call_event(ON_IDLE);
@@ -1516,13 +1767,8 @@ upload_error:
 	if (fd != NULL) {
 		fclose(fd);
 		fd = NULL;
-		remove(filename.c_str());
-	}
-	if (fd_md5 != NULL) {
-		fclose(fd_md5);
-		fd_md5 = NULL;
-		remove(md5_filename.c_str());
 	}
+	remove(part_filename.c_str());
 	flush_input(stream);
     if (stream->type() == 0) {
     	set_serial_rx_irq(true);
@@ -1539,21 +1785,47 @@ upload_success:
 		fclose(fd);
 		fd = NULL;
 	}
-	if (fd_md5 != NULL) {
-		fclose(fd_md5);
-		fd_md5 = NULL;
-	}
 	flush_input(stream);
 
     THEKERNEL->set_uploading(false);
-	//if file is lzCompress file,then need to Decompress
+	//if file is lzCompress file, it is played as it is once it checks out, a plain copy from before would be played instead
 	start_pos = filename.find(".lz");
-	string srcfilename=lzfilename;
 	string desfilename= filename;
-	if (start_pos != string::npos) {
+	if (is_lz) {
 		desfilename=filename.substr(0, start_pos);
-		if(!decompress(srcfilename,desfilename,u32filesize,stream))
+		if(!check_compressed(part_filename, md5, stream)) {
+			sprintf(error_msg, "Error: damaged file [%s]!\r\n", desfilename.substr(0, 30).c_str());
 			goto upload_error;
+		}
+    }
+	md5.finalize();
+	if (md5_client[0] != '\0' && strncasecmp(md5_client, md5.hexdigest().c_str(), 32) != 0) {
+		sprintf(error_msg, "Error: md5 mismatch [%s]!\r\n", desfilename.substr(0, 30).c_str());
+		goto upload_error;
+	}
+
+	// checked, it replaces the file now
+	remove(stored_filename.c_str());
+	if (rename(part_filename.c_str(), stored_filename.c_str()) != 0) {
+		sprintf(error_msg, "Error: failed to write file [%s]!\r\n", desfilename.substr(0, 30).c_str());
+		goto upload_error;
+	}
+	if (is_lz) {
+		remove(desfilename.c_str());
+	}
+
+	// the md5 is kept with the size and time stamp of the file it was taken from so md5sum need not read it again
+    if (filename.find("firmware.bin") == string::npos) {
+    	fd_md5 = fopen(md5_filename.c_str(), "wb");
+    	if (fd_md5 != NULL) {
+    		if (get_file_stamp(stored_filename, stored_size, stored_stamp)) {
+    			write_md5_record(fd_md5, md5.hexdigest().c_str(), stored_size, stored_stamp);
+    		} else {
+    			fputs(md5.hexdigest().c_str(), fd_md5);
+    		}
+    		fclose(fd_md5);
+    		fd_md5 = NULL;
+    	}
     }
 
 	// renable TIME0 and TIME1
@@ -1568,18 +1840,9 @@ upload_success:
 
 void Player::test_command( string parameters, StreamOutput* stream ) {
     string filename = absolute_from_relative(shift_parameter(parameters));
-	FILE *fd = fopen(filename.c_str(), "rb");
-	if (NULL != fd) {
-        MD5 md5;
-        uint8_t md5_buf[64];
-        do {
-            size_t n = fread(md5_buf, 1, sizeof(md5_buf), fd);
-            if (n > 0) md5.update(md5_buf, n);
-            THEKERNEL->call_event(ON_IDLE);
-        } while (!feof(fd));
+    MD5 md5;
+    if (md5_file(filename, md5, xbuff, 8192)) {
         strcpy(md5_str, md5.finalize().hexdigest().c_str());
-        fclose(fd);
-        fd = NULL;
 	}
 }
 
@@ -1629,6 +1892,8 @@ void Player::download_command( string parameters, StreamOutput *stream )
         fread(md5, sizeof(char), 64, fd);
         fclose(fd);
         fd = NULL;
+        // the digits alone, the size and time stamp after them are for md5sum
+        md5[32] = '\0';
     } else {
     	strcpy(md5, this->md5_str);
     }
@@ -9,6 +9,8 @@
 #pragma once
 
 #include "Module.h"
+#include "Block.h"
+#include "CompressedFile.h"
 
 #include <stdio.h>
 #include <string>
@@ -20,6 +22,7 @@
 using std::string;
 
 class StreamOutput;
+class MD5;
 
 class Player : public Module {
     public:
@@ -61,10 +64,8 @@ class Player : public Module {
         unsigned int crc16_ccitt(unsigned char *data, unsigned int len);
         int check_crc(int crc, unsigned char *data, unsigned int len);
 		
-		int decompress(string sfilename, string dfilename, uint32_t sfilesize, StreamOutput* stream);
+		int check_compressed(string sfilename, MD5 &md5, StreamOutput* stream);
 //		int compressfile(string sfilename, string dfilename, StreamOutput* stream);
-        // 2024
-        // bool check_cluster(const char *gcode_str, float *x_value, float *y_value, float *distance, float *slope, float *s_value);
 
         string filename;
         string last_filename;
@@ -83,6 +84,38 @@ class Player : public Module {
         std::queue<macro_file_queue_item> macro_file_queue;
         void clear_macro_file_queue();
 
+        // the file being played is read ahead in whole sectors and split into lines in place
+        bool open_file(const string &fn);
+        long file_length();
+        void reset_read_ahead();
+        bool fill_read_ahead();
+        const char *next_line(size_t &len);
+        const uint8_t *next_bytes(size_t want, size_t &len);
+        uint16_t read_head;
+        uint16_t read_tail;
+        // a file uploaded compressed is played from its copy in /sd/gcodes/.lz, decompressed a block at a time
+        CompressedFile compressed_file;
+
+        // M326 raster scanlines, a header line then a byte of intensity per pixel played straight into blocks
+        bool start_raster(const char *buf, size_t len);
+        bool play_raster(uint32_t start_us);
+        bool feeding_stopped(uint32_t start_us) const;
+        uint32_t raster_left;           // pixels of the scanline still to be read from the file
+        float raster_pixel[2];          // XY move of a pixel in the WCS
+        float raster_feed;              // mm/min
+        float raster_s_scale;           // S value of an intensity of 1
+
+        // in laser mode runs of short relative G1s in line with each other, a pixel or a few each, are played as one G1
+        // carrying an intensity per pixel, S1:0:0.5:0.75
+        bool cluster_line(const char *buf, size_t len);
+        void flush_cluster();
+        double cluster_x;               // relative move of the lines in the cluster
+        double cluster_y;
+        float cluster_pitch;            // length of a pixel, the first line's
+        float cluster_dir[2];           // unit direction they all move in
+        float cluster_s_values[Block::max_s_values];
+        uint8_t cluster_count;          // pixels in the cluster
+
         FILE* current_file_handler;
         // FILE* temp_file_handler;
         long file_size;
@@ -91,6 +124,9 @@ class Player : public Module {
         unsigned long played_lines;
         unsigned long goto_line;
         unsigned int playing_lines;
+        unsigned long fed_lines;        // lines fed since the last second tick
+        unsigned long lines_per_sec;
+        unsigned long underruns;        // times the block queue ran dry between two main loop passes
         // last progress when playback finished or was interrupted (for status ? to keep showing |P:...)
         bool has_last_progress;
         unsigned long last_played_lines;
@@ -98,7 +134,6 @@ class Player : public Module {
         unsigned long last_elapsed_secs;
         uint8_t current_motion_mode;
         float saved_position[3]; // only saves XYZ
-        float slope;
         std::map<uint16_t, float> saved_temperatures;
         struct {
             bool on_boot_gcode_enable:1;
@@ -109,5 +144,9 @@ class Player : public Module {
             bool override_leave_heaters_on:1;
             bool inner_playing:1;
             bool laser_clustering:1;
+            bool read_eof:1;
+            bool discarding:1;
+            bool queue_was_running:1;
+            bool compressed:1;
         };
 };
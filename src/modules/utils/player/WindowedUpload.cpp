@@ -0,0 +1,165 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WindowedUpload.h"
+#include "crc16.h"
+
+WindowedUpload::WindowedUpload(UploadLink *link, UploadSink *sink, uint8_t *frame)
+{
+    this->link= link;
+    this->sink= sink;
+    this->frame= frame;
+    this->timeout_ms= 100;
+    this->idle_ms= 1000;
+    this->max_retries= 10;
+    this->bytes= 0;
+    this->naks= 0;
+}
+
+WindowedUpload::result_t WindowedUpload::run(uint8_t window)
+{
+    if(window < 1) window= 1;
+    if(window > max_window) window= max_window;
+
+    // the offer goes out until the first frame starts
+    int n= 0;
+    for(uint8_t i= 0; i < max_retries && n == 0; i++) {
+        const uint8_t offer[2]= { 'W', window };
+        link->send(offer, 2);
+        n= link->receive(frame, 1, idle_ms);
+    }
+    if(n == 0) return TIMED_OUT;
+
+    uint8_t expected= 1;
+    bool md5_received= false;
+    bool resync= false;         // a NAK is out, frames are dropped until the one it asked for comes
+    uint8_t retries= 0;         // since the last block taken
+    result_t failure= TOO_MANY_ERRORS;
+    bool have_byte= true;
+
+    while(true) {
+        if(!have_byte && link->receive(frame, 1, idle_ms) == 0) {
+            // quiet, the frame or the ACK for it was lost
+            if(++retries > max_retries) {
+                failure= TIMED_OUT;
+                break;
+            }
+            reply(nak, expected);
+            resync= true;
+            continue;
+        }
+        have_byte= false;
+
+        if(frame[0] == eot) {
+            if(link->receive(frame, 1, timeout_ms) == 1 && frame[0] == (uint8_t)(expected - 1)) {
+                send_byte(ack);
+                return DONE;
+            }
+            // the last block, or one before it, has not come yet, the host goes back for it before it ends
+            if(++retries > max_retries) break;
+            reply(nak, expected);
+            resync= true;
+            continue;
+        }
+        if(frame[0] == can) {
+            if(link->receive(frame, 1, timeout_ms) == 1 && frame[0] == can) {
+                send_byte(ack);
+                flush();
+                return CANCELED;
+            }
+            continue;
+        }
+        if(frame[0] != stx) continue;   // noise between frames
+
+        if(read_frame() != GOOD) {
+            // where the frames start is lost, so wait for the line to go quiet before asking again
+            flush();
+            if(++retries > max_retries) break;
+            reply(nak, expected);
+            resync= true;
+            continue;
+        }
+
+        uint8_t block= frame[1];
+        size_t len= (frame[3] << 8) | frame[4];
+        const uint8_t *data= &frame[5];
+
+        if(!md5_received && block == 0 && len == 32 && expected == 1) {
+            reply(ack, 0);
+            sink->md5(data);
+            md5_received= true;
+            continue;
+        }
+
+        uint8_t ahead= block - expected;
+        if(ahead == 0) {
+            // taken, it is acknowledged before it is written so the sender can carry on meanwhile
+            reply(ack, block);
+            expected++;
+            resync= false;
+            retries= 0;
+            if(!sink->write(data, len)) {
+                send_byte(can);
+                flush();
+                return WRITE_FAILED;
+            }
+            bytes += len;
+
+        } else if(ahead < max_window) {
+            // one before it went missing, the rest of the window is dropped until it comes again
+            if(!resync) {
+                if(++retries > max_retries) break;
+                reply(nak, expected);
+                resync= true;
+            }
+
+        } else {
+            // already taken, the ACK for it went missing
+            reply(ack, expected - 1);
+        }
+    }
+
+    send_byte(can);
+    flush();
+    return failure;
+}
+
+// the rest of a frame after the STX already in frame[0]
+WindowedUpload::frame_t WindowedUpload::read_frame()
+{
+    size_t got= 1;
+    while(got < frame_size) {
+        int n= link->receive(&frame[got], frame_size - got, idle_ms);
+        if(n <= 0) return INCOMPLETE;
+        got += n;
+    }
+
+    if(frame[1] != (uint8_t)~frame[2]) return BAD;
+    size_t len= (frame[3] << 8) | frame[4];
+    if(len > block_size) return BAD;
+    uint16_t crc= (frame[block_size + 5] << 8) | frame[block_size + 6];
+    return crc16_xmodem(&frame[3], block_size + 2) == crc ? GOOD : BAD;
+}
+
+void WindowedUpload::send_byte(uint8_t c)
+{
+    link->send(&c, 1);
+}
+
+void WindowedUpload::reply(uint8_t c, uint8_t block)
+{
+    const uint8_t r[2]= { c, block };
+    link->send(r, 2);
+    if(c == nak) naks++;
+}
+
+// drops whatever is still coming
+void WindowedUpload::flush()
+{
+    uint8_t b[64];
+    while(link->receive(b, sizeof(b), timeout_ms) > 0) continue;
+}
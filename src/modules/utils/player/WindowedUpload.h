@@ -0,0 +1,86 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WINDOWEDUPLOAD_H
+#define WINDOWEDUPLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// What the upload runs over, the console the upload command came from on the machine and a simulated link in the sim
+class UploadLink {
+    public:
+        virtual ~UploadLink() {}
+        // whatever has arrived up to size bytes, waiting at most timeout_ms for the first of them, 0 if nothing came
+        virtual int receive(uint8_t *buf, int size, uint32_t timeout_ms) = 0;
+        virtual void send(const uint8_t *data, int len) = 0;
+};
+
+// Where the blocks go, in order and each once
+class UploadSink {
+    public:
+        virtual ~UploadSink() {}
+        virtual bool write(const uint8_t *data, size_t len) = 0;
+        virtual void md5(const uint8_t *hex) = 0;     // the 32 hex digits the sender may send as block 0
+};
+
+// The receiving end of the windowed upload, the host asks for it with upload <file> -w<window>. The frames are the
+// same 8K XMODEM frames as the plain upload,
+//
+//   STX, block number, 255 - block number, length high, length low, 8192 bytes of data, CRC-16 high, CRC-16 low
+//
+// but the host keeps up to window of them in flight rather than waiting for each ACK. The machine answers the offer
+// with 'W' and the window it takes, then every frame it takes in order with ACK and its block number, and asks for
+// the next one it needs with NAK and that block number when a frame is lost or damaged. The host goes back to that
+// block and sends on from there, the frames after it are dropped, there is no room to keep them. ACK goes out before
+// the block is written to the SD card so the next frames are already on the way while it is, and over WiFi they wait
+// in the module rather than in a round trip. CAN CAN cancels the upload as before. EOT ends it, but here it is followed
+// by the number of the last block, and unless that is the last one taken it is answered with the NAK for the next
+// one instead, so a lost final frame is sent again rather than the file being one block short.
+class WindowedUpload {
+    public:
+        WindowedUpload(UploadLink *link, UploadSink *sink, uint8_t *frame);
+
+        enum result_t { DONE, CANCELED, TIMED_OUT, TOO_MANY_ERRORS, WRITE_FAILED };
+
+        static const uint8_t max_window= 16;
+        static const size_t block_size= 8192;
+        static const size_t frame_size= block_size + 7;  // the size of the buffer given to the constructor
+
+        static const uint8_t soh= 0x01;
+        static const uint8_t stx= 0x02;
+        static const uint8_t eot= 0x04;
+        static const uint8_t ack= 0x06;
+        static const uint8_t nak= 0x15;
+        static const uint8_t can= 0x16;
+
+        result_t run(uint8_t window);
+
+        uint32_t get_bytes() const { return bytes; }
+        uint32_t get_naks() const { return naks; }
+
+        // how long a receive waits, how long the line may stay quiet before the block is asked for again and how
+        // many times it is asked for before giving up
+        uint32_t timeout_ms;
+        uint32_t idle_ms;
+        uint8_t max_retries;
+
+    private:
+        enum frame_t { GOOD, BAD, INCOMPLETE };
+        frame_t read_frame();
+        void send_byte(uint8_t c);
+        void reply(uint8_t c, uint8_t block);
+        void flush();
+
+        UploadLink *link;
+        UploadSink *sink;
+        uint8_t *frame;
+        uint32_t bytes;
+        uint32_t naks;
+};
+
+#endif
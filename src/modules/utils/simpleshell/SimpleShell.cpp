@@ -17,6 +17,7 @@
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
 #include "libs/gpio.h"
+#include "libs/SlowTicker.h"
 #include "Conveyor.h"
 #include "DirHandle.h"
 #include "mri.h"
@@ -46,6 +47,8 @@
 #include "SDFAT.h"
 #include "Thermistor.h"
 #include "md5.h"
+#include "Md5Cache.h"
+#include "CompressedFile.h"
 #include "utils.h"
 #include "AutoPushPop.h"
 #include "MainButtonPublicAccess.h"
@@ -101,6 +104,8 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
 	{"ftype",	 SimpleShell::ftype_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"ticks",    SimpleShell::ticks_command},
+    {"publicdata", SimpleShell::publicdata_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -409,6 +414,9 @@ void SimpleShell::on_console_line_received( void *argument )
         } else if (cmd == "laser") {
             // these are handled by Laser module
 
+        } else if (cmd == "status_push") {
+            // handled by StatusReport module
+
         } else if (cmd.substr(0, 2) == "ok") {
             // probably an echo so ignore the whole line
             //new_message.stream->printf("ok\n");
@@ -445,41 +453,65 @@ void SimpleShell::ls_command( string parameters, StreamOutput *stream )
     struct tm timeinfo;
     char dirTmp[256]; 
     unsigned int npos=0;
+    auto list_entry = [&]() {
+    	for (int i = 0; i < NAME_MAX; i ++) {
+    		if (p->d_name[i] == ' ') p->d_name[i] = 0x01;
+    	}
+    	if (opts.find("-s", 0, 2) != string::npos) {
+    	    get_fftime(p->d_date, p->d_time, &timeinfo);
+    		// name size date
+            memset(dirTmp, 0, sizeof(dirTmp));
+            sprintf(dirTmp, "%s%s %d %04d%02d%02d%02d%02d%02d\r\n", string(p->d_name).c_str(),  p->d_isdir ? "/" : "",
+            		p->d_isdir ? 0 : p->d_fsize, timeinfo.tm_year + 1980, timeinfo.tm_mon, timeinfo.tm_mday,
+            				timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    	} else {
+    		// only name
+            memset(dirTmp, 0, sizeof(dirTmp));
+            sprintf(dirTmp, "%s%s\r\n", string(p->d_name).c_str(), p->d_isdir ? "/" : "");
+    	}
+    	memcpy(&xbuff[npos], dirTmp, strlen(dirTmp));
+    	npos += strlen(dirTmp);
+    	if(npos >= 7900)
+    	{
+    		stream->puts((char *)xbuff, npos);
+    		npos = 0;
+    	}
+    };
+
+    // files uploaded compressed are only kept in .lz, they are listed where they would be and played from there
+    string lz_path;
+    if (path.compare(0, 10, "/sd/gcodes") == 0 && (path.size() == 10 || path[10] == '/') && path.find("/.") == string::npos) {
+        lz_path = "/sd/gcodes/.lz" + path.substr(10);
+    }
+
     d = opendir(path.c_str());
     if (d != NULL) {
         while ((p = readdir(d)) != NULL) {
         	if (p->d_name[0] == '.') {
         		continue;
         	}
-        	for (int i = 0; i < NAME_MAX; i ++) {
-        		if (p->d_name[i] == ' ') p->d_name[i] = 0x01;
-        	}
-        	if (opts.find("-s", 0, 2) != string::npos) {
-        	    get_fftime(p->d_date, p->d_time, &timeinfo);
-        		// name size date
-                memset(dirTmp, 0, sizeof(dirTmp));
-                sprintf(dirTmp, "%s%s %d %04d%02d%02d%02d%02d%02d\r\n", string(p->d_name).c_str(),  p->d_isdir ? "/" : "",
-                		p->d_isdir ? 0 : p->d_fsize, timeinfo.tm_year + 1980, timeinfo.tm_mon, timeinfo.tm_mday,
-                				timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-        	} else {
-        		// only name
-                memset(dirTmp, 0, sizeof(dirTmp));
-                sprintf(dirTmp, "%s%s\r\n", string(p->d_name).c_str(), p->d_isdir ? "/" : "");
-        	}
-        	memcpy(&xbuff[npos], dirTmp, strlen(dirTmp));
-        	npos += strlen(dirTmp);
-        	if(npos >= 7900)
-        	{
-        		stream->puts((char *)xbuff, npos);
-        		npos = 0;
-        	}
-        	
+        	list_entry();
+        }
+        closedir(d);
+        if (!lz_path.empty() && (d = opendir(lz_path.c_str())) != NULL) {
+            string dir = path.back() == '/' ? path : path + "/";
+            while ((p = readdir(d)) != NULL) {
+                if (p->d_name[0] == '.' || p->d_isdir) {
+                    continue;
+                }
+                FILE *fp = fopen((dir + p->d_name).c_str(), "r");
+                if (fp != NULL) {
+                    fclose(fp);
+                    continue;
+                }
+                list_entry();
+            }
+            closedir(d);
         }
         if( npos != 0)
         {
         	stream->puts((char *)xbuff, npos);
         }
-        closedir(d);
         if(opts.find("-e", 0, 2) != string::npos) {
         	char eot = EOT;
             stream->puts(&eot, 1);
@@ -513,6 +545,10 @@ void SimpleShell::rm_command( string parameters, StreamOutput *stream )
 
     string toRemove = absolute_from_relative(path);
     int s = remove(toRemove.c_str());
+    if (s != 0 && path.compare(0, 11, "/sd/gcodes/") == 0) {
+        // a gcode file uploaded compressed is only kept in the .lz dir
+        s = remove(lz_path.c_str());
+    }
     if (s != 0) {
         if(send_eof) {
             stream->_putc(CAN);
@@ -566,6 +602,10 @@ void SimpleShell::mv_command( string parameters, StreamOutput *stream )
     	send_eof = true;
     }
     int s = rename(from.c_str(), to.c_str());
+    if (s != 0 && from.compare(0, 11, "/sd/gcodes/") == 0 && to.compare(0, 11, "/sd/gcodes/") == 0) {
+        // a gcode file uploaded compressed is only kept in the .lz dir
+        s = rename(lz_from.c_str(), lz_to.c_str());
+    }
     if (s != 0)  {
     	if (send_eof) {
     		stream->_putc(CAN);
@@ -670,6 +710,14 @@ void SimpleShell::pwd_command( string parameters, StreamOutput *stream )
 }
 
 // Output the contents of a file, first parameter is the filename, second is the limit ( in number of lines to output )
+// a stream that queues its output drops what does not fit, so a long listing waits for it to go out
+static void wait_for_tx(StreamOutput *stream)
+{
+    while (stream->is_tx_full()) {
+        THEKERNEL->call_event(ON_IDLE);
+    }
+}
+
 void SimpleShell::cat_command( string parameters, StreamOutput *stream )
 {
     // Get parameters ( filename and line limit )
@@ -721,6 +769,7 @@ void SimpleShell::cat_command( string parameters, StreamOutput *stream )
         // buffer.append((char *)&c, 1);
         charcnt ++;
         if (charcnt > 190) {
+            wait_for_tx(stream);
             sentcnt = stream->puts(buffer);
             // if (sentcnt < strlen()(int)buffer.size()) {
             if (sentcnt < (int)strlen(buffer)) {
@@ -745,6 +794,7 @@ void SimpleShell::cat_command( string parameters, StreamOutput *stream )
     // if (buffer.size() > 0) {
     if (strlen(buffer) > 0) {
     	// stream->puts(buffer.c_str());
+    	wait_for_tx(stream);
     	stream->puts(buffer);
     }
 }
@@ -849,7 +899,27 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
         stream->printf("--- End AHB Pool Details ---\n");
     }
 
-    stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
+    stream->printf("Block size: %u bytes\n", sizeof(Block));
+}
+
+// what each SlowTicker hook costs, -r starts the counts again
+void SimpleShell::ticks_command( string parameters, StreamOutput *stream)
+{
+    bool reset = shift_parameter( parameters ).find_first_of("Rr") != string::npos;
+    THEKERNEL->slow_ticker->print_stats(stream, reset);
+}
+
+// how long PublicData requests take, -b sends them all to the events as before so the two can be compared, -d direct again
+void SimpleShell::publicdata_command( string parameters, StreamOutput *stream)
+{
+    bool reset = false;
+    while (!parameters.empty()) {
+        string s = shift_parameter( parameters );
+        if(s == "-r") reset = true;
+        else if(s == "-b") PublicData::set_broadcast_only(true);
+        else if(s == "-d") PublicData::set_broadcast_only(false);
+    }
+    PublicData::print_stats(stream, reset);
 }
 
 /*
@@ -1887,24 +1957,71 @@ void SimpleShell::switch_command( string parameters, StreamOutput *stream)
 void SimpleShell::md5sum_command( string parameters, StreamOutput *stream )
 {
 	string filename = absolute_from_relative(parameters);
-
-	// Open file
-	FILE *lp = fopen(filename.c_str(), "r");
-	if (lp == NULL) {
+	// a gcode file uploaded compressed is only kept in the .lz dir
+	bool gcodes = filename.compare(0, 11, "/sd/gcodes/") == 0;
+	string path = filename;
+	uint32_t size = 0, stamp = 0;
+	bool found = get_file_stamp(path, size, stamp);
+	if (!found && gcodes) {
+		path = change_to_lz_path(filename);
+		found = get_file_stamp(path, size, stamp);
+	}
+	if (!found && filename.compare(0, 4, "/sd/") == 0) {
 		stream->printf("File not found: %s\r\n", filename.c_str());
 		return;
 	}
-	MD5 md5;
-	uint8_t buf[64];
-	do {
-		size_t n= fread(buf, 1, sizeof buf, lp);
-		if(n > 0) md5.update(buf, n);
-		THEKERNEL->call_event(ON_IDLE);
-	} while(!feof(lp));
 
-	stream->printf("%s %s\n", md5.finalize().hexdigest().c_str(), filename.c_str());
-	fclose(lp);
+	// the digest kept when it was uploaded or last asked for, while the file has not changed since
+	char hex[33];
+	string md5_path;
+	if (gcodes) {
+		md5_path = change_to_md5_path(filename);
+		if (read_md5_record(md5_path, size, stamp, hex)) {
+			stream->printf("%s %s\n", hex, filename.c_str());
+			return;
+		}
+	}
 
+	MD5 md5;
+	if (path == filename) {
+		if (!md5_file(filename, md5, xbuff, 8192)) {
+			stream->printf("File not found: %s\r\n", filename.c_str());
+			return;
+		}
+	} else {
+		// the md5 is of the gcode, as it was for the upload
+		FILE *lp = fopen(path.c_str(), "rb");
+		uint8_t *out = (uint8_t *)AHB.alloc(4096);
+		if (lp == NULL || out == NULL) {
+			if (lp != NULL) fclose(lp);
+			if (out != NULL) AHB.dealloc(out);
+			stream->printf("File not found: %s\r\n", filename.c_str());
+			return;
+		}
+		CompressedFile lz(xbuff, sizeof(xbuff), out, 4096);
+		lz.attach(lp);
+		while (lz.next_block()) {
+			md5.update(out, lz.get_block_size());
+			THEKERNEL->call_event(ON_IDLE);
+		}
+		bool ok = lz.sum_matches();
+		fclose(lp);
+		AHB.dealloc(out);
+		if (!ok) {
+			stream->printf("Error: damaged file [%s]!\r\n", filename.c_str());
+			return;
+		}
+	}
+	strcpy(hex, md5.finalize().hexdigest().c_str());
+	stream->printf("%s %s\n", hex, filename.c_str());
+
+	if (gcodes) {
+		FILE *fp = fopen(md5_path.c_str(), "w");
+		if (fp != NULL) {
+			write_md5_record(fp, hex, size, stamp);
+			fclose(fp);
+		}
+	}
 }
 
 // runs several types of test on the mechanisms
@@ -2522,6 +2639,9 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
+    stream->printf("ticks [-r] - time spent in each SlowTicker hook\r\n");
+    stream->printf("publicdata [-r] [-b|-d] - time spent in PublicData requests\r\n");
+    stream->printf("status_push [ms|off] - push binary status frames to this console\r\n");
     stream->printf("ls [-s] [-e] [folder]\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
@@ -2610,6 +2730,7 @@ void SimpleShell::config_get_all_command( string parameters, StreamOutput *strea
 		    vsize = (end_value == string::npos) ? end_value : end_value - begin_value;
 		    value = buffer.substr(begin_value, vsize);
 
+		    wait_for_tx(stream);
 		    stream->printf("%s=%s\n", key.c_str(), value.c_str());
 
 			buffer.clear();
@@ -59,6 +59,8 @@ private:
 
     static void switch_command(string parameters, StreamOutput *stream );
     static void mem_command(string parameters, StreamOutput *stream );
+    static void ticks_command(string parameters, StreamOutput *stream );
+    static void publicdata_command(string parameters, StreamOutput *stream );
 
     static void net_command( string parameters, StreamOutput *stream);
     static void ap_command( string parameters, StreamOutput *stream);
@@ -0,0 +1,190 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StatusReport.h"
+#include "libs/Kernel.h"
+#include "libs/SerialMessage.h"
+#include "libs/StreamOutput.h"
+#include "libs/StreamOutputPool.h"
+#include "libs/utils.h"
+#include "libs/PublicData.h"
+#include "Robot.h"
+#include "Conveyor.h"
+#include "StepperMotor.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "SpindlePublicAccess.h"
+#include "ATCHandlerPublicAccess.h"
+#include "PlayerPublicAccess.h"
+#include "crc16.h"
+
+#include "us_ticker_api.h"
+
+#include <math.h>
+#include <string.h>
+
+#define status_push_interval_checksum   CHECKSUM("status_push_interval")
+
+StatusReport::StatusReport()
+{
+    stream= nullptr;
+    interval_us= 0;
+    last_us= 0;
+    memset(last_payload, 0, sizeof(last_payload));
+}
+
+void StatusReport::on_module_loaded()
+{
+    this->default_interval_ms= THEKERNEL->config->value(status_push_interval_checksum)->by_default(250)->as_number();
+
+    this->register_for_event(ON_IDLE);
+    this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+}
+
+// status_push [ms|off], pushes frames to the console it came from every ms, the configured interval by default
+void StatusReport::on_console_line_received(void *argument)
+{
+    SerialMessage *msgp = static_cast<SerialMessage *>(argument);
+    string possible_command = msgp->message;
+
+    if(possible_command.empty() || !islower(possible_command[0])) return;
+
+    string cmd = shift_parameter(possible_command);
+    if(cmd != "status_push") return;
+
+    string param = shift_parameter(possible_command);
+    if(param == "off" || param == "0") {
+        if(this->stream == msgp->stream) this->stream= nullptr;
+        return;
+    }
+
+    uint32_t ms= param.empty() ? this->default_interval_ms : strtoul(param.c_str(), nullptr, 10);
+    if(ms < 20) ms= 20;
+    this->interval_us= ms * 1000;
+    this->stream= msgp->stream;
+    // the first one goes out straight away whatever it holds
+    this->last_us= us_ticker_read() - this->interval_us;
+    this->last_payload[0]= 0;
+}
+
+void StatusReport::on_idle(void *argument)
+{
+    if(this->stream == nullptr || THEKERNEL->is_uploading()) return;
+
+    uint32_t now= us_ticker_read();
+    if(now - this->last_us < this->interval_us) return;
+    this->last_us= now;
+
+    // the console may have gone away, a WiFi client disconnecting takes its stream out of the pool
+    if(!THEKERNEL->streams->has_stream(this->stream)) {
+        this->stream= nullptr;
+        return;
+    }
+
+    uint8_t frame[frame_size];
+    uint8_t *payload= &frame[2];
+    build_payload(payload);
+    if(memcmp(payload, this->last_payload, payload_size) == 0) return;
+    memcpy(this->last_payload, payload, payload_size);
+
+    frame[0]= frame_start;
+    frame[1]= payload_size;
+    uint16_t crc= crc16_xmodem(&frame[1], payload_size + 1);
+    frame[payload_size + 2]= crc >> 8;
+    frame[payload_size + 3]= crc & 0xFF;
+    this->stream->puts((const char *)frame, frame_size);
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++= v & 0xFF;
+    *p++= v >> 8;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p= put16(p, v & 0xFFFF);
+    return put16(p, v >> 16);
+}
+
+static uint8_t *put_position(uint8_t *p, float v)
+{
+    return put32(p, (int32_t)lroundf(v * 10000.0F));
+}
+
+static uint16_t clamp16(float v)
+{
+    return v <= 0 ? 0 : v >= 65535.0F ? 65535 : (uint16_t)lroundf(v);
+}
+
+// the same values get_query_string() reports, in machine units
+void StatusReport::build_payload(uint8_t *payload)
+{
+    Robot *robot= THEROBOT;
+    uint8_t state= THEKERNEL->get_state();
+    bool running= state == RUN || state == HOME;
+
+    float mpos[5];
+    if(running) {
+        robot->get_current_machine_position(mpos);
+        // the actuator position includes the compensation, the reported one does not
+        if(robot->compensationTransform) robot->compensationTransform(mpos, true, false);
+        mpos[A_AXIS]= robot->actuators[A_AXIS]->get_current_position();
+        mpos[B_AXIS]= robot->actuators[B_AXIS]->get_current_position();
+    }else{
+        robot->get_axis_position(mpos, 5);
+    }
+    Robot::wcs_t wpos= robot->mcs2wcs(mpos);
+
+    struct spindle_status ss;
+    bool spindle= PublicData::get_value(pwm_spindle_control_checksum, get_spindle_status_checksum, &ss);
+
+    struct tool_status tool;
+    bool has_tool= PublicData::get_value(atc_handler_checksum, get_tool_status_checksum, &tool);
+
+    void *returned_data;
+    const struct pad_progress *progress= nullptr;
+    if(PublicData::get_value(player_checksum, get_progress_checksum, &returned_data)) {
+        progress= static_cast<const struct pad_progress *>(returned_data);
+    }
+
+    uint8_t flags= 0;
+    if(progress != nullptr && progress->is_playing) flags |= 1;
+    if(THEKERNEL->is_halted()) flags |= 2;
+    if(robot->inch_mode) flags |= 4;
+    if(robot->absolute_mode) flags |= 8;
+    if(robot->compensationTransform) flags |= 16;
+    if(THEKERNEL->get_laser_mode()) flags |= 32;
+    if(THEKERNEL->get_vacuum_mode()) flags |= 64;
+
+    uint8_t *p= payload;
+    *p++= 1;
+    *p++= state;
+    *p++= flags;
+    *p++= THEKERNEL->get_halt_reason();
+    *p++= THEKERNEL->get_atc_state();
+    *p++= robot->get_current_wcs();
+    *p++= has_tool ? (int8_t)tool.active_tool : -1;
+
+    for (int i = 0; i < 5; ++i) p= put_position(p, mpos[i]);
+    p= put_position(p, std::get<X_AXIS>(wpos));
+    p= put_position(p, std::get<Y_AXIS>(wpos));
+    p= put_position(p, std::get<Z_AXIS>(wpos));
+    p= put_position(p, std::get<A_AXIS>(wpos));
+    p= put_position(p, std::get<B_AXIS>(wpos));
+
+    p= put16(p, clamp16(running ? THECONVEYOR->get_current_feedrate() * 60.0F : 0));
+    p= put16(p, clamp16(60000.0F / robot->get_seconds_per_minute()));
+    p= put16(p, clamp16(spindle ? ss.current_rpm : 0));
+    p= put16(p, clamp16(spindle ? ss.factor * 10.0F : 1000));
+
+    *p++= progress != nullptr ? progress->percent_complete : 0;
+    p= put32(p, progress != nullptr ? progress->played_lines : 0);
+    p= put32(p, progress != nullptr ? progress->elapsed_secs : 0);
+}
@@ -0,0 +1,64 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATUSREPORT_H
+#define STATUSREPORT_H
+
+#include "Module.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+class StreamOutput;
+
+// Pushes a binary status frame to a console that asks for it with status_push, instead of it polling with ? and getting
+// the text report from Kernel::get_query_string. A frame goes out at most every interval and only when something in it
+// has changed, so an idle machine sends nothing. The frame is
+//
+//   0xA5, payload length, payload, CRC-16/CCITT of the length and the payload high byte first
+//
+// and the payload, little endian:
+//
+//   0   version, 1
+//   1   state, as Kernel::get_state()
+//   2   flags: 1 playing, 2 halted, 4 inch mode, 8 absolute mode, 16 compensation on, 32 laser mode, 64 vacuum mode
+//   3   halt reason
+//   4   atc state
+//   5   work coordinate system, 0 is G54
+//   6   active tool, int8
+//   7   machine position X Y Z A B, int32 in 0.0001mm and 0.0001°
+//   27  work position X Y Z A B, the same
+//   47  feed rate, uint16 mm/min
+//   49  feed override, uint16 in 0.1%
+//   51  spindle rpm, uint16
+//   53  spindle override, uint16 in 0.1%
+//   55  percent complete, uint8
+//   56  played lines, uint32
+//   60  elapsed seconds, uint32
+class StatusReport : public Module {
+    public:
+        StatusReport();
+
+        void on_module_loaded();
+        void on_idle(void *argument);
+        void on_console_line_received(void *argument);
+
+        static const uint8_t frame_start= 0xA5;
+        static const uint8_t payload_size= 64;
+        static const uint8_t frame_size= payload_size + 4;
+
+    private:
+        void build_payload(uint8_t *payload);
+
+        StreamOutput *stream;       // the console frames are pushed to, nullptr when push mode is off
+        uint32_t interval_us;
+        uint32_t default_interval_ms;
+        uint32_t last_us;
+        uint8_t last_payload[payload_size];
+};
+
+#endif
@@ -59,6 +59,10 @@ WifiProvider::WifiProvider()
 	wifi_init_ok = false;
 	has_data_flag = false;
 	connection_fail_count = 0;
+	tx_head = 0;
+	tx_tail = 0;
+	tx_dropped = 0;
+	tx_stall_s = 0;
 }
 
 void WifiProvider::on_module_loaded()
@@ -88,7 +92,6 @@ void WifiProvider::on_module_loaded()
         PinName pinname = port_pin((PortName)smoothie_pin->port_number, smoothie_pin->pin);
         wifi_interrupt_pin = new(AHB) mbed::InterruptIn(pinname);
         wifi_interrupt_pin->rise(this, &WifiProvider::on_pin_rise);
-        NVIC_SetPriority(EINT3_IRQn, 16);
     } else {
         THEKERNEL->streams->printf("Error: Wifi interrupt pin has to be on P0 or P2.\n");
         delete this;
@@ -107,8 +110,8 @@ void WifiProvider::on_module_loaded()
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, wlan_checksum, get_wlan_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, wlan_checksum);
 }
 
 
@@ -122,7 +125,9 @@ void WifiProvider::receive_wifi_data() {
 	u16 received = 0;
 	u16 status;
 
-	while (true)
+	// a frame is only read while a whole one fits, until then the module holds on to the data and TCP stops the host,
+	// so nothing has to be thrown away
+	while (buffer.size() + WIFI_DATA_MAX_SIZE <= buffer.capacity())
 	{
 		received = M8266WIFI_SPI_RecvData(WifiData, WIFI_DATA_MAX_SIZE, WIFI_DATA_TIMEOUT_MS, &link_no, &status);
 		if (link_no == udp_link_no) {
@@ -161,12 +166,7 @@ void WifiProvider::receive_wifi_data() {
 				THEKERNEL->set_keep_alive_request(true);
 				continue;
 			}
-			bool at_line_start;
-			at_line_start = (this->buffer.head == this->buffer.tail);
-			if (!at_line_start) {
-				int last_idx = this->buffer.prev_block_index(this->buffer.head);
-				at_line_start = (this->buffer.buffer[last_idx] == '\n' || this->buffer.buffer[last_idx] == '\r');
-			}
+			bool at_line_start = this->buffer.at_line_start();
 
 	        if(THEKERNEL->is_feed_hold_enabled() && at_line_start) {
 	            if(WifiData[i] == '!') { // safe pause
@@ -189,6 +189,8 @@ void WifiProvider::receive_wifi_data() {
 			return;
 		}
 	}
+	// there is more to read once on_main_loop has taken some lines out
+	has_data_flag = true;
 }
 
 bool WifiProvider::ready() {
@@ -232,6 +234,14 @@ void WifiProvider::on_second_tick(void *)
 
 	if (!wifi_init_ok || THEKERNEL->is_uploading()) return;
 
+	// the module has taken nothing for a while, whatever it is waiting for is not coming
+	if (tx_queued() == 0) {
+		tx_stall_s = 0;
+	} else if (++tx_stall_s >= WIFI_TX_STALL_S) {
+		tx_tail = tx_head;
+		tx_stall_s = 0;
+	}
+
 	M8266WIFI_SPI_List_Clients_On_A_TCP_Server(tcp_link_no, &client_num, RemoteClients, &status);
 
 	M8266WIFI_SPI_Get_STA_Connection_Status(&connection_status, &status);
@@ -324,7 +334,7 @@ void WifiProvider::on_idle(void *argument)
  {
 	if (THEKERNEL->is_uploading()) return;
 
-	if (has_data_flag || M8266WIFI_SPI_Has_DataReceived()) {
+	if ((has_data_flag || M8266WIFI_SPI_Has_DataReceived()) && buffer.size() + WIFI_DATA_MAX_SIZE <= buffer.capacity()) {
 		has_data_flag = false;
 		receive_wifi_data();
 	}
@@ -349,39 +359,141 @@ void WifiProvider::on_idle(void *argument)
             puts("HALTED, M999 or $X to exit HALT state\r\n");
         }
     }
+
+    // one frame per pass so the main loop is never held up for long
+    send_tx_frame();
+
+    if (tx_dropped != 0) {
+    	static const char discarded[] = "error:Transmit buffer full, output discarded\r\n";
+    	if (queue_tx(discarded, sizeof(discarded) - 1)) {
+    		tx_dropped = 0;
+    	}
+    }
 }
 
 void WifiProvider::on_main_loop(void *argument)
 {
-    if( this->has_char('\n') ){
-        string received;
-        received.reserve(20);
-        while(1){
-           char c;
-           this->buffer.pop_front(c);
-           if( c == '\n' ){
-                struct SerialMessage message;
-                message.message = received;
-                message.stream = this;
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-                return;
-            }else{
-                received += c;
-            }
-        }
+    if (this->buffer.take_dropped() != 0) {
+        puts("error:Discarded long line\r\n");
+    }
+    if (this->buffer.take_overflowed() != 0) {
+        puts("error:Receive buffer full, line discarded\r\n");
+    }
+
+    struct SerialMessage message;
+    if (this->buffer.get_line(message.message)) {
+        message.stream = this;
+        message.line = 0;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
     }
 }
 
 int WifiProvider::puts(const char* s, int size)
 {
 	size_t total_length = size == 0 ? strlen(s) : size;
-    size_t sent_index = 0;
+
+	// the upload and download protocols wait for each reply, so those go out straight away and in order
+	if (THEKERNEL->is_uploading()) {
+		flush_tx();
+		return send_blocking(s, total_length);
+	}
+
+	if (queue_tx(s, total_length)) {
+		return total_length;
+	}
+
+	// no room, send a frame and try once more. Waiting here for the host would hold up the main loop, so if that is
+	// not enough the write is dropped and reported from on_idle
+	send_tx_frame();
+	if (queue_tx(s, total_length)) {
+		return total_length;
+	}
+	tx_dropped += total_length;
+	return 0;
+}
+
+int WifiProvider::_putc(int c)
+{
+	char to_send = c;
+	return puts(&to_send, 1);
+}
+
+// more than a frame still waiting to go out
+bool WifiProvider::is_tx_full()
+{
+	return tx_queued() >= WIFI_DATA_MAX_SIZE;
+}
+
+size_t WifiProvider::tx_queued() const
+{
+	return (tx_head + WIFI_TX_BUFFER_SIZE - tx_tail) % WIFI_TX_BUFFER_SIZE;
+}
+
+bool WifiProvider::queue_tx(const char *s, size_t len)
+{
+	// one slot is kept free so a full buffer can be told from an empty one
+	if (len > WIFI_TX_BUFFER_SIZE - 1 - tx_queued()) {
+		return false;
+	}
+	size_t first = WIFI_TX_BUFFER_SIZE - tx_head;
+	if (first > len) first = len;
+	memcpy(&tx_buffer[tx_head], s, first);
+	memcpy(tx_buffer, s + first, len - first);
+	tx_head = (tx_head + len) % WIFI_TX_BUFFER_SIZE;
+	return true;
+}
+
+// sends as much of the queue as fits in a frame, whatever the module does not take is tried again next time
+void WifiProvider::send_tx_frame()
+{
+	size_t to_send = tx_queued();
+	if (to_send == 0) return;
+	if (to_send > WIFI_DATA_MAX_SIZE) to_send = WIFI_DATA_MAX_SIZE;
+
+	size_t first = WIFI_TX_BUFFER_SIZE - tx_tail;
+	if (first > to_send) first = to_send;
+	memcpy(WifiData, &tx_buffer[tx_tail], first);
+	memcpy(WifiData + first, tx_buffer, to_send - first);
+
+	u16 status = 0;
+	u16 sent = M8266WIFI_SPI_Send_Data(WifiData, to_send, tcp_link_no, &status);
+	u8 errcode = status & 0xff;
+	if (sent < to_send && (errcode == 0x13 || errcode == 0x14 || errcode == 0x15 || errcode == 0x18 || errcode == 0x1E || errcode == 0x1F)) {
+		// nobody to send it to or the module has given up on it, drop the lot rather than hold up whoever connects next
+		tx_tail = tx_head;
+		tx_stall_s = 0;
+		return;
+	}
+	if (sent != 0) {
+		tx_stall_s = 0;
+	}
+	tx_tail = (tx_tail + sent) % WIFI_TX_BUFFER_SIZE;
+}
+
+// sends everything queued before returning, like puts used to
+void WifiProvider::flush_tx()
+{
+	while (tx_head != tx_tail) {
+		size_t to_send = tx_head > tx_tail ? tx_head - tx_tail : WIFI_TX_BUFFER_SIZE - tx_tail;
+		u32 sent = send_blocking(&tx_buffer[tx_tail], to_send);
+		if (sent < to_send) {
+			// the connection is gone
+			tx_tail = tx_head;
+			return;
+		}
+		tx_tail = (tx_tail + sent) % WIFI_TX_BUFFER_SIZE;
+	}
+}
+
+u32 WifiProvider::send_blocking(const char *s, size_t len)
+{
+	size_t sent_index = 0;
 	u16 status = 0;
 	u32 sent = 0;
 	u32 to_send = 0;
-    while (sent_index < total_length) {
-    	to_send = total_length - sent_index > WIFI_DATA_MAX_SIZE ? WIFI_DATA_MAX_SIZE : total_length - sent_index;
-    	memcpy(WifiData, s + sent_index, to_send);
+	while (sent_index < len) {
+		to_send = len - sent_index > WIFI_DATA_MAX_SIZE ? WIFI_DATA_MAX_SIZE : len - sent_index;
+		memcpy(WifiData, s + sent_index, to_send);
 		// errcode:
 		// 	0x13: Wrong link_no used
 		// 	0x14: connection by link_no not present
@@ -389,26 +501,13 @@ int WifiProvider::puts(const char* s, int size)
 		// 	0x18: No clients connecting to this TCP server
 		// 	0x1E: too many errors ecountered during sending can not fixed
 		// 	0x1F: Other errors
-    	sent = M8266WIFI_SPI_Send_BlockData(WifiData, to_send, 5000, tcp_link_no, NULL, 0, &status);
-    	sent_index += sent;
-		if (sent == to_send) {
-			continue;
-		} else {
-    		break;
+		sent = M8266WIFI_SPI_Send_BlockData(WifiData, to_send, 5000, tcp_link_no, NULL, 0, &status);
+		sent_index += sent;
+		if (sent != to_send) {
+			break;
 		}
-    }
-    return sent_index;
-}
-
-int WifiProvider::_putc(int c)
-{
-	u16 status = 0;
-	u8 to_send = c;
-	if (M8266WIFI_SPI_Send_Data(&to_send, 1, tcp_link_no, &status) == 0) {
-		return 0;
-	} else {
-		return 1;
 	}
+	return sent_index;
 }
 
 int WifiProvider::_getc()
@@ -436,18 +535,6 @@ int WifiProvider::gets(char** buf, int size)
 	return received;
 }
 
-// Does the queue have a given char ?
-bool WifiProvider::has_char(char letter) {
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
-
 void WifiProvider::on_gcode_received(void *argument)
 {
     Gcode *gcode = static_cast<Gcode*>(argument);
@@ -847,6 +934,7 @@ void WifiProvider::init_wifi_module(bool reset) {
 
 		// remove current stream
 		THEKERNEL->streams->remove_stream(this);
+		tx_head = tx_tail = 0;
 	}
 
 
@@ -17,10 +17,12 @@ using namespace std;
 #include "StreamOutput.h"
 
 #include "M8266WIFIDrv.h"
-#include "libs/RingBuffer.h"
+#include "libs/LineBuffer.h"
 
 #define WIFI_DATA_MAX_SIZE 1460
 #define WIFI_DATA_TIMEOUT_MS 10
+#define WIFI_TX_BUFFER_SIZE 2048
+#define WIFI_TX_STALL_S 5
 #define MAX_WLAN_SIGNALS 8
 
 class WifiProvider : public Module, public StreamOutput
@@ -41,8 +43,8 @@ public:
     int _putc(int c);
     int _getc(void);
     bool ready();
-    bool has_char(char letter);
     int type(); // 0: serial, 1: wifi
+    bool is_tx_full();
 
 
 private:
@@ -62,14 +64,27 @@ private:
     void on_pin_rise();
     void receive_wifi_data();
 
+    size_t tx_queued() const;
+    bool queue_tx(const char *s, size_t len);
+    void send_tx_frame();
+    void flush_tx();
+    u32 send_blocking(const char *s, size_t len);
+
     mbed::InterruptIn *wifi_interrupt_pin; // Interrupt pin for measuring speed
     float probe_slow_rate;
 
-    RingBuffer<char, 256> buffer; // Receive buffer
+    LineBuffer<2048> buffer; // Receive buffer, a frame is only read while there is room for a whole one
     string test_buffer;
 
 	u8 WifiData[WIFI_DATA_MAX_SIZE];
 
+	// replies are queued here and sent from on_idle, so a burst of small writes goes out as a few full frames
+	char tx_buffer[WIFI_TX_BUFFER_SIZE];
+	size_t tx_head;
+	size_t tx_tail;
+	size_t tx_dropped;		// bytes of replies dropped because the queue was full, reported once there is room
+	u8 tx_stall_s;			// seconds the queue has not moved
+
 	int tcp_port;
 	int udp_send_port;
 	int udp_recv_port;
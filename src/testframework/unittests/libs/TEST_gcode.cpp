@@ -1,6 +1,7 @@
 #include "utils.h"
 
 #include "Gcode.h"
+#include "mbed.h" // for us_ticker_read()
 
 #include <vector>
 #include <stdio.h>
@@ -60,3 +61,100 @@ TEST(GCodeTest,subcode)
     ASSERT_EQUALS_DELTA_V(2.3, gc4.get_value('Y'), 0.001);
 
 }
+
+TEST(GCodeTest,word_table)
+{
+    Gcode gc1("G1 X1.5E2 Y-3 X7", nullptr);
+    ASSERT_EQUALS_V(1, gc1.g);
+    // E after a number is the next word not an exponent, and the first of two words wins
+    ASSERT_EQUALS_DELTA_V(1.5, gc1.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(2, gc1.get_value('E'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-3, gc1.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_V(4, gc1.get_num_args());
+    ASSERT_EQUALS_V(3, (int)gc1.get_args().size());
+    ASSERT_TRUE(!gc1.has_letter('Z'));
+    ASSERT_EQUALS_DELTA_V(0, gc1.get_value('Z'), 0.0001);
+
+    // expressions are still evaluated when asked for
+    Gcode gc2("G1 X[1+2] Y2*3 Z4", nullptr);
+    ASSERT_EQUALS_DELTA_V(3, gc2.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(6, gc2.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(4, gc2.get_value('Z'), 0.0001);
+
+    Gcode gc3("M3 S123456789", nullptr);
+    ASSERT_EQUALS_V(123456789, gc3.get_uint('S'));
+    ASSERT_EQUALS_V(3, gc3.m);
+
+    // a line too long to be kept in the object
+    Gcode gc4("G1 X1.0000000000 Y2.0000000000 Z3.0000000000 A4.0000000000 B5.0000000000 F600.0000000000", nullptr);
+    Gcode gc5("", nullptr);
+    gc5= gc4;
+    ASSERT_EQUALS_V(6, gc5.get_num_args());
+    ASSERT_EQUALS_DELTA_V(5, gc5.get_value('B'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(600, gc5.get_value('F'), 0.0001);
+    ASSERT_TRUE(strcmp(gc4.get_command(), gc5.get_command()) == 0);
+
+    Gcode gc6("G1 X1 F100", nullptr);
+    ASSERT_TRUE(strcmp(gc6.get_command(), " X1 F100") == 0);
+    Gcode gc7("G1 X1 F100", nullptr, false);
+    ASSERT_TRUE(strcmp(gc7.get_command(), "G1 X1 F100") == 0);
+    ASSERT_EQUALS_V(2, gc7.get_num_args());
+}
+
+TEST(GCodeTest,parse_speed)
+{
+    const char *lines[] = {
+        "G1 X123.4567 Y-23.4567 Z-1.2345 F1200",
+        "X124.0012 Y-22.9876",
+        "G2 X10.5 Y20.25 I5.125 J-3.5 F800",
+        "G0 Z5",
+        "M3 S12000",
+        "G1 X1.5 Y2.5 A90.25"
+    };
+    const int n= 6000;
+
+    // the words the timed loop reads back have to be the right ones
+    Gcode gc1(lines[0], nullptr);
+    ASSERT_TRUE(gc1.has_g);
+    ASSERT_EQUALS_V(1, gc1.g);
+    ASSERT_EQUALS_V(4, gc1.get_num_args());
+    ASSERT_EQUALS_DELTA_V(123.4567, gc1.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-23.4567, gc1.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-1.2345, gc1.get_value('Z'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(1200, gc1.get_value('F'), 0.0001);
+    ASSERT_TRUE(!gc1.has_letter('A'));
+    ASSERT_TRUE(!gc1.has_letter('S'));
+
+    Gcode gc2(lines[1], nullptr);
+    ASSERT_TRUE(!gc2.has_g);
+    ASSERT_EQUALS_V(2, gc2.get_num_args());
+    ASSERT_EQUALS_DELTA_V(124.0012, gc2.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-22.9876, gc2.get_value('Y'), 0.0001);
+    ASSERT_TRUE(!gc2.has_letter('F'));
+
+    Gcode gc3(lines[2], nullptr);
+    ASSERT_EQUALS_V(2, gc3.g);
+    ASSERT_EQUALS_DELTA_V(5.125, gc3.get_value('I'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-3.5, gc3.get_value('J'), 0.0001);
+    ASSERT_TRUE(!gc3.has_letter('K'));
+
+    Gcode gc5(lines[4], nullptr);
+    ASSERT_TRUE(gc5.has_m);
+    ASSERT_EQUALS_V(3, gc5.m);
+    ASSERT_EQUALS_DELTA_V(12000, gc5.get_value('S'), 0.0001);
+
+    // parse and read the words back the way Robot does for a move
+    double sum= 0;
+    uint32_t start= us_ticker_read();
+    for (int i = 0; i < n; ++i) {
+        Gcode gc(lines[i % 6], nullptr);
+        for (char c : {'X', 'Y', 'Z', 'A', 'B', 'E', 'F', 'I', 'J', 'K', 'S'}) {
+            if(gc.has_letter(c)) sum += gc.get_value(c);
+        }
+    }
+    uint32_t us= us_ticker_read() - start;
+
+    printf("Gcode parse: %d lines in %lu us, %lu lines/s\n", n, (unsigned long)us, us > 0 ? (unsigned long)(n * 1000000ULL / us) : 0UL);
+    // the sum of the words of the six lines, a thousand times over
+    ASSERT_EQUALS_DELTA_V(14331404.1, sum, 1);
+}